@@ -0,0 +1,289 @@
+#include "emotient.hpp"
+#include <algorithm>
+#include <cmath>
+#include <sys/time.h>
+
+namespace EMOTIENT {
+namespace FacetSDK {
+
+static const char* LANDMARK_NAMES[] = {
+    "left_eye_lateral", "left_eye_pupil", "left_eye_medial",
+    "right_eye_medial", "right_eye_pupil", "right_eye_lateral", "nose_tip"
+};
+static const char* EMOTION_NAMES[] = {
+    "anger", "contempt", "disgust", "joy", "fear", "sadness", "surprise",
+    "neutral", "negative", "positive", "confusion", "frustration"
+};
+static const char* ACTION_UNIT_NAMES[] = {
+    "AU1", "AU2", "AU4", "AU5", "AU6", "AU7", "AU9", "AU10", "AU12", "AU14",
+    "AU15", "AU17", "AU18", "AU20", "AU23", "AU24", "AU25", "AU26", "AU28", "AU43"
+};
+static const char* POSE_NAMES[] = { "roll", "pitch", "yaw" };
+
+/** Landmark positions, relative to the face box **/
+static const float LANDMARK_X[] = { 0.20f, 0.30f, 0.40f, 0.60f, 0.70f, 0.80f, 0.50f };
+static const float LANDMARK_Y[] = { 0.35f, 0.35f, 0.35f, 0.35f, 0.35f, 0.35f, 0.60f };
+
+static StubSettings settings;
+
+static double seconds()
+{
+    struct timeval now;
+    gettimeofday(&now, 0);
+    return now.tv_sec + now.tv_usec * 1e-6;
+}
+
+template <class T>
+static std::vector<T> range(int first, int last)
+{
+    std::vector<T> names;
+    for (int i = first; i <= last; i++) {
+        names.push_back((T)i);
+    }
+    return names;
+}
+
+std::vector<LandmarkName> AllLandmarkNames() { return range<LandmarkName>(LEFT_EYE_LATERAL, NOSE_TIP); }
+std::vector<EmotionName> AllPrimaryEmotionNames() { return range<EmotionName>(ANGER, SURPRISE); }
+std::vector<EmotionName> AllSentimentEmotionNames() { return range<EmotionName>(NEUTRAL, POSITIVE); }
+std::vector<EmotionName> AllAdvancedEmotionNames() { return range<EmotionName>(CONFUSION, FRUSTRATION); }
+std::vector<EmotionName> AllEmotionNames() { return range<EmotionName>(ANGER, FRUSTRATION); }
+std::vector<ActionUnit> AllActionUnits() { return range<ActionUnit>(AU1, AU43); }
+std::vector<PoseDimension> AllPoseDimensions() { return range<PoseDimension>(ROLL, YAW); }
+
+std::string LandmarkNameToString(LandmarkName name) { return LANDMARK_NAMES[name]; }
+std::string EmotionNameToString(EmotionName name) { return EMOTION_NAMES[name]; }
+std::string ActionUnitToString(ActionUnit name) { return ACTION_UNIT_NAMES[name]; }
+std::string PoseDimensionToString(PoseDimension name) { return POSE_NAMES[name]; }
+
+std::string DefineErrorCode(int code)
+{
+    switch (code) {
+        case SUCCESS: return "SUCCESS";
+        case EMPTY_INPUT: return "EMPTY_INPUT";
+        case NOT_AVAILABLE: return "NOT_AVAILABLE";
+        case NOT_INITIALIZED: return "NOT_INITIALIZED";
+    }
+    return "UNKNOWN";
+}
+
+void SetStubSettings(const StubSettings& newSettings)
+{
+    settings = newSettings;
+}
+
+StubSettings GetStubSettings()
+{
+    return settings;
+}
+
+Point Face::LandmarkLocation(LandmarkName name) const
+{
+    float jitter = 0.02f * std::sin(seed_ + 1.7f * name);
+    return Point(location_.x + (LANDMARK_X[name] + jitter) * location_.width,
+                 location_.y + (LANDMARK_Y[name] - jitter) * location_.height);
+}
+
+float Face::PoseValue(PoseDimension dimension) const
+{
+    return 15.0f * std::sin(0.3f * seed_ + 2.1f * dimension);
+}
+
+float Face::EmotionValue(EmotionName name) const
+{
+    return 2.5f * std::sin(0.2f * seed_ + 0.9f * name) - 0.5f;
+}
+
+float Face::ActionUnitValue(ActionUnit name) const
+{
+    return 2.0f * std::sin(0.25f * seed_ + 1.3f * name) - 0.8f;
+}
+
+float Face::DemographicValue(DemographicName name) const
+{
+    return std::sin(0.05f * seed_);
+}
+
+void FrameAnalysis::LargestFace(Face& face) const
+{
+    size_t largest = 0;
+    float largestArea = -1;
+    Rectangle location;
+    for (size_t i = 0; i < faces_.size(); i++) {
+        faces_[i].FaceLocation(location);
+        if (location.width * location.height > largestArea) {
+            largestArea = location.width * location.height;
+            largest = i;
+        }
+    }
+    if (!faces_.empty()) {
+        face = faces_[largest];
+    }
+}
+
+FrameAnalyzer::FrameAnalyzer()
+: initialized_(false), maxThreads_(1), minFaceWidth_(0)
+{
+    for (int c = 0; c < NUM_CHANNELS; c++) {
+        active_[c] = true;
+    }
+}
+
+int FrameAnalyzer::Initialize(const std::string& facetsDir, const std::string& configFile)
+{
+    initialized_ = true;
+    return SUCCESS;
+}
+
+int FrameAnalyzer::SetMinFaceDetectionWidth(float width)
+{
+    minFaceWidth_ = width;
+    return SUCCESS;
+}
+
+void FrameAnalyzer::SetChannelActive(Channel channel, bool active)
+{
+    active_[channel] = active;
+    if (channel == EMOTIONS) {
+        active_[PRIMARY_EMOTIONS] = active_[SENTIMENTS] = active_[ADVANCED_EMOTIONS] = active;
+    }
+}
+
+bool FrameAnalyzer::IsChannelActive(Channel channel) const
+{
+    return active_[channel];
+}
+
+bool FrameAnalyzer::IsChannelAvailable(Channel channel) const
+{
+    return true;
+}
+
+int FrameAnalyzer::Analyze(const unsigned char* data, int rows, int cols, FrameAnalysis& analysis)
+{
+    analysis.faces_.clear();
+    if (!initialized_) {
+        return NOT_INITIALIZED;
+    }
+    if (data == 0 || rows <= 0 || cols <= 0) {
+        return EMPTY_INPUT;
+    }
+    double start = seconds();
+
+    // Read every pixel, as a detector would; the sum seeds the synthetic faces
+    unsigned long sum = 0;
+    const size_t numPixels = (size_t)rows * cols;
+    for (size_t i = 0; i < numPixels; i++) {
+        sum += data[i];
+    }
+    float seed = (float)(sum % 100003) / 100.0f;
+
+    // Faces side by side, each a fraction of the frame
+    int numFaces = settings.numFaces;
+    float width = (float)cols / (numFaces + 1);
+    float height = std::min(width * 1.2f, 0.8f * rows);
+    for (int f = 0; f < numFaces; f++) {
+        if (width < minFaceWidth_) {
+            break;
+        }
+        float shift = 0.05f * width * std::sin(seed + f);
+        Rectangle location(width * (f + 0.5f) + shift, 0.5f * (rows - height) - shift, width, height);
+        analysis.faces_.push_back(Face(location, seed + 10.0f * f));
+    }
+
+    // The rest of the cost of a real analysis
+    while ((seconds() - start) * 1e3 < settings.frameMillis) {
+    }
+    return SUCCESS;
+}
+
+void VideoAnalysis::FaceLocations(std::vector<Rectangle>& locations) const
+{
+    locations.resize(faces_.size());
+    for (size_t i = 0; i < faces_.size(); i++) {
+        faces_[i].FaceLocation(locations[i]);
+    }
+}
+
+void VideoAnalysis::EmotionEvidence(EmotionName name, std::vector<float>& values) const
+{
+    values.resize(faces_.size());
+    for (size_t i = 0; i < faces_.size(); i++) {
+        values[i] = faces_[i].EmotionValue(name);
+    }
+}
+
+void VideoAnalysis::ActionUnitEvidence(ActionUnit name, std::vector<float>& values) const
+{
+    values.resize(faces_.size());
+    for (size_t i = 0; i < faces_.size(); i++) {
+        values[i] = faces_[i].ActionUnitValue(name);
+    }
+}
+
+void VideoAnalysis::DemographicEvidence(DemographicName name, std::vector<float>& values) const
+{
+    values.resize(faces_.size());
+    for (size_t i = 0; i < faces_.size(); i++) {
+        values[i] = faces_[i].DemographicValue(name);
+    }
+}
+
+void VideoAnalysis::LandmarkLocations(LandmarkName name, std::vector<Point>& points) const
+{
+    points.resize(faces_.size());
+    for (size_t i = 0; i < faces_.size(); i++) {
+        points[i] = faces_[i].LandmarkLocation(name);
+    }
+}
+
+void VideoAnalysis::Pose(PoseDimension dimension, std::vector<float>& values) const
+{
+    values.resize(faces_.size());
+    for (size_t i = 0; i < faces_.size(); i++) {
+        values[i] = faces_[i].PoseValue(dimension);
+    }
+}
+
+int SpatialTrackingManager::AddFrame(const unsigned char* data, int rows, int cols, const TrackerMetaData& metaData)
+{
+    FrameAnalysis analysis;
+    int retVal = analyzer_.Analyze(data, rows, cols, analysis);
+    times_.push_back(metaData.frameTime);
+    frames_.push_back(analysis);
+    return retVal;
+}
+
+int SpatialTrackingManager::CreateTracks(std::vector<VideoAnalysisPtr>& tracks)
+{
+    tracks.clear();
+    size_t numTracks = 0;
+    for (size_t k = 0; k < frames_.size(); k++) {
+        numTracks = std::max(numTracks, frames_[k].NumFaces());
+    }
+    for (size_t t = 0; t < numTracks; t++) {
+        VideoAnalysisPtr track(new VideoAnalysis);
+        for (size_t k = 0; k < frames_.size(); k++) {
+            Face face;
+            bool present = t < frames_[k].NumFaces();
+            if (present) {
+                frames_[k].GetFace(t, face);
+            }
+            track->times_.push_back((float)times_[k]);
+            track->present_.push_back(present);
+            track->faces_.push_back(face);
+        }
+        tracks.push_back(track);
+    }
+    return SUCCESS;
+}
+
+int TrackerFactory::GetSpatialTracker(SpatialTrackingManagerPtr& tracker, const std::string& facetsDir,
+                                      const std::string& configFile)
+{
+    tracker.reset(new SpatialTrackingManager);
+    return tracker->analyzer_.Initialize(facetsDir, configFile);
+}
+
+}  // namespace FacetSDK
+}  // namespace EMOTIENT
@@ -0,0 +1,222 @@
+#ifndef FACETSTUB_EMOTIENT_HPP
+#define FACETSTUB_EMOTIENT_HPP
+
+/**
+ * Stand-in for the part of the FACET SDK the drivers use (FrameAnalyzer,
+ * SpatialTrackingManager and the channel enums), so that fexbench builds
+ * and runs without the proprietary SDK.
+ *
+ * It does no face analysis. Analyze() and AddFrame() read the whole frame,
+ * then keep the CPU busy until StubSettings::frameMillis have passed, and
+ * report StubSettings::numFaces synthetic faces whose boxes and values are
+ * a deterministic function of the frame contents. The channel names are
+ * the ones of shared/fexchannels.txt.
+ */
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <tr1/memory>
+
+namespace EMOTIENT {
+namespace FacetSDK {
+
+enum ErrorCode {
+    SUCCESS = 0,
+    EMPTY_INPUT,
+    NOT_AVAILABLE,
+    NOT_INITIALIZED
+};
+
+enum Channel {
+    ACTION_UNITS,
+    PRIMARY_EMOTIONS,
+    SENTIMENTS,
+    ADVANCED_EMOTIONS,
+    EMOTIONS,
+    POSE,
+    LANDMARKS,
+    DEMOGRAPHICS,
+    NUM_CHANNELS
+};
+
+enum LandmarkName {
+    LEFT_EYE_LATERAL, LEFT_EYE_PUPIL, LEFT_EYE_MEDIAL,
+    RIGHT_EYE_MEDIAL, RIGHT_EYE_PUPIL, RIGHT_EYE_LATERAL,
+    NOSE_TIP
+};
+
+enum EmotionName {
+    ANGER, CONTEMPT, DISGUST, JOY, FEAR, SADNESS, SURPRISE,         // Primary emotions
+    NEUTRAL, NEGATIVE, POSITIVE,                                    // Sentiments
+    CONFUSION, FRUSTRATION                                          // Advanced emotions
+};
+
+enum ActionUnitEnum {
+    AU1, AU2, AU4, AU5, AU6, AU7, AU9, AU10, AU12, AU14,
+    AU15, AU17, AU18, AU20, AU23, AU24, AU25, AU26, AU28, AU43
+};
+typedef ActionUnitEnum ActionUnit;
+
+enum DemographicName { IS_MALE };
+
+enum PoseDimension { ROLL, PITCH, YAW };
+
+std::vector<LandmarkName> AllLandmarkNames();
+std::vector<EmotionName> AllPrimaryEmotionNames();
+std::vector<EmotionName> AllSentimentEmotionNames();
+std::vector<EmotionName> AllAdvancedEmotionNames();
+std::vector<EmotionName> AllEmotionNames();
+std::vector<ActionUnit> AllActionUnits();
+std::vector<PoseDimension> AllPoseDimensions();
+
+std::string LandmarkNameToString(LandmarkName name);
+std::string EmotionNameToString(EmotionName name);
+std::string ActionUnitToString(ActionUnit name);
+std::string PoseDimensionToString(PoseDimension name);
+std::string DefineErrorCode(int code);
+
+inline std::ostream& operator<<(std::ostream& out, LandmarkName name) { return out << LandmarkNameToString(name); }
+inline std::ostream& operator<<(std::ostream& out, EmotionName name) { return out << EmotionNameToString(name); }
+inline std::ostream& operator<<(std::ostream& out, ActionUnit name) { return out << ActionUnitToString(name); }
+inline std::ostream& operator<<(std::ostream& out, PoseDimension name) { return out << PoseDimensionToString(name); }
+
+struct Point {
+    Point() : x(0), y(0) {}
+    Point(float x_, float y_) : x(x_), y(y_) {}
+    float x, y;
+};
+
+struct Rectangle {
+    Rectangle() : x(0), y(0), width(0), height(0) {}
+    Rectangle(float x_, float y_, float width_, float height_) : x(x_), y(y_), width(width_), height(height_) {}
+    float x, y, width, height;
+};
+
+/**
+ * Behaviour of the stand-in (not part of the FACET SDK).
+ */
+struct StubSettings {
+    StubSettings() : frameMillis(20), numFaces(1) {}
+    double frameMillis;     ///< Wall-clock cost of Analyze() and AddFrame()
+    int numFaces;           ///< Faces found in every frame
+};
+
+void SetStubSettings(const StubSettings& settings);
+StubSettings GetStubSettings();
+
+/**
+ * A synthetic face: its box, and a seed all its values are derived from.
+ */
+class Face {
+public:
+    Face() : seed_(0) {}
+    Face(const Rectangle& location, float seed) : location_(location), seed_(seed) {}
+
+    void FaceLocation(Rectangle& location) const { location = location_; }
+    Point LandmarkLocation(LandmarkName name) const;
+    float PoseValue(PoseDimension dimension) const;
+    float EmotionValue(EmotionName name) const;
+    float ActionUnitValue(ActionUnit name) const;
+    float DemographicValue(DemographicName name) const;
+
+private:
+    Rectangle location_;
+    float seed_;
+};
+
+class FrameAnalysis {
+public:
+    size_t NumFaces() const { return faces_.size(); }
+    void GetFace(size_t index, Face& face) const { face = faces_[index]; }
+    void LargestFace(Face& face) const;
+
+private:
+    friend class FrameAnalyzer;
+    std::vector<Face> faces_;
+};
+
+class FrameAnalyzer {
+public:
+    FrameAnalyzer();
+
+    void SetMaxThreads(int maxThreads) { maxThreads_ = maxThreads; }
+    int Initialize(const std::string& facetsDir, const std::string& configFile);
+    int SetMinFaceDetectionWidth(float width);
+    void SetChannelActive(Channel channel, bool active);
+    bool IsChannelActive(Channel channel) const;
+    bool IsChannelAvailable(Channel channel) const;
+
+    /**
+     * "Analyze" a rows x cols 8-bit grayscale image (see StubSettings).
+     */
+    int Analyze(const unsigned char* data, int rows, int cols, FrameAnalysis& analysis);
+
+private:
+    bool initialized_;
+    int maxThreads_;
+    float minFaceWidth_;
+    bool active_[NUM_CHANNELS];
+};
+
+struct TrackerMetaData {
+    explicit TrackerMetaData(double time) : frameTime(time) {}
+    double frameTime;
+};
+
+/**
+ * One track: a face followed over the frames it was added to.
+ */
+class VideoAnalysis {
+public:
+    void FrameTimes(std::vector<float>& times) const { times = times_; }
+    void IsFacePresent(std::vector<bool>& present) const { present = present_; }
+    void FaceLocations(std::vector<Rectangle>& locations) const;
+    void EmotionEvidence(EmotionName name, std::vector<float>& values) const;
+    void ActionUnitEvidence(ActionUnit name, std::vector<float>& values) const;
+    void DemographicEvidence(DemographicName name, std::vector<float>& values) const;
+    void LandmarkLocations(LandmarkName name, std::vector<Point>& points) const;
+    void Pose(PoseDimension dimension, std::vector<float>& values) const;
+
+private:
+    friend class SpatialTrackingManager;
+    std::vector<float> times_;
+    std::vector<bool> present_;
+    std::vector<Face> faces_;   ///< One per frame (default Face when not present)
+};
+typedef std::tr1::shared_ptr<VideoAnalysis> VideoAnalysisPtr;
+
+class SpatialTrackingManager {
+public:
+    void SetBackgroundModelActive(bool active) {}
+    void SetChannelActive(Channel channel, bool active) { analyzer_.SetChannelActive(channel, active); }
+    void SetMaxThreads(int maxThreads) { analyzer_.SetMaxThreads(maxThreads); }
+    void SetMinFaceSize(int minSize) { analyzer_.SetMinFaceDetectionWidth((float)minSize); }
+
+    /**
+     * Analyze a frame like FrameAnalyzer::Analyze and keep its faces.
+     */
+    int AddFrame(const unsigned char* data, int rows, int cols, const TrackerMetaData& metaData);
+
+    /**
+     * One track per synthetic face (the i-th face of every frame).
+     */
+    int CreateTracks(std::vector<VideoAnalysisPtr>& tracks);
+
+private:
+    friend struct TrackerFactory;
+    FrameAnalyzer analyzer_;
+    std::vector<double> times_;
+    std::vector<FrameAnalysis> frames_;
+};
+typedef std::tr1::shared_ptr<SpatialTrackingManager> SpatialTrackingManagerPtr;
+
+struct TrackerFactory {
+    static int GetSpatialTracker(SpatialTrackingManagerPtr& tracker, const std::string& facetsDir,
+                                 const std::string& configFile);
+};
+
+}  // namespace FacetSDK
+}  // namespace EMOTIENT
+
+#endif  // FACETSTUB_EMOTIENT_HPP
@@ -0,0 +1,423 @@
+/**
+ * Stage-level benchmark of the video and image paths, built against the
+ * FACET stand-in of facetstub/ (no SDK or licence needed).
+ *
+ * Each stage is timed separately, per frame, with the wall clock:
+ *
+ *   decode      cv::VideoCapture::read (BGR)
+ *   gray        cvtColor BGR -> gray, full size
+ *   resize      area resize of the gray frame to -q
+ *   grayresize  fused convert + resize (GrayResizer)
+ *   luma        LumaSource::read, with setScale(-q)
+ *   analysis    FrameAnalyzer::Analyze (the stand-in: -a ms, -f faces)
+ *   format      image driver row (ImageRows<IMAGE_FULL, TabRow>)
+ *   write       TextWriter to a file
+ *   track       SpatialTrackingManager::AddFrame
+ *   tracks      SpatialTrackingManager::CreateTracks
+ *   trackjson   TrackFormatter fetch + format, per track
+ *
+ * then the whole fexfacet pipeline (FramePipeline with -t analyzers) runs
+ * end to end. Without -v a synthetic video (a bright ellipse moving over a
+ * textured gradient) is written with cv::VideoWriter and removed at the
+ * end, so runs are reproducible.
+ *
+ * Usage: fexbench [-v VIDEO] [-n FRAMES] [-s WIDTHxHEIGHT] [-q QUALITYSCALE]
+ *                 [-a ANALYSISMS] [-f FACES] [-t WORKERS] [-p PRECISION]
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <opencv2/opencv.hpp>
+#include "emotient.hpp"
+#include "grayresize.hpp"
+#include "imagerows.hpp"
+#include "lumasource.hpp"
+#include "pipeline.hpp"
+#include "stagestats.hpp"
+#include "textwriter.hpp"
+#include "trackjson.hpp"
+
+using namespace EMOTIENT;
+
+const int DEFAULT_FRAMES = 300;
+const int DEFAULT_WIDTH = 640;
+const int DEFAULT_HEIGHT = 480;
+const char* SYNTHETIC_VIDEO = "fexbench.avi";
+const char* ROWS_OUTPUT = "fexbench.out";
+const char* JSON_OUTPUT = "fexbench.json";
+const double TWO_PI = 6.283185307179586;
+
+typedef ImageRows<IMAGE_FULL, TabRow> BenchRows;
+
+struct BenchOptions {
+    BenchOptions()
+    : numFrames(DEFAULT_FRAMES), width(DEFAULT_WIDTH), height(DEFAULT_HEIGHT), qualityScale(1),
+      numWorkers(1), precision(DEFAULT_PRECISION) {}
+
+    std::string videoFile;      ///< Empty: generate a synthetic video
+    int numFrames;
+    int width;
+    int height;
+    double qualityScale;
+    int numWorkers;
+    int precision;
+    FacetSDK::StubSettings stub;
+};
+
+static char* getCmdOption(char** begin, char** end, const std::string& option)
+{
+    char** itr = std::find(begin, end, option);
+    if (itr != end && ++itr != end) {
+        return *itr;
+    }
+    return 0;
+}
+
+static bool parseBenchArgs(int argc, char* argv[], BenchOptions& options)
+{
+    for (int i = 1; i < argc; i += 2) {
+        std::string flag(argv[i]);
+        char* value = getCmdOption(argv + i, argv + argc, flag);
+        if (value == 0) {
+            return false;
+        }
+        if (flag == "-v") {
+            options.videoFile = value;
+        } else if (flag == "-n") {
+            options.numFrames = atoi(value);
+        } else if (flag == "-s") {
+            if (sscanf(value, "%dx%d", &options.width, &options.height) != 2) {
+                return false;
+            }
+        } else if (flag == "-q") {
+            options.qualityScale = atof(value);
+        } else if (flag == "-a") {
+            options.stub.frameMillis = atof(value);
+        } else if (flag == "-f") {
+            options.stub.numFaces = atoi(value);
+        } else if (flag == "-t") {
+            options.numWorkers = atoi(value);
+        } else if (flag == "-p") {
+            options.precision = clampPrecision(atoi(value));
+        } else {
+            return false;
+        }
+    }
+    return options.numFrames > 0 && options.width > 0 && options.height > 0 &&
+           options.qualityScale > 0 && options.qualityScale <= 1 && options.numWorkers > 0 &&
+           options.stub.frameMillis >= 0 && options.stub.numFaces >= 0;
+}
+
+/**
+ * Frame k of the synthetic video: a gradient with a fine texture (so the
+ * encoder has detail to keep) and a bright "face" ellipse moving across.
+ */
+static void syntheticFrame(cv::Mat& frame, int k)
+{
+    for (int y = 0; y < frame.rows; y++) {
+        unsigned char* row = frame.ptr(y);
+        for (int x = 0; x < frame.cols; x++) {
+            unsigned int texture = ((unsigned int)(x * 7 + y * 13 + k * 3) * 2654435761U) >> 28;
+            unsigned char level = (unsigned char)std::min(255, (x + y) * 160 / (frame.rows + frame.cols) + (int)texture * 4);
+            row[3 * x] = level;
+            row[3 * x + 1] = (unsigned char)(level / 2 + 40);
+            row[3 * x + 2] = (unsigned char)(255 - level);
+        }
+    }
+    int radius = std::max(4, frame.rows / 5);
+    double phase = TWO_PI * k / 120;
+    cv::Point center((int)(frame.cols * (0.5 + 0.3 * std::sin(phase))), (int)(frame.rows * (0.5 + 0.1 * std::cos(phase))));
+    cv::ellipse(frame, center, cv::Size(radius * 4 / 5, radius), 0, 0, 360, cv::Scalar(170, 190, 220), -1);
+}
+
+static bool writeSyntheticVideo(const std::string& filename, const BenchOptions& options)
+{
+    cv::VideoWriter writer(filename, CV_FOURCC('M', 'J', 'P', 'G'), 30, cv::Size(options.width, options.height));
+    if (!writer.isOpened()) {
+        return false;
+    }
+    cv::Mat frame(options.height, options.width, CV_8UC3);
+    for (int k = 0; k < options.numFrames; k++) {
+        syntheticFrame(frame, k);
+        writer << frame;
+    }
+    return true;
+}
+
+static void printHeader()
+{
+    std::cout << std::left << std::setw(12) << "stage" << std::right
+              << std::setw(8) << "count" << std::setw(10) << "mean" << std::setw(10) << "p50"
+              << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "max"
+              << "   (ms)" << std::endl;
+}
+
+static void printStage(const StageStats& stats)
+{
+    if (stats.count() == 0) {
+        return;
+    }
+    std::cout << std::left << std::setw(12) << stats.name() << std::right << std::fixed << std::setprecision(3)
+              << std::setw(8) << stats.count()
+              << std::setw(10) << 1e3 * stats.mean()
+              << std::setw(10) << 1e3 * stats.percentile(50)
+              << std::setw(10) << 1e3 * stats.percentile(90)
+              << std::setw(10) << 1e3 * stats.percentile(99)
+              << std::setw(10) << 1e3 * stats.max() << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+}
+
+static cv::Size scaledSize(int width, int height, double scale)
+{
+    return cv::Size(std::max(1, (int)(width * scale)), std::max(1, (int)(height * scale)));
+}
+
+/**
+ * cv::VideoCapture path: decode, gray, resize, fused gray + resize, then
+ * analysis and the image driver row of the analyzed frame.
+ */
+static bool benchFrameStages(const BenchOptions& options, FacetSDK::FrameAnalyzer& analyzer)
+{
+    cv::VideoCapture videoCap(options.videoFile);
+    if (!videoCap.isOpened()) {
+        return false;
+    }
+    StageStats decode("decode"), gray("gray"), resize("resize"), grayresize("grayresize");
+    StageStats analysis("analysis"), format("format"), write("write");
+
+    std::ofstream rowsFile(ROWS_OUTPUT);
+    TextWriter text(rowsFile, true);
+    BenchRows rows(analyzer);
+    rows.setPrecision(options.precision);
+
+    cv::Mat bgrFrame, grayFrame, smallFrame, fusedFrame;
+    GrayResizer resizer;
+    FacetSDK::FrameAnalysis frameAnalysis;
+    FacetSDK::Face face;
+    std::string row;
+    const std::string name("frame");
+    for (int k = 0; k < options.numFrames; k++) {
+        {
+            StageTimer timer(decode);
+            if (!videoCap.read(bgrFrame) || bgrFrame.empty()) {
+                break;
+            }
+        }
+        {
+            StageTimer timer(gray);
+            cv::cvtColor(bgrFrame, grayFrame, CV_BGR2GRAY);
+        }
+        const cv::Mat* analyzed = &grayFrame;
+        if (options.qualityScale < 1) {
+            cv::Size size = scaledSize(grayFrame.cols, grayFrame.rows, options.qualityScale);
+            {
+                StageTimer timer(resize);
+                cv::resize(grayFrame, smallFrame, size, 0, 0, CV_INTER_AREA);
+            }
+            {
+                StageTimer timer(grayresize);
+                grayResize(bgrFrame, fusedFrame, size, resizer);
+            }
+            analyzed = &fusedFrame;
+        }
+        {
+            StageTimer timer(analysis);
+            analyzer.Analyze(analyzed->data, analyzed->rows, analyzed->cols, frameAnalysis);
+        }
+        {
+            StageTimer timer(format);
+            row.clear();
+            rows.format(row, name, *analyzed, frameAnalysis, face, scaledMapping(grayFrame.size(), analyzed->size()));
+        }
+        {
+            StageTimer timer(write);
+            text.write(row);
+        }
+    }
+    text.close();
+    rowsFile.close();
+
+    printStage(decode);
+    printStage(gray);
+    printStage(resize);
+    printStage(grayresize);
+    printStage(analysis);
+    printStage(format);
+    printStage(write);
+    return true;
+}
+
+/**
+ * LumaSource path (straight to the luma plane, scaled while decoding).
+ */
+static bool benchLumaSource(const BenchOptions& options)
+{
+    LumaSource source;
+    if (!source.open(options.videoFile)) {
+        return false;
+    }
+    source.setScale(options.qualityScale);
+    StageStats luma("luma");
+    LumaFrame frame;
+    for (int k = 0; k < options.numFrames; k++) {
+        StageTimer timer(luma);
+        if (!source.read(frame)) {
+            break;
+        }
+    }
+    printStage(luma);
+    return true;
+}
+
+/**
+ * fexfacetexec path: tracker, tracks and their JSON.
+ */
+static bool benchTracker(const BenchOptions& options)
+{
+    LumaSource source;
+    if (!source.open(options.videoFile)) {
+        return false;
+    }
+    source.setScale(options.qualityScale);
+    FacetSDK::SpatialTrackingManagerPtr tracker;
+    FacetSDK::TrackerFactory::GetSpatialTracker(tracker, "", "");
+
+    StageStats track("track"), tracks("tracks"), trackjson("trackjson");
+    LumaFrame frame;
+    std::vector<double> frameTimes;
+    for (int k = 0; k < options.numFrames && source.read(frame); k++) {
+        StageTimer timer(track);
+        tracker->AddFrame(frame.data(), frame.rows(), frame.cols(), FacetSDK::TrackerMetaData(frame.timestamp()));
+        frameTimes.push_back(frame.timestamp());
+    }
+    std::vector<FacetSDK::VideoAnalysisPtr> videoTracks;
+    {
+        StageTimer timer(tracks);
+        tracker->CreateTracks(videoTracks);
+    }
+    TrackFormatter formatter;
+    TrackData data;
+    std::string text;
+    for (size_t t = 0; t < videoTracks.size(); t++) {
+        StageTimer timer(trackjson);
+        formatter.fetch(*videoTracks[t], data);
+        text.clear();
+        formatter.format(data, 0, 1e300, text);
+    }
+    double start = wallSeconds();
+    SerializeTracksToJSON(JSON_OUTPUT, videoTracks, frameTimes, source.width(), source.height(), options.numWorkers);
+    double serialize = wallSeconds() - start;
+
+    printStage(track);
+    printStage(tracks);
+    printStage(trackjson);
+    std::cout << "SerializeTracksToJSON: " << 1e3 * serialize << " ms (" << videoTracks.size() << " tracks)" << std::endl;
+    return true;
+}
+
+/**
+ * Image driver rows for the frames of the pipeline.
+ */
+class BenchFormatter : public FrameFormatter {
+public:
+    BenchFormatter(const BenchRows& rows, TextWriter& text, const FrameMapping& mapping)
+    : rows_(rows), text_(text), name_("frame"), mapping_(mapping) {}
+
+    void format(std::string& row, size_t framenum, const cv::Mat& grayFrame,
+                FacetSDK::FrameAnalysis& analysis, FacetSDK::FrameAnalyzer& analyzer, const cv::Rect& region)
+    {
+        FacetSDK::Face face;
+        rows_.format(row, name_, grayFrame, analysis, face, mapping_.region(region.x, region.y));
+    }
+
+    void write(std::ostream& out, const std::string& row) { text_.write(row); }
+
+private:
+    const BenchRows& rows_;
+    TextWriter& text_;
+    const std::string name_;
+    FrameMapping mapping_;
+};
+
+/**
+ * fexfacet path end to end: FramePipeline with numWorkers analyzers.
+ */
+static bool benchPipeline(const BenchOptions& options)
+{
+    LumaSource source;
+    if (!source.open(options.videoFile)) {
+        return false;
+    }
+    source.setScale(options.qualityScale);
+    std::vector<FacetSDK::FrameAnalyzer*> analyzers;
+    for (int i = 0; i < options.numWorkers; i++) {
+        analyzers.push_back(new FacetSDK::FrameAnalyzer);
+        analyzers.back()->Initialize("", "");
+    }
+    BenchRows rows(*analyzers[0]);
+    rows.setPrecision(options.precision);
+
+    std::ofstream rowsFile(ROWS_OUTPUT);
+    double start = wallSeconds();
+    size_t numRows;
+    {
+        TextWriter text(rowsFile, true);
+        BenchFormatter formatter(rows, text, source.mapping());
+        FramePipeline pipeline(source, analyzers, formatter, rowsFile, 2 * analyzers.size() + 2);
+        numRows = pipeline.run(options.numFrames);
+        text.close();
+    }
+    double elapsed = wallSeconds() - start;
+    for (size_t i = 0; i < analyzers.size(); i++) {
+        delete analyzers[i];
+    }
+    std::cout << "pipeline: " << numRows << " frames, " << options.numWorkers << " workers, "
+              << elapsed << " s, " << numRows / std::max(elapsed, 1e-6) << " frames/s" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    if (!parseBenchArgs(argc, argv, options)) {
+        std::cout << "Usage: fexbench [-v VIDEO] [-n FRAMES] [-s WIDTHxHEIGHT] [-q QUALITYSCALE]" << std::endl
+                  << "                [-a ANALYSISMS] [-f FACES] [-t WORKERS] [-p PRECISION]" << std::endl;
+        return -1;
+    }
+    FacetSDK::SetStubSettings(options.stub);
+
+    bool synthetic = options.videoFile.empty();
+    if (synthetic) {
+        options.videoFile = SYNTHETIC_VIDEO;
+        if (!writeSyntheticVideo(options.videoFile, options)) {
+            std::cout << "Could not write " << options.videoFile << std::endl;
+            return -1;
+        }
+    }
+    std::cout << options.videoFile << ": " << options.numFrames << " frames, quality scale " << options.qualityScale
+              << ", analysis " << options.stub.frameMillis << " ms, " << options.stub.numFaces << " faces" << std::endl;
+
+    FacetSDK::FrameAnalyzer analyzer;
+    analyzer.Initialize("", "");
+    printHeader();
+    bool ok = benchFrameStages(options, analyzer) && benchLumaSource(options) && benchTracker(options);
+    if (ok) {
+        ok = benchPipeline(options);
+    }
+    if (!ok) {
+        std::cout << "Could not open video file " << options.videoFile << std::endl;
+    }
+
+    remove(ROWS_OUTPUT);
+    remove(JSON_OUTPUT);
+    if (synthetic) {
+        remove(options.videoFile.c_str());
+    }
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,102 @@
+/**
+ * Micro-benchmark of the fused BGR -> gray + area resize (GrayResizer)
+ * against the resize-then-convert sequence fexfacetexec used to run.
+ *
+ * Usage: bench_grayresize [WIDTH HEIGHT [ITERATIONS]]
+ */
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+#include "grayresize.hpp"
+
+const int DEFAULT_WIDTH = 1920;
+const int DEFAULT_HEIGHT = 1080;
+const int DEFAULT_ITERATIONS = 50;
+
+/**
+ * Average milliseconds per iteration.
+ */
+double millisPerFrame(int64 ticks, int iterations)
+{
+    return 1000.0 * ticks / cv::getTickFrequency() / iterations;
+}
+
+/**
+ * Largest absolute difference between two gray images of the same size.
+ */
+int maxDiff(const cv::Mat& a, const cv::Mat& b)
+{
+    cv::Mat diff;
+    cv::absdiff(a, b, diff);
+    double maxVal(0);
+    cv::minMaxLoc(diff, 0, &maxVal);
+    return (int)maxVal;
+}
+
+void benchScale(const cv::Mat& bgrFrame, double scale, int iterations)
+{
+    cv::Size dsize((int)(bgrFrame.cols * scale + 1e-6), (int)(bgrFrame.rows * scale + 1e-6));
+    cv::Mat resized, reference, linear, area, fused;
+    GrayResizer resizer;
+
+    // Old path: resize the three channels, then convert
+    int64 start = cv::getTickCount();
+    for (int i = 0; i < iterations; i++) {
+        cv::resize(bgrFrame, resized, dsize);
+        cv::cvtColor(resized, linear, CV_BGR2GRAY);
+    }
+    double linearMs = millisPerFrame(cv::getTickCount() - start, iterations);
+
+    start = cv::getTickCount();
+    for (int i = 0; i < iterations; i++) {
+        cv::resize(bgrFrame, resized, dsize, 0, 0, CV_INTER_AREA);
+        cv::cvtColor(resized, area, CV_BGR2GRAY);
+    }
+    double areaMs = millisPerFrame(cv::getTickCount() - start, iterations);
+
+    // Fused path
+    start = cv::getTickCount();
+    for (int i = 0; i < iterations; i++) {
+        grayResize(bgrFrame, fused, dsize, resizer);
+    }
+    double fusedMs = millisPerFrame(cv::getTickCount() - start, iterations);
+
+    // Reference: convert at full size, then area resize
+    cv::cvtColor(bgrFrame, reference, CV_BGR2GRAY);
+    cv::resize(reference, reference, dsize, 0, 0, CV_INTER_AREA);
+
+    std::cout << "scale " << scale << " (" << dsize.width << "x" << dsize.height << "): "
+              << "resize+cvtColor " << linearMs << " ms, "
+              << "area resize+cvtColor " << areaMs << " ms, "
+              << "fused " << fusedMs << " ms "
+              << "(max diff vs gray+area " << maxDiff(fused, reference) << ")" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int width(DEFAULT_WIDTH), height(DEFAULT_HEIGHT), iterations(DEFAULT_ITERATIONS);
+    if (argc >= 3) {
+        width = atoi(argv[1]);
+        height = atoi(argv[2]);
+    }
+    if (argc >= 4) {
+        iterations = atoi(argv[3]);
+    }
+    if (width <= 0 || height <= 0 || iterations <= 0) {
+        std::cout << "Usage: bench_grayresize [WIDTH HEIGHT [ITERATIONS]]" << std::endl;
+        return -1;
+    }
+
+    // Synthetic frame: smooth gradients plus noise, so neither path gets a free ride
+    cv::Mat bgrFrame(height, width, CV_8UC3);
+    cv::randu(bgrFrame, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(bgrFrame, bgrFrame, cv::Size(5, 5), 0);
+
+    std::cout << width << "x" << height << " BGR, " << iterations << " iterations" << std::endl;
+    const double scales[] = { 0.5, 1.0 / 3, 0.25, 0.37, 0.75 };
+    for (size_t i = 0; i < sizeof(scales) / sizeof(scales[0]); i++) {
+        benchScale(bgrFrame, scales[i], iterations);
+    }
+    return 0;
+}
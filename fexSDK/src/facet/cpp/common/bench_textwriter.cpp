@@ -0,0 +1,139 @@
+/**
+ * Benchmark of the text row output: std::ostream formatting (the path
+ * fexfacet and the image drivers used) against appendFloat and TextWriter,
+ * on a synthetic table shaped like the fexfacet rows.
+ *
+ * Usage: bench_textwriter [ROWS [OUTPUTFILE]]
+ */
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <sys/time.h>
+#include "textwriter.hpp"
+
+const long DEFAULT_ROWS = 1000000;
+const int COLUMNS = 60;     /**< Face box, landmarks, pose, emotions and action units **/
+const char* DEFAULT_OUTPUT = "bench_textwriter.out";
+
+static double seconds()
+{
+    struct timeval now;
+    gettimeofday(&now, 0);
+    return now.tv_sec + now.tv_usec * 1e-6;
+}
+
+/**
+ * Values of a row: coordinates in pixels, angles and evidence around 0.
+ */
+static void fillRow(std::vector<float>& values, long row)
+{
+    for (int c = 0; c < COLUMNS; c++) {
+        unsigned int x = (unsigned int)(row * 2654435761UL + c * 40503UL);
+        float noise = (x % 100000) / 100000.0f;
+        values[c] = c < 44 ? 100.0f + 500.0f * noise : 4.0f * noise - 2.0f;
+    }
+}
+
+/**
+ * Old path: each row formatted in an ostringstream, then written to the
+ * file stream.
+ */
+static double writeOstream(const std::string& filename, long numRows)
+{
+    std::vector<float> values(COLUMNS);
+    std::ofstream out(filename.c_str());
+    double start = seconds();
+    std::ostringstream row;
+    for (long r = 0; r < numRows; r++) {
+        fillRow(values, r);
+        row.str("");
+        row.clear();
+        row << r + 1 << "\t" << 480 << "\t" << 640;
+        for (int c = 0; c < COLUMNS; c++) {
+            row << "\t" << values[c];
+        }
+        row << "\n";
+        out << row.str();
+    }
+    out.close();
+    return seconds() - start;
+}
+
+/**
+ * New path: rows appended to a reused string, written by a TextWriter.
+ */
+static double writeTextWriter(const std::string& filename, long numRows, int precision, bool background)
+{
+    std::vector<float> values(COLUMNS);
+    std::ofstream out(filename.c_str());
+    double start = seconds();
+    {
+        TextWriter writer(out, background);
+        std::string row;
+        for (long r = 0; r < numRows; r++) {
+            fillRow(values, r);
+            row.clear();
+            appendInt(row, r + 1);
+            row += "\t480\t640";
+            for (int c = 0; c < COLUMNS; c++) {
+                row += '\t';
+                appendFloat(row, values[c], precision);
+            }
+            row += '\n';
+            writer.write(row);
+        }
+        writer.close();
+    }
+    out.close();
+    return seconds() - start;
+}
+
+static std::string readFile(const std::string& filename)
+{
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char* argv[])
+{
+    long numRows(DEFAULT_ROWS);
+    std::string filename(DEFAULT_OUTPUT);
+    if (argc >= 2) {
+        numRows = atol(argv[1]);
+    }
+    if (argc >= 3) {
+        filename = argv[2];
+    }
+    if (numRows <= 0) {
+        std::cout << "Usage: bench_textwriter [ROWS [OUTPUTFILE]]" << std::endl;
+        return -1;
+    }
+
+    std::cout << numRows << " rows of " << COLUMNS + 3 << " columns" << std::endl;
+    double ostreamSecs = writeOstream(filename, numRows);
+    std::string reference = readFile(filename);
+    std::cout << "ostream:                        " << ostreamSecs << " s ("
+              << reference.size() / ostreamSecs / 1e6 << " MB/s)" << std::endl;
+
+    const int precisions[] = { DEFAULT_PRECISION, ROUNDTRIP_PRECISION };
+    for (size_t p = 0; p < sizeof(precisions) / sizeof(precisions[0]); p++) {
+        for (int background = 0; background <= 1; background++) {
+            double secs = writeTextWriter(filename, numRows, precisions[p], background != 0);
+            std::string text = readFile(filename);
+            std::cout << "TextWriter, " << precisions[p] << " digits, "
+                      << (background ? "background: " : "caller:     ") << secs << " s ("
+                      << text.size() / secs / 1e6 << " MB/s, " << ostreamSecs / secs << "x)";
+            if (precisions[p] == DEFAULT_PRECISION) {
+                std::cout << (text == reference ? ", same output" : ", OUTPUT DIFFERS");
+            }
+            std::cout << std::endl;
+        }
+    }
+    remove(filename.c_str());
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "checkpoint.hpp"
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <unistd.h>
+#include "stagestats.hpp"
+
+bool replaceFile(const std::string& fileName, const std::string& text, bool sync)
+{
+    std::string temporary(fileName + ".tmp");
+    FILE* file = fopen(temporary.c_str(), "w");
+    if (file == 0) {
+        return false;
+    }
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = (fflush(file) == 0) && ok;
+    if (sync) {
+        ok = (fsync(fileno(file)) == 0) && ok;
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temporary.c_str(), fileName.c_str()) != 0) {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool syncFile(const std::string& fileName)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    return (close(fd) == 0) && ok;
+}
+
+bool truncateFile(const std::string& fileName, long long size)
+{
+    return truncate(fileName.c_str(), (off_t)size) == 0;
+}
+
+bool loadCheckpoint(const std::string& fileName, Checkpoint& checkpoint)
+{
+    std::ifstream file(fileName.c_str());
+    if (!file) {
+        return false;
+    }
+    // One "key<TAB>value" per line
+    std::string line;
+    size_t found(0);
+    while (std::getline(file, line)) {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos) {
+            continue;
+        }
+        std::string key(line.substr(0, tab));
+        std::istringstream value(line.substr(tab + 1));
+        if (key == "input") {
+            checkpoint.input = line.substr(tab + 1);
+        } else if (key == "frame") {
+            value >> checkpoint.frame;
+        } else if (key == "timestamp") {
+            value >> checkpoint.timestamp;
+        } else if (key == "offset") {
+            value >> checkpoint.offset;
+        } else {
+            continue;
+        }
+        found++;
+    }
+    return found == 4;
+}
+
+Checkpointer::Checkpointer(const std::string& fileName, const std::string& input, double interval)
+: fileName_(fileName), input_(input), interval_(interval), last_(wallSeconds())
+{
+}
+
+bool Checkpointer::due() const
+{
+    return wallSeconds() - last_ >= interval_;
+}
+
+bool Checkpointer::save(size_t frame, double timestamp, long long offset)
+{
+    last_ = wallSeconds();
+    std::ostringstream text;
+    text.precision(17);
+    text << "input\t" << input_ << "\n";
+    text << "frame\t" << frame << "\n";
+    text << "timestamp\t" << timestamp << "\n";
+    text << "offset\t" << offset << "\n";
+    return replaceFile(fileName_, text.str(), true);
+}
+
+void Checkpointer::remove()
+{
+    ::remove(fileName_.c_str());
+}
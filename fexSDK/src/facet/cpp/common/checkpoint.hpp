@@ -0,0 +1,76 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <string>
+
+const double CHECKPOINT_INTERVAL = 60;  /**< Seconds between two checkpoints of a long run **/
+const std::string CHECKPOINT_EXT = ".ckpt";
+
+/**
+ * Replace fileName with text: the text is written to a temporary file,
+ * synced to disk when sync is set, and renamed, so readers (and a run
+ * resumed after a crash) never see a partial file. Returns false on error.
+ */
+bool replaceFile(const std::string& fileName, const std::string& text, bool sync);
+
+/**
+ * Flush the data of fileName to disk. Returns false on error.
+ */
+bool syncFile(const std::string& fileName);
+
+/**
+ * Cut fileName to its first size bytes. Returns false on error.
+ */
+bool truncateFile(const std::string& fileName, long long size);
+
+/**
+ * Where a run over the frames of a video stopped: its output holds the
+ * rows of the frames before frame, in its first offset bytes, and the last
+ * of these frames was decoded at timestamp.
+ */
+struct Checkpoint {
+    Checkpoint() : frame(0), timestamp(0), offset(0) {}
+
+    std::string input;      ///< Video being processed
+    size_t frame;           ///< Number of frames committed
+    double timestamp;       ///< Seconds
+    long long offset;       ///< Bytes of the output
+};
+
+/**
+ * Read the checkpoint saved in fileName. Returns false if there is none.
+ */
+bool loadCheckpoint(const std::string& fileName, Checkpoint& checkpoint);
+
+/**
+ * Saves the checkpoints of a run every interval seconds (wall clock) to
+ * OUTPUTNAME.ckpt, and removes the file when the run is complete. Used
+ * from a single thread.
+ */
+class Checkpointer {
+public:
+    Checkpointer(const std::string& fileName, const std::string& input, double interval = CHECKPOINT_INTERVAL);
+
+    /** True when the next checkpoint is due **/
+    bool due() const;
+
+    /**
+     * Record that the output is committed up to frame (exclusive): its
+     * offset bytes are on disk, and frame - 1 was decoded at timestamp.
+     * Returns false if the checkpoint could not be written.
+     */
+    bool save(size_t frame, double timestamp, long long offset);
+
+    /** The run is complete: delete the checkpoint **/
+    void remove();
+
+    const std::string& fileName() const { return fileName_; }
+
+private:
+    std::string fileName_;
+    std::string input_;
+    double interval_;
+    double last_;           ///< Wall-clock time of the last checkpoint
+};
+
+#endif  // CHECKPOINT_HPP
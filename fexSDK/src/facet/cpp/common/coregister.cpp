@@ -0,0 +1,343 @@
+#include "coregister.hpp"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include "threads.hpp"
+
+static const double NOT_A_NUMBER = std::numeric_limits<double>::quiet_NaN();
+
+Procrustes::Procrustes(const std::vector<double>& reference, bool scaling, bool reflection)
+: points_(reference.size() / 2), scaling_(scaling), reflection_(reflection),
+  centered_(reference), meanX_(0), meanY_(0), norm2_(0)
+{
+    for (size_t p = 0; p < points_; p++) {
+        meanX_ += reference[2 * p];
+        meanY_ += reference[2 * p + 1];
+    }
+    meanX_ /= std::max(points_, (size_t)1);
+    meanY_ /= std::max(points_, (size_t)1);
+    for (size_t p = 0; p < points_; p++) {
+        centered_[2 * p] -= meanX_;
+        centered_[2 * p + 1] -= meanY_;
+        norm2_ += centered_[2 * p] * centered_[2 * p] + centered_[2 * p + 1] * centered_[2 * p + 1];
+    }
+}
+
+size_t Procrustes::align(const double* shapes, size_t frames, double* aligned, double* params, double* error,
+                         double* sum) const
+{
+    size_t width = 2 * points_;
+    size_t numAligned(0);
+    for (size_t begin = 0; begin < frames; begin += COREG_BATCH) {
+        alignBatch(shapes + begin * width, std::min(COREG_BATCH, frames - begin),
+                   aligned ? aligned + begin * width : 0, params ? params + begin * COREG_PARAMS : 0,
+                   error ? error + begin : 0, sum, numAligned);
+    }
+    return numAligned;
+}
+
+/**
+ * Up to COREG_BATCH frames. With the reference centered, the cross sums
+ * of the best rotation do not need the centroid of the frame: one pass
+ * over the points gives all the sums, a second one the aligned points.
+ */
+void Procrustes::alignBatch(const double* shapes, size_t frames, double* aligned, double* params, double* error,
+                            double* sum, size_t& numAligned) const
+{
+    const size_t B = COREG_BATCH;
+    size_t width = 2 * points_;
+    // Structure of arrays: x of point p of frame f at xs[p * B + f]
+    std::vector<double> xs(points_ * B, 0), ys(points_ * B, 0);
+    bool valid[B];
+    std::fill(valid, valid + B, false);
+    for (size_t f = 0; f < frames; f++) {
+        const double* shape = shapes + f * width;
+        valid[f] = true;
+        for (size_t i = 0; i < width; i++) {
+            valid[f] = valid[f] && shape[i] == shape[i];
+        }
+        if (!valid[f]) {
+            continue;
+        }
+        for (size_t p = 0; p < points_; p++) {
+            xs[p * B + f] = shape[2 * p];
+            ys[p * B + f] = shape[2 * p + 1];
+        }
+    }
+
+    // Sums of the coordinates, of their squares, and the cross sums with the reference
+    double sx[B], sy[B], ss[B], sa[B], sq[B];
+    std::fill(sx, sx + B, 0.0);
+    std::fill(sy, sy + B, 0.0);
+    std::fill(ss, ss + B, 0.0);
+    std::fill(sa, sa + B, 0.0);
+    std::fill(sq, sq + B, 0.0);
+    // Rotation: maximize cos * sa + sin * sq, sa = sum(rx x + ry y), sq = sum(ry x - rx y);
+    // reflection: sa = sum(rx x - ry y), sq = sum(rx y + ry x)
+    double flip = reflection_ ? -1 : 1;
+    for (size_t p = 0; p < points_; p++) {
+        const double* x = &xs[p * B];
+        const double* y = &ys[p * B];
+        double rx = centered_[2 * p], ry = centered_[2 * p + 1];
+        for (size_t f = 0; f < B; f++) {
+            sx[f] += x[f];
+            sy[f] += y[f];
+            ss[f] += x[f] * x[f] + y[f] * y[f];
+            sa[f] += rx * x[f] + flip * ry * y[f];
+            sq[f] += ry * x[f] - flip * rx * y[f];
+        }
+    }
+
+    // b, T (column-major) and c of each frame
+    double b[B], t11[B], t21[B], t12[B], t22[B], cx[B], cy[B];
+    for (size_t f = 0; f < frames; f++) {
+        double mx = sx[f] / points_, my = sy[f] / points_;
+        double norm2 = ss[f] - points_ * (mx * mx + my * my);
+        if (!valid[f] || !(norm2 > 0) || !(norm2_ > 0)) {
+            valid[f] = false;
+            if (error) {
+                error[f] = NOT_A_NUMBER;
+            }
+            if (params) {
+                std::fill(params + f * COREG_PARAMS, params + (f + 1) * COREG_PARAMS, NOT_A_NUMBER);
+            }
+            continue;
+        }
+        double a = sa[f], q = sq[f];
+        double r = sqrt(a * a + q * q);
+        double cosine = r > 0 ? a / r : 1, sine = r > 0 ? q / r : 0;
+        t11[f] = cosine;
+        t12[f] = sine;
+        t21[f] = reflection_ ? sine : -sine;
+        t22[f] = reflection_ ? -cosine : cosine;
+        if (scaling_) {
+            b[f] = r / norm2;
+            if (error) {
+                error[f] = 1 - r * r / (norm2_ * norm2);
+            }
+        } else {
+            b[f] = 1;
+            if (error) {
+                error[f] = 1 + norm2 / norm2_ - 2 * r / norm2_;
+            }
+        }
+        cx[f] = meanX_ - b[f] * (mx * t11[f] + my * t21[f]);
+        cy[f] = meanY_ - b[f] * (mx * t12[f] + my * t22[f]);
+        if (params) {
+            double* param = params + f * COREG_PARAMS;
+            param[0] = b[f];
+            param[1] = t11[f];
+            param[2] = t21[f];
+            param[3] = t12[f];
+            param[4] = t22[f];
+            param[5] = cx[f];
+            param[6] = cy[f];
+        }
+        numAligned++;
+    }
+
+    if (!aligned && !sum) {
+        return;
+    }
+    for (size_t f = 0; f < B; f++) {
+        if (!valid[f]) {
+            b[f] = t11[f] = t21[f] = t12[f] = t22[f] = cx[f] = cy[f] = 0;
+            if (aligned && f < frames) {
+                std::fill(aligned + f * width, aligned + (f + 1) * width, NOT_A_NUMBER);
+            }
+        }
+    }
+    // Z = b Y T + c, written back frame by frame
+    double zx[B], zy[B];
+    for (size_t p = 0; p < points_; p++) {
+        const double* x = &xs[p * B];
+        const double* y = &ys[p * B];
+        for (size_t f = 0; f < B; f++) {
+            zx[f] = b[f] * (x[f] * t11[f] + y[f] * t21[f]) + cx[f];
+            zy[f] = b[f] * (x[f] * t12[f] + y[f] * t22[f]) + cy[f];
+        }
+        for (size_t f = 0; f < frames; f++) {
+            if (!valid[f]) {
+                continue;
+            }
+            if (aligned) {
+                aligned[f * width + 2 * p] = zx[f];
+                aligned[f * width + 2 * p + 1] = zy[f];
+            }
+            if (sum) {
+                sum[2 * p] += zx[f];
+                sum[2 * p + 1] += zy[f];
+            }
+        }
+    }
+}
+
+/**
+ * Aligns a contiguous range of frames and adds up its aligned shapes.
+ */
+class AlignWorker : public Thread {
+public:
+    AlignWorker(const Procrustes& procrustes, const double* shapes, size_t frames, double* aligned,
+                double* params, double* error)
+    : procrustes_(procrustes), shapes_(shapes), frames_(frames), aligned_(aligned), params_(params),
+      error_(error), sum_(2 * procrustes.points(), 0), numAligned_(0) {}
+
+    const std::vector<double>& sum() const { return sum_; }
+    size_t numAligned() const { return numAligned_; }
+
+    void run() {
+        numAligned_ = procrustes_.align(shapes_, frames_, aligned_, params_, error_, &sum_[0]);
+    }
+
+private:
+    const Procrustes& procrustes_;
+    const double* shapes_;
+    size_t frames_;
+    double* aligned_;
+    double* params_;
+    double* error_;
+    std::vector<double> sum_;
+    size_t numAligned_;
+};
+
+Coregistration::Coregistration(size_t points, bool scaling, bool reflection, int iterations, double tolerance,
+                               int threads)
+: points_(points), scaling_(scaling), reflection_(reflection), iterations_(std::max(iterations, 1)),
+  tolerance_(tolerance), threads_(std::max(threads, 1))
+{
+}
+
+void Coregistration::align(const Procrustes& procrustes, const double* shapes, size_t frames, double* aligned,
+                           double* params, double* error, std::vector<double>& sum, size_t& numAligned) const
+{
+    size_t width = 2 * points_;
+    sum.assign(width, 0);
+    // Whole batches per thread
+    size_t batches = (frames + COREG_BATCH - 1) / COREG_BATCH;
+    size_t numThreads = std::min((size_t)threads_, batches);
+    if (numThreads <= 1) {
+        numAligned = procrustes.align(shapes, frames, aligned, params, error, &sum[0]);
+        return;
+    }
+    std::vector<AlignWorker*> workers;
+    for (size_t i = 0; i < numThreads; i++) {
+        size_t begin = std::min(frames, batches * i / numThreads * COREG_BATCH);
+        size_t end = std::min(frames, batches * (i + 1) / numThreads * COREG_BATCH);
+        workers.push_back(new AlignWorker(procrustes, shapes + begin * width, end - begin, aligned + begin * width,
+                                          params + begin * COREG_PARAMS, error + begin));
+    }
+    // The first range runs on this thread
+    for (size_t i = 1; i < workers.size(); i++) {
+        if (!workers[i]->start()) {
+            workers[i]->run();
+        }
+    }
+    workers[0]->run();
+    numAligned = 0;
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i]->join();
+        numAligned += workers[i]->numAligned();
+        for (size_t k = 0; k < width; k++) {
+            sum[k] += workers[i]->sum()[k];
+        }
+        delete workers[i];
+    }
+}
+
+/**
+ * Centroid and root sum of squares of the centered points of shape.
+ */
+static double shapeSize(const std::vector<double>& shape, double& meanX, double& meanY)
+{
+    size_t points = shape.size() / 2;
+    meanX = meanY = 0;
+    for (size_t p = 0; p < points; p++) {
+        meanX += shape[2 * p] / points;
+        meanY += shape[2 * p + 1] / points;
+    }
+    double norm2(0);
+    for (size_t p = 0; p < points; p++) {
+        norm2 += (shape[2 * p] - meanX) * (shape[2 * p] - meanX) + (shape[2 * p + 1] - meanY) * (shape[2 * p + 1] - meanY);
+    }
+    return sqrt(norm2);
+}
+
+int Coregistration::run(const double* shapes, size_t frames, double* aligned, double* params, double* error)
+{
+    size_t width = 2 * points_;
+    // Mean of the shapes without NaNs
+    reference_.assign(width, 0);
+    size_t count(0);
+    for (size_t f = 0; f < frames; f++) {
+        const double* shape = shapes + f * width;
+        bool valid(true);
+        for (size_t i = 0; i < width; i++) {
+            valid = valid && shape[i] == shape[i];
+        }
+        if (valid) {
+            for (size_t i = 0; i < width; i++) {
+                reference_[i] += shape[i];
+            }
+            count++;
+        }
+    }
+    for (size_t i = 0; i < width; i++) {
+        reference_[i] = count > 0 ? reference_[i] / count : NOT_A_NUMBER;
+    }
+    double meanX, meanY;
+    double size = shapeSize(reference_, meanX, meanY);
+
+    std::vector<double> sum;
+    int iteration(0);
+    while (true) {
+        iteration++;
+        size_t numAligned;
+        align(Procrustes(reference_, scaling_, reflection_), shapes, frames, aligned, params, error, sum, numAligned);
+        if (iteration >= iterations_ || numAligned == 0) {
+            break;
+        }
+        // The mean of the aligned shapes, moved and scaled back to the first mean
+        double nextX, nextY;
+        for (size_t i = 0; i < width; i++) {
+            sum[i] /= numAligned;
+        }
+        double nextSize = shapeSize(sum, nextX, nextY);
+        double rescale = nextSize > 0 ? size / nextSize : 1;
+        double change(0);
+        for (size_t p = 0; p < points_; p++) {
+            sum[2 * p] = meanX + (sum[2 * p] - nextX) * rescale;
+            sum[2 * p + 1] = meanY + (sum[2 * p + 1] - nextY) * rescale;
+            change += (sum[2 * p] - reference_[2 * p]) * (sum[2 * p] - reference_[2 * p]) +
+                      (sum[2 * p + 1] - reference_[2 * p + 1]) * (sum[2 * p + 1] - reference_[2 * p + 1]);
+        }
+        if (!(sqrt(change) > tolerance_ * size)) {
+            // The shapes are aligned to a reference that no longer moves
+            break;
+        }
+        reference_.swap(sum);
+    }
+    return iteration;
+}
+
+StreamingCoregistration::StreamingCoregistration(size_t points, bool scaling)
+: points_(points), scaling_(scaling), count_(0), sum_(2 * points, 0), reference_(2 * points, 0)
+{
+}
+
+bool StreamingCoregistration::align(const double* shape, double* aligned, double* params, double& error)
+{
+    size_t width = 2 * points_;
+    if (count_ == 0) {
+        reference_.assign(shape, shape + width);
+    }
+    std::vector<double> sum(width, 0);
+    if (Procrustes(reference_, scaling_).align(shape, 1, aligned, params, &error, &sum[0]) == 0) {
+        return false;
+    }
+    count_++;
+    for (size_t i = 0; i < width; i++) {
+        sum_[i] += sum[i];
+        reference_[i] = sum_[i] / count_;
+    }
+    return true;
+}
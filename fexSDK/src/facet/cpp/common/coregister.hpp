@@ -0,0 +1,126 @@
+#ifndef COREGISTER_HPP
+#define COREGISTER_HPP
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Procrustes coregistration of face shapes, as fex_reallign and
+ * fexc.coregister do with Matlab's procrustes: each shape (the face box
+ * corners and the landmarks, as (x, y) points) is mapped onto a reference
+ * shape by Z = b * Y * T + c, with scale b, rotation (or reflection) T and
+ * translation c. The error is procrustes' standardized residual d.
+ *
+ * Shapes are points * 2 values, x and y interleaved (the order of the
+ * landmark columns). Frames are aligned COREG_BATCH at a time in
+ * structure-of-arrays order (the x of one point for all the frames of a
+ * batch, then its y, ...), so the loops over the frames of a batch run
+ * over contiguous memory and vectorize. In 2-D the best rotation has a
+ * closed form: no SVD per frame.
+ */
+
+const size_t COREG_BATCH = 32;    /**< Frames aligned together **/
+const size_t COREG_PARAMS = 7;    /**< b, T (2x2, column-major), c (x, y): the coregparam columns of fexc **/
+
+/**
+ * Align shapes to one reference shape.
+ */
+class Procrustes {
+public:
+    /**
+     * \param reference points * 2 values
+     * \param scaling fit the scale b (otherwise b = 1)
+     * \param reflection T is a reflection instead of a rotation
+     */
+    Procrustes(const std::vector<double>& reference, bool scaling = true, bool reflection = false);
+
+    size_t points() const { return points_; }
+
+    /**
+     * Align frames shapes, frames * points() * 2 values. aligned receives
+     * the shapes as Z (same layout), params COREG_PARAMS values per frame
+     * and error one per frame; any of them may be null. The outputs of a
+     * shape with a NaN are NaN. Returns the number of shapes aligned, whose
+     * aligned coordinates are added to sum (points() * 2 values), if not null.
+     */
+    size_t align(const double* shapes, size_t frames, double* aligned, double* params, double* error,
+                 double* sum = 0) const;
+
+private:
+    void alignBatch(const double* shapes, size_t frames, double* aligned, double* params, double* error,
+                    double* sum, size_t& numAligned) const;
+
+    size_t points_;
+    bool scaling_;
+    bool reflection_;
+    std::vector<double> centered_;  ///< Reference minus its centroid
+    double meanX_, meanY_;          ///< Centroid of the reference
+    double norm2_;                  ///< Sum of squares of centered_
+};
+
+/**
+ * Coregistration of a whole session: the reference is the mean shape of
+ * the frames. With iterations > 1, the reference is refined as the mean
+ * of the aligned shapes (generalized Procrustes analysis), kept at the
+ * centroid and size of the first mean, until it changes by less than
+ * tolerance (relative) or the iterations are done. One iteration is what
+ * fex_reallign does.
+ *
+ * The frames are split among threads, which also add up the aligned
+ * shapes for the next reference.
+ */
+class Coregistration {
+public:
+    Coregistration(size_t points, bool scaling = true, bool reflection = false, int iterations = 1,
+                   double tolerance = 1e-9, int threads = 1);
+
+    /**
+     * Align frames shapes (see Procrustes::align; aligned, params and
+     * error are required). Returns the number of iterations run; the final
+     * reference is reference().
+     */
+    int run(const double* shapes, size_t frames, double* aligned, double* params, double* error);
+
+    const std::vector<double>& reference() const { return reference_; }
+
+private:
+    void align(const Procrustes& procrustes, const double* shapes, size_t frames, double* aligned,
+               double* params, double* error, std::vector<double>& sum, size_t& numAligned) const;
+
+    size_t points_;
+    bool scaling_;
+    bool reflection_;
+    int iterations_;
+    double tolerance_;
+    int threads_;
+    std::vector<double> reference_;
+};
+
+/**
+ * Online coregistration of the frames of a video as they are written: each
+ * shape is aligned to the mean of the shapes aligned before it (the first
+ * one is its own reference). Frames must be pushed in order.
+ */
+class StreamingCoregistration {
+public:
+    explicit StreamingCoregistration(size_t points, bool scaling = true);
+
+    /**
+     * Align shape (points * 2 values). aligned, params and error are as
+     * in Procrustes::align for one frame; false (and NaN outputs) for a
+     * shape with a NaN.
+     */
+    bool align(const double* shape, double* aligned, double* params, double& error);
+
+    size_t points() const { return points_; }
+    size_t numAligned() const { return count_; }
+
+private:
+    size_t points_;
+    bool scaling_;
+    size_t count_;
+    std::vector<double> sum_;       ///< Of the aligned shapes
+    std::vector<double> reference_;
+};
+
+#endif  // COREGISTER_HPP
@@ -0,0 +1,80 @@
+#include "faceroi.hpp"
+#include <algorithm>
+#include <cmath>
+
+/**
+ * True where |value - mean| > threshold * standard deviation.
+ */
+static void markOutliers(const std::vector<double>& values, double threshold, std::vector<bool>& outlier)
+{
+    size_t n = values.size();
+    if (n < 2) {
+        return;
+    }
+    double mean(0), var(0);
+    for (size_t i = 0; i < n; i++) {
+        mean += values[i];
+    }
+    mean /= n;
+    for (size_t i = 0; i < n; i++) {
+        var += (values[i] - mean) * (values[i] - mean);
+    }
+    double sd = std::sqrt(var / (n - 1));
+    for (size_t i = 0; i < n; i++) {
+        if (sd > 0 && std::fabs(values[i] - mean) > threshold * sd) {
+            outlier[i] = true;
+        }
+    }
+}
+
+static double median(std::vector<double> values)
+{
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+cv::Rect estimateFaceRoi(const std::vector<cv::Rect_<float> >& boxes, const cv::Size& frameSize,
+                         double threshold, double margin)
+{
+    std::vector<double> area, cx, cy;
+    for (size_t i = 0; i < boxes.size(); i++) {
+        area.push_back(boxes[i].width * boxes[i].height);
+        cx.push_back(boxes[i].x + boxes[i].width / 2);
+        cy.push_back(boxes[i].y + boxes[i].height / 2);
+    }
+    std::vector<bool> outlier(boxes.size(), false);
+    markOutliers(area, threshold, outlier);
+    markOutliers(cx, threshold, outlier);
+    markOutliers(cy, threshold, outlier);
+
+    double left(0), top(0), right(0), bottom(0);
+    std::vector<double> widths, heights;
+    for (size_t i = 0; i < boxes.size(); i++) {
+        if (outlier[i]) {
+            continue;
+        }
+        const cv::Rect_<float>& box(boxes[i]);
+        if (widths.empty()) {
+            left = box.x;
+            top = box.y;
+            right = box.x + box.width;
+            bottom = box.y + box.height;
+        } else {
+            left = std::min(left, (double)box.x);
+            top = std::min(top, (double)box.y);
+            right = std::max(right, (double)(box.x + box.width));
+            bottom = std::max(bottom, (double)(box.y + box.height));
+        }
+        widths.push_back(box.width);
+        heights.push_back(box.height);
+    }
+    if (widths.empty()) {
+        return cv::Rect();
+    }
+    double dx = margin * median(widths);
+    double dy = margin * median(heights);
+    cv::Rect roi((int)std::floor(left - dx), (int)std::floor(top - dy), 0, 0);
+    roi.width = (int)std::ceil(right + dx) - roi.x;
+    roi.height = (int)std::ceil(bottom + dy) - roi.y;
+    return roi & cv::Rect(0, 0, frameSize.width, frameSize.height);
+}
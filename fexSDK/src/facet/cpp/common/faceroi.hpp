@@ -0,0 +1,24 @@
+#ifndef FACEROI_HPP
+#define FACEROI_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+const double ROI_THRESHOLD = 1.5;   /**< Standard deviations beyond which a sampled box is a false alarm **/
+const double ROI_MARGIN    = 0.5;   /**< Margin around the boxes, as a fraction of the median box size **/
+
+/**
+ * Region of a video that holds the face, from the largest-face boxes of a
+ * sparse sample of its frames (as fex_fastproc does with falsepositive and
+ * the union of the face boxes).
+ *
+ * Boxes whose area, or whose center along x or y, is more than threshold
+ * standard deviations from the mean are dropped first; the region is the
+ * union of the other boxes, grown by margin times the median box width and
+ * height on each side, and clipped to frameSize. Returns an empty region
+ * when no box is left.
+ */
+cv::Rect estimateFaceRoi(const std::vector<cv::Rect_<float> >& boxes, const cv::Size& frameSize,
+                         double threshold = ROI_THRESHOLD, double margin = ROI_MARGIN);
+
+#endif  // FACEROI_HPP
@@ -0,0 +1,46 @@
+#include "falsepositive.hpp"
+#include <algorithm>
+#include <math.h>
+
+FalsePositiveFilter::FalsePositiveFilter(double threshold, size_t warmup)
+: threshold_(threshold), minShare_(erfc(threshold / sqrt(2.0))), warmup_(warmup),
+  count_(0), mean_(0), m2_(0), cells_(FALSEPOSITIVE_GRID * FALSEPOSITIVE_GRID, 0), rejected_(0)
+{
+}
+
+size_t FalsePositiveFilter::numRejected()
+{
+    ScopedLock lock(mutex_);
+    return rejected_;
+}
+
+bool FalsePositiveFilter::reject(const cv::Rect_<float>& face, const cv::Size& frameSize)
+{
+    double area = (double)face.width * face.height;
+    int col = (int)((face.x + face.width / 2) * FALSEPOSITIVE_GRID / std::max(frameSize.width, 1));
+    int row = (int)((face.y + face.height / 2) * FALSEPOSITIVE_GRID / std::max(frameSize.height, 1));
+    col = std::min(std::max(col, 0), FALSEPOSITIVE_GRID - 1);
+    row = std::min(std::max(row, 0), FALSEPOSITIVE_GRID - 1);
+
+    ScopedLock lock(mutex_);
+    bool rejected(false);
+    if (count_ >= std::max(warmup_, (size_t)2)) {
+        double sd = sqrt(m2_ / (count_ - 1));
+        bool size = sd > 0 && fabs(area - mean_) / sd >= threshold_;
+        size_t around(0);
+        for (int r = std::max(row - 1, 0); r <= std::min(row + 1, FALSEPOSITIVE_GRID - 1); r++) {
+            for (int c = std::max(col - 1, 0); c <= std::min(col + 1, FALSEPOSITIVE_GRID - 1); c++) {
+                around += cells_[r * FALSEPOSITIVE_GRID + c];
+            }
+        }
+        bool position = (double)around / count_ < minShare_;
+        rejected = size || position;
+    }
+    count_++;
+    double delta = area - mean_;
+    mean_ += delta / count_;
+    m2_ += delta * (area - mean_);
+    cells_[row * FALSEPOSITIVE_GRID + col]++;
+    rejected_ += rejected;
+    return rejected;
+}
@@ -0,0 +1,57 @@
+#ifndef FALSEPOSITIVE_HPP
+#define FALSEPOSITIVE_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "threads.hpp"
+
+const double FALSEPOSITIVE_THRESHOLD = 2.5;  /**< Standard deviations, as fexc.falsepositive **/
+const size_t FALSEPOSITIVE_WARMUP = 30;      /**< Faces seen before any is rejected **/
+const int    FALSEPOSITIVE_GRID = 16;        /**< Cells across and down the position histogram **/
+
+/**
+ * Online version of fexc.falsepositive ('size' and 'position'): each face
+ * found is judged against the faces found before it in the video.
+ *
+ * - size: the area (width x height) of the face box is more than threshold
+ *   standard deviations from the mean (running mean and variance, Welford).
+ * - position: the center of the box falls where few faces were seen: the
+ *   share of the centers in its cell of a FALSEPOSITIVE_GRID histogram of
+ *   the frame and the 8 cells around it is below the two-sided normal tail
+ *   of threshold (1.2% for 2.5), the chance of a |z| that large.
+ *
+ * Every face then joins the statistics, rejected or not, as the whole
+ * session does offline. Nothing is rejected before warmup faces are seen.
+ *
+ * reject() must be called in frame order, as FramePipeline does for its
+ * analyzer workers; it may be called from any thread.
+ */
+class FalsePositiveFilter {
+public:
+    explicit FalsePositiveFilter(double threshold = FALSEPOSITIVE_THRESHOLD, size_t warmup = FALSEPOSITIVE_WARMUP);
+
+    /**
+     * Judge the face box of a frame of frameSize, then add it to the
+     * statistics. True if it is a false positive.
+     */
+    bool reject(const cv::Rect_<float>& face, const cv::Size& frameSize);
+
+    double threshold() const { return threshold_; }
+    size_t numRejected();
+
+private:
+    FalsePositiveFilter(const FalsePositiveFilter&);
+    FalsePositiveFilter& operator=(const FalsePositiveFilter&);
+
+    double threshold_;
+    double minShare_;       ///< Of the centers around a position, below which it is rejected
+    size_t warmup_;
+    Mutex mutex_;
+    size_t count_;          ///< Faces seen
+    double mean_;           ///< Of the box area
+    double m2_;             ///< Sum of squared deviations from mean_
+    std::vector<size_t> cells_;   ///< Box centers per cell, row-major
+    size_t rejected_;
+};
+
+#endif  // FALSEPOSITIVE_HPP
@@ -0,0 +1,262 @@
+#include "fexbinary.hpp"
+#include <algorithm>
+#include <limits>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+const char FEXB_MAGIC[4] = { 'F', 'E', 'X', 'B' };
+const uint32_t FEXB_VERSION = 1;
+const size_t FEXB_HEADER_BYTES = 64;
+const size_t FEXB_CLASS_CHARS = 16;
+const size_t FEXB_NAME_CHARS = 48;
+const std::streamoff FEXB_NUMFRAMES_OFFSET = 24;
+
+/**
+ * Write str into a NUL-padded field of size chars (truncated if longer).
+ */
+static void writeField(std::ofstream& file, const std::string& str, size_t size)
+{
+    std::vector<char> field(size, 0);
+    memcpy(&field[0], str.data(), std::min(str.size(), size - 1));
+    file.write(&field[0], size);
+}
+
+FexbWriter::FexbWriter()
+: blockFrames_(0), inBlock_(0), numFrames_(0)
+{
+}
+
+FexbWriter::~FexbWriter()
+{
+    close();
+}
+
+void FexbWriter::addChannel(const std::string& channelClass, const std::string& name)
+{
+    classes_.push_back(channelClass);
+    names_.push_back(name);
+}
+
+bool FexbWriter::open(const std::string& filename, size_t blockFrames)
+{
+    close();
+    file_.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file_.is_open()) {
+        return false;
+    }
+    // Whole bytes of bitmap, and float columns stay 4-byte aligned
+    blockFrames_ = ((std::max(blockFrames, (size_t)1) + 31) / 32) * 32;
+    inBlock_ = 0;
+    numFrames_ = 0;
+    block_.assign(blockFrames_ * numChannels(), std::numeric_limits<float>::quiet_NaN());
+    present_.assign(blockFrames_ / 8, 0);
+
+    // version, dataOffset, numChannels, blockFrames, reserved
+    uint32_t header[5];
+    header[0] = FEXB_VERSION;
+    header[1] = (uint32_t)dataOffset();
+    header[2] = (uint32_t)numChannels();
+    header[3] = (uint32_t)blockFrames_;
+    header[4] = 0;
+    uint64_t numFrames(0);
+    std::vector<char> pad(FEXB_HEADER_BYTES, 0);
+    file_.write(FEXB_MAGIC, sizeof(FEXB_MAGIC));
+    file_.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file_.write(reinterpret_cast<const char*>(&numFrames), sizeof(numFrames));
+    file_.write(&pad[0], FEXB_HEADER_BYTES - sizeof(FEXB_MAGIC) - sizeof(header) - sizeof(numFrames));
+    for (size_t c = 0; c < numChannels(); c++) {
+        writeField(file_, classes_[c], FEXB_CLASS_CHARS);
+        writeField(file_, names_[c], FEXB_NAME_CHARS);
+    }
+    return file_.good();
+}
+
+size_t FexbWriter::dataOffset() const
+{
+    return FEXB_HEADER_BYTES + (FEXB_CLASS_CHARS + FEXB_NAME_CHARS) * numChannels();
+}
+
+size_t FexbWriter::blockBytes() const
+{
+    return blockFrames_ / 8 + blockFrames_ * numChannels() * sizeof(float);
+}
+
+bool FexbWriter::resume(const std::string& filename, long long offset, size_t blockFrames)
+{
+    close();
+    blockFrames_ = ((std::max(blockFrames, (size_t)1) + 31) / 32) * 32;
+    if (offset < (long long)dataOffset() || (offset - dataOffset()) % blockBytes() != 0) {
+        return false;
+    }
+    // The schema of the file must be ours
+    std::ifstream existing(filename.c_str(), std::ios::in | std::ios::binary);
+    char magic[sizeof(FEXB_MAGIC)];
+    uint32_t header[5];
+    existing.read(magic, sizeof(magic));
+    existing.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!existing || memcmp(magic, FEXB_MAGIC, sizeof(magic)) != 0 || header[1] != dataOffset() ||
+        header[2] != numChannels() || header[3] != blockFrames_) {
+        return false;
+    }
+    // and hold the committed blocks
+    existing.seekg(0, std::ios::end);
+    if ((long long)existing.tellg() < offset) {
+        return false;
+    }
+    existing.close();
+    if (truncate(filename.c_str(), (off_t)offset) != 0) {
+        return false;
+    }
+    file_.open(filename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    if (!file_.is_open()) {
+        return false;
+    }
+    file_.seekp(0, std::ios::end);
+    inBlock_ = 0;
+    numFrames_ = (offset - dataOffset()) / blockBytes() * blockFrames_;
+    block_.assign(blockFrames_ * numChannels(), std::numeric_limits<float>::quiet_NaN());
+    present_.assign(blockFrames_ / 8, 0);
+    return file_.good();
+}
+
+long long FexbWriter::sync()
+{
+    if (!file_.is_open() || inBlock_ != 0) {
+        return -1;
+    }
+    file_.flush();
+    return file_.good() ? (long long)file_.tellp() : -1;
+}
+
+void FexbWriter::addFrame(const float* values, bool facePresent)
+{
+    if (!file_.is_open()) {
+        return;
+    }
+    for (size_t c = 0; c < numChannels(); c++) {
+        block_[c * blockFrames_ + inBlock_] = values[c];
+    }
+    if (facePresent) {
+        present_[inBlock_ / 8] |= (unsigned char)(1 << (inBlock_ % 8));
+    }
+    inBlock_++;
+    numFrames_++;
+    if (inBlock_ == blockFrames_) {
+        flushBlock();
+    }
+}
+
+void FexbWriter::flushBlock()
+{
+    file_.write(reinterpret_cast<const char*>(&present_[0]), present_.size());
+    if (!block_.empty()) {
+        file_.write(reinterpret_cast<const char*>(&block_[0]), block_.size() * sizeof(float));
+    }
+    std::fill(block_.begin(), block_.end(), std::numeric_limits<float>::quiet_NaN());
+    std::fill(present_.begin(), present_.end(), 0);
+    inBlock_ = 0;
+}
+
+bool FexbWriter::close()
+{
+    if (!file_.is_open()) {
+        return true;
+    }
+    if (inBlock_ > 0) {
+        flushBlock();
+    }
+    uint64_t numFrames(numFrames_);
+    file_.seekp(FEXB_NUMFRAMES_OFFSET);
+    file_.write(reinterpret_cast<const char*>(&numFrames), sizeof(numFrames));
+    bool ok = file_.good();
+    file_.close();
+    return ok;
+}
+
+/**
+ * NUL-padded field of size chars.
+ */
+static std::string readField(std::ifstream& file, size_t size)
+{
+    std::vector<char> field(size + 1, 0);
+    file.read(&field[0], size);
+    return std::string(&field[0]);
+}
+
+bool FexbReader::open(const std::string& filename)
+{
+    file_.open(filename.c_str(), std::ios::in | std::ios::binary);
+    char magic[sizeof(FEXB_MAGIC)];
+    uint32_t header[5];
+    uint64_t numFrames(0);
+    file_.read(magic, sizeof(magic));
+    file_.read(reinterpret_cast<char*>(header), sizeof(header));
+    file_.read(reinterpret_cast<char*>(&numFrames), sizeof(numFrames));
+    if (!file_ || memcmp(magic, FEXB_MAGIC, sizeof(magic)) != 0 || header[0] != FEXB_VERSION ||
+        header[3] == 0 || header[3] % 32 != 0) {
+        return false;
+    }
+    dataOffset_ = header[1];
+    blockFrames_ = header[3];
+    file_.seekg(FEXB_HEADER_BYTES);
+    for (uint32_t c = 0; c < header[2]; c++) {
+        classes_.push_back(readField(file_, FEXB_CLASS_CHARS));
+        names_.push_back(readField(file_, FEXB_NAME_CHARS));
+    }
+    size_t blockBytes = blockFrames_ / 8 + blockFrames_ * numChannels() * sizeof(float);
+    file_.seekg(0, std::ios::end);
+    long long blocks = ((long long)file_.tellg() - (long long)dataOffset_) / (long long)blockBytes;
+    numFrames_ = numFrames > 0 ? (size_t)numFrames : (size_t)std::max(blocks, 0LL) * blockFrames_;
+    return file_.good() && (long long)numFrames_ <= blocks * (long long)blockFrames_;
+}
+
+bool FexbReader::read(std::vector<float>& values, std::vector<char>& facePresent)
+{
+    size_t channels = numChannels();
+    values.resize(numFrames_ * channels);
+    facePresent.resize(numFrames_);
+    std::vector<unsigned char> bitmap(blockFrames_ / 8);
+    std::vector<float> block(blockFrames_ * channels);
+    file_.seekg(dataOffset_);
+    for (size_t first = 0; first < numFrames_; first += blockFrames_) {
+        file_.read(reinterpret_cast<char*>(&bitmap[0]), bitmap.size());
+        if (!block.empty()) {
+            file_.read(reinterpret_cast<char*>(&block[0]), block.size() * sizeof(float));
+        }
+        size_t frames = std::min(blockFrames_, numFrames_ - first);
+        for (size_t k = 0; k < frames; k++) {
+            facePresent[first + k] = (bitmap[k / 8] >> (k % 8)) & 1;
+            for (size_t c = 0; c < channels; c++) {
+                values[(first + k) * channels + c] = block[c * blockFrames_ + k];
+            }
+        }
+    }
+    return file_.good();
+}
+
+bool FexbReader::readBlock(std::vector<float>& values, std::vector<char>& facePresent)
+{
+    if (nextFrame_ >= numFrames_) {
+        return false;
+    }
+    size_t channels = numChannels();
+    std::vector<unsigned char> bitmap(blockFrames_ / 8);
+    std::vector<float> block(blockFrames_ * channels);
+    file_.seekg(dataOffset_ + nextFrame_ / blockFrames_ * (bitmap.size() + block.size() * sizeof(float)));
+    file_.read(reinterpret_cast<char*>(&bitmap[0]), bitmap.size());
+    if (!block.empty()) {
+        file_.read(reinterpret_cast<char*>(&block[0]), block.size() * sizeof(float));
+    }
+    size_t frames = std::min(blockFrames_, numFrames_ - nextFrame_);
+    values.resize(frames * channels);
+    facePresent.resize(frames);
+    for (size_t k = 0; k < frames; k++) {
+        facePresent[k] = (bitmap[k / 8] >> (k % 8)) & 1;
+        for (size_t c = 0; c < channels; c++) {
+            values[k * channels + c] = block[c * blockFrames_ + k];
+        }
+    }
+    nextFrame_ += frames;
+    return file_.good();
+}
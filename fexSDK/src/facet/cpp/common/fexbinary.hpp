@@ -0,0 +1,131 @@
+#ifndef FEXBINARY_HPP
+#define FEXBINARY_HPP
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * Binary columnar output (.fexb), read lazily in Matlab by fex_binimport.
+ *
+ * Layout (native byte order, i.e. little endian on every supported platform):
+ *
+ *   header    64 bytes: "FEXB", version, dataOffset, numChannels,
+ *             blockFrames (uint32 each), a reserved uint32 and numFrames (uint64)
+ *   channels  numChannels records of 64 bytes: class (16 chars) and name
+ *             (48 chars), NUL padded; classes follow shared/fexchannels.txt
+ *             (face, land, pose, emo1, sent1, emo2, au) plus "frame"
+ *   blocks    from dataOffset, every blockFrames frames: a face-present bitmap
+ *             (blockFrames / 8 bytes, bit k of byte j is frame 8j + k), then one
+ *             float32 column of blockFrames values per channel
+ *
+ * Every block has the same size, so the last one is padded with NaN. Values
+ * of frames without a face are NaN. numFrames is written by close(); a file
+ * that was never closed reports 0 frames.
+ */
+class FexbWriter {
+public:
+    FexbWriter();
+    ~FexbWriter();
+
+    /**
+     * Append a channel to the schema; must be called before open().
+     */
+    void addChannel(const std::string& channelClass, const std::string& name);
+    size_t numChannels() const { return classes_.size(); }
+
+    /**
+     * Create filename and write the header and schema.
+     * \param blockFrames frames per block, rounded up to a multiple of 32
+     */
+    bool open(const std::string& filename, size_t blockFrames = DEFAULT_BLOCKFRAMES);
+
+    /**
+     * Reopen filename, written with the same schema and blockFrames, to
+     * append frames after its first offset bytes (whole blocks, as returned
+     * by sync()); the file is cut there.
+     */
+    bool resume(const std::string& filename, long long offset, size_t blockFrames = DEFAULT_BLOCKFRAMES);
+    bool isOpen() const { return file_.is_open(); }
+
+    /**
+     * Append one frame.
+     * \param values numChannels() values, in schema order
+     * \param facePresent whether a face was found in the frame
+     */
+    void addFrame(const float* values, bool facePresent);
+
+    /**
+     * Flush the blocks written so far and return the size of the file, or
+     * -1 on error or inside a block (only whole blocks can be committed).
+     */
+    long long sync();
+
+    /**
+     * Write the last (padded) block and the frame count. Returns false on I/O errors.
+     */
+    bool close();
+
+    size_t numFrames() const { return numFrames_; }
+
+    static const size_t DEFAULT_BLOCKFRAMES = 4096;
+
+private:
+    FexbWriter(const FexbWriter&);
+    FexbWriter& operator=(const FexbWriter&);
+
+    void flushBlock();
+    size_t dataOffset() const;
+    size_t blockBytes() const;
+
+    std::ofstream file_;
+    std::vector<std::string> classes_;
+    std::vector<std::string> names_;
+    std::vector<float> block_;            ///< Column-major: channel c at c * blockFrames_
+    std::vector<unsigned char> present_;  ///< Face-present bitmap of the current block
+    size_t blockFrames_;
+    size_t inBlock_;                      ///< Frames in the current block
+    size_t numFrames_;
+};
+
+/**
+ * Reads a whole .fexb file back, for the tools that rewrite one.
+ */
+class FexbReader {
+public:
+    FexbReader() : dataOffset_(0), blockFrames_(0), numFrames_(0), nextFrame_(0) {}
+
+    /**
+     * Read the header and schema of filename. A file that was never
+     * closed holds the frames of its whole blocks.
+     */
+    bool open(const std::string& filename);
+
+    size_t numChannels() const { return classes_.size(); }
+    size_t numFrames() const { return numFrames_; }
+    const std::string& channelClass(size_t c) const { return classes_[c]; }
+    const std::string& name(size_t c) const { return names_[c]; }
+
+    /**
+     * Read all the frames, row-major (numChannels() values per frame), and
+     * their face-present flags.
+     */
+    bool read(std::vector<float>& values, std::vector<char>& facePresent);
+
+    /**
+     * Read the next block of frames, as read() does, for the tools that
+     * stream a file: false after the last one, or on error.
+     */
+    bool readBlock(std::vector<float>& values, std::vector<char>& facePresent);
+
+private:
+    std::ifstream file_;
+    std::vector<std::string> classes_;
+    std::vector<std::string> names_;
+    size_t dataOffset_;
+    size_t blockFrames_;
+    size_t numFrames_;
+    size_t nextFrame_;      ///< Of readBlock()
+};
+
+#endif  // FEXBINARY_HPP
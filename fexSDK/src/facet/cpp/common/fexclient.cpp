@@ -0,0 +1,62 @@
+/**
+ file fexclient.cpp
+ Runs a driver on the analyzer daemon (fexfacetd), which keeps its
+ analyzers initialized between jobs, instead of starting the driver: the
+ arguments are the command line of the driver, with the same flags.
+
+ Usage:
+
+   fexclient [-s SOCKET] DRIVER [ARGS...]
+
+   fexclient fexfacet -v video.mp4 -o video.txt -t 2
+   ls *.jpg | fexclient fexfacet_full -o images.fexb
+
+ The standard input is forwarded to the job (the image list of the image
+ drivers), its output is printed, and the exit status is the one of the
+ job. Relative paths, in the arguments and in the image list, are relative
+ to the working directory of fexclient. SOCKET defaults to $FEX_SOCKET, or
+ /tmp/fexfacetd-UID.sock.
+**/
+
+#include <signal.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "jobsocket.hpp"
+
+int main(int argc, char* argv[])
+{
+    std::string socketPath = defaultSocketPath();
+    int first(1);
+    if (argc > 2 && std::string(argv[1]) == "-s") {
+        socketPath = argv[2];
+        first = 3;
+    }
+    if (first >= argc) {
+        std::cout << "Usage:" << std::endl;
+        std::cout << "   fexclient [-s SOCKET] DRIVER [ARGS...]" << std::endl;
+        std::cout << "   - Runs DRIVER (fexfacet, fexfacet_face, fexfacet_aus, fexfacet_emotions" << std::endl;
+        std::cout << "     or fexfacet_full) with ARGS, its usual flags, on the fexfacetd daemon." << std::endl;
+        std::cout << "   - SOCKET defaults to " << socketPath << std::endl;
+        return -1;
+    }
+    std::vector<std::string> args(argv + first, argv + argc);
+
+    std::string workingDir;
+    std::vector<char> cwd(4096);
+    if (getcwd(&cwd[0], cwd.size()) != 0) {
+        workingDir = &cwd[0];
+    }
+
+    // A daemon that goes away is reported below, not by SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    std::cout.flush();
+    int status(-1);
+    if (!runRemoteJob(socketPath, workingDir, args, STDIN_FILENO, STDOUT_FILENO, status)) {
+        std::cerr << "Could not run " << args[0] << " on the daemon at " << socketPath
+                  << " (is fexfacetd running?)" << std::endl;
+        return -1;
+    }
+    return status;
+}
@@ -0,0 +1,586 @@
+/**
+ file fexfilter.cpp
+ Temporal filter of the emotion, sentiment and action unit channels of
+ result files, as fexc.temporalfilt does in Matlab (fir1 kernel applied
+ forward and backward by filtfilt), with the filter engine of
+ temporalfilter.hpp: all the channels of a file are filtered at once, and
+ files are filtered in parallel.
+
+ Input files are .fexb files (fexfacet, fexjson2dat) or text tables with a
+ header line: tab separated (fexfacet) or comma separated (fexjson2dat).
+ Filtered are the channels of class emo1, sent1, emo2 and au of .fexb
+ files, and the same columns of text files: not the frame, face box,
+ landmark (_x, _y), pose, demographic (isMale), flag (FaceRejected),
+ timestamp or track_id columns. Frames without a face, and the NaN values
+ of each channel, are interpolated for filtering and left as they were;
+ channels without any value stay NaN. Files with a track_id column are filtered one track at a
+ time; a file none of whose tracks can be filtered (fewer than 2 frames
+ with a face, or no value in any channel) is an error.
+
+ With -motion, the same channels are first corrected for head motion, as
+ fexc.motioncorrect does, with the kernel of motioncorrect.hpp: each is
+ regressed on |roll|, |pitch| and |yaw| (the pose channels, or the Roll,
+ Pitch and Yaw columns) and replaced by its residual plus the constant.
+ Frames with a NaN pose have their channels set to NaN. -motion alone
+ corrects the files without filtering them.
+
+ Usage:
+
+   fexfilter [-lp HZ | -hp HZ | -bp LOW:HIGH] [-r FPS] [-order ORDER | -iir ORDER]
+             [-keepmean] [-motion THRESHOLD [-whiten]] [-j WORKERS] [-suffix SUFFIX] FILE...
+
+   -lp, -hp, -bp  low pass, high pass or band pass cutoffs in Hz
+   -r             frame rate; by default the median step of the timestamp
+                  column (required for files without one)
+   -order         order of the FIR kernel (default: 3 cycles of the lowest
+                  cutoff, at most a third of the track; see firOrder)
+   -iir           Butterworth filter of this order instead of the FIR kernel
+   -keepmean      add the mean of each channel back (fexc.temporalfilt 'dc', false)
+   -motion        motion correction first; pose predictors are used for a
+                  channel if their |r| is at least THRESHOLD (0 to 1) and p <= 0.05
+   -whiten        whiten the pose predictors (fexc.motioncorrect 'whiten')
+   -j             files filtered at a time (default: the number of CPUs)
+   -suffix        FILE.EXT is written to FILE SUFFIX.EXT (default _filtered)
+**/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "fexbinary.hpp"
+#include "motioncorrect.hpp"
+#include "temporalfilter.hpp"
+#include "textwriter.hpp"
+#include "threads.hpp"
+
+const std::string BINARY_EXT = ".fexb";
+const std::string DEFAULT_SUFFIX = "_filtered";
+const double NOT_A_NUMBER = std::numeric_limits<double>::quiet_NaN();
+
+/**
+ * Filter and options shared by all the files.
+ */
+struct FilterOptions {
+    bool filter;        ///< false: -motion only
+    FilterBand band;
+    double low;
+    double high;
+    double rate;        ///< 0: from the timestamp column
+    int order;          ///< 0: default FIR order
+    int iirOrder;       ///< > 0: Butterworth instead of FIR
+    bool keepMean;
+    double motion;      ///< -motion threshold; < 0: no motion correction
+    bool whiten;
+    std::string suffix;
+};
+
+/**
+ * A result file in memory: values are row-major, width per row.
+ */
+struct Table {
+    Table() : width(0), track(-1), time(-1)
+    {
+        std::fill(pose, pose + MOTION_PREDICTORS, -1);
+    }
+    size_t width;
+    std::vector<double> values;
+    std::vector<char> present;
+    std::vector<size_t> filtered;   ///< Columns to filter
+    int track;                      ///< track_id column, or -1
+    int time;                       ///< timestamp column, or -1
+    int pose[MOTION_PREDICTORS];    ///< Roll, pitch and yaw columns, or -1
+    size_t rows() const { return present.size(); }
+};
+
+/**
+ * Index of Roll, Pitch or Yaw in Table::pose, or -1.
+ */
+static int poseIndex(const std::string& name)
+{
+    return name == "Roll" ? 0 : name == "Pitch" ? 1 : name == "Yaw" ? 2 : -1;
+}
+
+static bool isFiltered(const std::string& channelClass)
+{
+    return channelClass == "emo1" || channelClass == "sent1" || channelClass == "emo2" || channelClass == "au";
+}
+
+/**
+ * Functional columns of a text table, by name: not the frame columns and
+ * flags (Frame..., FaceRejected), the face box, the pose, the demographic
+ * isMale, the landmarks or the naninfo counts of fexc.
+ */
+static bool isFilteredColumn(const std::string& name)
+{
+    if (name.empty() || name.compare(0, 5, "Frame") == 0 || name.compare(0, 4, "Face") == 0 ||
+        name == "Roll" || name == "Pitch" || name == "Yaw" || name == "timestamp" || name == "track_id" ||
+        name == "isMale" || name == "count" || name == "tag" || name == "falsepositive") {
+        return false;
+    }
+    size_t n = name.size();
+    return !(n > 2 && name[n - 2] == '_' && (name[n - 1] == 'x' || name[n - 1] == 'y'));
+}
+
+static void split(const std::string& line, char delimiter, std::vector<std::string>& fields)
+{
+    fields.clear();
+    size_t start = 0;
+    for (;;) {
+        size_t end = line.find(delimiter, start);
+        fields.push_back(line.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (end == std::string::npos) {
+            return;
+        }
+        start = end + 1;
+    }
+}
+
+/**
+ * Frame rate from the median step of the timestamps of the present rows.
+ */
+static double frameRate(const Table& table)
+{
+    std::vector<double> steps;
+    double previous = NOT_A_NUMBER;
+    for (size_t r = 0; r < table.rows(); r++) {
+        double t = table.values[r * table.width + table.time];
+        if (table.present[r] && t > previous) {
+            steps.push_back(t - previous);
+        }
+        if (table.present[r] && t == t) {
+            previous = t;
+        }
+    }
+    if (steps.empty()) {
+        return 0;
+    }
+    std::nth_element(steps.begin(), steps.begin() + steps.size() / 2, steps.end());
+    return 1 / steps[steps.size() / 2];
+}
+
+/**
+ * Value of a text field: empty fields (and "NaN") are NaN.
+ */
+static double parseField(const std::string& field)
+{
+    return field.empty() ? NOT_A_NUMBER : strtod(field.c_str(), 0);
+}
+
+/**
+ * Filter rows [first, end) of table; absent rows are NaN for filtering.
+ * False if they cannot be filtered: fewer than 2 present rows, or no value
+ * in any channel.
+ */
+static bool filterRows(Table& table, size_t first, size_t end, const FilterOptions& options, double rate)
+{
+    size_t rows = end - first;
+    size_t channels = table.filtered.size();
+    std::vector<double> data(rows * channels, NOT_A_NUMBER);
+    std::vector<double> mean(channels, 0.0);
+    std::vector<size_t> numFinite(channels, 0);
+    size_t numPresent(0);
+    for (size_t r = 0; r < rows; r++) {
+        if (!table.present[first + r]) {
+            continue;
+        }
+        numPresent++;
+        for (size_t c = 0; c < channels; c++) {
+            double value = table.values[(first + r) * table.width + table.filtered[c]];
+            data[r * channels + c] = value;
+            if (value == value) {
+                mean[c] += value;
+                numFinite[c]++;
+            }
+        }
+    }
+    if (numPresent < 2) {
+        return false;
+    }
+    double nyquist = rate / 2;
+    bool filtered;
+    if (options.iirOrder > 0) {
+        filtered = TemporalFilter(designButterworth(options.band, options.iirOrder, options.low, options.high, nyquist))
+            .filtfilt(&data[0], rows, channels);
+    } else {
+        int order = firOrder(options.order, options.low, rate, rows);
+        filtered = TemporalFilter(designFir(options.band, order, options.low, options.high, nyquist))
+            .filtfilt(&data[0], rows, channels);
+    }
+    if (!filtered) {
+        return false;
+    }
+    for (size_t r = 0; r < rows; r++) {
+        if (!table.present[first + r]) {
+            continue;
+        }
+        for (size_t c = 0; c < channels; c++) {
+            double value = data[r * channels + c];
+            if (options.keepMean && numFinite[c] > 0) {
+                value += mean[c] / numFinite[c];
+            }
+            table.values[(first + r) * table.width + table.filtered[c]] = value;
+        }
+    }
+    return true;
+}
+
+/**
+ * Motion-correct and filter each track of table (or the whole table):
+ * false if the frame rate or the pose is unknown, if a cutoff is not below
+ * the Nyquist frequency, or if no track can be filtered. unfiltered receives the tracks that could not be.
+ */
+static bool filterTable(Table& table, const FilterOptions& options, std::string& error, size_t& unfiltered)
+{
+    unfiltered = 0;
+    double rate = options.rate;
+    if (options.filter && rate <= 0 && table.time >= 0) {
+        rate = frameRate(table);
+    }
+    if (options.filter && !(rate > 0)) {
+        error = "unknown frame rate (use -r)";
+        return false;
+    }
+    // The rate of the timestamps is only known here
+    if (options.filter && !((options.band == BANDPASS ? options.high : options.low) < rate / 2)) {
+        std::ostringstream message;
+        message << "the cutoffs must be below the Nyquist frequency (" << rate / 2 << " Hz)";
+        error = message.str();
+        return false;
+    }
+    size_t pose[MOTION_PREDICTORS];
+    for (size_t j = 0; j < MOTION_PREDICTORS; j++) {
+        if (options.motion >= 0 && table.pose[j] < 0) {
+            error = "no Roll, Pitch and Yaw for -motion";
+            return false;
+        }
+        pose[j] = (size_t)table.pose[j];
+    }
+    if (table.filtered.empty()) {
+        error = "no emotion, sentiment or action unit channel";
+        return false;
+    }
+    MotionCorrection motion(options.motion, options.whiten);
+    size_t numFiltered(0);
+    for (size_t first = 0; first < table.rows();) {
+        size_t end = first + 1;
+        if (table.track >= 0) {
+            double track = table.values[first * table.width + table.track];
+            while (end < table.rows() && table.values[end * table.width + table.track] == track) {
+                end++;
+            }
+            if (!(track >= 0)) {
+                first = end;
+                continue;
+            }
+        } else {
+            end = table.rows();
+        }
+        if (options.motion >= 0) {
+            motion.correct(&table.values[first * table.width], end - first, table.width, pose, table.filtered);
+        }
+        if (options.filter) {
+            if (filterRows(table, first, end, options, rate)) {
+                numFiltered++;
+            } else {
+                unfiltered++;
+            }
+        }
+        first = end;
+    }
+    if (options.filter && numFiltered == 0) {
+        error = "nothing to filter (no channel with a value in 2 frames with a face)";
+        return false;
+    }
+    return true;
+}
+
+static bool filterBinary(const std::string& input, const std::string& output, const FilterOptions& options,
+                         std::string& error, size_t& unfiltered)
+{
+    FexbReader reader;
+    std::vector<float> values;
+    Table table;
+    if (!reader.open(input) || !reader.read(values, table.present)) {
+        error = "could not read the file";
+        return false;
+    }
+    table.width = reader.numChannels();
+    table.values.assign(values.begin(), values.end());
+    for (size_t c = 0; c < table.width; c++) {
+        if (isFiltered(reader.channelClass(c))) {
+            table.filtered.push_back(c);
+        } else if (reader.name(c) == "track_id") {
+            table.track = (int)c;
+        } else if (reader.name(c) == "timestamp") {
+            table.time = (int)c;
+        } else if (reader.channelClass(c) == "pose" && poseIndex(reader.name(c)) >= 0) {
+            table.pose[poseIndex(reader.name(c))] = (int)c;
+        }
+    }
+    if (!filterTable(table, options, error, unfiltered)) {
+        return false;
+    }
+    FexbWriter writer;
+    for (size_t c = 0; c < table.width; c++) {
+        writer.addChannel(reader.channelClass(c), reader.name(c));
+    }
+    if (!writer.open(output)) {
+        error = "could not open " + output + " for writing";
+        return false;
+    }
+    values.assign(table.values.begin(), table.values.end());
+    for (size_t r = 0; r < table.rows(); r++) {
+        writer.addFrame(table.width > 0 ? &values[r * table.width] : 0, table.present[r] != 0);
+    }
+    if (!writer.close()) {
+        error = "could not write " + output;
+        return false;
+    }
+    return true;
+}
+
+static bool filterText(const std::string& input, const std::string& output, const FilterOptions& options,
+                       std::string& error, size_t& unfiltered)
+{
+    std::ifstream in(input.c_str());
+    std::string header;
+    if (!std::getline(in, header)) {
+        error = "could not read the file";
+        return false;
+    }
+    char delimiter = header.find('\t') != std::string::npos ? '\t' : ',';
+    std::vector<std::string> names;
+    split(header, delimiter, names);
+    Table table;
+    table.width = names.size();
+    for (size_t c = 0; c < names.size(); c++) {
+        if (isFilteredColumn(names[c])) {
+            table.filtered.push_back(c);
+        } else if (names[c] == "track_id") {
+            table.track = (int)c;
+        } else if (names[c] == "timestamp") {
+            table.time = (int)c;
+        } else if (poseIndex(names[c]) >= 0) {
+            table.pose[poseIndex(names[c])] = (int)c;
+        }
+    }
+    // Rows without a face stop short ("Nan") or hold NaN in every filtered column
+    std::vector< std::vector<std::string> > fields;
+    std::string line;
+    while (std::getline(in, line)) {
+        fields.push_back(std::vector<std::string>());
+        split(line, delimiter, fields.back());
+        const std::vector<std::string>& row = fields.back();
+        for (size_t c = 0; c < table.width; c++) {
+            table.values.push_back(c < row.size() ? parseField(row[c]) : NOT_A_NUMBER);
+        }
+        const double* values = &table.values[table.values.size() - table.width];
+        bool present = table.filtered.empty();
+        for (size_t c = 0; c < table.filtered.size() && !present; c++) {
+            present = values[table.filtered[c]] == values[table.filtered[c]];
+        }
+        if (table.track >= 0 && !(values[table.track] >= 0)) {
+            present = false;
+        }
+        table.present.push_back(present);
+    }
+    if (!filterTable(table, options, error, unfiltered)) {
+        return false;
+    }
+    std::ofstream out(output.c_str(), std::ios::out | std::ios::binary);
+    if (!out.is_open()) {
+        error = "could not open " + output + " for writing";
+        return false;
+    }
+    std::string text(header);
+    text += '\n';
+    for (size_t r = 0; r < table.rows(); r++) {
+        std::vector<std::string>& row = fields[r];
+        if (table.present[r]) {
+            for (size_t c = 0; c < table.filtered.size() && table.filtered[c] < row.size(); c++) {
+                std::string& field = row[table.filtered[c]];
+                double value = table.values[r * table.width + table.filtered[c]];
+                // Missing values are kept as they were written
+                if (value == value || parseField(field) == parseField(field)) {
+                    field.clear();
+                    appendFloat(field, (float)value);
+                }
+            }
+        }
+        for (size_t c = 0; c < row.size(); c++) {
+            if (c > 0) text += delimiter;
+            text += row[c];
+        }
+        text += '\n';
+        if (text.size() >= TEXT_BUFFER_BYTES) {
+            out << text;
+            text.clear();
+        }
+    }
+    out << text;
+    out.close();
+    if (out.fail()) {
+        error = "could not write " + output;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * FILE.EXT -> FILE SUFFIX.EXT
+ */
+static std::string outputName(const std::string& input, const std::string& suffix)
+{
+    size_t slash = input.find_last_of('/');
+    size_t dot = input.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return input + suffix;
+    }
+    return input.substr(0, dot) + suffix + input.substr(dot);
+}
+
+/**
+ * Filters files from a shared list until none is left.
+ */
+class FilterWorker : public Thread {
+public:
+    FilterWorker(const std::vector<std::string>& files, size_t& next, size_t& failed, Mutex& mutex,
+                 const FilterOptions& options)
+    : files_(files), next_(next), failed_(failed), mutex_(mutex), options_(options) {}
+
+protected:
+    void run()
+    {
+        for (;;) {
+            size_t f;
+            {
+                ScopedLock lock(mutex_);
+                if (next_ == files_.size()) {
+                    return;
+                }
+                f = next_++;
+            }
+            const std::string& input = files_[f];
+            std::string output = outputName(input, options_.suffix);
+            std::string error;
+            size_t unfiltered(0);
+            bool binary = input.size() >= BINARY_EXT.size() &&
+                          input.compare(input.size() - BINARY_EXT.size(), BINARY_EXT.size(), BINARY_EXT) == 0;
+            bool ok = binary ? filterBinary(input, output, options_, error, unfiltered)
+                             : filterText(input, output, options_, error, unfiltered);
+            ScopedLock lock(mutex_);
+            if (ok) {
+                std::cout << input << " -> " << output;
+                if (unfiltered > 0) {
+                    std::cout << " (" << unfiltered << " tracks left unfiltered)";
+                }
+                std::cout << std::endl;
+            } else {
+                std::cout << "ERROR -- " << input << ": " << error << std::endl;
+                failed_++;
+            }
+        }
+    }
+
+private:
+    const std::vector<std::string>& files_;
+    size_t& next_;
+    size_t& failed_;
+    Mutex& mutex_;
+    const FilterOptions& options_;
+};
+
+static void usage()
+{
+    std::cout << "Usage:" << std::endl;
+    std::cout << "   fexfilter [-lp HZ | -hp HZ | -bp LOW:HIGH] [-r FPS] [-order ORDER | -iir ORDER]" << std::endl;
+    std::cout << "             [-keepmean] [-motion THRESHOLD [-whiten]] [-j WORKERS] [-suffix SUFFIX] FILE..." << std::endl;
+    std::cout << "   - A cutoff, -motion or both are required." << std::endl;
+    std::cout << "   - FILE: .fexb file, or tab or comma separated table with a header line." << std::endl;
+    std::cout << "   - FPS: frame rate (default: from the timestamp column)." << std::endl;
+    std::cout << "   - ORDER: FIR kernel order (default: 3 cycles of the lowest cutoff), or Butterworth order with -iir." << std::endl;
+    std::cout << "   - THRESHOLD: minimum |r| of a pose predictor in motion correction (0 to 1)." << std::endl;
+    std::cout << "   - WORKERS: files filtered at a time (default: the number of CPUs)." << std::endl;
+    std::cout << "   - FILE.EXT is written to FILE SUFFIX.EXT (default: " << DEFAULT_SUFFIX << ")." << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    FilterOptions options;
+    options.band = BANDPASS;
+    options.low = options.high = 0;
+    options.rate = 0;
+    options.order = 0;
+    options.iirOrder = 0;
+    options.keepMean = false;
+    options.motion = -1;
+    options.whiten = false;
+    options.suffix = DEFAULT_SUFFIX;
+    long numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+    bool bandSet(false);
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        bool hasValue = i + 1 < argc;
+        if ((arg == "-lp" || arg == "-hp") && hasValue) {
+            options.band = arg == "-lp" ? LOWPASS : HIGHPASS;
+            options.low = atof(argv[++i]);
+            bandSet = true;
+        } else if (arg == "-bp" && hasValue) {
+            options.band = BANDPASS;
+            bandSet = sscanf(argv[++i], "%lf:%lf", &options.low, &options.high) == 2;
+            if (options.low > options.high) {
+                std::swap(options.low, options.high);
+            }
+        } else if (arg == "-r" && hasValue) {
+            options.rate = atof(argv[++i]);
+        } else if (arg == "-order" && hasValue) {
+            options.order = atoi(argv[++i]);
+        } else if (arg == "-iir" && hasValue) {
+            options.iirOrder = atoi(argv[++i]);
+        } else if (arg == "-keepmean") {
+            options.keepMean = true;
+        } else if (arg == "-motion" && hasValue) {
+            options.motion = atof(argv[++i]);
+        } else if (arg == "-whiten") {
+            options.whiten = true;
+        } else if (arg == "-j" && hasValue) {
+            numWorkers = atol(argv[++i]);
+        } else if (arg == "-suffix" && hasValue) {
+            options.suffix = argv[++i];
+        } else {
+            files.push_back(arg);
+        }
+    }
+    options.filter = bandSet;
+    bool motionSet = options.motion >= 0 && options.motion <= 1;
+    if (!(bandSet || motionSet) || (bandSet && !(options.low > 0)) || (options.motion >= 0 && !motionSet) ||
+        files.empty() || options.suffix.empty()) {
+        usage();
+        return 1;
+    }
+    if (bandSet && options.rate > 0 && !((options.band == BANDPASS ? options.high : options.low) < options.rate / 2)) {
+        std::cout << "The cutoffs must be below the Nyquist frequency (" << options.rate / 2 << " Hz)" << std::endl;
+        return 1;
+    }
+
+    size_t next(0), failed(0);
+    Mutex mutex;
+    std::vector<FilterWorker*> workers;
+    numWorkers = std::min(std::max(numWorkers, 1L), (long)files.size());
+    for (long w = 0; w < numWorkers; w++) {
+        workers.push_back(new FilterWorker(files, next, failed, mutex, options));
+        workers.back()->start();
+    }
+    for (size_t w = 0; w < workers.size(); w++) {
+        workers[w]->join();
+        delete workers[w];
+    }
+    return failed > 0 ? 1 : 0;
+}
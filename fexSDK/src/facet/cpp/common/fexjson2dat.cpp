@@ -0,0 +1,265 @@
+/**
+ file fexjson2dat.cpp
+ Converts the .json file written by fexfacetexec to a table: one row per
+ frame of each track, then one row (track_id = -1) for every frame time
+ without a face.
+
+ The file is parsed as a stream, so memory does not grow with the number
+ of channels or the file size (only two times per frame are kept, to find
+ the frames without a face). The columns are taken from the first frame
+ in the file:
+
+   FrameRows, FrameCols   from "resolution"
+   timestamp              from each frame
+   FaceBoxX ... FaceBoxH  from "face-location"
+   <name>                 from "au-evidence", "emotion-evidence",
+                          "demographic-evidence" and "pose"
+   <landmark>_x, _y       from "landmarks"
+   track_id               0-based index of the track
+
+ Usage:
+
+   fexjson2dat JSONFILE [OUTPUTFILE] [-nohdr]
+
+ OUTPUTFILE defaults to JSONFILE with a .csv extension. An OUTPUTFILE
+ ending in .fexb is written in the binary columnar format (fexbinary.hpp),
+ otherwise as comma separated values with a header line (unless -nohdr).
+**/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include "fexbinary.hpp"
+#include "jsonframes.hpp"
+#include "jsonstream.hpp"
+
+const double TIME_TOLERANCE = 1e-3;     /**< Frame times closer than this are the same frame **/
+const size_t CSV_BUFFER_BYTES = 1 << 20;
+const std::string BINARY_EXT = ".fexb";
+
+/**
+ * Buffered comma separated output.
+ */
+class CsvWriter {
+public:
+    CsvWriter() : file_(0) { buffer_.reserve(CSV_BUFFER_BYTES + 256); }
+    ~CsvWriter() { close(); }
+
+    bool open(const std::string& filename)
+    {
+        file_ = fopen(filename.c_str(), "wb");
+        return file_ != 0;
+    }
+
+    void header(const std::vector<std::string>& names)
+    {
+        for (size_t i = 0; i < names.size(); i++) {
+            if (i > 0) buffer_ += ',';
+            buffer_ += names[i];
+        }
+        buffer_ += '\n';
+    }
+
+    void row(const std::vector<double>& values)
+    {
+        char number[32];
+        for (size_t i = 0; i < values.size(); i++) {
+            if (i > 0) buffer_ += ',';
+            if (values[i] != values[i]) {
+                buffer_ += "NaN";
+            } else {
+                int n = snprintf(number, sizeof(number), "%.9g", values[i]);
+                buffer_.append(number, n);
+            }
+        }
+        buffer_ += '\n';
+        if (buffer_.size() >= CSV_BUFFER_BYTES) {
+            flush();
+        }
+    }
+
+    bool close()
+    {
+        if (file_ == 0) {
+            return true;
+        }
+        flush();
+        bool ok = !ferror(file_);
+        fclose(file_);
+        file_ = 0;
+        return ok;
+    }
+
+private:
+    void flush()
+    {
+        fwrite(buffer_.data(), 1, buffer_.size(), file_);
+        buffer_.clear();
+    }
+
+    FILE* file_;
+    std::string buffer_;
+};
+
+/**
+ * Writes the rows of the frames as they are read.
+ */
+class TrackConverter : public JsonFrameReader {
+public:
+    TrackConverter(const std::string& outfile, bool binary, bool writeHeader)
+    : outfile_(outfile), binary_(binary), writeHeader_(writeHeader), opened_(false), ok_(true) {}
+
+    /**
+     * Write the frame times without a face and close the output.
+     */
+    bool finish()
+    {
+        if (!opened_) {
+            freezeColumns();
+            if (!openOutput()) {
+                return false;
+            }
+        }
+        std::sort(faceTimes_.begin(), faceTimes_.end());
+        std::vector<double> values(names().size(), std::numeric_limits<double>::quiet_NaN());
+        const std::vector<double>& frameTimes = this->frameTimes();
+        for (size_t i = 0; i < frameTimes.size(); i++) {
+            double t = frameTimes[i];
+            std::vector<double>::const_iterator it = std::lower_bound(faceTimes_.begin(), faceTimes_.end(), t - TIME_TOLERANCE);
+            if (it != faceTimes_.end() && std::fabs(*it - t) <= TIME_TOLERANCE) {
+                continue;
+            }
+            if (timeColumn() >= 0) {
+                values[timeColumn()] = t;
+            }
+            writeRow(values, -1);
+        }
+        if (numIgnored() > 0) {
+            std::cout << numIgnored() << " values outside the columns of the first frame were ignored" << std::endl;
+        }
+        bool closed = binary_ ? binaryWriter_.close() : csvWriter_.close();
+        return ok_ && closed;
+    }
+
+protected:
+    void columnsReady()
+    {
+        openOutput();
+    }
+
+    void frame(int track, const std::vector<double>& values)
+    {
+        if (timeColumn() >= 0) {
+            faceTimes_.push_back(values[timeColumn()]);
+        }
+        writeRow(values, track);
+    }
+
+private:
+    bool openOutput()
+    {
+        opened_ = true;
+        const std::vector<std::string>& names = this->names();
+        if (binary_) {
+            binaryWriter_.addChannel("frame", "FrameRows");
+            binaryWriter_.addChannel("frame", "FrameCols");
+            for (size_t i = 0; i < names.size(); i++) {
+                binaryWriter_.addChannel(classes()[i], names[i]);
+            }
+            binaryWriter_.addChannel("frame", "track_id");
+            ok_ = binaryWriter_.open(outfile_);
+        } else {
+            ok_ = csvWriter_.open(outfile_);
+            if (ok_ && writeHeader_) {
+                std::vector<std::string> header;
+                header.push_back("FrameRows");
+                header.push_back("FrameCols");
+                header.insert(header.end(), names.begin(), names.end());
+                header.push_back("track_id");
+                csvWriter_.header(header);
+            }
+        }
+        if (!ok_) {
+            std::cout << "Could not open " << outfile_ << " for writing" << std::endl;
+        }
+        return ok_;
+    }
+
+    void writeRow(const std::vector<double>& values, int trackId)
+    {
+        if (!ok_) {
+            return;
+        }
+        row_.resize(values.size() + 3);
+        row_[0] = frameRows();
+        row_[1] = frameCols();
+        std::copy(values.begin(), values.end(), row_.begin() + 2);
+        row_[row_.size() - 1] = trackId;
+        if (binary_) {
+            rowf_.assign(row_.begin(), row_.end());
+            binaryWriter_.addFrame(&rowf_[0], trackId >= 0);
+        } else {
+            csvWriter_.row(row_);
+        }
+    }
+
+    std::string outfile_;
+    bool binary_;
+    bool writeHeader_;
+    bool opened_;
+    bool ok_;
+    CsvWriter csvWriter_;
+    FexbWriter binaryWriter_;
+    std::vector<double> faceTimes_;
+    std::vector<double> row_;
+    std::vector<float> rowf_;
+};
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> args;
+    bool writeHeader(true);
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "-nohdr") {
+            writeHeader = false;
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.empty()) {
+        std::cout << "Usage:" << std::endl;
+        std::cout << "   fexjson2dat JSONFILE [OUTPUTFILE] [-nohdr]" << std::endl;
+        std::cout << "   - OUTPUTFILE defaults to JSONFILE with a .csv extension." << std::endl;
+        std::cout << "   - An OUTPUTFILE ending in " << BINARY_EXT << " is written in the binary columnar format." << std::endl;
+        std::cout << "   - With -nohdr, the CSV file has no header line." << std::endl;
+        return -1;
+    }
+
+    std::string jsonfile(args[0]), outfile;
+    if (args.size() > 1) {
+        outfile = args[1];
+    } else {
+        size_t dot = jsonfile.find_last_of('.');
+        size_t slash = jsonfile.find_last_of('/');
+        outfile = jsonfile.substr(0, (dot != std::string::npos && (slash == std::string::npos || dot > slash)) ? dot : jsonfile.size()) + ".csv";
+    }
+    bool binary = outfile.size() > BINARY_EXT.size() &&
+                  outfile.compare(outfile.size() - BINARY_EXT.size(), BINARY_EXT.size(), BINARY_EXT) == 0;
+
+    TrackConverter converter(outfile, binary, writeHeader);
+    JsonStream json;
+    if (!json.parse(jsonfile, converter)) {
+        std::cout << "Could not parse " << jsonfile << ": " << json.error() << std::endl;
+        return -2;
+    }
+    if (!converter.finish()) {
+        std::cout << "Error writing " << outfile << std::endl;
+        return -3;
+    }
+    return 0;
+}
@@ -0,0 +1,744 @@
+/**
+ file fexresample.cpp
+ Resamples result files to a constant frame rate, as fexc.interpolate and
+ fexc.downsample do in Matlab, with the engine of resampler.hpp: gaps are
+ filled (nearest, linear, pchip or spline) up to a maximum gap, and rates
+ below the rate of the input are reached by low-pass filtering and
+ decimation. Files are read as a stream and resampled a chunk of rows at
+ a time, so memory does not grow with their length; the channels of a
+ file are split among threads, and files are resampled in parallel.
+
+ Input files are the .json files of fexfacetexec (only the frames with a
+ face are listed: the others are gaps), .fexb files (fexfacet,
+ fexjson2dat) or text tables with a header line: tab separated (fexfacet)
+ or comma separated (fexjson2dat). Resampled are all the channels but the
+ frame columns (class frame of .fexb and .json files; FrameNumber and the
+ other Frame... columns, FaceRejected, timestamp and track_id of text
+ files). Times are the timestamp column or, without one, FrameNumber (or
+ the row) divided by the -r frame rate. Files with a track_id column are
+ resampled one track at a time, and the rows of track -1 are skipped.
+
+ The output rows hold the timestamp, the track_id (if the input has
+ one) and the resampled channels. .json files are written as comma
+ separated values, the others in their own format.
+
+ Usage:
+
+   fexresample -fps FPS [-method METHOD] [-maxgap SECONDS] [-r FPS] [-t THREADS]
+               [-j WORKERS] [-suffix SUFFIX] FILE...
+
+   -fps      output frame rate
+   -method   nearest, linear, pchip (default, as fex_interpolate) or spline
+   -maxgap   longest gap filled, in seconds (default 1; inf fills all, but
+             then a channel that stops may hold its whole track in memory);
+             at least 1.5 frame steps of the input, so that consecutive
+             frames are never a gap
+   -r        frame rate of the input: by default the median step of the
+             times of the first rows of each track (of all the frames,
+             with a face or not, for .json files)
+   -t        threads per file, each resampling a share of the channels
+             (default 1)
+   -j        files resampled at a time (default: the number of CPUs)
+   -suffix   FILE.EXT is written to FILE SUFFIX.EXT (default _resampled);
+             nothing is resampled if two files would have the same output,
+             as FILE.json and FILE.csv do
+**/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "fexbinary.hpp"
+#include "jsonframes.hpp"
+#include "jsonstream.hpp"
+#include "resampler.hpp"
+#include "textwriter.hpp"
+#include "threads.hpp"
+
+const std::string BINARY_EXT = ".fexb";
+const std::string JSON_EXT = ".json";
+const std::string DEFAULT_SUFFIX = "_resampled";
+const size_t CHUNK_ROWS = 4096;     /**< Input rows resampled at a time **/
+const double NOT_A_NUMBER = std::numeric_limits<double>::quiet_NaN();
+
+/**
+ * Resampling options shared by all the files.
+ */
+struct ResampleOptions {
+    double rate;
+    double sourceRate;  ///< 0: from the times of each track
+    GapMethod method;
+    double maxGap;
+    int threads;
+    std::string suffix;
+};
+
+static bool hasExtension(const std::string& name, const std::string& ext)
+{
+    return name.size() >= ext.size() && name.compare(name.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+/**
+ * Frame rate from the median step of increasing times, or 0 without one.
+ */
+static double medianRate(const std::vector<double>& times)
+{
+    std::vector<double> steps;
+    for (size_t r = 1; r < times.size(); r++) {
+        if (times[r] > times[r - 1]) {
+            steps.push_back(times[r] - times[r - 1]);
+        }
+    }
+    if (steps.empty()) {
+        return 0;
+    }
+    std::nth_element(steps.begin(), steps.begin() + steps.size() / 2, steps.end());
+    return 1 / steps[steps.size() / 2];
+}
+
+/**
+ * Frame columns of a text table, by name: not resampled.
+ */
+static bool isFrameColumn(const std::string& name)
+{
+    return name.compare(0, 5, "Frame") == 0 || name == "FaceRejected" || name == "timestamp" || name == "track_id";
+}
+
+static void split(const std::string& line, char delimiter, std::vector<std::string>& fields)
+{
+    fields.clear();
+    size_t start = 0;
+    for (;;) {
+        size_t end = line.find(delimiter, start);
+        fields.push_back(line.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        if (end == std::string::npos) {
+            return;
+        }
+        start = end + 1;
+    }
+}
+
+/**
+ * Resampled rows of a file: timestamp, track_id (optional) and the
+ * channels, as delimited text with a header line or as .fexb.
+ */
+class ResampledOutput {
+public:
+    ResampledOutput() : binary_(false), delimiter_(','), tracks_(false) {}
+
+    bool open(const std::string& filename, bool binary, char delimiter, bool tracks,
+              const std::vector<std::string>& classes, const std::vector<std::string>& names)
+    {
+        binary_ = binary;
+        delimiter_ = delimiter;
+        tracks_ = tracks;
+        if (binary_) {
+            writer_.addChannel("frame", "timestamp");
+            if (tracks_) {
+                writer_.addChannel("frame", "track_id");
+            }
+            for (size_t c = 0; c < names.size(); c++) {
+                writer_.addChannel(classes[c], names[c]);
+            }
+            return writer_.open(filename);
+        }
+        file_.open(filename.c_str(), std::ios::out | std::ios::binary);
+        text_ = "timestamp";
+        if (tracks_) {
+            text_ += delimiter_;
+            text_ += "track_id";
+        }
+        for (size_t c = 0; c < names.size(); c++) {
+            text_ += delimiter_;
+            text_ += names[c];
+        }
+        text_ += '\n';
+        return file_.is_open();
+    }
+
+    void row(double time, int track, const std::vector<double>& values)
+    {
+        if (binary_) {
+            // A face is present if any channel has a value
+            row_.clear();
+            row_.push_back(time);
+            if (tracks_) {
+                row_.push_back(track);
+            }
+            bool present(false);
+            for (size_t c = 0; c < values.size(); c++) {
+                row_.push_back(values[c]);
+                present = present || values[c] == values[c];
+            }
+            writer_.addFrame(&row_[0], present);
+            return;
+        }
+        char number[32];
+        int n = snprintf(number, sizeof(number), "%.9g", time);
+        text_.append(number, n);
+        if (tracks_) {
+            text_ += delimiter_;
+            appendInt(text_, track);
+        }
+        for (size_t c = 0; c < values.size(); c++) {
+            text_ += delimiter_;
+            appendFloat(text_, (float)values[c]);
+        }
+        text_ += '\n';
+        if (text_.size() >= TEXT_BUFFER_BYTES) {
+            file_ << text_;
+            text_.clear();
+        }
+    }
+
+    bool close()
+    {
+        if (binary_) {
+            return writer_.close();
+        }
+        file_ << text_;
+        text_.clear();
+        file_.close();
+        return !file_.fail();
+    }
+
+private:
+    bool binary_;
+    char delimiter_;
+    bool tracks_;
+    FexbWriter writer_;
+    std::vector<float> row_;
+    std::ofstream file_;
+    std::string text_;
+};
+
+/**
+ * Resamples the channels [first, first + resampler.channels()) of a chunk
+ * of rows, and collects the output frames.
+ */
+class ChannelWorker : public Thread {
+public:
+    ChannelWorker(StreamingResampler& resampler, size_t first)
+    : resampler_(resampler), first_(first), times_(0), values_(0), width_(0), finish_(false),
+      frame_(resampler.channels()) {}
+
+    void setChunk(const std::vector<double>& times, const std::vector<double>& values, size_t width, bool finish)
+    {
+        times_ = &times;
+        values_ = &values;
+        width_ = width;
+        finish_ = finish;
+    }
+
+    void process()
+    {
+        for (size_t r = 0; r < times_->size(); r++) {
+            resampler_.push((*times_)[r], width_ > 0 ? &(*values_)[r * width_ + first_] : 0);
+        }
+        if (finish_) {
+            resampler_.finish();
+        }
+        double time;
+        while (resampler_.pop(time, frame_.empty() ? 0 : &frame_[0])) {
+            outTimes.push_back(time);
+            outValues.insert(outValues.end(), frame_.begin(), frame_.end());
+        }
+    }
+
+    std::deque<double> outTimes;
+    std::deque<double> outValues;   ///< resampler.channels() per output frame
+
+protected:
+    void run() { process(); }
+
+private:
+    StreamingResampler& resampler_;
+    size_t first_;
+    const std::vector<double>* times_;
+    const std::vector<double>* values_;
+    size_t width_;
+    bool finish_;
+    std::vector<double> frame_;
+};
+
+/**
+ * Takes the rows of a file in order, and resamples each track in chunks
+ * of CHUNK_ROWS rows, its channels split among threads.
+ */
+class TrackResampler {
+public:
+    TrackResampler(const ResampleOptions& options, size_t channels, ResampledOutput& output)
+    : options_(options), channels_(channels), output_(output), track_(0), started_(false), numDropped_(0),
+      frame_(channels) {}
+
+    ~TrackResampler() { clear(); }
+
+    void row(int track, double time, const double* values)
+    {
+        if (started_ && track != track_) {
+            process(true);
+        }
+        started_ = true;
+        track_ = track;
+        times_.push_back(time);
+        values_.insert(values_.end(), values, values + channels_);
+        if (times_.size() == CHUNK_ROWS) {
+            process(false);
+        }
+    }
+
+    void finish()
+    {
+        if (started_) {
+            process(true);
+        }
+        started_ = false;
+    }
+
+    size_t numDropped() const { return numDropped_; }
+
+private:
+
+    void process(bool last)
+    {
+        if (workers_.empty()) {
+            // A new track: the first chunk gives its frame rate
+            double rate = options_.sourceRate > 0 ? options_.sourceRate : medianRate(times_);
+            int factor = decimationFactor(rate, options_.rate);
+            // Below the frame step, every pair of frames would be a gap
+            double maxGap = rate > 0 ? std::max(options_.maxGap, RESAMPLE_MIN_GAP_STEPS / rate) : options_.maxGap;
+            size_t groups = std::max<size_t>(1, std::min<size_t>(std::max(options_.threads, 1), channels_));
+            for (size_t g = 0; g < groups; g++) {
+                size_t first = g * channels_ / groups, end = (g + 1) * channels_ / groups;
+                resamplers_.push_back(new StreamingResampler(end - first, options_.rate, options_.method,
+                                                             maxGap, factor));
+                workers_.push_back(new ChannelWorker(*resamplers_.back(), first));
+            }
+        }
+        for (size_t g = 0; g < workers_.size(); g++) {
+            workers_[g]->setChunk(times_, values_, channels_, last);
+            if (g > 0 && !workers_[g]->start()) {
+                workers_[g]->process();
+            }
+        }
+        workers_[0]->process();
+        for (size_t g = 1; g < workers_.size(); g++) {
+            workers_[g]->join();
+        }
+        times_.clear();
+        values_.clear();
+
+        // Frames that every group has output
+        size_t ready = workers_[0]->outTimes.size();
+        for (size_t g = 1; g < workers_.size(); g++) {
+            ready = std::min(ready, workers_[g]->outTimes.size());
+        }
+        for (size_t k = 0; k < ready; k++) {
+            double time = workers_[0]->outTimes.front();
+            for (size_t g = 0; g < workers_.size(); g++) {
+                ChannelWorker& worker = *workers_[g];
+                size_t first = g * channels_ / workers_.size();
+                size_t width = resamplers_[g]->channels();
+                std::copy(worker.outValues.begin(), worker.outValues.begin() + width, frame_.begin() + first);
+                worker.outValues.erase(worker.outValues.begin(), worker.outValues.begin() + width);
+                worker.outTimes.pop_front();
+            }
+            output_.row(time, track_, frame_);
+        }
+        if (last) {
+            clear();
+        }
+    }
+
+    void clear()
+    {
+        for (size_t g = 0; g < workers_.size(); g++) {
+            numDropped_ += resamplers_[g]->numDropped();
+            delete workers_[g];
+            delete resamplers_[g];
+        }
+        workers_.clear();
+        resamplers_.clear();
+    }
+
+    const ResampleOptions& options_;
+    size_t channels_;
+    ResampledOutput& output_;
+    int track_;
+    bool started_;
+    size_t numDropped_;         ///< Rows whose time did not increase
+    std::vector<double> times_;     ///< Rows of the chunk
+    std::vector<double> values_;
+    std::vector<StreamingResampler*> resamplers_;
+    std::vector<ChannelWorker*> workers_;
+    std::vector<double> frame_;
+};
+
+static bool resampleBinary(const std::string& input, const std::string& output, const ResampleOptions& options,
+                           size_t& numDropped, std::string& error)
+{
+    FexbReader reader;
+    if (!reader.open(input)) {
+        error = "could not read the file";
+        return false;
+    }
+    std::vector<size_t> resampled;
+    std::vector<std::string> classes, names;
+    int track(-1), time(-1), frame(-1);
+    for (size_t c = 0; c < reader.numChannels(); c++) {
+        if (reader.channelClass(c) != "frame") {
+            resampled.push_back(c);
+            classes.push_back(reader.channelClass(c));
+            names.push_back(reader.name(c));
+        } else if (reader.name(c) == "track_id") {
+            track = (int)c;
+        } else if (reader.name(c) == "timestamp") {
+            time = (int)c;
+        } else if (reader.name(c) == "FrameNumber") {
+            frame = (int)c;
+        }
+    }
+    if (time < 0 && !(options.sourceRate > 0)) {
+        error = "no timestamp channel (use -r)";
+        return false;
+    }
+    ResampledOutput out;
+    if (!out.open(output, true, ',', track >= 0, classes, names)) {
+        error = "could not open " + output + " for writing";
+        return false;
+    }
+    TrackResampler resampler(options, resampled.size(), out);
+    std::vector<float> values;
+    std::vector<char> present;
+    std::vector<double> row(resampled.size());
+    size_t width = reader.numChannels(), index(0);
+    while (reader.readBlock(values, present)) {
+        for (size_t r = 0; r < present.size(); r++, index++) {
+            const float* v = &values[r * width];
+            double trackId = track >= 0 ? v[track] : 0;
+            if (!(trackId >= 0)) {
+                continue;
+            }
+            double t = time >= 0 ? v[time] : (frame >= 0 ? v[frame] - 1 : index) / options.sourceRate;
+            for (size_t c = 0; c < resampled.size(); c++) {
+                row[c] = v[resampled[c]];
+            }
+            resampler.row((int)trackId, t, row.empty() ? 0 : &row[0]);
+        }
+    }
+    resampler.finish();
+    numDropped = resampler.numDropped();
+    if (!out.close()) {
+        error = "could not write " + output;
+        return false;
+    }
+    return true;
+}
+
+static bool resampleText(const std::string& input, const std::string& output, const ResampleOptions& options,
+                         size_t& numDropped, std::string& error)
+{
+    std::ifstream in(input.c_str());
+    std::string header;
+    if (!std::getline(in, header)) {
+        error = "could not read the file";
+        return false;
+    }
+    char delimiter = header.find('\t') != std::string::npos ? '\t' : ',';
+    std::vector<std::string> names, resampledNames;
+    split(header, delimiter, names);
+    std::vector<size_t> resampled;
+    int track(-1), time(-1), frame(-1);
+    for (size_t c = 0; c < names.size(); c++) {
+        if (!isFrameColumn(names[c])) {
+            resampled.push_back(c);
+            resampledNames.push_back(names[c]);
+        } else if (names[c] == "track_id") {
+            track = (int)c;
+        } else if (names[c] == "timestamp") {
+            time = (int)c;
+        } else if (names[c] == "FrameNumber") {
+            frame = (int)c;
+        }
+    }
+    if (time < 0 && !(options.sourceRate > 0)) {
+        error = "no timestamp column (use -r)";
+        return false;
+    }
+    ResampledOutput out;
+    std::vector<std::string> classes(resampled.size());
+    if (!out.open(output, false, delimiter, track >= 0, classes, resampledNames)) {
+        error = "could not open " + output + " for writing";
+        return false;
+    }
+    // Rows without a face stop short ("Nan") or hold NaN
+    TrackResampler resampler(options, resampled.size(), out);
+    std::vector<std::string> fields;
+    std::vector<double> row(resampled.size());
+    std::string line;
+    for (size_t index = 0; std::getline(in, line); index++) {
+        split(line, delimiter, fields);
+        size_t numFields = fields.size();
+        double trackId = track < 0 ? 0 : (size_t)track < numFields ? strtod(fields[track].c_str(), 0) : NOT_A_NUMBER;
+        if (!(trackId >= 0)) {
+            continue;
+        }
+        double t;
+        if (time >= 0) {
+            t = (size_t)time < numFields ? strtod(fields[time].c_str(), 0) : NOT_A_NUMBER;
+        } else {
+            t = (frame >= 0 && (size_t)frame < numFields ? strtod(fields[frame].c_str(), 0) - 1 : index) / options.sourceRate;
+        }
+        for (size_t c = 0; c < resampled.size(); c++) {
+            size_t i = resampled[c];
+            row[c] = i < numFields && !fields[i].empty() ? strtod(fields[i].c_str(), 0) : NOT_A_NUMBER;
+        }
+        resampler.row((int)trackId, t, row.empty() ? 0 : &row[0]);
+    }
+    resampler.finish();
+    numDropped = resampler.numDropped();
+    if (!out.close()) {
+        error = "could not write " + output;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Resamples the frames of a fexfacetexec .json file as they are parsed.
+ * Without -r, the frame rate is that of output.frametimes, which lists
+ * the frames without a face too and comes before the tracks.
+ */
+class JsonResampler : public JsonFrameReader {
+public:
+    JsonResampler(const std::string& output, const ResampleOptions& options)
+    : output_(output), options_(options), ok_(true), resampler_(0) {}
+
+    ~JsonResampler() { delete resampler_; }
+
+    /** Resample the last track and close the output **/
+    bool finish(size_t& numDropped, std::string& error)
+    {
+        if (!columnsFrozen()) {
+            freezeColumns();
+            columnsReady();
+        }
+        if (!ok_) {
+            error = "could not open " + output_ + " for writing";
+            return false;
+        }
+        resampler_->finish();
+        numDropped = resampler_->numDropped();
+        if (!out_.close()) {
+            error = "could not write " + output_;
+            return false;
+        }
+        return true;
+    }
+
+protected:
+    void columnsReady()
+    {
+        if (!(options_.sourceRate > 0)) {
+            options_.sourceRate = medianRate(frameTimes());
+        }
+        std::vector<std::string> classes, names;
+        for (size_t c = 0; c < this->names().size(); c++) {
+            if (this->classes()[c] != "frame") {
+                resampled_.push_back(c);
+                classes.push_back(this->classes()[c]);
+                names.push_back(this->names()[c]);
+            }
+        }
+        row_.resize(resampled_.size());
+        ok_ = out_.open(output_, hasExtension(output_, BINARY_EXT), ',', true, classes, names);
+        resampler_ = new TrackResampler(options_, resampled_.size(), out_);
+    }
+
+    void frame(int track, const std::vector<double>& values)
+    {
+        if (!ok_) {
+            return;
+        }
+        for (size_t c = 0; c < resampled_.size(); c++) {
+            row_[c] = values[resampled_[c]];
+        }
+        resampler_->row(track, values[timeColumn()], row_.empty() ? 0 : &row_[0]);
+    }
+
+private:
+    std::string output_;
+    ResampleOptions options_;
+    bool ok_;
+    ResampledOutput out_;
+    TrackResampler* resampler_;
+    std::vector<size_t> resampled_;
+    std::vector<double> row_;
+};
+
+static bool resampleJson(const std::string& input, const std::string& output, const ResampleOptions& options,
+                         size_t& numDropped, std::string& error)
+{
+    JsonResampler resampler(output, options);
+    JsonStream json;
+    if (!json.parse(input, resampler)) {
+        error = json.error();
+        return false;
+    }
+    return resampler.finish(numDropped, error);
+}
+
+/**
+ * FILE.EXT -> FILE SUFFIX.EXT, or FILE SUFFIX.csv for .json files
+ */
+static std::string outputName(const std::string& input, const std::string& suffix)
+{
+    size_t slash = input.find_last_of('/');
+    size_t dot = input.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return input + suffix;
+    }
+    return input.substr(0, dot) + suffix + (hasExtension(input, JSON_EXT) ? ".csv" : input.substr(dot));
+}
+
+/**
+ * Resamples files from a shared list until none is left.
+ */
+class ResampleWorker : public Thread {
+public:
+    ResampleWorker(const std::vector<std::string>& files, size_t& next, size_t& failed, Mutex& mutex,
+                   const ResampleOptions& options)
+    : files_(files), next_(next), failed_(failed), mutex_(mutex), options_(options) {}
+
+protected:
+    void run()
+    {
+        for (;;) {
+            size_t f;
+            {
+                ScopedLock lock(mutex_);
+                if (next_ == files_.size()) {
+                    return;
+                }
+                f = next_++;
+            }
+            const std::string& input = files_[f];
+            std::string output = outputName(input, options_.suffix);
+            std::string error;
+            size_t numDropped(0);
+            bool ok = hasExtension(input, BINARY_EXT) ? resampleBinary(input, output, options_, numDropped, error) :
+                      hasExtension(input, JSON_EXT) ? resampleJson(input, output, options_, numDropped, error) :
+                      resampleText(input, output, options_, numDropped, error);
+            ScopedLock lock(mutex_);
+            if (ok) {
+                std::cout << input << " -> " << output;
+                if (numDropped > 0) {
+                    std::cout << " (" << numDropped << " rows without increasing times dropped)";
+                }
+                std::cout << std::endl;
+            } else {
+                std::cout << "ERROR -- " << input << ": " << error << std::endl;
+                failed_++;
+            }
+        }
+    }
+
+private:
+    const std::vector<std::string>& files_;
+    size_t& next_;
+    size_t& failed_;
+    Mutex& mutex_;
+    const ResampleOptions& options_;
+};
+
+static void usage()
+{
+    std::cout << "Usage:" << std::endl;
+    std::cout << "   fexresample -fps FPS [-method METHOD] [-maxgap SECONDS] [-r FPS] [-t THREADS]" << std::endl;
+    std::cout << "               [-j WORKERS] [-suffix SUFFIX] FILE..." << std::endl;
+    std::cout << "   - FILE: fexfacetexec " << JSON_EXT << " file, " << BINARY_EXT << " file, or tab or comma separated table with a header line." << std::endl;
+    std::cout << "   - METHOD: nearest, linear, pchip (default) or spline." << std::endl;
+    std::cout << "   - SECONDS: longest gap filled (default: " << RESAMPLE_MAX_GAP << "; inf fills all), at least "
+              << RESAMPLE_MIN_GAP_STEPS << " input frame steps." << std::endl;
+    std::cout << "   - -r FPS: input frame rate (default: from the timestamps; required without them)." << std::endl;
+    std::cout << "   - THREADS: threads per file, splitting the channels (default: 1)." << std::endl;
+    std::cout << "   - WORKERS: files resampled at a time (default: the number of CPUs)." << std::endl;
+    std::cout << "   - FILE.EXT is written to FILE SUFFIX.EXT (default: " << DEFAULT_SUFFIX << "), " << JSON_EXT << " files to .csv." << std::endl;
+    std::cout << "     Nothing is resampled if two FILEs would have the same output (FILE" << JSON_EXT << " and FILE.csv)." << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    ResampleOptions options;
+    options.rate = 0;
+    options.sourceRate = 0;
+    options.method = PCHIP;
+    options.maxGap = RESAMPLE_MAX_GAP;
+    options.threads = 1;
+    options.suffix = DEFAULT_SUFFIX;
+    long numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+    bool methodSet(true);
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        bool hasValue = i + 1 < argc;
+        if (arg == "-fps" && hasValue) {
+            options.rate = atof(argv[++i]);
+        } else if (arg == "-method" && hasValue) {
+            methodSet = parseGapMethod(argv[++i], options.method);
+        } else if (arg == "-maxgap" && hasValue) {
+            options.maxGap = atof(argv[++i]);
+        } else if (arg == "-r" && hasValue) {
+            options.sourceRate = atof(argv[++i]);
+        } else if (arg == "-t" && hasValue) {
+            options.threads = atoi(argv[++i]);
+        } else if (arg == "-j" && hasValue) {
+            numWorkers = atol(argv[++i]);
+        } else if (arg == "-suffix" && hasValue) {
+            options.suffix = argv[++i];
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (!(options.rate > 0) || !methodSet || !(options.maxGap >= 0) || files.empty() || options.suffix.empty()) {
+        usage();
+        return 1;
+    }
+    // FILE.json and FILE.csv are both written to FILE SUFFIX.csv: no file
+    // is resampled rather than one overwriting the other
+    std::map<std::string, std::string> outputs;
+    for (size_t f = 0; f < files.size(); f++) {
+        outputs[files[f]];
+    }
+    for (size_t f = 0; f < files.size(); f++) {
+        std::string output = outputName(files[f], options.suffix);
+        std::map<std::string, std::string>::iterator it = outputs.find(output);
+        if (it != outputs.end()) {
+            std::cout << "ERROR -- " << files[f] << ": " << output << " is "
+                      << (it->second.empty() ? "an input file" : "also the output of " + it->second) << std::endl;
+            return 1;
+        }
+        outputs[output] = files[f];
+    }
+
+    size_t next(0), failed(0);
+    Mutex mutex;
+    std::vector<ResampleWorker*> workers;
+    numWorkers = std::min(std::max(numWorkers, 1L), (long)files.size());
+    for (long w = 0; w < numWorkers; w++) {
+        workers.push_back(new ResampleWorker(files, next, failed, mutex, options));
+        workers.back()->start();
+    }
+    for (size_t w = 0; w < workers.size(); w++) {
+        workers[w]->join();
+        delete workers[w];
+    }
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,93 @@
+#include "framechange.hpp"
+#include <algorithm>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+const int CHUNK = 16;   ///< Pixels summed at a time
+
+FrameChangeDetector::FrameChangeDetector(double threshold, size_t maxRun)
+: threshold_(threshold), maxRun_(maxRun), run_(0), difference_(-1)
+{
+}
+
+void FrameChangeDetector::reset()
+{
+    reference_.clear();
+    run_ = 0;
+}
+
+bool FrameChangeDetector::unchanged(const cv::Mat& frame)
+{
+    thumbnail(frame, current_);
+    difference_ = -1;
+    if (!reference_.empty() && frame.rows == size_.height && frame.cols == size_.width) {
+        double sum = 0;
+        for (size_t i = 0; i < current_.size(); i++) {
+            sum += fabs(current_[i] - reference_[i]);
+        }
+        difference_ = sum / current_.size();
+        if (difference_ <= threshold_ && run_ < maxRun_) {
+            run_++;
+            return true;
+        }
+    }
+    reference_.swap(current_);
+    size_ = cv::Size(frame.cols, frame.rows);
+    run_ = 0;
+    return false;
+}
+
+/**
+ * Block means of frame: rows are summed in 16-pixel chunks into sums_, and
+ * the chunks of a band of rows are folded into its blocks.
+ */
+void FrameChangeDetector::thumbnail(const cv::Mat& frame, std::vector<float>& thumb)
+{
+    int rows = frame.rows;
+    int cols = frame.cols;
+    int chunks = (cols + CHUNK - 1) / CHUNK;
+    int thumbRows = std::min(CHANGE_THUMB_ROWS, rows);
+    int thumbCols = std::min(CHANGE_THUMB_COLS, chunks);
+    thumb.assign(thumbRows * thumbCols, 0.0f);
+    if (thumb.empty()) {
+        return;
+    }
+    std::vector<float> counts(thumb.size(), 0.0f);
+    int y = 0;
+    for (int band = 0; band < thumbRows; band++) {
+        int end = (int)((long long)(band + 1) * rows / thumbRows);
+        sums_.assign(chunks, 0);
+        unsigned int* sums = &sums_[0];
+        for (; y < end; y++) {
+            const unsigned char* p = frame.ptr(y);
+            int c = 0;
+#if defined(__SSE2__)
+            const __m128i zero = _mm_setzero_si128();
+            for (; (c + 1) * CHUNK <= cols; c++) {
+                // Two partial sums of 8 bytes, in the low 16 bits of each half
+                __m128i sad = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(p + c * CHUNK)), zero);
+                sums[c] += (unsigned int)(_mm_cvtsi128_si32(sad) + _mm_extract_epi16(sad, 4));
+            }
+#endif
+            for (; c < chunks; c++) {
+                unsigned int sum = 0;
+                for (int x = c * CHUNK; x < std::min((c + 1) * CHUNK, cols); x++) {
+                    sum += p[x];
+                }
+                sums[c] += sum;
+            }
+        }
+        int bandRows = end - (int)((long long)band * rows / thumbRows);
+        for (int c = 0; c < chunks; c++) {
+            int block = band * thumbCols + (int)((long long)c * thumbCols / chunks);
+            thumb[block] += sums[c];
+            counts[block] += (float)(bandRows * (std::min((c + 1) * CHUNK, cols) - c * CHUNK));
+        }
+    }
+    for (size_t i = 0; i < thumb.size(); i++) {
+        thumb[i] /= counts[i];
+    }
+}
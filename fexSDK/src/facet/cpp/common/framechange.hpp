@@ -0,0 +1,56 @@
+#ifndef FRAMECHANGE_HPP
+#define FRAMECHANGE_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+const int    CHANGE_THUMB_COLS = 32;  /**< Thumbnail size: blocks across and down the frame **/
+const int    CHANGE_THUMB_ROWS = 24;
+const size_t CHANGE_MAX_RUN = 100;    /**< Frames a result is reused at most before a fresh analysis **/
+
+/**
+ * Near-duplicate test for the frames of a static camera, to reuse the
+ * analysis of the previous frame.
+ *
+ * Each gray frame is reduced to a thumbnail of block means (rows summed
+ * 16 pixels at a time with SSE2 SAD when compiled for it), and compared
+ * with the thumbnail of the last frame that was not a duplicate: a frame
+ * is unchanged when the mean absolute difference of the thumbnails is at
+ * most threshold gray levels. The block means average out sensor noise,
+ * and comparing with the reference rather than the previous frame keeps
+ * slow drifts from going unnoticed. After maxRun duplicates in a row the
+ * next frame is reported changed, so results are refreshed regardless.
+ *
+ * Frames must be tested in order, from a single thread.
+ */
+class FrameChangeDetector {
+public:
+    explicit FrameChangeDetector(double threshold, size_t maxRun = CHANGE_MAX_RUN);
+
+    /**
+     * True if frame is a near duplicate of the reference frame; otherwise
+     * frame becomes the reference and false is returned.
+     */
+    bool unchanged(const cv::Mat& frame);
+
+    /** Forget the reference frame: the next frame is changed **/
+    void reset();
+
+    /** Mean absolute difference of the last frame tested, in gray levels (-1 if there was no reference) **/
+    double difference() const { return difference_; }
+    double threshold() const { return threshold_; }
+
+private:
+    void thumbnail(const cv::Mat& frame, std::vector<float>& thumb);
+
+    double threshold_;
+    size_t maxRun_;
+    size_t run_;                    ///< Duplicates since the reference
+    double difference_;
+    cv::Size size_;                 ///< Of the reference frame
+    std::vector<float> reference_;  ///< Thumbnail of the reference frame, empty if none
+    std::vector<float> current_;
+    std::vector<unsigned int> sums_;   ///< Per 16-pixel chunk of a block row
+};
+
+#endif  // FRAMECHANGE_HPP
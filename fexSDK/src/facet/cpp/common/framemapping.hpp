@@ -0,0 +1,61 @@
+#ifndef FRAMEMAPPING_HPP
+#define FRAMEMAPPING_HPP
+
+#include <opencv2/opencv.hpp>
+
+/**
+ * Maps the coordinates of an analyzed frame back to the video frame (or
+ * image) it was produced from, when it was scaled (-q, -r) or cropped
+ * (-roi): x in the original frame is x * scaleX + dx.
+ */
+struct FrameMapping {
+    FrameMapping() : scaleX(1), scaleY(1), dx(0), dy(0), rows(0), cols(0) {}
+
+    double scaleX;          ///< Original pixels per analyzed pixel
+    double scaleY;
+    double dx;              ///< Position of the analyzed region in the original frame
+    double dy;
+    int rows;               ///< Size of the original frame, 0 when it is the analyzed size
+    int cols;
+
+    float x(float value) const { return (float)(value * scaleX + dx); }
+    float y(float value) const { return (float)(value * scaleY + dy); }
+    float width(float value) const { return (float)(value * scaleX); }
+    float height(float value) const { return (float)(value * scaleY); }
+
+    int frameRows(int analyzedRows) const { return rows > 0 ? rows : analyzedRows; }
+    int frameCols(int analyzedCols) const { return cols > 0 ? cols : analyzedCols; }
+
+    /** True when coordinates are unchanged **/
+    bool identity() const { return scaleX == 1 && scaleY == 1 && dx == 0 && dy == 0; }
+
+    /**
+     * The mapping of the region of the analyzed frame at (x, y), when only
+     * that region was analyzed.
+     */
+    FrameMapping region(int x, int y) const
+    {
+        FrameMapping mapping(*this);
+        mapping.dx += x * scaleX;
+        mapping.dy += y * scaleY;
+        return mapping;
+    }
+};
+
+/**
+ * The mapping of frames of size analyzed resized from frames of size
+ * original.
+ */
+inline FrameMapping scaledMapping(const cv::Size& original, const cv::Size& analyzed)
+{
+    FrameMapping mapping;
+    if (analyzed.width > 0 && analyzed.height > 0) {
+        mapping.scaleX = (double)original.width / analyzed.width;
+        mapping.scaleY = (double)original.height / analyzed.height;
+    }
+    mapping.rows = original.height;
+    mapping.cols = original.width;
+    return mapping;
+}
+
+#endif  // FRAMEMAPPING_HPP
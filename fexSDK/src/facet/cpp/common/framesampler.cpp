@@ -0,0 +1,72 @@
+#include "framesampler.hpp"
+#include <math.h>
+
+const double DEFAULT_FPS = 30.0; /**< Used when the container does not report a frame rate **/
+
+FrameSampler::FrameSampler(LumaSource& source, double samplesPerSec, double maxGrabGap)
+: source_(source), samplesPerSec_(samplesPerSec), maxGrabGap_(maxGrabGap),
+  fps_(source.fps()), startTime_(0), timestamp_(0), grabTime_(0),
+  position_(-1), framenum_(0), numSampled_(0), numGrabbed_(0), numSeeks_(0), started_(false), seekable_(true)
+{
+    if (fps_ <= 0) {
+        fps_ = DEFAULT_FPS;
+    }
+    // Sampling faster than the video frame rate just means every frame
+    if (samplesPerSec_ <= 0 || samplesPerSec_ > fps_) {
+        samplesPerSec_ = fps_;
+    }
+}
+
+bool FrameSampler::grab()
+{
+    if (!source_.grab()) {
+        return false;
+    }
+    numGrabbed_++;
+    position_++;
+    // Some backends do not report timestamps: fall back on the frame count
+    double videoTime = source_.timestamp();
+    if (videoTime <= 0 && position_ > 0) {
+        videoTime = position_ / fps_;
+    }
+    grabTime_ = videoTime;
+    return true;
+}
+
+bool FrameSampler::next(LumaFrame& frame)
+{
+    if (!started_) {
+        if (!grab()) {
+            return false;
+        }
+        startTime_ = grabTime_;
+        started_ = true;
+    } else {
+        double target = startTime_ + numSampled_ / samplesPerSec_;
+        // Accept a frame within half a frame of the target time
+        double halfFrame = 0.5 / fps_;
+        if (seekable_ && target - grabTime_ > maxGrabGap_) {
+            // Far away: let the decoder restart from the keyframe before the target
+            if (source_.seek(target)) {
+                position_ = (long)floor(target * fps_ + 0.5) - 1;
+                numSeeks_++;
+            } else {
+                // The decoder stays where it was: grab up to the target, now and from now on
+                seekable_ = false;
+            }
+        }
+        do {
+            if (!grab()) {
+                return false;
+            }
+        } while (grabTime_ + halfFrame < target);
+    }
+
+    if (!source_.retrieve(frame)) {
+        return false;
+    }
+    framenum_ = (size_t)position_;
+    timestamp_ = grabTime_;
+    numSampled_++;
+    return true;
+}
@@ -0,0 +1,61 @@
+#ifndef FRAMESAMPLER_HPP
+#define FRAMESAMPLER_HPP
+
+#include "lumasource.hpp"
+
+/**
+ * Samples a video at a reduced rate without seeking on every sample.
+ *
+ * Samples are chosen by presentation timestamp: sample k is the first frame
+ * whose timestamp reaches start + k / samplesPerSec. Frames between samples
+ * are skipped with grab() only (no luma plane is produced for them), and the
+ * capture is only repositioned when the next sample is more than maxGrabGap
+ * seconds ahead, so long-GOP video is not re-decoded from a keyframe for
+ * every sample. If a seek fails, the rest of the video is grabbed frame by
+ * frame, so frame numbers stay right.
+ */
+class FrameSampler {
+public:
+    /**
+     * \param source an opened video, positioned at the first frame
+     * \param samplesPerSec desired sampling rate in frames per second
+     * \param maxGrabGap gaps (in seconds) above this are crossed with a seek
+     */
+    FrameSampler(LumaSource& source, double samplesPerSec, double maxGrabGap);
+
+    /**
+     * Retrieve the next sampled frame; returns false at the end of the video.
+     */
+    bool next(LumaFrame& frame);
+
+    /** 0-based frame number of the last sampled frame **/
+    size_t frameNumber() const { return framenum_; }
+    /** Presentation timestamp of the last sampled frame, in seconds **/
+    double timestamp() const { return timestamp_; }
+    /** Number of frames sampled so far **/
+    size_t numSampled() const { return numSampled_; }
+    /** Number of frames decoded with grab() so far **/
+    size_t numGrabbed() const { return numGrabbed_; }
+    /** Number of seeks so far **/
+    size_t numSeeks() const { return numSeeks_; }
+
+private:
+    bool grab();
+
+    LumaSource& source_;
+    double samplesPerSec_;
+    double maxGrabGap_;
+    double fps_;
+    double startTime_;
+    double timestamp_;
+    double grabTime_;
+    long position_;
+    size_t framenum_;
+    size_t numSampled_;
+    size_t numGrabbed_;
+    size_t numSeeks_;
+    bool started_;
+    bool seekable_;     ///< False after a failed seek
+};
+
+#endif  // FRAMESAMPLER_HPP
@@ -0,0 +1,225 @@
+#include "grayresize.hpp"
+#include <math.h>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Gray = (29 B + 150 G + 77 R) / 256; the sum of the weights is 256
+const unsigned short GRAY_B = 29;
+const unsigned short GRAY_G = 150;
+const unsigned short GRAY_R = 77;
+const float GRAY_SCALE = 1.0f / 256.0f;
+const float MIN_AREA_WEIGHT = 1e-6f;
+
+GrayResizer::GrayResizer()
+: srcRows_(0), srcCols_(0), channels_(0), dstRows_(0), dstCols_(0), cachedRow_(-1)
+{
+}
+
+bool GrayResizer::matches(int srcRows, int srcCols, int channels, int dstRows, int dstCols) const
+{
+    return srcRows == srcRows_ && srcCols == srcCols_ && channels == channels_ &&
+           dstRows == dstRows_ && dstCols == dstCols_;
+}
+
+/**
+ * Area weights: output pixel d covers source interval [d*scale, (d+1)*scale),
+ * and each source pixel weighs by its overlap with that interval.
+ */
+void GrayResizer::areaTable(int srcSize, int dstSize, std::vector<int>& start,
+                            std::vector<int>& ofs, std::vector<float>& alpha)
+{
+    double scale = (double)srcSize / dstSize;
+    start.assign(dstSize + 1, 0);
+    ofs.clear();
+    alpha.clear();
+    for (int d = 0; d < dstSize; d++) {
+        double f0 = d * scale;
+        double f1 = (d + 1) * scale;
+        start[d] = (int)ofs.size();
+        int s1 = std::min((int)ceil(f1), srcSize);
+        for (int s = (int)floor(f0); s < s1; s++) {
+            double overlap = std::min((double)s + 1, f1) - std::max((double)s, f0);
+            float weight = (float)(overlap / scale);
+            if (weight > MIN_AREA_WEIGHT) {
+                ofs.push_back(s);
+                alpha.push_back(weight);
+            }
+        }
+    }
+    start[dstSize] = (int)ofs.size();
+}
+
+void GrayResizer::init(int srcRows, int srcCols, int channels, int dstRows, int dstCols)
+{
+    srcRows_ = srcRows;
+    srcCols_ = srcCols;
+    channels_ = channels;
+    dstRows_ = dstRows;
+    dstCols_ = dstCols;
+    areaTable(srcCols, dstCols, xstart_, xofs_, xalpha_);
+    areaTable(srcRows, dstRows, ystart_, yofs_, yalpha_);
+    grayRow_.assign(srcCols + 32, 0);  // padded for the vector loops
+    colAcc_.assign(srcCols + 32, 0);
+    cachedRow_ = -1;
+}
+
+/**
+ * Convert one source row to gray * 256.
+ */
+void GrayResizer::convertRow(const unsigned char* src)
+{
+    unsigned short* gray = &grayRow_[0];
+    int x = 0;
+    if (channels_ == 3) {
+#if defined(__SSSE3__)
+        const __m128i bMask0 = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i bMask1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+        const __m128i bMask2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+        const __m128i gMask0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i gMask1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+        const __m128i gMask2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+        const __m128i rMask0 = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+        const __m128i rMask1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+        const __m128i rMask2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+#if defined(__AVX2__)
+        const __m256i wb = _mm256_set1_epi16(GRAY_B);
+        const __m256i wg = _mm256_set1_epi16(GRAY_G);
+        const __m256i wr = _mm256_set1_epi16(GRAY_R);
+#else
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i wb = _mm_set1_epi16(GRAY_B);
+        const __m128i wg = _mm_set1_epi16(GRAY_G);
+        const __m128i wr = _mm_set1_epi16(GRAY_R);
+#endif
+        for (; x + 16 <= srcCols_; x += 16) {
+            // Deinterleave 16 BGR pixels
+            const unsigned char* p = src + 3 * x;
+            __m128i a = _mm_loadu_si128((const __m128i*)p);
+            __m128i b = _mm_loadu_si128((const __m128i*)(p + 16));
+            __m128i c = _mm_loadu_si128((const __m128i*)(p + 32));
+            __m128i B = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, bMask0), _mm_shuffle_epi8(b, bMask1)), _mm_shuffle_epi8(c, bMask2));
+            __m128i G = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, gMask0), _mm_shuffle_epi8(b, gMask1)), _mm_shuffle_epi8(c, gMask2));
+            __m128i R = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, rMask0), _mm_shuffle_epi8(b, rMask1)), _mm_shuffle_epi8(c, rMask2));
+#if defined(__AVX2__)
+            __m256i g16 = _mm256_add_epi16(_mm256_add_epi16(
+                              _mm256_mullo_epi16(_mm256_cvtepu8_epi16(B), wb),
+                              _mm256_mullo_epi16(_mm256_cvtepu8_epi16(G), wg)),
+                              _mm256_mullo_epi16(_mm256_cvtepu8_epi16(R), wr));
+            _mm256_storeu_si256((__m256i*)(gray + x), g16);
+#else
+            __m128i lo = _mm_add_epi16(_mm_add_epi16(
+                             _mm_mullo_epi16(_mm_unpacklo_epi8(B, zero), wb),
+                             _mm_mullo_epi16(_mm_unpacklo_epi8(G, zero), wg)),
+                             _mm_mullo_epi16(_mm_unpacklo_epi8(R, zero), wr));
+            __m128i hi = _mm_add_epi16(_mm_add_epi16(
+                             _mm_mullo_epi16(_mm_unpackhi_epi8(B, zero), wb),
+                             _mm_mullo_epi16(_mm_unpackhi_epi8(G, zero), wg)),
+                             _mm_mullo_epi16(_mm_unpackhi_epi8(R, zero), wr));
+            _mm_storeu_si128((__m128i*)(gray + x), lo);
+            _mm_storeu_si128((__m128i*)(gray + x + 8), hi);
+#endif
+        }
+#endif  // __SSSE3__
+        for (; x < srcCols_; x++) {
+            const unsigned char* p = src + 3 * x;
+            gray[x] = (unsigned short)(GRAY_B * p[0] + GRAY_G * p[1] + GRAY_R * p[2]);
+        }
+    } else {
+#if defined(__SSSE3__)
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 16 <= srcCols_; x += 16) {
+            // v << 8: put the pixel in the high byte
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+            _mm_storeu_si128((__m128i*)(gray + x), _mm_unpacklo_epi8(zero, v));
+            _mm_storeu_si128((__m128i*)(gray + x + 8), _mm_unpackhi_epi8(zero, v));
+        }
+#endif
+        for (; x < srcCols_; x++) {
+            gray[x] = (unsigned short)(src[x] << 8);
+        }
+    }
+}
+
+/**
+ * Add weight * gray row to the column accumulator.
+ */
+void GrayResizer::accumulateRow(float weight)
+{
+    const unsigned short* gray = &grayRow_[0];
+    float* acc = &colAcc_[0];
+    int x = 0;
+#if defined(__AVX2__)
+    __m256 w8 = _mm256_set1_ps(weight);
+    for (; x + 8 <= srcCols_; x += 8) {
+        __m256 g = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(gray + x))));
+        _mm256_storeu_ps(acc + x, _mm256_add_ps(_mm256_loadu_ps(acc + x), _mm256_mul_ps(w8, g)));
+    }
+#elif defined(__SSSE3__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128 w4 = _mm_set1_ps(weight);
+    for (; x + 8 <= srcCols_; x += 8) {
+        __m128i g16 = _mm_loadu_si128((const __m128i*)(gray + x));
+        __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(g16, zero));
+        __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(g16, zero));
+        _mm_storeu_ps(acc + x, _mm_add_ps(_mm_loadu_ps(acc + x), _mm_mul_ps(w4, lo)));
+        _mm_storeu_ps(acc + x + 4, _mm_add_ps(_mm_loadu_ps(acc + x + 4), _mm_mul_ps(w4, hi)));
+    }
+#endif
+    for (; x < srcCols_; x++) {
+        acc[x] += weight * (float)gray[x];
+    }
+}
+
+/**
+ * Resample the column accumulator horizontally into one output row.
+ */
+void GrayResizer::resampleRow(unsigned char* out, const unsigned char* lut)
+{
+    const float* acc = &colAcc_[0];
+    const int* ofs = &xofs_[0];
+    const float* alpha = &xalpha_[0];
+    for (int x = 0; x < dstCols_; x++) {
+        float sum = 0;
+        for (int k = xstart_[x]; k < xstart_[x + 1]; k++) {
+            sum += acc[ofs[k]] * alpha[k];
+        }
+        int v = (int)(sum * GRAY_SCALE + 0.5f);
+        v = v < 0 ? 0 : (v > 255 ? 255 : v);
+        out[x] = lut ? lut[v] : (unsigned char)v;
+    }
+}
+
+void GrayResizer::resize(const unsigned char* src, size_t srcStep, unsigned char* dst, size_t dstStep,
+                         const unsigned char* lut)
+{
+    cachedRow_ = -1;
+    for (int y = 0; y < dstRows_; y++) {
+        // Vertical pass first: output rows are much cheaper to resample than source rows
+        std::fill(colAcc_.begin(), colAcc_.end(), 0.0f);
+        for (int k = ystart_[y]; k < ystart_[y + 1]; k++) {
+            // The boundary source row is shared with the previous output row
+            int row = yofs_[k];
+            if (row != cachedRow_) {
+                convertRow(src + (size_t)row * srcStep);
+                cachedRow_ = row;
+            }
+            accumulateRow(yalpha_[k]);
+        }
+        resampleRow(dst + (size_t)y * dstStep, lut);
+    }
+}
+
+void grayResize(const cv::Mat& src, cv::Mat& dst, const cv::Size& dsize, GrayResizer& resizer)
+{
+    int channels = src.channels();
+    if (!resizer.matches(src.rows, src.cols, channels, dsize.height, dsize.width)) {
+        resizer.init(src.rows, src.cols, channels, dsize.height, dsize.width);
+    }
+    dst.create(dsize, CV_8UC1);
+    resizer.resize(src.data, src.step, dst.data, dst.step);
+}
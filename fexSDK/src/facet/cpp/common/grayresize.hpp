@@ -0,0 +1,72 @@
+#ifndef GRAYRESIZE_HPP
+#define GRAYRESIZE_HPP
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/**
+ * Single-pass BGR (or gray) -> gray conversion and area resize.
+ *
+ * Each source row is converted to gray once and accumulated, with its
+ * area weight, into the output rows it overlaps (SSSE3/AVX2 when compiled
+ * for them, scalar otherwise); each output row is then resampled
+ * horizontally with precomputed area weights. Scale factors need not be
+ * integers, and no full-size gray or resized BGR image is ever allocated.
+ *
+ * Gray uses 8-bit fixed-point weights (B 29, G 150, R 77) and keeps the
+ * fractional part until the final rounding; all code paths produce
+ * identical results.
+ */
+class GrayResizer {
+public:
+    GrayResizer();
+
+    /**
+     * Precompute the area tables.
+     * \param srcRows, srcCols size of the input image
+     * \param channels 1 (gray) or 3 (BGR)
+     * \param dstRows, dstCols size of the output image
+     */
+    void init(int srcRows, int srcCols, int channels, int dstRows, int dstCols);
+
+    /**
+     * True if init() was called with these arguments.
+     */
+    bool matches(int srcRows, int srcCols, int channels, int dstRows, int dstCols) const;
+
+    /**
+     * Convert and resize one image.
+     * \param src first input row; rows are srcStep bytes apart
+     * \param dst first output row; rows are dstStep bytes apart
+     * \param lut optional 256-entry table applied to the output pixels
+     */
+    void resize(const unsigned char* src, size_t srcStep, unsigned char* dst, size_t dstStep,
+                const unsigned char* lut = 0);
+
+    int dstRows() const { return dstRows_; }
+    int dstCols() const { return dstCols_; }
+
+private:
+    static void areaTable(int srcSize, int dstSize, std::vector<int>& start,
+                          std::vector<int>& ofs, std::vector<float>& alpha);
+    void convertRow(const unsigned char* src);
+    void accumulateRow(float weight);
+    void resampleRow(unsigned char* out, const unsigned char* lut);
+
+    int srcRows_, srcCols_, channels_, dstRows_, dstCols_;
+    std::vector<int> xstart_, xofs_;     ///< Per output column: range into xofs_/xalpha_
+    std::vector<float> xalpha_;
+    std::vector<int> ystart_, yofs_;     ///< Per output row: range into yofs_/yalpha_
+    std::vector<float> yalpha_;
+    std::vector<unsigned short> grayRow_;  ///< Source row, gray * 256
+    std::vector<float> colAcc_;            ///< Weighted sum of source rows, srcCols_ wide
+    int cachedRow_;                        ///< Source row held in grayRow_
+};
+
+/**
+ * Convert src (BGR or gray) to a dsize gray image in one pass.
+ * resizer is (re)initialized when the geometry changes.
+ */
+void grayResize(const cv::Mat& src, cv::Mat& dst, const cv::Size& dsize, GrayResizer& resizer);
+
+#endif  // GRAYRESIZE_HPP
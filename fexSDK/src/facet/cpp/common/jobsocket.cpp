@@ -0,0 +1,402 @@
+#include "jobsocket.hpp"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <iostream>
+#include <list>
+#include "threads.hpp"
+
+const size_t FRAME_HEADER = 5;          /**< Type byte and 4 bytes length **/
+const size_t OUTPUT_BUFFER = 1 << 16;   /**< Bytes of output per frame **/
+const size_t INPUT_BUFFER = 1 << 16;
+const int ACCEPT_POLL_MS = 500;         /**< How often serveJobs() checks stopServing() **/
+const int LISTEN_BACKLOG = 16;
+
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;   // SIGPIPE is ignored by the daemon and the client
+#endif
+
+static volatile sig_atomic_t stopRequested = 0;
+
+std::string defaultSocketPath()
+{
+    const char* path = getenv("FEX_SOCKET");
+    if (path != 0 && path[0] != '\0') {
+        return path;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "/tmp/fexfacetd-%u.sock", (unsigned)getuid());
+    return name;
+}
+
+/**
+ * Send size bytes, retrying partial writes. Returns false on error.
+ */
+static bool sendAll(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, SEND_FLAGS);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool sendFrame(int fd, char type, const char* data, size_t size)
+{
+    unsigned char header[FRAME_HEADER];
+    header[0] = type;
+    header[1] = (size >> 24) & 0xff;
+    header[2] = (size >> 16) & 0xff;
+    header[3] = (size >> 8) & 0xff;
+    header[4] = size & 0xff;
+    return sendAll(fd, reinterpret_cast<char*>(header), FRAME_HEADER) && sendAll(fd, data, size);
+}
+
+static bool writeAll(int fd, const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+/**
+ * Fill the address of a socket path. Returns false if the path is too long.
+ */
+static bool socketAddress(const std::string& path, sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    strcpy(address.sun_path, path.c_str());
+    return true;
+}
+
+std::string resolvePath(const std::string& workingDir, const std::string& path)
+{
+    if (path.empty() || path[0] == '/' || workingDir.empty()) {
+        return path;
+    }
+    return workingDir + "/" + path;
+}
+
+/** Start JobOutputBuf / FdInputBuf +++++++++++++++++++++++++++++++++++++ **/
+
+JobOutputBuf::JobOutputBuf(int fd)
+: fd_(fd), buffer_(OUTPUT_BUFFER), ok_(true)
+{
+    setp(&buffer_[0], &buffer_[0] + buffer_.size());
+}
+
+JobOutputBuf::~JobOutputBuf()
+{
+    sync();
+}
+
+int JobOutputBuf::overflow(int c)
+{
+    sync();
+    if (c != traits_type::eof()) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int JobOutputBuf::sync()
+{
+    size_t size = pptr() - pbase();
+    if (size > 0 && ok_) {
+        ok_ = sendFrame(fd_, JOB_OUTPUT, pbase(), size);
+    }
+    setp(&buffer_[0], &buffer_[0] + buffer_.size());
+    return 0;
+}
+
+FdInputBuf::FdInputBuf(int fd)
+: fd_(fd), buffer_(INPUT_BUFFER)
+{
+    setg(&buffer_[0], &buffer_[0], &buffer_[0]);
+}
+
+int FdInputBuf::underflow()
+{
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    ssize_t n;
+    do {
+        n = read(fd_, &buffer_[0], buffer_.size());
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return traits_type::eof();
+    }
+    setg(&buffer_[0], &buffer_[0], &buffer_[0] + n);
+    return traits_type::to_int_type(*gptr());
+}
+
+/** Start Server ++++++++++++++++++++++++++++++++++++++++++++++++++++++++ **/
+
+/**
+ * Reads the job of a connection, runs it and sends back its exit status.
+ */
+class Connection : public Thread {
+public:
+    Connection(int fd, JobHandler& handler) : fd_(fd), handler_(handler), done_(false) {}
+    ~Connection() { join(); }
+
+    bool done()
+    {
+        ScopedLock lock(mutex_);
+        return done_;
+    }
+
+protected:
+    void run()
+    {
+        FdInputBuf inbuf(fd_);
+        std::istream in(&inbuf);
+        std::string workingDir;
+        std::getline(in, workingDir);
+        std::vector<std::string> args;
+        std::string line;
+        while (std::getline(in, line) && !line.empty()) {
+            args.push_back(line);
+        }
+        int status(-1);
+        {
+            JobOutputBuf outbuf(fd_);
+            std::ostream out(&outbuf);
+            if (args.empty()) {
+                out << "Empty job" << std::endl;
+            } else {
+                status = handler_.run(workingDir, args, in, out);
+            }
+            out.flush();
+        }
+        char text[16];
+        snprintf(text, sizeof(text), "%d", status);
+        sendFrame(fd_, JOB_STATUS, text, strlen(text));
+
+        // Let the client read the status before closing: closing with unread
+        // input would reset the connection
+        shutdown(fd_, SHUT_WR);
+        while (in.ignore(INPUT_BUFFER)) {
+        }
+        close(fd_);
+
+        ScopedLock lock(mutex_);
+        done_ = true;
+    }
+
+private:
+    int fd_;
+    JobHandler& handler_;
+    Mutex mutex_;
+    bool done_;
+};
+
+void stopServing()
+{
+    stopRequested = 1;
+}
+
+int serveJobs(const std::string& socketPath, JobHandler& handler)
+{
+    sockaddr_un address;
+    if (!socketAddress(socketPath, address)) {
+        std::cout << "Socket path too long: " << socketPath << std::endl;
+        return -1;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::cout << "Could not create a socket: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    // A leftover socket file is removed, unless a daemon still answers on it
+    if (connect(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+        std::cout << "A daemon is already listening on " << socketPath << std::endl;
+        close(listener);
+        return -1;
+    }
+    close(listener);
+    unlink(socketPath.c_str());
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t mask = umask(0077);  // Jobs read and write files as the daemon's user
+    int bound = bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    umask(mask);
+    if (bound != 0 || listen(listener, LISTEN_BACKLOG) != 0) {
+        std::cout << "Could not listen on " << socketPath << ": " << strerror(errno) << std::endl;
+        close(listener);
+        return -1;
+    }
+
+    std::list<Connection*> connections;
+    while (!stopRequested) {
+        pollfd pfd;
+        pfd.fd = listener;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, ACCEPT_POLL_MS) > 0) {
+            int fd = accept(listener, 0, 0);
+            if (fd >= 0) {
+                Connection* connection = new Connection(fd, handler);
+                if (connection->start()) {
+                    connections.push_back(connection);
+                } else {
+                    close(fd);
+                    delete connection;
+                }
+            }
+        }
+        for (std::list<Connection*>::iterator it = connections.begin(); it != connections.end();) {
+            if ((*it)->done()) {
+                delete *it;
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    close(listener);
+    unlink(socketPath.c_str());
+    for (std::list<Connection*>::iterator it = connections.begin(); it != connections.end(); ++it) {
+        delete *it;
+    }
+    return 0;
+}
+
+/** Start Client ++++++++++++++++++++++++++++++++++++++++++++++++++++++++ **/
+
+bool runRemoteJob(const std::string& socketPath, const std::string& workingDir,
+                  const std::vector<std::string>& args, int inFd, int outFd, int& status)
+{
+    sockaddr_un address;
+    if (!socketAddress(socketPath, address)) {
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return false;
+    }
+
+    std::string pending = workingDir + "\n";
+    for (size_t i = 0; i < args.size(); i++) {
+        pending += args[i] + "\n";
+    }
+    pending += "\n";
+
+    // Input and output are interleaved with poll(): the daemon may have to
+    // send rows before it reads more of the image list
+    std::string received;
+    std::vector<char> buffer(INPUT_BUFFER);
+    bool inputOpen(inFd >= 0);
+    bool sendOpen(true);
+    bool finished(false);
+    while (!finished) {
+        if (sendOpen && pending.empty() && !inputOpen) {
+            shutdown(fd, SHUT_WR);
+            sendOpen = false;
+        }
+        pollfd pfds[2];
+        nfds_t nfds(1);
+        pfds[0].fd = fd;
+        pfds[0].events = POLLIN | (pending.empty() ? 0 : POLLOUT);
+        pfds[0].revents = 0;
+        if (inputOpen && pending.empty()) {
+            pfds[1].fd = inFd;
+            pfds[1].events = POLLIN;
+            pfds[1].revents = 0;
+            nfds = 2;
+        }
+        if (poll(pfds, nfds, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(fd, &buffer[0], buffer.size());
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;  // Closed without a status
+            }
+            received.append(&buffer[0], n);
+            size_t used(0);
+            while (received.size() - used >= FRAME_HEADER) {
+                const unsigned char* header = reinterpret_cast<const unsigned char*>(received.data() + used);
+                size_t size = ((size_t)header[1] << 24) | (header[2] << 16) | (header[3] << 8) | header[4];
+                if (received.size() - used < FRAME_HEADER + size) {
+                    break;
+                }
+                const char* data = received.data() + used + FRAME_HEADER;
+                if (header[0] == JOB_OUTPUT) {
+                    writeAll(outFd, data, size);
+                } else if (header[0] == JOB_STATUS) {
+                    status = atoi(std::string(data, size).c_str());
+                    finished = true;
+                }
+                used += FRAME_HEADER + size;
+            }
+            received.erase(0, used);
+            if (finished) {
+                break;
+            }
+        }
+        // Never block on a full socket: the daemon may be waiting for us to read
+        if (!pending.empty() && (pfds[0].revents & POLLOUT)) {
+            ssize_t n = send(fd, pending.data(), pending.size(), SEND_FLAGS | MSG_DONTWAIT);
+            if (n > 0) {
+                pending.erase(0, n);
+            } else if (n < 0 && errno != EINTR && errno != EAGAIN) {
+                pending.clear();    // The daemon stopped reading; wait for its status
+                inputOpen = false;
+            }
+        }
+        if (nfds == 2 && (pfds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+            ssize_t n = read(inFd, &buffer[0], buffer.size());
+            if (n > 0) {
+                pending.assign(&buffer[0], n);
+            } else if (n == 0 || errno != EINTR) {
+                inputOpen = false;
+            }
+        }
+    }
+    close(fd);
+    return finished;
+}
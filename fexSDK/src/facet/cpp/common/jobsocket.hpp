@@ -0,0 +1,117 @@
+#ifndef JOBSOCKET_HPP
+#define JOBSOCKET_HPP
+
+#include <iosfwd>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/**
+ * Local protocol between fexclient and the analyzer daemon, over a Unix
+ * socket:
+ *
+ *  - the client sends its working directory and the job, the command
+ *    line of a driver (e.g. "fexfacet_full -o out.fexb"), one line each
+ *    and ended by an empty line; then it streams its standard input (the
+ *    image list of the image drivers) and shuts down its sending side;
+ *  - the daemon answers with frames made of a type byte and a 4 bytes
+ *    length (network order): JOB_OUTPUT frames carry the standard output
+ *    of the job, and the last frame, JOB_STATUS, its exit status as text.
+ */
+const char JOB_OUTPUT = 'o';
+const char JOB_STATUS = 's';
+
+/**
+ * The socket of the daemon: $FEX_SOCKET, or /tmp/fexfacetd-UID.sock.
+ */
+std::string defaultSocketPath();
+
+/**
+ * Output stream buffer sending JOB_OUTPUT frames. Writing stops (silently)
+ * once the client is gone, so a job always runs to completion.
+ */
+class JobOutputBuf : public std::streambuf {
+public:
+    explicit JobOutputBuf(int fd);
+    ~JobOutputBuf();
+
+    /** false once a frame could not be sent **/
+    bool ok() const { return ok_; }
+
+protected:
+    int overflow(int c);
+    int sync();
+
+private:
+    JobOutputBuf(const JobOutputBuf&);
+    JobOutputBuf& operator=(const JobOutputBuf&);
+
+    int fd_;
+    std::vector<char> buffer_;
+    bool ok_;
+};
+
+/**
+ * Input stream buffer reading a socket (or any file descriptor).
+ */
+class FdInputBuf : public std::streambuf {
+public:
+    explicit FdInputBuf(int fd);
+
+protected:
+    int underflow();
+
+private:
+    FdInputBuf(const FdInputBuf&);
+    FdInputBuf& operator=(const FdInputBuf&);
+
+    int fd_;
+    std::vector<char> buffer_;
+};
+
+/**
+ * Runs the jobs of the daemon. run() is called on one thread per client,
+ * so several jobs run at the same time.
+ */
+class JobHandler {
+public:
+    virtual ~JobHandler() {}
+    /**
+     * \param workingDir working directory of the client (see resolvePath)
+     * \param args the command line of the job, args[0] the driver name
+     * \param in the standard input of the client
+     * \param out sent to the standard output of the client
+     * \return the exit status of the job
+     */
+    virtual int run(const std::string& workingDir, const std::vector<std::string>& args,
+                    std::istream& in, std::ostream& out) = 0;
+};
+
+/**
+ * path relative to workingDir, unless it is absolute (or empty).
+ */
+std::string resolvePath(const std::string& workingDir, const std::string& path);
+
+/**
+ * Listen on socketPath and run the job of each connection on its own
+ * thread, until stopServing(). Returns 0, or -1 if the socket cannot be
+ * created (e.g. another daemon is listening on it).
+ */
+int serveJobs(const std::string& socketPath, JobHandler& handler);
+
+/**
+ * Make serveJobs() return once the running jobs are done. Safe to call
+ * from a signal handler.
+ */
+void stopServing();
+
+/**
+ * Run a job on the daemon listening on socketPath, forwarding inFd (if not
+ * negative) to its standard input and its standard output to outFd. Sets
+ * status to the exit status of the job; returns false if the daemon cannot
+ * be reached or closed the connection before the job ended.
+ */
+bool runRemoteJob(const std::string& socketPath, const std::string& workingDir,
+                  const std::vector<std::string>& args, int inFd, int outFd, int& status);
+
+#endif  // JOBSOCKET_HPP
@@ -0,0 +1,167 @@
+#include "jsonframes.hpp"
+#include <algorithm>
+#include <cctype>
+#include <limits>
+
+JsonFrameReader::JsonFrameReader()
+: rows_(std::numeric_limits<double>::quiet_NaN()), cols_(std::numeric_limits<double>::quiet_NaN()),
+  numTracks_(0), inFrame_(false), schemaFrozen_(false), timeColumn_(-1), nextColumn_(0), numIgnored_(0)
+{
+}
+
+void JsonFrameReader::startObject()
+{
+    // output.tracks[].frames[] holds the frames
+    if (path_.size() == 5 && path_[0] == "output" && path_[1] == "tracks" && path_[3] == "frames") {
+        inFrame_ = true;
+        nextColumn_ = 0;
+        std::fill(values_.begin(), values_.end(), std::numeric_limits<double>::quiet_NaN());
+    } else if (path_.size() == 3 && path_[0] == "output" && path_[1] == "tracks") {
+        numTracks_++;
+    }
+    path_.push_back("");
+}
+
+void JsonFrameReader::endObject()
+{
+    path_.pop_back();
+    if (inFrame_ && path_.size() == 5) {
+        inFrame_ = false;
+        endFrame();
+    }
+}
+
+void JsonFrameReader::number(double value)
+{
+    if (inFrame_) {
+        frameValue(value);
+    } else if (path_.size() == 3 && path_[0] == "output") {
+        if (path_[1] == "frametimes") {
+            frameTimes_.push_back(value);
+        } else if (path_[1] == "resolution") {
+            if (path_[2] == "height") rows_ = value;
+            if (path_[2] == "width") cols_ = value;
+        }
+    }
+}
+
+void JsonFrameReader::boolean(bool value)
+{
+    if (inFrame_) {
+        frameValue(value ? 1.0 : 0.0);
+    }
+}
+
+void JsonFrameReader::freezeColumns()
+{
+    if (schemaFrozen_) {
+        return;
+    }
+    schemaFrozen_ = true;
+    if (timeColumn_ < 0) {
+        // No frame with a face: the time column still exists
+        columns_["timestamp"] = (int)paths_.size();
+        timeColumn_ = (int)paths_.size();
+        paths_.push_back("timestamp");
+        names_.push_back("timestamp");
+        classes_.push_back("frame");
+        values_.push_back(std::numeric_limits<double>::quiet_NaN());
+    }
+}
+
+/**
+ * Flattened name of the current frame value, e.g. "landmarks.nose_tip.x".
+ */
+std::string JsonFrameReader::framePath() const
+{
+    std::string p(path_[5]);
+    for (size_t i = 6; i < path_.size(); i++) {
+        p += '.';
+        p += path_[i];
+    }
+    return p;
+}
+
+void JsonFrameReader::frameValue(double value)
+{
+    if (path_.size() < 6) {
+        return;
+    }
+    // Frames list their values in the same order: try the next column first
+    std::string p = framePath();
+    int column(-1);
+    if (nextColumn_ < paths_.size() && paths_[nextColumn_] == p) {
+        column = (int)nextColumn_;
+    } else {
+        std::map<std::string, int>::const_iterator it = columns_.find(p);
+        if (it != columns_.end()) {
+            column = it->second;
+        } else if (!schemaFrozen_) {
+            column = addColumn(p);
+        } else {
+            numIgnored_++;
+            return;
+        }
+    }
+    values_[column] = value;
+    nextColumn_ = column + 1;
+}
+
+int JsonFrameReader::addColumn(const std::string& p)
+{
+    std::vector<std::string> parts;
+    for (size_t i = 5; i < path_.size(); i++) {
+        parts.push_back(path_[i]);
+    }
+    std::string name, group(parts[0]), channelClass(group);
+    if (parts.size() == 1) {
+        name = parts[0];
+        channelClass = "frame";
+    } else if (group == "face-location") {
+        // x, y, width, height -> FaceBoxX, FaceBoxY, FaceBoxW, FaceBoxH
+        name = "FaceBox";
+        name += (char)toupper(parts[1][0]);
+        channelClass = "face";
+    } else {
+        name = parts[1];
+        for (size_t i = 2; i < parts.size(); i++) {
+            name += "_" + parts[i];
+        }
+        channelClass = channelClassOf(group, parts[1]);
+    }
+    if (name == "timestamp") {
+        timeColumn_ = (int)paths_.size();
+    }
+    columns_[p] = (int)paths_.size();
+    paths_.push_back(p);
+    names_.push_back(name);
+    classes_.push_back(channelClass);
+    values_.push_back(std::numeric_limits<double>::quiet_NaN());
+    return (int)paths_.size() - 1;
+}
+
+/**
+ * Channel class as in shared/fexchannels.txt.
+ */
+std::string JsonFrameReader::channelClassOf(const std::string& group, const std::string& name)
+{
+    if (group == "landmarks") return "land";
+    if (group == "pose") return "pose";
+    if (group == "au-evidence") return "au";
+    if (group == "demographic-evidence") return "demo";
+    if (group == "emotion-evidence") {
+        if (name == "neutral" || name == "negative" || name == "positive") return "sent1";
+        if (name == "confusion" || name == "frustration") return "emo2";
+        return "emo1";
+    }
+    return group;
+}
+
+void JsonFrameReader::endFrame()
+{
+    if (!schemaFrozen_) {
+        freezeColumns();
+        columnsReady();
+    }
+    frame((int)numTracks_ - 1, values_);
+}
@@ -0,0 +1,92 @@
+#ifndef JSONFRAMES_HPP
+#define JSONFRAMES_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include "jsonstream.hpp"
+
+/**
+ * Frames of the .json files written by fexfacetexec, read from the events
+ * of JsonStream: output.tracks[].frames[] hold the frames with a face,
+ * output.frametimes the times of all the frames.
+ *
+ * The columns are taken from the first frame in the file, with the names
+ * and channel classes (shared/fexchannels.txt) of fexjson2dat:
+ *
+ *   timestamp              from each frame ("frame")
+ *   FaceBoxX ... FaceBoxH  from "face-location" ("face")
+ *   <name>                 from "au-evidence", "emotion-evidence",
+ *                          "demographic-evidence" and "pose"
+ *   <landmark>_x, _y       from "landmarks" ("land")
+ *
+ * Values of later frames outside these columns are ignored. Derive and
+ * implement frame() to consume the frames as they are read.
+ */
+class JsonFrameReader : public JsonHandler {
+public:
+    JsonFrameReader();
+
+    void startObject();
+    void endObject();
+    void startArray() { path_.push_back("[]"); }
+    void endArray() { path_.pop_back(); }
+    void key(const std::string& name) { path_.back() = name; }
+    void number(double value);
+    void boolean(bool value);
+
+    size_t numTracks() const { return numTracks_; }
+    size_t numFrames() const { return frameTimes_.size(); }
+    size_t numIgnored() const { return numIgnored_; }
+    const std::vector<double>& frameTimes() const { return frameTimes_; }
+    double frameRows() const { return rows_; }
+    double frameCols() const { return cols_; }
+
+    const std::vector<std::string>& names() const { return names_; }
+    const std::vector<std::string>& classes() const { return classes_; }
+    int timeColumn() const { return timeColumn_; }
+
+protected:
+    /**
+     * Fix the columns: called before the first frame, or by the derived
+     * class at the end of a file without frames. A timestamp column is
+     * added if the first frame has none.
+     */
+    void freezeColumns();
+    bool columnsFrozen() const { return schemaFrozen_; }
+
+    /** The columns are fixed; the first frame follows **/
+    virtual void columnsReady() {}
+
+    /**
+     * A frame of track (0-based) was read: values holds one value per
+     * column, NaN for the values the frame does not have.
+     */
+    virtual void frame(int track, const std::vector<double>& values) = 0;
+
+private:
+    std::string framePath() const;
+    void frameValue(double value);
+    int addColumn(const std::string& p);
+    static std::string channelClassOf(const std::string& group, const std::string& name);
+    void endFrame();
+
+    std::vector<std::string> path_;   ///< Key (or "[]") at each nesting level
+    double rows_;
+    double cols_;
+    std::vector<double> frameTimes_;
+    size_t numTracks_;
+
+    bool inFrame_;
+    bool schemaFrozen_;               ///< Columns are fixed after the first frame
+    std::map<std::string, int> columns_;
+    std::vector<std::string> paths_;
+    std::vector<std::string> names_;
+    std::vector<std::string> classes_;
+    int timeColumn_;
+    size_t nextColumn_;
+    size_t numIgnored_;
+    std::vector<double> values_;
+};
+
+#endif  // JSONFRAMES_HPP
@@ -0,0 +1,361 @@
+#include "jsonstream.hpp"
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+
+const size_t JSON_BUFFER_BYTES = 1 << 20;
+const int MAX_FAST_DIGITS = 18;   /**< Digits that always fit in the integer mantissa **/
+const int MAX_FAST_EXPONENT = 22; /**< 10^22 is the largest exact power of ten in a double **/
+
+static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+JsonStream::JsonStream()
+: file_(0), buffer_(JSON_BUFFER_BYTES), pos_(0), end_(0), consumed_(0)
+{
+}
+
+JsonStream::~JsonStream()
+{
+    if (file_) {
+        fclose(file_);
+    }
+}
+
+bool JsonStream::fill()
+{
+    consumed_ += end_;
+    pos_ = 0;
+    end_ = fread(&buffer_[0], 1, buffer_.size(), file_);
+    return end_ > 0;
+}
+
+inline int JsonStream::peek()
+{
+    if (pos_ == end_ && !fill()) {
+        return EOF;
+    }
+    return (unsigned char)buffer_[pos_];
+}
+
+inline int JsonStream::get()
+{
+    int c = peek();
+    if (c != EOF) {
+        pos_++;
+    }
+    return c;
+}
+
+void JsonStream::skipSpace()
+{
+    while (true) {
+        int c = peek();
+        if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+            return;
+        }
+        pos_++;
+    }
+}
+
+bool JsonStream::fail(const std::string& message)
+{
+    std::ostringstream msg;
+    msg << message << " at byte " << consumed_ + pos_;
+    error_ = msg.str();
+    return false;
+}
+
+bool JsonStream::expect(const char* literal)
+{
+    for (const char* p = literal; *p; p++) {
+        if (get() != *p) {
+            return fail(std::string("Expected ") + literal);
+        }
+    }
+    return true;
+}
+
+bool JsonStream::parse(const std::string& filename, JsonHandler& handler)
+{
+    error_.clear();
+    file_ = fopen(filename.c_str(), "rb");
+    if (file_ == 0) {
+        error_ = "Could not open " + filename;
+        return false;
+    }
+    pos_ = end_ = consumed_ = 0;
+    skipSpace();
+    bool ok = parseValue(handler);
+    if (ok) {
+        skipSpace();
+        if (peek() != EOF) {
+            ok = fail("Unexpected data after the document");
+        }
+    }
+    fclose(file_);
+    file_ = 0;
+    return ok;
+}
+
+bool JsonStream::parseValue(JsonHandler& handler)
+{
+    int c = peek();
+    switch (c) {
+        case '{': {
+            pos_++;
+            handler.startObject();
+            skipSpace();
+            if (peek() == '}') {
+                pos_++;
+                handler.endObject();
+                return true;
+            }
+            while (true) {
+                skipSpace();
+                if (peek() != '"') {
+                    return fail("Expected an object key");
+                }
+                if (!parseString(text_)) {
+                    return false;
+                }
+                handler.key(text_);
+                skipSpace();
+                if (get() != ':') {
+                    return fail("Expected ':'");
+                }
+                skipSpace();
+                if (!parseValue(handler)) {
+                    return false;
+                }
+                skipSpace();
+                c = get();
+                if (c == '}') {
+                    handler.endObject();
+                    return true;
+                }
+                if (c != ',') {
+                    return fail("Expected ',' or '}'");
+                }
+            }
+        }
+        case '[': {
+            pos_++;
+            handler.startArray();
+            skipSpace();
+            if (peek() == ']') {
+                pos_++;
+                handler.endArray();
+                return true;
+            }
+            while (true) {
+                skipSpace();
+                if (!parseValue(handler)) {
+                    return false;
+                }
+                skipSpace();
+                c = get();
+                if (c == ']') {
+                    handler.endArray();
+                    return true;
+                }
+                if (c != ',') {
+                    return fail("Expected ',' or ']'");
+                }
+            }
+        }
+        case '"':
+            if (!parseString(text_)) {
+                return false;
+            }
+            handler.string(text_);
+            return true;
+        case 't':
+            if (!expect("true")) {
+                return false;
+            }
+            handler.boolean(true);
+            return true;
+        case 'f':
+            if (!expect("false")) {
+                return false;
+            }
+            handler.boolean(false);
+            return true;
+        case 'n':
+            if (!expect("null")) {
+                return false;
+            }
+            handler.null();
+            return true;
+        case EOF:
+            return fail("Unexpected end of file");
+        default: {
+            double value(0);
+            if (!parseNumber(value)) {
+                return false;
+            }
+            handler.number(value);
+            return true;
+        }
+    }
+}
+
+/**
+ * Append code point cp to out as UTF-8.
+ */
+static void appendUtf8(std::string& out, unsigned long cp)
+{
+    if (cp < 0x80) {
+        out += (char)cp;
+    } else if (cp < 0x800) {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+bool JsonStream::parseString(std::string& out)
+{
+    out.clear();
+    get();  // opening quote
+    while (true) {
+        // Copy runs of plain characters at once
+        size_t start = pos_;
+        while (pos_ < end_ && buffer_[pos_] != '"' && buffer_[pos_] != '\\') {
+            pos_++;
+        }
+        out.append(&buffer_[0] + start, pos_ - start);
+        int c = get();
+        if (c == '"') {
+            return true;
+        }
+        if (c == EOF) {
+            return fail("Unterminated string");
+        }
+        if (c != '\\') {
+            // The buffer ran out in the middle of the string
+            out += (char)c;
+            continue;
+        }
+        c = get();
+        switch (c) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned long cp(0);
+                for (int i = 0; i < 4; i++) {
+                    int h = get();
+                    cp <<= 4;
+                    if (h >= '0' && h <= '9') cp |= h - '0';
+                    else if (h >= 'a' && h <= 'f') cp |= h - 'a' + 10;
+                    else if (h >= 'A' && h <= 'F') cp |= h - 'A' + 10;
+                    else return fail("Invalid \\u escape");
+                }
+                appendUtf8(out, cp);
+                break;
+            }
+            default:
+                return fail("Invalid escape");
+        }
+    }
+}
+
+/**
+ * Numbers with at most MAX_FAST_DIGITS significant digits and a small
+ * exponent (everything the FACET writers produce) are converted directly;
+ * anything else goes through strtod.
+ */
+bool JsonStream::parseNumber(double& value)
+{
+    text_.clear();
+    unsigned long long mantissa(0);
+    int digits(0), exponent(0);
+    bool negative(false), exact(true);
+
+    int c = peek();
+    if (c == '-') {
+        negative = true;
+        text_ += (char)get();
+        c = peek();
+    }
+    if (c < '0' || c > '9') {
+        return fail("Invalid value");
+    }
+    while (c >= '0' && c <= '9') {
+        text_ += (char)get();
+        if (digits < MAX_FAST_DIGITS) {
+            mantissa = mantissa * 10 + (c - '0');
+            if (mantissa > 0) digits++;
+        } else {
+            exponent++;
+            exact = false;
+        }
+        c = peek();
+    }
+    if (c == '.') {
+        text_ += (char)get();
+        c = peek();
+        if (c < '0' || c > '9') {
+            return fail("Invalid number");
+        }
+        while (c >= '0' && c <= '9') {
+            text_ += (char)get();
+            if (digits < MAX_FAST_DIGITS) {
+                mantissa = mantissa * 10 + (c - '0');
+                exponent--;
+                if (mantissa > 0) digits++;
+            } else {
+                exact = false;
+            }
+            c = peek();
+        }
+    }
+    if (c == 'e' || c == 'E') {
+        text_ += (char)get();
+        c = peek();
+        bool negativeExp(false);
+        if (c == '+' || c == '-') {
+            negativeExp = (c == '-');
+            text_ += (char)get();
+            c = peek();
+        }
+        if (c < '0' || c > '9') {
+            return fail("Invalid number");
+        }
+        int e(0);
+        while (c >= '0' && c <= '9') {
+            text_ += (char)get();
+            if (e < 10000) e = e * 10 + (c - '0');
+            c = peek();
+        }
+        exponent += negativeExp ? -e : e;
+    }
+
+    if (exact && exponent >= -MAX_FAST_EXPONENT && exponent <= MAX_FAST_EXPONENT) {
+        value = (double)mantissa;
+        value = (exponent < 0) ? value / POW10[-exponent] : value * POW10[exponent];
+    } else {
+        value = strtod(text_.c_str() + (negative ? 1 : 0), 0);
+    }
+    if (negative) {
+        value = -value;
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef JSONSTREAM_HPP
+#define JSONSTREAM_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * Callbacks of JsonStream, one per JSON token. Keys of an object are
+ * reported by key() before their value.
+ */
+class JsonHandler {
+public:
+    virtual ~JsonHandler() {}
+    virtual void startObject() {}
+    virtual void endObject() {}
+    virtual void startArray() {}
+    virtual void endArray() {}
+    virtual void key(const std::string& name) {}
+    virtual void number(double value) {}
+    virtual void string(const std::string& value) {}
+    virtual void boolean(bool value) {}
+    virtual void null() {}
+};
+
+/**
+ * Event-based (SAX style) JSON reader.
+ *
+ * The document is read through a fixed buffer and never held in memory:
+ * memory use only grows with the nesting depth and the longest string.
+ */
+class JsonStream {
+public:
+    JsonStream();
+    ~JsonStream();
+
+    /**
+     * Parse the file, calling handler for each token. Returns false, with
+     * error() set, if the file cannot be read or is not valid JSON.
+     */
+    bool parse(const std::string& filename, JsonHandler& handler);
+
+    /** Description of the last error, with its byte offset **/
+    const std::string& error() const { return error_; }
+
+private:
+    JsonStream(const JsonStream&);
+    JsonStream& operator=(const JsonStream&);
+
+    bool fill();
+    int peek();
+    int get();
+    void skipSpace();
+    bool expect(const char* literal);
+    bool parseValue(JsonHandler& handler);
+    bool parseString(std::string& out);
+    bool parseNumber(double& value);
+    bool fail(const std::string& message);
+
+    FILE* file_;
+    std::vector<char> buffer_;
+    size_t pos_;
+    size_t end_;
+    size_t consumed_;   ///< Bytes of the file before buffer_
+    std::string text_;  ///< Current string or number
+    std::string error_;
+};
+
+#endif  // JSONSTREAM_HPP
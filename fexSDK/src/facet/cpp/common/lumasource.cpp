@@ -0,0 +1,510 @@
+#include "lumasource.hpp"
+#include <string.h>
+#include <algorithm>
+
+#ifdef FEX_WITH_LIBAV
+#define __STDC_CONSTANT_MACROS
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+#endif
+
+const double MILLIS_PER_SEC = 1000.0;
+
+/** Start LumaFrame ++++++++++++++++++++++++++++++++++++++++++++++++++++ **/
+
+LumaFrame::LumaFrame()
+: avframe_(0), timestamp_(0)
+{
+}
+
+LumaFrame::LumaFrame(const LumaFrame& other)
+: avframe_(0), plane_(other.plane_), timestamp_(other.timestamp_)
+{
+#ifdef FEX_WITH_LIBAV
+    if (other.avframe_) {
+        avframe_ = av_frame_clone(static_cast<AVFrame*>(other.avframe_));
+    }
+#endif
+}
+
+LumaFrame& LumaFrame::operator=(const LumaFrame& other)
+{
+    if (this != &other) {
+        release();
+        plane_ = other.plane_;
+        timestamp_ = other.timestamp_;
+#ifdef FEX_WITH_LIBAV
+        if (other.avframe_) {
+            avframe_ = av_frame_clone(static_cast<AVFrame*>(other.avframe_));
+        }
+#endif
+    }
+    return *this;
+}
+
+LumaFrame::~LumaFrame()
+{
+    release();
+}
+
+void LumaFrame::release()
+{
+#ifdef FEX_WITH_LIBAV
+    if (avframe_) {
+        AVFrame* avframe = static_cast<AVFrame*>(avframe_);
+        av_frame_free(&avframe);
+        avframe_ = 0;
+    }
+#endif
+    plane_.release();
+}
+
+/** Start libav decoder ++++++++++++++++++++++++++++++++++++++++++++++++ **/
+
+#ifdef FEX_WITH_LIBAV
+
+/**
+ * Pixel formats whose first plane is 8-bit luma, one byte per pixel.
+ */
+static bool hasLumaPlane(int format)
+{
+    switch (format) {
+        case AV_PIX_FMT_GRAY8:
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_YUVJ420P:
+        case AV_PIX_FMT_YUVA420P:
+        case AV_PIX_FMT_YUV422P:
+        case AV_PIX_FMT_YUVJ422P:
+        case AV_PIX_FMT_YUV444P:
+        case AV_PIX_FMT_YUVJ444P:
+        case AV_PIX_FMT_YUV440P:
+        case AV_PIX_FMT_YUVJ440P:
+        case AV_PIX_FMT_YUV411P:
+        case AV_PIX_FMT_YUV410P:
+        case AV_PIX_FMT_NV12:
+        case AV_PIX_FMT_NV21:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * True if luma already spans 0-255 (JPEG range), as a BGR->gray conversion would.
+ */
+static bool isFullRange(const AVFrame* avframe)
+{
+    switch (avframe->format) {
+        case AV_PIX_FMT_GRAY8:
+        case AV_PIX_FMT_YUVJ420P:
+        case AV_PIX_FMT_YUVJ422P:
+        case AV_PIX_FMT_YUVJ444P:
+        case AV_PIX_FMT_YUVJ440P:
+            return true;
+        default:
+            return avframe->color_range == AVCOL_RANGE_JPEG;
+    }
+}
+
+struct LumaSource::Impl {
+    Impl()
+    : format(0), codec(0), packet(0), decoded(0), sws(0), stream(-1),
+      timeBase(0), startPts(0), seekTarget(-1), flushing(false)
+    {
+        // Limited (16-235) to full (0-255) range, as the YUV->BGR conversion does
+        for (int i = 0; i < 256; i++) {
+            int v = ((i - 16) * 255 + 109) / 219;
+            expandRange[i] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+    }
+
+    ~Impl()
+    {
+        if (sws) sws_freeContext(sws);
+        if (decoded) av_frame_free(&decoded);
+        if (packet) av_packet_free(&packet);
+        if (codec) avcodec_free_context(&codec);
+        if (format) avformat_close_input(&format);
+    }
+
+    bool open(const std::string& filename)
+    {
+        if (avformat_open_input(&format, filename.c_str(), 0, 0) < 0) {
+            return false;
+        }
+        if (avformat_find_stream_info(format, 0) < 0) {
+            return false;
+        }
+        const AVCodec* decoder(0);
+        stream = av_find_best_stream(format, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+        if (stream < 0 || decoder == 0) {
+            return false;
+        }
+        AVStream* avstream = format->streams[stream];
+        codec = avcodec_alloc_context3(decoder);
+        if (codec == 0 || avcodec_parameters_to_context(codec, avstream->codecpar) < 0) {
+            return false;
+        }
+        codec->thread_count = 0;  // let libavcodec pick the number of threads
+        if (avcodec_open2(codec, decoder, 0) < 0) {
+            return false;
+        }
+        packet = av_packet_alloc();
+        decoded = av_frame_alloc();
+        timeBase = av_q2d(avstream->time_base);
+        startPts = (avstream->start_time != AV_NOPTS_VALUE) ? avstream->start_time : 0;
+        return packet != 0 && decoded != 0;
+    }
+
+    /**
+     * Decode the next frame of the video stream into decoded.
+     */
+    bool decode()
+    {
+        av_frame_unref(decoded);
+        while (true) {
+            int ret = avcodec_receive_frame(codec, decoded);
+            if (ret == 0) {
+                return true;
+            }
+            if (ret != AVERROR(EAGAIN) || flushing) {
+                return false;
+            }
+            // The decoder needs more input: feed it the next video packet
+            while (true) {
+                if (av_read_frame(format, packet) < 0) {
+                    avcodec_send_packet(codec, 0);  // drain the decoder
+                    flushing = true;
+                    break;
+                }
+                bool isVideo = (packet->stream_index == stream);
+                if (isVideo) {
+                    avcodec_send_packet(codec, packet);
+                }
+                av_packet_unref(packet);
+                if (isVideo) {
+                    break;
+                }
+            }
+        }
+    }
+
+    double timestamp() const
+    {
+        int64_t pts = decoded->best_effort_timestamp;
+        if (pts == AV_NOPTS_VALUE) {
+            pts = decoded->pts;
+        }
+        return (pts == AV_NOPTS_VALUE) ? 0 : (pts - startPts) * timeBase;
+    }
+
+    /**
+     * Expose the decoded luma plane through frame, without copying when possible.
+     * Only the crop region is produced, downscaled to dstRows x dstCols when
+     * those are smaller.
+     */
+    bool retrieve(LumaFrame& frame, const cv::Rect& crop, int dstRows, int dstCols, GrayResizer& resizer)
+    {
+        int rows = crop.height;
+        int cols = crop.width;
+        bool scaled = (dstRows < rows || dstCols < cols);
+        bool cropped = (rows < decoded->height || cols < decoded->width);
+        frame.timestamp_ = timestamp();
+
+        const unsigned char* plane(0);
+        size_t step(0);
+        const unsigned char* lut(0);
+        if (hasLumaPlane(decoded->format)) {
+            plane = decoded->data[0];
+            step = decoded->linesize[0];
+            lut = isFullRange(decoded) ? 0 : expandRange;
+        } else if (cropped) {
+            // The region is taken from the whole frame converted to gray
+            sws = sws_getCachedContext(sws, decoded->width, decoded->height, (AVPixelFormat)decoded->format,
+                                       decoded->width, decoded->height, AV_PIX_FMT_GRAY8, SWS_POINT, 0, 0, 0);
+            if (sws == 0) {
+                return false;
+            }
+            gray.create(decoded->height, decoded->width, CV_8UC1);
+            uint8_t* grayData[4] = { gray.data, 0, 0, 0 };
+            int grayStride[4] = { (int)gray.step, 0, 0, 0 };
+            sws_scale(sws, decoded->data, decoded->linesize, 0, decoded->height, grayData, grayStride);
+            plane = gray.data;
+            step = gray.step;
+        }
+
+        if (plane) {
+            plane += (size_t)crop.y * step + crop.x;
+            if (scaled) {
+                // Area-resize the Y plane; the range is expanded on the output pixels
+                ownPlane(frame, dstRows, dstCols);
+                if (!resizer.matches(rows, cols, 1, dstRows, dstCols)) {
+                    resizer.init(rows, cols, 1, dstRows, dstCols);
+                }
+                resizer.resize(plane, step, frame.plane_.data, frame.plane_.step, lut);
+                return true;
+            }
+            bool contiguous = !cropped && (step == (size_t)cols);
+            if (lut == 0 && contiguous) {
+                // Zero copy: keep a reference to the decoder's plane
+                if (frame.avframe_ == 0) {
+                    frame.plane_.release();
+                    frame.avframe_ = av_frame_alloc();
+                }
+                AVFrame* avframe = static_cast<AVFrame*>(frame.avframe_);
+                av_frame_unref(avframe);
+                if (av_frame_ref(avframe, decoded) < 0) {
+                    return false;
+                }
+                frame.plane_ = cv::Mat(rows, cols, CV_8UC1, avframe->data[0]);
+                return true;
+            }
+            // Limited range, padded rows or a region: one pass over the Y plane only
+            ownPlane(frame, rows, cols);
+            for (int i = 0; i < rows; i++) {
+                const unsigned char* src = plane + (size_t)i * step;
+                unsigned char* dst = frame.plane_.ptr(i);
+                if (lut) {
+                    for (int j = 0; j < cols; j++) {
+                        dst[j] = lut[src[j]];
+                    }
+                } else {
+                    memcpy(dst, src, cols);
+                }
+            }
+            return true;
+        }
+
+        // Packed RGB, high bit depth, ...: let libswscale produce gray
+        sws = sws_getCachedContext(sws, cols, rows, (AVPixelFormat)decoded->format,
+                                   dstCols, dstRows, AV_PIX_FMT_GRAY8, scaled ? SWS_AREA : SWS_POINT, 0, 0, 0);
+        if (sws == 0) {
+            return false;
+        }
+        ownPlane(frame, dstRows, dstCols);
+        uint8_t* dstData[4] = { frame.plane_.data, 0, 0, 0 };
+        int dstStride[4] = { dstCols, 0, 0, 0 };
+        sws_scale(sws, decoded->data, decoded->linesize, 0, rows, dstData, dstStride);
+        return true;
+    }
+
+    /**
+     * Make frame own a rows x cols buffer (reused across calls).
+     */
+    static void ownPlane(LumaFrame& frame, int rows, int cols)
+    {
+        if (frame.avframe_) {
+            AVFrame* avframe = static_cast<AVFrame*>(frame.avframe_);
+            av_frame_free(&avframe);
+            frame.avframe_ = 0;
+            frame.plane_.release();
+        }
+        frame.plane_.create(rows, cols, CV_8UC1);
+    }
+
+    bool seek(double seconds)
+    {
+        int64_t target = startPts + (int64_t)(seconds / timeBase);
+        if (av_seek_frame(format, stream, target, AVSEEK_FLAG_BACKWARD) < 0) {
+            return false;
+        }
+        avcodec_flush_buffers(codec);
+        flushing = false;
+        seekTarget = seconds;
+        return true;
+    }
+
+    AVFormatContext* format;
+    AVCodecContext* codec;
+    AVPacket* packet;
+    AVFrame* decoded;
+    SwsContext* sws;
+    cv::Mat gray;        ///< Whole frame, when a region is taken from a non-YUV frame
+    int stream;
+    double timeBase;
+    int64_t startPts;
+    double seekTarget;   ///< After a seek, frames before this are dropped
+    bool flushing;       ///< End of file reached, the decoder is being drained
+    unsigned char expandRange[256];
+};
+
+#endif  // FEX_WITH_LIBAV
+
+/** Start LumaSource +++++++++++++++++++++++++++++++++++++++++++++++++++ **/
+
+LumaSource::LumaSource()
+: impl_(0), scale_(1.0), width_(0), height_(0), fps_(0), duration_(0), frameCount_(0)
+{
+}
+
+LumaSource::~LumaSource()
+{
+    close();
+}
+
+bool LumaSource::open(const std::string& filename)
+{
+    close();
+#ifdef FEX_WITH_LIBAV
+    impl_ = new Impl();
+    if (impl_->open(filename)) {
+        AVStream* avstream = impl_->format->streams[impl_->stream];
+        width_ = impl_->codec->width;
+        height_ = impl_->codec->height;
+        fps_ = av_q2d(av_guess_frame_rate(impl_->format, avstream, 0));
+        if (avstream->duration != AV_NOPTS_VALUE) {
+            duration_ = avstream->duration * impl_->timeBase;
+        } else if (impl_->format->duration != AV_NOPTS_VALUE) {
+            duration_ = (double)impl_->format->duration / AV_TIME_BASE;
+        }
+        frameCount_ = (avstream->nb_frames > 0) ? (size_t)avstream->nb_frames : (size_t)(duration_ * fps_ + 0.5);
+        return true;
+    }
+    delete impl_;
+    impl_ = 0;
+#endif
+    // Fallback on OpenCV
+    if (!videoCap_.open(filename)) {
+        return false;
+    }
+    width_ = (int)videoCap_.get(CV_CAP_PROP_FRAME_WIDTH);
+    height_ = (int)videoCap_.get(CV_CAP_PROP_FRAME_HEIGHT);
+    fps_ = videoCap_.get(CV_CAP_PROP_FPS);
+    frameCount_ = (size_t)videoCap_.get(CV_CAP_PROP_FRAME_COUNT);
+    duration_ = (fps_ > 0) ? frameCount_ / fps_ : 0;
+    return videoCap_.isOpened();
+}
+
+bool LumaSource::isOpened() const
+{
+    return impl_ != 0 || videoCap_.isOpened();
+}
+
+void LumaSource::close()
+{
+#ifdef FEX_WITH_LIBAV
+    delete impl_;
+#endif
+    impl_ = 0;
+    if (videoCap_.isOpened()) {
+        videoCap_.release();
+    }
+    width_ = height_ = 0;
+    crop_ = cv::Rect();
+    fps_ = duration_ = 0;
+    frameCount_ = 0;
+}
+
+bool LumaSource::grab()
+{
+#ifdef FEX_WITH_LIBAV
+    if (impl_) {
+        while (impl_->decode()) {
+            // Decode forward from the keyframe to the seek target
+            if (impl_->seekTarget >= 0 && impl_->timestamp() + 0.5 / fps_ < impl_->seekTarget) {
+                continue;
+            }
+            impl_->seekTarget = -1;
+            return true;
+        }
+        return false;
+    }
+#endif
+    return videoCap_.grab();
+}
+
+bool LumaSource::retrieve(LumaFrame& frame)
+{
+#ifdef FEX_WITH_LIBAV
+    if (impl_) {
+        return impl_->retrieve(frame, crop(), frameHeight(), frameWidth(), resizer_);
+    }
+#endif
+    if (!videoCap_.retrieve(bgrFrame_)) {
+        return false;
+    }
+    if (frame.avframe_) {
+        // A plane of an earlier libav source: not written into
+        frame.release();
+    }
+    frame.timestamp_ = videoCap_.get(CV_CAP_PROP_POS_MSEC) / MILLIS_PER_SEC;
+    cv::Mat region(bgrFrame_(crop() & cv::Rect(0, 0, bgrFrame_.cols, bgrFrame_.rows)));
+    if (scale_ < 1.0) {
+        // Convert and downscale in one pass, without a full-size gray frame
+        grayResize(region, frame.plane_, cv::Size(frameWidth(), frameHeight()), resizer_);
+    } else if (region.channels() > 1) {
+        cv::cvtColor(region, frame.plane_, CV_BGR2GRAY);
+    } else {
+        // The capture reuses its buffer, so grayscale frames must be copied
+        region.copyTo(frame.plane_);
+    }
+    return true;
+}
+
+bool LumaSource::read(LumaFrame& frame)
+{
+    return grab() && retrieve(frame);
+}
+
+double LumaSource::timestamp()
+{
+#ifdef FEX_WITH_LIBAV
+    if (impl_) {
+        return impl_->timestamp();
+    }
+#endif
+    return videoCap_.get(CV_CAP_PROP_POS_MSEC) / MILLIS_PER_SEC;
+}
+
+bool LumaSource::seek(double seconds)
+{
+#ifdef FEX_WITH_LIBAV
+    if (impl_) {
+        return impl_->seek(seconds);
+    }
+#endif
+    return videoCap_.set(CV_CAP_PROP_POS_MSEC, seconds * MILLIS_PER_SEC);
+}
+
+void LumaSource::setScale(double scale)
+{
+    scale_ = (scale > 0 && scale < 1.0) ? scale : 1.0;
+}
+
+void LumaSource::setCrop(const cv::Rect& crop)
+{
+    crop_ = crop & cv::Rect(0, 0, width_, height_);
+}
+
+cv::Rect LumaSource::crop() const
+{
+    return crop_.area() > 0 ? crop_ : cv::Rect(0, 0, width_, height_);
+}
+
+// The epsilon keeps e.g. 1920 * (1.0/3) at 640
+int LumaSource::frameWidth() const
+{
+    return std::max((int)(crop().width * scale_ + 1e-6), 1);
+}
+
+int LumaSource::frameHeight() const
+{
+    return std::max((int)(crop().height * scale_ + 1e-6), 1);
+}
+
+FrameMapping LumaSource::mapping() const
+{
+    cv::Rect region(crop());
+    FrameMapping mapping;
+    mapping.scaleX = (double)region.width / frameWidth();
+    mapping.scaleY = (double)region.height / frameHeight();
+    mapping.dx = region.x;
+    mapping.dy = region.y;
+    mapping.rows = height_;
+    mapping.cols = width_;
+    return mapping;
+}
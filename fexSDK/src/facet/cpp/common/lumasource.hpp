@@ -0,0 +1,153 @@
+#ifndef LUMASOURCE_HPP
+#define LUMASOURCE_HPP
+
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "framemapping.hpp"
+#include "grayresize.hpp"
+
+/**
+ * A decoded 8-bit grayscale frame.
+ *
+ * When a full-range video is decoded with libavcodec (FEX_WITH_LIBAV), the
+ * frame holds a reference to the decoder's own luma (Y) plane, and data()
+ * points straight into it: there is no YUV->BGR->gray round trip and no
+ * copy. Limited-range planes (and cropped or padded ones) are copied once
+ * into a plane of the frame. Copies of a LumaFrame share the same plane.
+ */
+class LumaFrame {
+public:
+    LumaFrame();
+    LumaFrame(const LumaFrame& other);
+    LumaFrame& operator=(const LumaFrame& other);
+    ~LumaFrame();
+
+    /** Pointer to rows() x cols() contiguous 8-bit pixels **/
+    const unsigned char* data() const { return plane_.data; }
+    int rows() const { return plane_.rows; }
+    int cols() const { return plane_.cols; }
+    /** Presentation timestamp in seconds **/
+    double timestamp() const { return timestamp_; }
+    /** Header over the plane (no copy) **/
+    const cv::Mat& mat() const { return plane_; }
+    bool empty() const { return plane_.data == 0; }
+    /** Drop the reference to the plane **/
+    void release();
+    /**
+     * True if data() points into the decoder's luma plane; false for the
+     * planes copied (limited range, cropped, padded or downscaled) or
+     * converted.
+     */
+    bool isZeroCopy() const { return avframe_ != 0; }
+
+private:
+    friend class LumaSource;
+    void* avframe_;   ///< AVFrame reference when decoded by libavcodec
+    cv::Mat plane_;   ///< Header over (or owner of) the luma plane
+    double timestamp_;
+};
+
+/**
+ * Decodes a video straight to its luma plane.
+ *
+ * Built with FEX_WITH_LIBAV, frames in YUV formats are returned as their Y
+ * plane. For limited-range video the plane is copied through a lookup
+ * table that expands 16-235 to 0-255, so the values match a BGR->gray
+ * conversion; other formats are converted to gray with libswscale. Which
+ * frames are not copied is decided by the range of each decoded frame
+ * (LumaFrame::isZeroCopy). Without libav, or for files libavformat cannot
+ * open, this falls back on cv::VideoCapture and cvtColorSafe().
+ *
+ * With setScale(), frames are area-downscaled while they are produced
+ * (GrayResizer on the luma or BGR frame, libswscale otherwise), so no
+ * full-size gray frame is made and resized afterwards. With setCrop(),
+ * only a region of the frames is produced, before it is downscaled.
+ */
+class LumaSource {
+public:
+    LumaSource();
+    ~LumaSource();
+
+    /**
+     * Open a video file. Returns false if it cannot be decoded.
+     */
+    bool open(const std::string& filename);
+    bool isOpened() const;
+    void close();
+
+    /**
+     * Decode the next frame without producing its luma plane (cf. cv::VideoCapture::grab).
+     */
+    bool grab();
+
+    /**
+     * Produce the luma plane of the last grabbed frame.
+     */
+    bool retrieve(LumaFrame& frame);
+
+    /**
+     * grab() and retrieve(); returns false at the end of the video.
+     */
+    bool read(LumaFrame& frame);
+
+    /**
+     * Presentation timestamp of the last grabbed frame, in seconds.
+     */
+    double timestamp();
+
+    /**
+     * Reposition at the keyframe at or before seconds; the next read()
+     * returns the first frame at or after it (decoded forward from the keyframe).
+     */
+    bool seek(double seconds);
+
+    /**
+     * Downscale the frames returned by retrieve() to
+     * floor(width() * scale) x floor(height() * scale); scale is in (0, 1].
+     */
+    void setScale(double scale);
+    double scale() const { return scale_; }
+
+    /**
+     * Produce only the region crop of the frames (in video pixels, clipped
+     * to the video); an empty crop restores whole frames. Reset by open().
+     */
+    void setCrop(const cv::Rect& crop);
+    /** Region of the video returned by retrieve() **/
+    cv::Rect crop() const;
+
+    /** Size of the frames returned by retrieve() **/
+    int frameWidth() const;
+    int frameHeight() const;
+
+    /** Maps the coordinates of the frames returned by retrieve() to the video frames **/
+    FrameMapping mapping() const;
+
+    /** Size of the video **/
+    int width() const { return width_; }
+    int height() const { return height_; }
+    double fps() const { return fps_; }
+    /** Duration in seconds (0 if unknown) **/
+    double duration() const { return duration_; }
+    /** Number of frames (an estimate; 0 if unknown) **/
+    size_t frameCount() const { return frameCount_; }
+
+private:
+    LumaSource(const LumaSource&);
+    LumaSource& operator=(const LumaSource&);
+
+    struct Impl;
+    Impl* impl_;                 ///< libav decoder, null when using the fallback
+    cv::VideoCapture videoCap_;  ///< Fallback decoder
+    cv::Mat bgrFrame_;
+    GrayResizer resizer_;        ///< Fused convert + resize when scale_ < 1
+    double scale_;
+    cv::Rect crop_;              ///< Empty for whole frames
+    int width_;
+    int height_;
+    double fps_;
+    double duration_;
+    size_t frameCount_;
+};
+
+#endif  // LUMASOURCE_HPP
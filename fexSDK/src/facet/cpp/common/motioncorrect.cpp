@@ -0,0 +1,409 @@
+#include "motioncorrect.hpp"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+static const double NOT_A_NUMBER = std::numeric_limits<double>::quiet_NaN();
+static const size_t P = MOTION_PREDICTORS;
+
+/**
+ * Continued fraction of the incomplete beta function (modified Lentz).
+ */
+static double betaFraction(double a, double b, double x)
+{
+    const double tiny = 1e-300;
+    double c = 1, d = 1 - (a + b) * x / (a + 1);
+    d = 1 / (fabs(d) < tiny ? tiny : d);
+    double h = d;
+    for (int m = 1; m <= 300; m++) {
+        for (int k = 0; k < 2; k++) {
+            double num = k == 0 ? m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m))
+                                : -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+            d = 1 + num * d;
+            d = 1 / (fabs(d) < tiny ? tiny : d);
+            c = 1 + num / c;
+            c = fabs(c) < tiny ? tiny : c;
+            h *= d * c;
+            if (k == 1 && fabs(d * c - 1) < 1e-15) {
+                return h;
+            }
+        }
+    }
+    return h;
+}
+
+/**
+ * Regularized incomplete beta function I_x(a, b).
+ */
+static double incompleteBeta(double a, double b, double x)
+{
+    if (x <= 0) {
+        return 0;
+    }
+    if (x >= 1) {
+        return 1;
+    }
+    double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1 - x));
+    if (x < (a + 1) / (a + b + 2)) {
+        return front * betaFraction(a, b, x) / a;
+    }
+    return 1 - front * betaFraction(b, a, 1 - x) / b;
+}
+
+/**
+ * Smallest r^2 of a correlation significant at MOTION_ALPHA (two-sided t
+ * test with df degrees of freedom, as Matlab's corr): p = I_(1-r^2)(df/2, 1/2).
+ */
+static double criticalR2(double df)
+{
+    double low = 0, high = 1;
+    for (int i = 0; i < 60; i++) {
+        double mid = (low + high) / 2;
+        if (incompleteBeta(df / 2, 0.5, mid) > MOTION_ALPHA) {
+            high = mid;
+        } else {
+            low = mid;
+        }
+    }
+    return 1 - low;
+}
+
+/**
+ * Cholesky factor (lower, row-major n * n) of a; false if not positive definite.
+ */
+static bool cholesky(const double* a, size_t n, double* l)
+{
+    std::fill(l, l + n * n, 0.0);
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j <= i; j++) {
+            double s = a[i * n + j];
+            for (size_t k = 0; k < j; k++) {
+                s -= l[i * n + k] * l[j * n + k];
+            }
+            if (i == j) {
+                if (!(s > 1e-12 * a[i * n + i]) || !(a[i * n + i] > 0)) {
+                    return false;
+                }
+                l[i * n + i] = sqrt(s);
+            } else {
+                l[i * n + j] = s / l[j * n + j];
+            }
+        }
+    }
+    return true;
+}
+
+MotionMoments::MotionMoments(size_t channels)
+: channels(channels), meanY(channels), sxy(P * channels), syy(channels)
+{
+    clear();
+}
+
+void MotionMoments::clear()
+{
+    weight = 0;
+    std::fill(meanX, meanX + P, 0.0);
+    std::fill(sxx, sxx + P * P, 0.0);
+    std::fill(meanY.begin(), meanY.end(), 0.0);
+    std::fill(sxy.begin(), sxy.end(), 0.0);
+    std::fill(syy.begin(), syy.end(), 0.0);
+}
+
+void MotionMoments::add(const double* x, const double* y, double forgetting)
+{
+    // Co-moments are updated with the deviation from the old mean times the one from the new mean
+    weight = forgetting * weight + 1;
+    double dx[P];
+    for (size_t j = 0; j < P; j++) {
+        dx[j] = x[j] - meanX[j];
+        meanX[j] += dx[j] / weight;
+    }
+    for (size_t j = 0; j < P; j++) {
+        for (size_t k = 0; k < P; k++) {
+            sxx[j * P + k] = forgetting * sxx[j * P + k] + dx[j] * (x[k] - meanX[k]);
+        }
+    }
+    double* sy = channels > 0 ? &syy[0] : 0;
+    double* my = channels > 0 ? &meanY[0] : 0;
+    for (size_t c = 0; c < channels; c++) {
+        double dy = y[c] - my[c];
+        my[c] += dy / weight;
+        sy[c] = forgetting * sy[c] + dy * (y[c] - my[c]);
+    }
+    for (size_t j = 0; j < P; j++) {
+        double* s = channels > 0 ? &sxy[j * channels] : 0;
+        for (size_t c = 0; c < channels; c++) {
+            s[c] = forgetting * s[c] + dx[j] * (y[c] - my[c]);
+        }
+    }
+}
+
+void MotionMoments::coefficients(double threshold, std::vector<double>& b) const
+{
+    b.assign(P * channels, 0.0);
+    double df = weight - 2;
+    if (!(df > 0)) {
+        return;
+    }
+    double minR2 = std::max(criticalR2(df), threshold * threshold);
+
+    // Normal equations of each subset of predictors, factorized when first needed
+    double factors[MOTION_SUBSETS][P * P];
+    int factorized[MOTION_SUBSETS];
+    std::fill(factorized, factorized + MOTION_SUBSETS, -1);
+    for (size_t c = 0; c < channels; c++) {
+        size_t subset(0);
+        for (size_t j = 0; j < P; j++) {
+            double r2 = sxx[j * P + j] > 0 && syy[c] > 0 ?
+                        sxy[j * channels + c] * sxy[j * channels + c] / (sxx[j * P + j] * syy[c]) : 0;
+            if (r2 >= minR2) {
+                subset |= 1 << j;
+            }
+        }
+        if (subset == 0) {
+            continue;
+        }
+        size_t index[P], n(0);
+        for (size_t j = 0; j < P; j++) {
+            if (subset & (1 << j)) {
+                index[n++] = j;
+            }
+        }
+        double* l = factors[subset];
+        if (factorized[subset] < 0) {
+            double a[P * P];
+            for (size_t i = 0; i < n; i++) {
+                for (size_t k = 0; k < n; k++) {
+                    a[i * n + k] = sxx[index[i] * P + index[k]];
+                }
+            }
+            factorized[subset] = cholesky(a, n, l) ? 1 : 0;
+        }
+        if (!factorized[subset]) {
+            continue;
+        }
+        // L L' beta = sxy of the subset
+        double z[P];
+        for (size_t i = 0; i < n; i++) {
+            double s = sxy[index[i] * channels + c];
+            for (size_t k = 0; k < i; k++) {
+                s -= l[i * n + k] * z[k];
+            }
+            z[i] = s / l[i * n + i];
+        }
+        for (size_t i = n; i-- > 0;) {
+            double s = z[i];
+            for (size_t k = i + 1; k < n; k++) {
+                s -= l[k * n + i] * z[k];
+            }
+            z[i] = s / l[i * n + i];
+        }
+        for (size_t i = 0; i < n; i++) {
+            b[index[i] * channels + c] = z[i];
+        }
+    }
+}
+
+/**
+ * Eigenvectors (columns of vectors, row-major) and eigenvalues of the
+ * symmetric P * P matrix a (cyclic Jacobi).
+ */
+static void symmetricEigen(const double* a, double* vectors, double* values)
+{
+    double m[P * P];
+    std::copy(a, a + P * P, m);
+    for (size_t i = 0; i < P; i++) {
+        for (size_t j = 0; j < P; j++) {
+            vectors[i * P + j] = i == j;
+        }
+    }
+    for (int sweep = 0; sweep < 50; sweep++) {
+        double off(0);
+        for (size_t i = 0; i < P; i++) {
+            for (size_t j = i + 1; j < P; j++) {
+                off += m[i * P + j] * m[i * P + j];
+            }
+        }
+        if (!(off > 1e-30)) {
+            break;
+        }
+        for (size_t p = 0; p < P; p++) {
+            for (size_t q = p + 1; q < P; q++) {
+                if (m[p * P + q] == 0) {
+                    continue;
+                }
+                double theta = (m[q * P + q] - m[p * P + p]) / (2 * m[p * P + q]);
+                double t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta * theta + 1));
+                double c = 1 / sqrt(t * t + 1), s = t * c;
+                for (size_t k = 0; k < P; k++) {
+                    double mkp = m[k * P + p], mkq = m[k * P + q];
+                    m[k * P + p] = c * mkp - s * mkq;
+                    m[k * P + q] = s * mkp + c * mkq;
+                }
+                for (size_t k = 0; k < P; k++) {
+                    double mpk = m[p * P + k], mqk = m[q * P + k];
+                    m[p * P + k] = c * mpk - s * mqk;
+                    m[q * P + k] = s * mpk + c * mqk;
+                }
+                for (size_t k = 0; k < P; k++) {
+                    double vkp = vectors[k * P + p], vkq = vectors[k * P + q];
+                    vectors[k * P + p] = c * vkp - s * vkq;
+                    vectors[k * P + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < P; i++) {
+        values[i] = m[i * P + i];
+    }
+}
+
+/**
+ * Whiten the rows * P predictors in place, as fex_whiteningt: centered,
+ * then multiplied by sqrt(rows - 1) U (S + epsilon)^-1/2 U', with U S U'
+ * the eigendecomposition of their cross products.
+ */
+static void whiten(std::vector<double>& x, size_t rows)
+{
+    double mean[P] = { 0 };
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t j = 0; j < P; j++) {
+            mean[j] += x[r * P + j] / rows;
+        }
+    }
+    double cross[P * P] = { 0 };
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t j = 0; j < P; j++) {
+            x[r * P + j] -= mean[j];
+        }
+        for (size_t j = 0; j < P; j++) {
+            for (size_t k = 0; k < P; k++) {
+                cross[j * P + k] += x[r * P + j] * x[r * P + k];
+            }
+        }
+    }
+    double u[P * P], s[P];
+    symmetricEigen(cross, u, s);
+    double w[P * P];
+    for (size_t i = 0; i < P; i++) {
+        for (size_t j = 0; j < P; j++) {
+            double v(0);
+            for (size_t k = 0; k < P; k++) {
+                v += u[i * P + k] * u[j * P + k] / sqrt(std::max(s[k], 0.0) + MOTION_EPSILON);
+            }
+            w[i * P + j] = sqrt(rows - 1.0) * v;
+        }
+    }
+    for (size_t r = 0; r < rows; r++) {
+        double row[P];
+        for (size_t j = 0; j < P; j++) {
+            row[j] = 0;
+            for (size_t k = 0; k < P; k++) {
+                row[j] += x[r * P + k] * w[k * P + j];
+            }
+        }
+        std::copy(row, row + P, &x[r * P]);
+    }
+}
+
+MotionCorrection::MotionCorrection(double threshold, bool whiten)
+: threshold_(threshold), whiten_(whiten)
+{
+}
+
+size_t MotionCorrection::correct(double* values, size_t rows, size_t width, const size_t pose[MOTION_PREDICTORS],
+                                 const std::vector<size_t>& channels) const
+{
+    size_t numChannels = channels.size();
+    // Predictors and channels of the rows used, contiguous
+    std::vector<size_t> used;
+    std::vector<double> x, y;
+    for (size_t r = 0; r < rows; r++) {
+        const double* row = values + r * width;
+        bool valid(true);
+        for (size_t j = 0; j < P; j++) {
+            valid = valid && row[pose[j]] == row[pose[j]];
+        }
+        for (size_t c = 0; c < numChannels; c++) {
+            valid = valid && row[channels[c]] == row[channels[c]];
+        }
+        if (!valid) {
+            for (size_t c = 0; c < numChannels; c++) {
+                values[r * width + channels[c]] = NOT_A_NUMBER;
+            }
+            continue;
+        }
+        used.push_back(r);
+        for (size_t j = 0; j < P; j++) {
+            x.push_back(fabs(row[pose[j]]));
+        }
+        for (size_t c = 0; c < numChannels; c++) {
+            y.push_back(row[channels[c]]);
+        }
+    }
+    if (used.empty() || numChannels == 0) {
+        return used.size();
+    }
+    if (whiten_) {
+        whiten(x, used.size());
+    }
+
+    MotionMoments moments(numChannels);
+    for (size_t i = 0; i < used.size(); i++) {
+        moments.add(&x[i * P], &y[i * numChannels]);
+    }
+    std::vector<double> b;
+    moments.coefficients(threshold_, b);
+
+    // Residual plus the constant: the channel minus the pose terms
+    for (size_t i = 0; i < used.size(); i++) {
+        double* yi = &y[i * numChannels];
+        for (size_t j = 0; j < P; j++) {
+            double xj = x[i * P + j];
+            const double* bj = &b[j * numChannels];
+            for (size_t c = 0; c < numChannels; c++) {
+                yi[c] -= bj[c] * xj;
+            }
+        }
+        double* row = values + used[i] * width;
+        for (size_t c = 0; c < numChannels; c++) {
+            row[channels[c]] = yi[c];
+        }
+    }
+    return used.size();
+}
+
+StreamingMotionCorrection::StreamingMotionCorrection(size_t channels, double threshold, double forgetting,
+                                                     size_t warmup)
+: threshold_(threshold), forgetting_(forgetting), warmup_(warmup), count_(0), moments_(channels)
+{
+}
+
+bool StreamingMotionCorrection::correct(const double pose[MOTION_PREDICTORS], double* channels)
+{
+    size_t numChannels = moments_.channels;
+    double x[P];
+    bool valid(true);
+    for (size_t j = 0; j < P; j++) {
+        x[j] = fabs(pose[j]);
+        valid = valid && x[j] == x[j];
+    }
+    for (size_t c = 0; c < numChannels; c++) {
+        valid = valid && channels[c] == channels[c];
+    }
+    if (!valid) {
+        return false;
+    }
+    moments_.add(x, channels, forgetting_);
+    if (++count_ < warmup_) {
+        return false;
+    }
+    moments_.coefficients(threshold_, b_);
+    for (size_t j = 0; j < P; j++) {
+        const double* bj = &b_[j * numChannels];
+        for (size_t c = 0; c < numChannels; c++) {
+            channels[c] -= bj[c] * x[j];
+        }
+    }
+    return true;
+}
@@ -0,0 +1,108 @@
+#ifndef MOTIONCORRECT_HPP
+#define MOTIONCORRECT_HPP
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Removal of pose artifacts, as fexc.motioncorrect: each channel (emotions
+ * and action units) is regressed on a constant and |roll|, |pitch|, |yaw|,
+ * and replaced by its residual plus the constant. A pose predictor is used
+ * for a channel only if it correlates with it significantly (p <= 0.05)
+ * and by at least threshold (|Pearson r|).
+ *
+ * All the channels are solved at once from the same moments of the
+ * predictors: the normal equations of a channel only differ by the subset
+ * of predictors it uses, and there are MOTION_SUBSETS of them, each
+ * factorized once (Cholesky). Data are channel-interleaved rows, so the
+ * loops over the channels of a row run over contiguous memory.
+ */
+
+const size_t MOTION_PREDICTORS = 3;   /**< |roll|, |pitch|, |yaw| **/
+const size_t MOTION_SUBSETS = 1 << MOTION_PREDICTORS;
+const double MOTION_ALPHA = 0.05;     /**< Significance of the correlations, as fexc.motioncorrect **/
+const double MOTION_EPSILON = 1e-4;   /**< Regularization of -whiten, as fex_whiteningt **/
+const size_t MOTION_WARMUP = 30;      /**< Rows seen by StreamingMotionCorrection before it corrects any **/
+
+/**
+ * Weighted means and co-moments of the predictors and the channels.
+ */
+struct MotionMoments {
+    explicit MotionMoments(size_t channels = 0);
+
+    void clear();
+    /**
+     * Add one row (predictors and channels), after the weight of the rows
+     * before it is multiplied by forgetting (1: all rows weigh the same).
+     */
+    void add(const double* x, const double* y, double forgetting = 1);
+
+    /**
+     * Coefficients (MOTION_PREDICTORS * channels, predictor-major, 0 for
+     * the predictors left out) of the regressions, with predictor selection.
+     */
+    void coefficients(double threshold, std::vector<double>& b) const;
+
+    size_t channels;
+    double weight;                      ///< Number of rows (weighted)
+    double meanX[MOTION_PREDICTORS];
+    double sxx[MOTION_PREDICTORS * MOTION_PREDICTORS];
+    std::vector<double> meanY;
+    std::vector<double> sxy;            ///< MOTION_PREDICTORS * channels, predictor-major
+    std::vector<double> syy;
+};
+
+/**
+ * Motion correction of a whole session.
+ */
+class MotionCorrection {
+public:
+    /**
+     * \param threshold minimum |r| of a predictor
+     * \param whiten whiten the predictors first (fexc.motioncorrect '-whiten')
+     */
+    explicit MotionCorrection(double threshold = 0, bool whiten = false);
+
+    /**
+     * Correct in place the channels of rows * width values (row-major).
+     * pose holds the columns of roll, pitch and yaw. As in fexc, rows with
+     * a NaN in the pose or in any channel are not used, and their channels
+     * are set to NaN. Returns the number of rows used.
+     */
+    size_t correct(double* values, size_t rows, size_t width, const size_t pose[MOTION_PREDICTORS],
+                   const std::vector<size_t>& channels) const;
+
+private:
+    double threshold_;
+    bool whiten_;
+};
+
+/**
+ * Online motion correction, one row at a time in frame order, as the rows
+ * of a video are written: the moments are updated with each row (recursive
+ * least squares in the form of its normal equations), and the row is
+ * corrected with the coefficients of the rows up to it. With forgetting
+ * below 1, older rows weigh exponentially less (weight forgetting^age).
+ */
+class StreamingMotionCorrection {
+public:
+    StreamingMotionCorrection(size_t channels, double threshold = 0, double forgetting = 1,
+                              size_t warmup = MOTION_WARMUP);
+
+    /**
+     * Correct channels in place with the roll, pitch and yaw of pose. Rows
+     * with a NaN are left as they are, like the first warmup rows; false
+     * for those.
+     */
+    bool correct(const double pose[MOTION_PREDICTORS], double* channels);
+
+private:
+    double threshold_;
+    double forgetting_;
+    size_t warmup_;
+    size_t count_;
+    MotionMoments moments_;
+    std::vector<double> b_;
+};
+
+#endif  // MOTIONCORRECT_HPP
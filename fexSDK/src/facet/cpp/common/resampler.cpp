@@ -0,0 +1,293 @@
+#include "resampler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "temporalfilter.hpp"
+
+static const double NOT_A_NUMBER = std::numeric_limits<double>::quiet_NaN();
+
+bool parseGapMethod(const std::string& name, GapMethod& method)
+{
+    if (name == "nearest") {
+        method = NEAREST;
+    } else if (name == "linear") {
+        method = LINEAR;
+    } else if (name == "pchip") {
+        method = PCHIP;
+    } else if (name == "spline") {
+        method = SPLINE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int decimationFactor(double sourceRate, double rate)
+{
+    if (!(rate > 0) || !(sourceRate > rate * (1 + RESAMPLE_RATE_TOLERANCE))) {
+        return 1;
+    }
+    return (int)ceil(sourceRate / rate - RESAMPLE_RATE_TOLERANCE);
+}
+
+StreamingResampler::StreamingResampler(size_t channels, double rate, GapMethod method, double maxGap, int factor)
+: method_(method), maxGap_(maxGap), factor_(std::max(factor, 1)), step_(1 / (rate * std::max(factor, 1))),
+  states_(channels), first_(0), last_(0), started_(false), finished_(false), dropped_(0), end_(0), base_(0),
+  complete_(0), nextOutput_(0), acc_(channels), weight_(channels)
+{
+    if (factor_ > 1) {
+        // Even order: the centre tap falls on a grid frame
+        int order = std::max(RESAMPLE_MIN_ORDER, RESAMPLE_ORDER_PER_FACTOR * factor_);
+        order += order % 2;
+        kernel_ = designFir(LOWPASS, order, RESAMPLE_CUTOFF * rate / 2, 0, rate * factor_ / 2);
+    }
+}
+
+void StreamingResampler::push(double time, const double* values)
+{
+    if (finished_ || !(time == time) || (started_ && !(time > last_))) {
+        dropped_++;
+        return;
+    }
+    if (!started_) {
+        first_ = time;
+        started_ = true;
+    }
+    last_ = time;
+    for (size_t c = 0; c < states_.size(); c++) {
+        Channel& channel = states_[c];
+        if (values[c] == values[c]) {
+            addKnot(c, time, values[c]);
+        } else if (channel.knots == 0 || time - channel.t[channel.knots - 1] > maxGap_) {
+            // No knot of the segment to come can be within maxGap of the frames up to time
+            closeSegment(c);
+            fillNaN(c, time, true);
+        }
+    }
+    release();
+}
+
+void StreamingResampler::finish()
+{
+    if (finished_) {
+        return;
+    }
+    finished_ = true;
+    end_ = started_ ? (long long)floor((last_ - first_) / step_ + 1e-9) + 1 : 0;
+    for (size_t c = 0; c < states_.size(); c++) {
+        closeSegment(c);
+        fillNaN(c, std::numeric_limits<double>::infinity(), true);
+    }
+    release();
+}
+
+bool StreamingResampler::pop(double& time, double* values)
+{
+    if (times_.empty()) {
+        return false;
+    }
+    time = times_.front();
+    std::copy(frames_.front().begin(), frames_.front().end(), values);
+    times_.pop_front();
+    frames_.pop_front();
+    return true;
+}
+
+void StreamingResampler::addKnot(size_t c, double time, double value)
+{
+    Channel& channel = states_[c];
+    if (channel.knots > 0 && time - channel.t[channel.knots - 1] > maxGap_) {
+        closeSegment(c);
+    }
+    if (channel.knots == 0) {
+        fillNaN(c, time, false);
+    }
+    if (channel.knots == 4) {
+        std::copy(channel.t + 1, channel.t + 4, channel.t);
+        std::copy(channel.y + 1, channel.y + 4, channel.y);
+        channel.knots--;
+    }
+    channel.t[channel.knots] = time;
+    channel.y[channel.knots] = value;
+    int n = ++channel.knots;
+    // The frames of an interval are known once the slopes at both its knots are
+    if ((method_ == NEAREST || method_ == LINEAR) && n >= 2) {
+        fillInterval(c, n - 2, time, false);
+    } else if (n >= 3) {
+        fillInterval(c, n - 3, channel.t[n - 2], false);
+    }
+}
+
+/**
+ * Fill the frames of the segment up to its last knot, and start a new one.
+ */
+void StreamingResampler::closeSegment(size_t c)
+{
+    Channel& channel = states_[c];
+    int n = channel.knots;
+    if (n == 0) {
+        return;
+    }
+    if (n == 1 || method_ == NEAREST || method_ == LINEAR) {
+        fillInterval(c, n - 1, channel.t[n - 1], true);
+    } else {
+        fillInterval(c, n - 2, channel.t[n - 1], true);
+    }
+    channel.knots = 0;
+}
+
+void StreamingResampler::fillNaN(size_t c, double until, bool inclusive)
+{
+    Channel& channel = states_[c];
+    for (; !finished_ || channel.next < end_; channel.next++) {
+        double time = gridTime(channel.next);
+        if (inclusive ? time > until : time >= until) {
+            break;
+        }
+        gridRow(channel.next)[c] = NOT_A_NUMBER;
+    }
+}
+
+/**
+ * Fill the frames up to until between knots a and a + 1 (at knot a if it
+ * is the last one).
+ */
+void StreamingResampler::fillInterval(size_t c, int a, double until, bool inclusive)
+{
+    Channel& channel = states_[c];
+    int b = a + 1 < channel.knots ? a + 1 : a;
+    double h = channel.t[b] - channel.t[a];
+    double delta = b > a ? (channel.y[b] - channel.y[a]) / h : 0;
+    double da(0), cubic2(0), cubic3(0);
+    if (b > a && (method_ == PCHIP || method_ == SPLINE)) {
+        // Hermite form of Matlab's pwch: y + s (d + s (c2 + s c3))
+        da = slope(channel, a);
+        double db = slope(channel, b);
+        cubic2 = (3 * delta - 2 * da - db) / h;
+        cubic3 = (da - 2 * delta + db) / (h * h);
+    }
+    for (; !finished_ || channel.next < end_; channel.next++) {
+        double time = gridTime(channel.next);
+        if (inclusive ? time > until : time >= until) {
+            break;
+        }
+        double s = time - channel.t[a];
+        double value;
+        if (b == a) {
+            value = channel.y[a];
+        } else if (method_ == NEAREST) {
+            value = s < h / 2 ? channel.y[a] : channel.y[b];
+        } else if (method_ == LINEAR) {
+            value = channel.y[a] + delta * s;
+        } else {
+            value = channel.y[a] + s * (da + s * (cubic2 + s * cubic3));
+        }
+        gridRow(channel.next)[c] = value;
+    }
+}
+
+static double sign(double x)
+{
+    return x > 0 ? 1 : x < 0 ? -1 : 0;
+}
+
+/**
+ * Slope of the cubic at knot k of the segment: from the knots on both
+ * sides inside, from the two intervals next to it at the ends (Matlab's
+ * pchip end conditions).
+ */
+double StreamingResampler::slope(const Channel& channel, int k) const
+{
+    int n = channel.knots;
+    const double* t = channel.t;
+    const double* y = channel.y;
+    if (n < 3) {
+        return n < 2 ? 0 : (y[1] - y[0]) / (t[1] - t[0]);
+    }
+    if (k > 0 && k < n - 1) {
+        double h0 = t[k] - t[k - 1], h1 = t[k + 1] - t[k];
+        double d0 = (y[k] - y[k - 1]) / h0, d1 = (y[k + 1] - y[k]) / h1;
+        if (method_ == SPLINE) {
+            return (h1 * d0 + h0 * d1) / (h0 + h1);
+        }
+        // Weighted harmonic mean, zero at extrema
+        if (sign(d0) * sign(d1) <= 0) {
+            return 0;
+        }
+        double w1 = 2 * h1 + h0, w2 = h1 + 2 * h0;
+        return (w1 + w2) / (w1 / d0 + w2 / d1);
+    }
+    // The interval at the end (h0, d0), then the next one (h1, d1)
+    int e = k == 0 ? 0 : n - 1, i = k == 0 ? 1 : n - 2, j = k == 0 ? 2 : n - 3;
+    double h0 = t[i] - t[e], h1 = t[j] - t[i];
+    double d0 = (y[i] - y[e]) / h0, d1 = (y[j] - y[i]) / h1;
+    double d = ((2 * h0 + h1) * d0 - h0 * d1) / (h0 + h1);
+    if (method_ == PCHIP) {
+        if (sign(d) != sign(d0)) {
+            d = 0;
+        } else if (sign(d0) != sign(d1) && fabs(d) > fabs(3 * d0)) {
+            d = 3 * d0;
+        }
+    }
+    return d;
+}
+
+double* StreamingResampler::gridRow(long long index)
+{
+    while (base_ + (long long)grid_.size() <= index) {
+        grid_.push_back(std::vector<double>(states_.size(), NOT_A_NUMBER));
+    }
+    return &grid_[index - base_][0];
+}
+
+/**
+ * Move the frames that every channel has filled to the output, through
+ * the low-pass kernel when decimating.
+ */
+void StreamingResampler::release()
+{
+    size_t channels = states_.size();
+    complete_ = finished_ ? end_ : channels > 0 ? std::numeric_limits<long long>::max() : 0;
+    for (size_t c = 0; c < channels; c++) {
+        complete_ = std::min(complete_, states_[c].next);
+    }
+    if (factor_ == 1) {
+        for (; nextOutput_ < complete_; nextOutput_++) {
+            times_.push_back(gridTime(nextOutput_));
+            frames_.push_back(channels > 0 ? grid_[nextOutput_ - base_] : std::vector<double>());
+        }
+    } else {
+        long long half = (long long)kernel_.size() / 2;
+        for (; finished_ ? nextOutput_ < end_ : nextOutput_ + half < complete_; nextOutput_ += factor_) {
+            // Weighted mean over the valid frames under the kernel
+            std::fill(acc_.begin(), acc_.end(), 0.0);
+            std::fill(weight_.begin(), weight_.end(), 0.0);
+            for (long long i = std::max(nextOutput_ - half, 0LL); channels > 0 && i <= nextOutput_ + half && i < complete_; i++) {
+                double w = kernel_[i - nextOutput_ + half];
+                const double* row = &grid_[i - base_][0];
+                for (size_t c = 0; c < channels; c++) {
+                    if (row[c] == row[c]) {
+                        acc_[c] += w * row[c];
+                        weight_[c] += w;
+                    }
+                }
+            }
+            std::vector<double> frame(channels);
+            const double* centre = channels > 0 ? &grid_[nextOutput_ - base_][0] : 0;
+            for (size_t c = 0; c < channels; c++) {
+                frame[c] = centre[c] == centre[c] && weight_[c] >= RESAMPLE_MIN_WEIGHT ? acc_[c] / weight_[c] : NOT_A_NUMBER;
+            }
+            times_.push_back(gridTime(nextOutput_));
+            frames_.push_back(frame);
+        }
+    }
+    // Frames still under the kernel of the next output frame stay
+    long long keep = factor_ == 1 ? nextOutput_ : nextOutput_ - (long long)kernel_.size() / 2;
+    while (base_ < keep && !grid_.empty()) {
+        grid_.pop_front();
+        base_++;
+    }
+    if (grid_.empty()) {
+        base_ = std::max(base_, keep);
+    }
+}
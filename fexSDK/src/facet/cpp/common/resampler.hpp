@@ -0,0 +1,129 @@
+#ifndef RESAMPLER_HPP
+#define RESAMPLER_HPP
+
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * Resampling of timestamped rows to a constant frame rate, as
+ * fexc.interpolate (fex_interpolate) and fexc.downsample do with the
+ * matrices of a whole session, one row at a time.
+ *
+ * Each channel is interpolated on its own between its valid (not NaN)
+ * values, the knots. Knots further apart than the maximum gap split the
+ * channel into segments, and the frames between segments (or before the
+ * first knot and after the last) are NaN: the rule of fex_interpolate, in
+ * seconds instead of frames. Since a row only waits for the next knot of
+ * each channel, or for the maximum gap to pass, the memory held is
+ * bounded by the maximum gap.
+ *
+ * Below the frame rate of the input, the rows are first interpolated at
+ * factor times the output rate, then low-pass filtered below the output
+ * Nyquist frequency (fir1 kernel, see designFir) and decimated: averaging
+ * instead of picking frames, as fexc.downsample, without aliasing. The
+ * cutoff is RESAMPLE_CUTOFF of the output Nyquist frequency, as in Matlab's
+ * decimate: a fir1 kernel only halves the amplitude at its cutoff, and a
+ * cutoff at the Nyquist frequency would let the band just above it alias.
+ *
+ * Rows hold channels values, channel-interleaved (row-major).
+ */
+
+enum GapMethod {
+    NEAREST,    ///< Value of the nearest knot
+    LINEAR,
+    PCHIP,      ///< Shape-preserving piecewise cubic, as Matlab's pchip (fex_interpolate)
+    SPLINE      ///< Piecewise cubic with the slopes of the parabolas through three knots (Catmull-Rom)
+};
+
+const double RESAMPLE_MAX_GAP = 1.0;        /**< Seconds between knots filled by default **/
+const double RESAMPLE_MIN_GAP_STEPS = 1.5;  /**< Maximum gap, at least: input frame steps (consecutive frames are no gap) **/
+const int RESAMPLE_MIN_ORDER = 30;          /**< Order of the low-pass kernel, at least (Matlab's decimate) **/
+const int RESAMPLE_ORDER_PER_FACTOR = 8;    /**< ... and per unit of the decimation factor **/
+const double RESAMPLE_CUTOFF = 0.8;         /**< Low-pass cutoff, relative to the output Nyquist frequency (decimate) **/
+const double RESAMPLE_MIN_WEIGHT = 0.5;     /**< Share of the kernel on valid frames for a decimated value **/
+const double RESAMPLE_RATE_TOLERANCE = 1e-6;   /**< Relative error of the rates (rounded timestamps) **/
+
+/**
+ * Parse "nearest", "linear", "pchip" or "spline". Returns false for other names.
+ */
+bool parseGapMethod(const std::string& name, GapMethod& method);
+
+/**
+ * Decimation factor for input at sourceRate and output at rate (Hz): 1
+ * (no low-pass) unless the input is faster than the output by more than
+ * RESAMPLE_RATE_TOLERANCE, as a rate measured from rounded timestamps is.
+ */
+int decimationFactor(double sourceRate, double rate);
+
+class StreamingResampler {
+public:
+    /**
+     * \param rate output frames per second
+     * \param maxGap seconds between knots filled (infinity fills every gap)
+     * \param factor decimation factor (see decimationFactor)
+     */
+    StreamingResampler(size_t channels, double rate, GapMethod method = PCHIP, double maxGap = RESAMPLE_MAX_GAP,
+                       int factor = 1);
+
+    /**
+     * Add the next input row at time (seconds); NaN values are missing.
+     * Rows whose time does not increase are dropped. The output frames are
+     * at the time of the first row plus multiples of 1 / rate.
+     */
+    void push(double time, const double* values);
+
+    /** The input has ended at the last row: the remaining frames are released **/
+    void finish();
+
+    /**
+     * Copy the next output frame to values (channels values) and its time
+     * to time, and return true; false if it is not ready yet.
+     */
+    bool pop(double& time, double* values);
+
+    size_t channels() const { return states_.size(); }
+    size_t numDropped() const { return dropped_; }
+
+private:
+    /** Interpolation state of a channel: the last knots of its segment **/
+    struct Channel {
+        Channel() : knots(0), next(0) {}
+        double t[4];
+        double y[4];
+        int knots;              ///< Knots held, the newest last
+        long long next;         ///< Next grid frame to fill
+    };
+
+    void addKnot(size_t c, double time, double value);
+    void closeSegment(size_t c);
+    void fillNaN(size_t c, double until, bool inclusive);
+    void fillInterval(size_t c, int a, double until, bool inclusive);
+    double slope(const Channel& channel, int k) const;
+    double gridTime(long long index) const { return first_ + index * step_; }
+    double* gridRow(long long index);
+    void release();
+
+    GapMethod method_;
+    double maxGap_;
+    int factor_;
+    double step_;                           ///< Seconds between grid frames
+    std::vector<double> kernel_;            ///< Low-pass kernel, if factor_ > 1
+    std::vector<Channel> states_;
+    double first_;                          ///< Time of the first row
+    double last_;                           ///< Time of the last row
+    bool started_;
+    bool finished_;
+    size_t dropped_;
+    long long end_;                         ///< Grid frames, once finished
+    std::deque< std::vector<double> > grid_;   ///< Grid frames from base_ on
+    long long base_;
+    long long complete_;                    ///< Grid frames filled in every channel
+    long long nextOutput_;                  ///< Next grid frame to output
+    std::deque<double> times_;              ///< Output frames not popped
+    std::deque< std::vector<double> > frames_;
+    std::vector<double> acc_;
+    std::vector<double> weight_;
+};
+
+#endif  // RESAMPLER_HPP
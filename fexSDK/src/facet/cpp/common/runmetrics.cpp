@@ -0,0 +1,333 @@
+#include "runmetrics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdio.h>
+#include <sys/resource.h>
+#include "checkpoint.hpp"
+#include "textwriter.hpp"
+
+static const int NUM_DECADES = 8;       /**< 1 us to 100 s **/
+static const int PER_DECADE = 90;       /**< 1.0, 1.1, ... 9.9 **/
+static const size_t NUM_BUCKETS = 2 + NUM_DECADES * PER_DECADE;
+static const double POW10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8 };
+
+/** Upper bounds of the Prometheus buckets (all are bucket bounds of LatencyHistogram) **/
+static const double PROMETHEUS_BOUNDS[] = {
+    1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+
+LatencyHistogram::LatencyHistogram()
+: counts_(NUM_BUCKETS, 0), count_(0), sum_(0), max_(0)
+{
+}
+
+size_t LatencyHistogram::bucket(double seconds)
+{
+    double us = seconds * 1e6;
+    // Also sends NaN and negative durations to the underflow bucket
+    if (!(us >= 1)) {
+        return 0;
+    }
+    int decade = 0;
+    while (decade < NUM_DECADES && us >= POW10[decade + 1]) {
+        decade++;
+    }
+    if (decade == NUM_DECADES) {
+        return NUM_BUCKETS - 1;
+    }
+    int mantissa = (int)(us / POW10[decade] * 10);
+    mantissa = std::max(10, std::min(99, mantissa));
+    return 1 + decade * PER_DECADE + (mantissa - 10);
+}
+
+double LatencyHistogram::upperBound(size_t bucket)
+{
+    if (bucket == 0) {
+        return 1e-6;
+    }
+    if (bucket == NUM_BUCKETS - 1) {
+        return std::numeric_limits<double>::infinity();
+    }
+    int decade = (int)(bucket - 1) / PER_DECADE;
+    int mantissa = (int)(bucket - 1) % PER_DECADE + 10;
+    return (mantissa + 1) * POW10[decade] * 1e-7;
+}
+
+void LatencyHistogram::record(double seconds)
+{
+    counts_[bucket(seconds)]++;
+    count_++;
+    sum_ += seconds;
+    max_ = std::max(max_, seconds);
+}
+
+double LatencyHistogram::percentile(double pct) const
+{
+    if (count_ == 0) {
+        return 0;
+    }
+    double rank = std::max(1.0, std::ceil(pct / 100 * count_));
+    unsigned long long seen = 0;
+    for (size_t b = 0; b < counts_.size(); b++) {
+        seen += counts_[b];
+        if (seen >= rank) {
+            return std::min(upperBound(b), max_);
+        }
+    }
+    return max_;
+}
+
+unsigned long long LatencyHistogram::countBelow(double bound) const
+{
+    unsigned long long below = 0;
+    for (size_t b = 0; b < counts_.size() && upperBound(b) <= bound * (1 + 1e-9); b++) {
+        below += counts_[b];
+    }
+    return below;
+}
+
+long long peakRssBytes()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return usage.ru_maxrss;             // bytes
+#else
+    return usage.ru_maxrss * 1024LL;    // kilobytes
+#endif
+}
+
+static void appendDouble(std::string& out, double value)
+{
+    char text[32];
+    if (value != value) {
+        out += "NaN";
+        return;
+    }
+    snprintf(text, sizeof(text), "%.15g", value);
+    out += text;
+}
+
+/** Escapes for a JSON string or a Prometheus label value (same rules for these characters) **/
+static void appendQuoted(std::string& out, const std::string& text)
+{
+    out += '"';
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '"' || text[i] == '\\') {
+            out += '\\';
+            out += text[i];
+        } else if (text[i] == '\n') {
+            out += "\\n";
+        } else {
+            out += text[i];
+        }
+    }
+    out += '"';
+}
+
+RunMetrics::RunMetrics(const std::string& program, const std::string& input, const std::string& basename)
+: program_(program), input_(input), basename_(basename), start_(wallSeconds())
+{
+    size_t slash = basename.find_last_of("/\\");
+    labels_ = "program=";
+    appendQuoted(labels_, program);
+    labels_ += ",run=";
+    appendQuoted(labels_, slash == std::string::npos ? basename : basename.substr(slash + 1));
+}
+
+size_t RunMetrics::addStage(const std::string& name)
+{
+    ScopedLock lock(mutex_);
+    stages_.push_back(Stage());
+    stages_.back().name = name;
+    return stages_.size() - 1;
+}
+
+size_t RunMetrics::addCounter(const std::string& name, const std::string& help)
+{
+    ScopedLock lock(mutex_);
+    Value counter = { name, help, 0 };
+    counters_.push_back(counter);
+    return counters_.size() - 1;
+}
+
+size_t RunMetrics::addGauge(const std::string& name, const std::string& help)
+{
+    ScopedLock lock(mutex_);
+    Value gauge = { name, help, 0 };
+    gauges_.push_back(gauge);
+    return gauges_.size() - 1;
+}
+
+void RunMetrics::record(size_t stage, double seconds)
+{
+    ScopedLock lock(mutex_);
+    stages_[stage].histogram.record(seconds);
+}
+
+void RunMetrics::increment(size_t counter, unsigned long long count)
+{
+    ScopedLock lock(mutex_);
+    counters_[counter].value += count;
+}
+
+void RunMetrics::setGauge(size_t gauge, double value)
+{
+    ScopedLock lock(mutex_);
+    gauges_[gauge].value = value;
+}
+
+void RunMetrics::formatJson(std::string& out, double elapsed, long long peakRss) const
+{
+    static const double PERCENTILES[] = { 50, 90, 99 };
+    out += "{\n   \"program\" : ";
+    appendQuoted(out, program_);
+    out += ",\n   \"input\" : ";
+    appendQuoted(out, input_);
+    out += ",\n   \"elapsed_seconds\" : ";
+    appendDouble(out, elapsed);
+    out += ",\n   \"peak_rss_bytes\" : ";
+    appendInt(out, (long)peakRss);
+    out += ",\n   \"stages\" : {";
+    for (size_t s = 0; s < stages_.size(); s++) {
+        const LatencyHistogram& histogram(stages_[s].histogram);
+        out += s == 0 ? "\n      " : ",\n      ";
+        appendQuoted(out, stages_[s].name);
+        out += " : { \"count\" : ";
+        appendInt(out, (long)histogram.count());
+        out += ", \"sum_seconds\" : ";
+        appendDouble(out, histogram.sum());
+        out += ", \"mean_seconds\" : ";
+        appendDouble(out, histogram.count() ? histogram.sum() / histogram.count() : 0);
+        for (size_t p = 0; p < sizeof(PERCENTILES) / sizeof(PERCENTILES[0]); p++) {
+            out += ", \"p";
+            appendInt(out, (long)PERCENTILES[p]);
+            out += "_seconds\" : ";
+            appendDouble(out, histogram.percentile(PERCENTILES[p]));
+        }
+        out += ", \"max_seconds\" : ";
+        appendDouble(out, histogram.max());
+        out += " }";
+    }
+    out += "\n   },\n   \"counters\" : {";
+    for (size_t c = 0; c < counters_.size(); c++) {
+        out += c == 0 ? "\n      " : ",\n      ";
+        appendQuoted(out, counters_[c].name);
+        out += " : ";
+        appendDouble(out, counters_[c].value);
+    }
+    out += "\n   },\n   \"gauges\" : {";
+    for (size_t g = 0; g < gauges_.size(); g++) {
+        out += g == 0 ? "\n      " : ",\n      ";
+        appendQuoted(out, gauges_[g].name);
+        out += " : ";
+        appendDouble(out, gauges_[g].value);
+    }
+    out += "\n   }\n}\n";
+}
+
+void RunMetrics::formatPrometheus(std::string& out, double elapsed, long long peakRss) const
+{
+    out += "# HELP fex_stage_seconds Wall-clock time of a processing stage.\n";
+    out += "# TYPE fex_stage_seconds histogram\n";
+    for (size_t s = 0; s < stages_.size(); s++) {
+        const LatencyHistogram& histogram(stages_[s].histogram);
+        std::string labels(labels_ + ",stage=");
+        appendQuoted(labels, stages_[s].name);
+        for (size_t b = 0; b < sizeof(PROMETHEUS_BOUNDS) / sizeof(PROMETHEUS_BOUNDS[0]); b++) {
+            out += "fex_stage_seconds_bucket{" + labels + ",le=\"";
+            appendFloat(out, (float)PROMETHEUS_BOUNDS[b]);
+            out += "\"} ";
+            appendInt(out, (long)histogram.countBelow(PROMETHEUS_BOUNDS[b]));
+            out += '\n';
+        }
+        out += "fex_stage_seconds_bucket{" + labels + ",le=\"+Inf\"} ";
+        appendInt(out, (long)histogram.count());
+        out += "\nfex_stage_seconds_sum{" + labels + "} ";
+        appendDouble(out, histogram.sum());
+        out += "\nfex_stage_seconds_count{" + labels + "} ";
+        appendInt(out, (long)histogram.count());
+        out += '\n';
+    }
+    for (size_t c = 0; c < counters_.size(); c++) {
+        const std::string name("fex_" + counters_[c].name + "_total");
+        out += "# HELP " + name + " " + counters_[c].help + "\n# TYPE " + name + " counter\n";
+        out += name + "{" + labels_ + "} ";
+        appendDouble(out, counters_[c].value);
+        out += '\n';
+    }
+    for (size_t g = 0; g < gauges_.size(); g++) {
+        const std::string name("fex_" + gauges_[g].name);
+        out += "# HELP " + name + " " + gauges_[g].help + "\n# TYPE " + name + " gauge\n";
+        out += name + "{" + labels_ + "} ";
+        appendDouble(out, gauges_[g].value);
+        out += '\n';
+    }
+    out += "# HELP fex_peak_rss_bytes Peak resident set size of the process.\n# TYPE fex_peak_rss_bytes gauge\n";
+    out += "fex_peak_rss_bytes{" + labels_ + "} ";
+    appendInt(out, (long)peakRss);
+    out += "\n# HELP fex_elapsed_seconds Wall-clock time since the run started.\n# TYPE fex_elapsed_seconds gauge\n";
+    out += "fex_elapsed_seconds{" + labels_ + "} ";
+    appendDouble(out, elapsed);
+    out += '\n';
+}
+
+bool RunMetrics::write()
+{
+    std::string json, prometheus;
+    double elapsed = wallSeconds() - start_;
+    long long peakRss = peakRssBytes();
+    {
+        ScopedLock lock(mutex_);
+        formatJson(json, elapsed, peakRss);
+        formatPrometheus(prometheus, elapsed, peakRss);
+    }
+    bool ok = replaceFile(basename_ + ".json", json, false);
+    return replaceFile(basename_ + ".prom", prometheus, false) && ok;
+}
+
+MetricsReporter::MetricsReporter(RunMetrics& metrics, double interval)
+: metrics_(metrics), interval_(interval), stopping_(false), ok_(true)
+{
+    start();
+}
+
+MetricsReporter::~MetricsReporter()
+{
+    stop();
+}
+
+void MetricsReporter::run()
+{
+    while (true) {
+        {
+            ScopedLock lock(mutex_);
+            if (!stopping_) {
+                stopped_.waitFor(mutex_, interval_);
+            }
+            if (stopping_) {
+                return;
+            }
+        }
+        // ok_ belongs to this thread until it is joined
+        ok_ = metrics_.write() && ok_;
+    }
+}
+
+bool MetricsReporter::stop()
+{
+    {
+        ScopedLock lock(mutex_);
+        if (stopping_) {
+            return ok_;
+        }
+        stopping_ = true;
+    }
+    stopped_.signal();
+    join();
+    ok_ = metrics_.write() && ok_;
+    return ok_;
+}
@@ -0,0 +1,158 @@
+#ifndef RUNMETRICS_HPP
+#define RUNMETRICS_HPP
+
+#include <string>
+#include <vector>
+#include "stagestats.hpp"
+#include "threads.hpp"
+
+const double METRICS_INTERVAL = 10;   /**< Seconds between two writes of the metrics files **/
+
+/**
+ * Latency histogram with two significant digits (as HdrHistogram): 90
+ * linear buckets per decade from 1 us to 100 s, plus an underflow and an
+ * overflow bucket. Recording is O(1) and the memory is fixed, however
+ * long the run.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(double seconds);
+
+    unsigned long long count() const { return count_; }
+    double sum() const { return sum_; }
+    double max() const { return max_; }
+    /** Upper bound of the bucket holding the pct-th percentile, in seconds **/
+    double percentile(double pct) const;
+    /** Number of durations below bound (exact when bound has two significant digits) **/
+    unsigned long long countBelow(double bound) const;
+
+private:
+    static size_t bucket(double seconds);
+    static double upperBound(size_t bucket);
+
+    std::vector<unsigned long long> counts_;
+    unsigned long long count_;
+    double sum_;
+    double max_;
+};
+
+/**
+ * Metrics of a driver run: a latency histogram per processing stage,
+ * counters (frames, failures) and gauges (queue depths), shared by the
+ * threads of the run.
+ *
+ * Stages, counters and gauges are declared before the run starts and
+ * referred to by the index returned by add*(); record(), increment() and
+ * setGauge() may then be called from any thread.
+ *
+ * write() replaces BASENAME.json (a sidecar with percentiles) and
+ * BASENAME.prom (Prometheus text format, for the node exporter textfile
+ * collector); both are written to a temporary file and renamed, so
+ * readers never see a partial file.
+ */
+class RunMetrics {
+public:
+    /**
+     * \param program name of the driver (the "program" label)
+     * \param input file being processed (in the sidecar)
+     * \param basename output files without extension; its file name is the "run" label
+     */
+    RunMetrics(const std::string& program, const std::string& input, const std::string& basename);
+
+    size_t addStage(const std::string& name);
+    size_t addCounter(const std::string& name, const std::string& help);
+    size_t addGauge(const std::string& name, const std::string& help);
+
+    void record(size_t stage, double seconds);
+    void increment(size_t counter, unsigned long long count = 1);
+    void setGauge(size_t gauge, double value);
+
+    /**
+     * Write the JSON sidecar and the Prometheus file. Returns false on error.
+     */
+    bool write();
+
+private:
+    struct Stage {
+        std::string name;
+        LatencyHistogram histogram;
+    };
+    struct Value {
+        std::string name;
+        std::string help;
+        double value;
+    };
+
+    void formatJson(std::string& out, double elapsed, long long peakRss) const;
+    void formatPrometheus(std::string& out, double elapsed, long long peakRss) const;
+
+    std::string program_;
+    std::string input_;
+    std::string basename_;
+    std::string labels_;     ///< program="...",run="..."
+    double start_;
+    std::vector<Stage> stages_;
+    std::vector<Value> counters_;
+    std::vector<Value> gauges_;
+    Mutex mutex_;
+};
+
+/**
+ * Peak resident set size of the process in bytes (0 if unknown).
+ */
+long long peakRssBytes();
+
+/**
+ * Writes a RunMetrics every interval seconds from a background thread,
+ * and a last time on stop().
+ */
+class MetricsReporter : public Thread {
+public:
+    MetricsReporter(RunMetrics& metrics, double interval = METRICS_INTERVAL);
+    ~MetricsReporter();
+
+    /** Stop the thread and write the final metrics; returns false if a write failed **/
+    bool stop();
+
+protected:
+    void run();
+
+private:
+    RunMetrics& metrics_;
+    double interval_;
+    bool stopping_;
+    bool ok_;
+    Mutex mutex_;
+    Condition stopped_;
+};
+
+/**
+ * Adds the wall-clock time from construction to destruction (or stop()) to
+ * a stage of a RunMetrics; does nothing without one.
+ */
+class MetricsTimer {
+public:
+    MetricsTimer(RunMetrics* metrics, size_t stage)
+    : metrics_(metrics), stage_(stage), start_(metrics ? wallSeconds() : 0) {}
+    ~MetricsTimer() { stop(); }
+
+    void stop()
+    {
+        if (metrics_) {
+            metrics_->record(stage_, wallSeconds() - start_);
+            metrics_ = 0;
+        }
+    }
+
+private:
+    MetricsTimer(const MetricsTimer&);
+    MetricsTimer& operator=(const MetricsTimer&);
+
+    RunMetrics* metrics_;
+    size_t stage_;
+    double start_;
+};
+
+#endif  // RUNMETRICS_HPP
@@ -0,0 +1,52 @@
+#include "searchwindow.hpp"
+#include <algorithm>
+#include <cmath>
+
+SearchWindow::SearchWindow(int refresh, size_t lag, double margin)
+: refresh_(refresh), lag_(std::max(lag, (size_t)1)), margin_(margin)
+{
+}
+
+cv::Rect SearchWindow::region(size_t framenum, const cv::Size& frameSize)
+{
+    cv::Rect whole(0, 0, frameSize.width, frameSize.height);
+    if (refresh_ > 0 && framenum % refresh_ == 0) {
+        return whole;
+    }
+    cv::Rect_<float> face;
+    {
+        ScopedLock lock(mutex_);
+        // Latest frame recorded at least lag_ frames before
+        std::deque<Record>::const_reverse_iterator it = records_.rbegin();
+        while (it != records_.rend() && it->framenum + lag_ > framenum) {
+            ++it;
+        }
+        if (it == records_.rend() || !it->found) {
+            return whole;
+        }
+        face = it->face;
+    }
+    double dx = margin_ * face.width;
+    double dy = margin_ * face.height;
+    int x0 = (int)std::floor(face.x - dx);
+    int y0 = (int)std::floor(face.y - dy);
+    int x1 = (int)std::ceil(face.x + face.width + dx);
+    int y1 = (int)std::ceil(face.y + face.height + dy);
+    cv::Rect window = cv::Rect(x0, y0, x1 - x0, y1 - y0) & whole;
+    return window.area() > 0 ? window : whole;
+}
+
+void SearchWindow::update(size_t framenum, const cv::Rect_<float>& face, bool found)
+{
+    Record record;
+    record.framenum = framenum;
+    record.found = found;
+    record.face = face;
+    ScopedLock lock(mutex_);
+    records_.push_back(record);
+    // The frames to come are after framenum: drop the records older than
+    // the latest one at least lag_ frames before framenum + 1
+    while (records_.size() > 1 && records_[1].framenum + lag_ <= framenum + 1) {
+        records_.pop_front();
+    }
+}
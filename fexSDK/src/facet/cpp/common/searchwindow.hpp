@@ -0,0 +1,64 @@
+#ifndef SEARCHWINDOW_HPP
+#define SEARCHWINDOW_HPP
+
+#include <deque>
+#include <opencv2/opencv.hpp>
+#include "threads.hpp"
+
+const double SEARCH_MARGIN = 1.0;   /**< Margin around the last face, as a fraction of its size **/
+const int    SEARCH_REFRESH = 30;   /**< Frames between two whole-frame searches **/
+const size_t SEARCH_LAG = 4;        /**< Frames between a face and the frames searched around it, in a pipeline **/
+
+/**
+ * Region of the next frame where the face is searched, from the face found
+ * in the previous frames: the last face box grown by margin times its size
+ * on each side. Whole frames are searched when there is no face to follow,
+ * and every refresh frames, so new or moved faces are picked up.
+ *
+ * Frame k is searched around the face of the latest frame recorded up to
+ * frame k - lag. With lag 1 that is the previous frame; the analyzer
+ * workers of a pipeline analyze up to lag frames at a time, and since
+ * the region of a frame only depends on the frames lag or more before it,
+ * it is the same whatever the number of workers or the order they finish
+ * in. update() must be called in frame order, and the frames up to
+ * k - lag recorded before region() is asked for frame k; region() may be
+ * called from any thread.
+ */
+class SearchWindow {
+public:
+    SearchWindow(int refresh = SEARCH_REFRESH, size_t lag = 1, double margin = SEARCH_MARGIN);
+
+    /**
+     * Region of frame framenum (of frameSize) to search; the whole frame
+     * when no face is followed or a whole-frame search is due.
+     */
+    cv::Rect region(size_t framenum, const cv::Size& frameSize);
+
+    /**
+     * Record the largest face of frame framenum, in whole-frame
+     * coordinates; found is false when the search found no face, and the
+     * frames that follow it are then searched whole.
+     */
+    void update(size_t framenum, const cv::Rect_<float>& face, bool found);
+
+    size_t lag() const { return lag_; }
+
+private:
+    SearchWindow(const SearchWindow&);
+    SearchWindow& operator=(const SearchWindow&);
+
+    /** Outcome of the search of a frame **/
+    struct Record {
+        size_t framenum;
+        bool found;
+        cv::Rect_<float> face;
+    };
+
+    int refresh_;
+    size_t lag_;
+    double margin_;
+    Mutex mutex_;
+    std::deque<Record> records_;    ///< Frames the regions to come may follow, oldest first
+};
+
+#endif  // SEARCHWINDOW_HPP
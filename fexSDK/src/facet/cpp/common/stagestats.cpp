@@ -0,0 +1,26 @@
+#include "stagestats.hpp"
+#include <algorithm>
+#include <cmath>
+#include <sys/time.h>
+
+double wallSeconds()
+{
+    struct timeval now;
+    gettimeofday(&now, 0);
+    return now.tv_sec + now.tv_usec * 1e-6;
+}
+
+double StageStats::percentile(double pct) const
+{
+    if (samples_.empty()) {
+        return 0;
+    }
+    if (!sorted_) {
+        std::sort(samples_.begin(), samples_.end());
+        sorted_ = true;
+    }
+    // Nearest rank: the smallest sample with at least pct% of the samples at or below it
+    double rank = std::ceil(pct / 100 * samples_.size());
+    size_t index = rank < 1 ? 0 : std::min((size_t)rank, samples_.size()) - 1;
+    return samples_[index];
+}
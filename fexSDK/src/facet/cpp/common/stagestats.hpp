@@ -0,0 +1,69 @@
+#ifndef STAGESTATS_HPP
+#define STAGESTATS_HPP
+
+#include <string>
+#include <vector>
+
+/**
+ * Wall-clock time in seconds (clock() is CPU time, which adds up the
+ * threads).
+ */
+double wallSeconds();
+
+/**
+ * Wall-clock durations of one processing stage, with their percentiles.
+ */
+class StageStats {
+public:
+    explicit StageStats(const std::string& name) : name_(name), total_(0), sorted_(true) {}
+
+    void add(double seconds)
+    {
+        samples_.push_back(seconds);
+        total_ += seconds;
+        sorted_ = false;
+    }
+
+    const std::string& name() const { return name_; }
+    size_t count() const { return samples_.size(); }
+    /** Sum of the durations, in seconds **/
+    double total() const { return total_; }
+    double mean() const { return samples_.empty() ? 0 : total_ / samples_.size(); }
+    /** Nearest-rank percentile (0 to 100) of the durations, in seconds **/
+    double percentile(double pct) const;
+    double max() const { return percentile(100); }
+
+private:
+    std::string name_;
+    mutable std::vector<double> samples_;
+    double total_;
+    mutable bool sorted_;
+};
+
+/**
+ * Adds the wall-clock time from construction to destruction (or stop()) to
+ * a StageStats.
+ */
+class StageTimer {
+public:
+    explicit StageTimer(StageStats& stats) : stats_(stats), start_(wallSeconds()), running_(true) {}
+    ~StageTimer() { stop(); }
+
+    void stop()
+    {
+        if (running_) {
+            stats_.add(wallSeconds() - start_);
+            running_ = false;
+        }
+    }
+
+private:
+    StageTimer(const StageTimer&);
+    StageTimer& operator=(const StageTimer&);
+
+    StageStats& stats_;
+    double start_;
+    bool running_;
+};
+
+#endif  // STAGESTATS_HPP
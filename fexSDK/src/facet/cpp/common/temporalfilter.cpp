@@ -0,0 +1,413 @@
+#include "temporalfilter.hpp"
+#include <algorithm>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+const size_t CHANNEL_BLOCK = 64;   ///< Channels accumulated at a time, to stay in L1
+
+bool parseFilterBand(const std::string& name, FilterBand& band)
+{
+    if (name == "lp" || name == "low" || name == "lowpass") {
+        band = LOWPASS;
+    } else if (name == "hp" || name == "high" || name == "highpass") {
+        band = HIGHPASS;
+    } else if (name == "bp" || name == "band" || name == "bandpass") {
+        band = BANDPASS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static double sinc(double x)
+{
+    return x == 0 ? 1 : sin(M_PI * x) / (M_PI * x);
+}
+
+std::vector<double> designFir(FilterBand band, int order, double low, double high, double nyquist)
+{
+    if (band == HIGHPASS && order % 2) {
+        order++;
+    }
+    order = std::max(order, 1);
+    double w1 = low / nyquist;
+    double w2 = high / nyquist;
+    std::vector<double> kernel(order + 1);
+    for (int k = 0; k <= order; k++) {
+        double m = k - order / 2.0;
+        double ideal;
+        if (band == LOWPASS) {
+            ideal = w1 * sinc(w1 * m);
+        } else if (band == HIGHPASS) {
+            ideal = (m == 0 ? 1 : 0) - w1 * sinc(w1 * m);
+        } else {
+            ideal = w2 * sinc(w2 * m) - w1 * sinc(w1 * m);
+        }
+        kernel[k] = ideal * (0.54 - 0.46 * cos(2 * M_PI * k / order));
+    }
+    // Unit gain at the centre of the first pass band, as fir1 scales it
+    double f0 = band == LOWPASS ? 0 : band == HIGHPASS ? 1 : (w1 + w2) / 2;
+    double re = 0, im = 0;
+    for (int k = 0; k <= order; k++) {
+        re += kernel[k] * cos(M_PI * k * f0);
+        im -= kernel[k] * sin(M_PI * k * f0);
+    }
+    double gain = sqrt(re * re + im * im);
+    if (gain > 0) {
+        for (int k = 0; k <= order; k++) {
+            kernel[k] /= gain;
+        }
+    }
+    return kernel;
+}
+
+int firOrder(int order, double lowest, double rate, size_t rows)
+{
+    int cycle = (int)floor(rate / lowest + 0.5);
+    if (order <= 0) {
+        order = (int)floor(std::min(rows / 3.0, 3 * rate / lowest));
+    }
+    if ((order + order % 2) * 3 >= (int)rows) {
+        order = (int)(rows / 3) - 1;
+        order -= order % 2;
+    } else if (order < cycle) {
+        order = cycle;
+    }
+    return std::max(order, 2);
+}
+
+std::vector<double> selfConvolve(const std::vector<double>& kernel)
+{
+    std::vector<double> result(kernel.empty() ? 0 : 2 * kernel.size() - 1, 0.0);
+    for (size_t i = 0; i < kernel.size(); i++) {
+        for (size_t j = 0; j < kernel.size(); j++) {
+            result[i + j] += kernel[i] * kernel[j];
+        }
+    }
+    return result;
+}
+
+/**
+ * Sections of a Butterworth filter, bilinear transform of each pole pair.
+ */
+static void butterworth(std::vector<Biquad>& sections, bool highpass, int order, double cutoff, double nyquist)
+{
+    double k = tan(M_PI * std::min(cutoff / nyquist, 0.999) / 2);
+    for (int p = 0; p < order / 2; p++) {
+        double q = -1 / (2 * cos(M_PI * (2 * p + order + 1) / (2 * order)));
+        double norm = 1 / (1 + k / q + k * k);
+        Biquad s;
+        s.b0 = highpass ? norm : k * k * norm;
+        s.b1 = highpass ? -2 * s.b0 : 2 * s.b0;
+        s.b2 = s.b0;
+        s.a1 = 2 * (k * k - 1) * norm;
+        s.a2 = (1 - k / q + k * k) * norm;
+        sections.push_back(s);
+    }
+    if (order % 2) {
+        double norm = 1 / (1 + k);
+        Biquad s;
+        s.b0 = highpass ? norm : k * norm;
+        s.b1 = highpass ? -s.b0 : s.b0;
+        s.b2 = 0;
+        s.a1 = (k - 1) * norm;
+        s.a2 = 0;
+        sections.push_back(s);
+    }
+}
+
+std::vector<Biquad> designButterworth(FilterBand band, int order, double low, double high, double nyquist)
+{
+    std::vector<Biquad> sections;
+    order = std::max(order, 1);
+    if (band == LOWPASS) {
+        butterworth(sections, false, order, low, nyquist);
+    } else if (band == HIGHPASS) {
+        butterworth(sections, true, order, low, nyquist);
+    } else {
+        butterworth(sections, true, order, low, nyquist);
+        butterworth(sections, false, order, high, nyquist);
+    }
+    return sections;
+}
+
+/**
+ * acc[c] += weight * x[c] for n channels.
+ */
+static void accumulate(double* acc, const double* x, double weight, size_t n)
+{
+    size_t c = 0;
+#if defined(__SSE2__)
+    const __m128d w = _mm_set1_pd(weight);
+    for (; c + 2 <= n; c += 2) {
+        _mm_storeu_pd(acc + c, _mm_add_pd(_mm_loadu_pd(acc + c), _mm_mul_pd(w, _mm_loadu_pd(x + c))));
+    }
+#endif
+    for (; c < n; c++) {
+        acc[c] += weight * x[c];
+    }
+}
+
+/**
+ * Interpolate the NaN values of each channel linearly between the values
+ * of the channel around them, holding its first and last values at the
+ * ends. Marks the values filled in missing (rows x channels); channels
+ * without a value are left NaN. Returns the number of channels with a value.
+ */
+static size_t fillGaps(double* data, size_t rows, size_t channels, std::vector<char>& missing)
+{
+    missing.assign(rows * channels, 0);
+    size_t numFilled(0);
+    for (size_t c = 0; c < channels; c++) {
+        long long previous = -1;
+        for (size_t r = 0; r <= rows; r++) {
+            if (r < rows && data[r * channels + c] != data[r * channels + c]) {
+                missing[r * channels + c] = 1;
+                continue;
+            }
+            if (r == rows && previous < 0) {
+                break;
+            }
+            for (size_t g = previous < 0 ? 0 : previous + 1; g < r; g++) {
+                double& value = data[g * channels + c];
+                if (previous < 0) {
+                    value = data[r * channels + c];
+                } else if (r == rows) {
+                    value = data[previous * channels + c];
+                } else {
+                    double t = (double)(g - previous) / (r - previous);
+                    value = (1 - t) * data[previous * channels + c] + t * data[r * channels + c];
+                }
+            }
+            previous = r;
+        }
+        numFilled += previous >= 0;
+    }
+    return numFilled;
+}
+
+/**
+ * Set the values marked in missing back to NaN.
+ */
+static void restoreGaps(double* data, size_t rows, size_t channels, const std::vector<char>& missing)
+{
+    for (size_t i = 0; i < rows * channels; i++) {
+        if (missing[i]) {
+            data[i] = NAN;
+        }
+    }
+}
+
+static void reverseRows(double* data, size_t rows, size_t channels)
+{
+    for (size_t r = 0; r < rows / 2; r++) {
+        std::swap_ranges(data + r * channels, data + (r + 1) * channels, data + (rows - 1 - r) * channels);
+    }
+}
+
+TemporalFilter::TemporalFilter(const std::vector<double>& kernel)
+: kernel_(kernel)
+{
+}
+
+TemporalFilter::TemporalFilter(const std::vector<Biquad>& sections)
+: sections_(sections)
+{
+}
+
+size_t TemporalFilter::padding() const
+{
+    size_t length = sections_.empty() ? kernel_.size() : 2 * sections_.size() + 1;
+    return 3 * (length - 1);
+}
+
+/**
+ * Filter in place, as if the first row had always been there.
+ */
+void TemporalFilter::forward(double* data, size_t rows, size_t channels) const
+{
+    if (rows == 0) {
+        return;
+    }
+    if (sections_.empty()) {
+        // From the last row back, so the rows each output needs are still inputs
+        std::vector<double> acc(std::min(channels, CHANNEL_BLOCK));
+        for (size_t r = rows; r-- > 0;) {
+            for (size_t c0 = 0; c0 < channels; c0 += CHANNEL_BLOCK) {
+                size_t n = std::min(CHANNEL_BLOCK, channels - c0);
+                std::fill(acc.begin(), acc.begin() + n, 0.0);
+                for (size_t k = 0; k < kernel_.size(); k++) {
+                    size_t input = r >= k ? r - k : 0;
+                    accumulate(&acc[0], data + input * channels + c0, kernel_[k], n);
+                }
+                std::copy(acc.begin(), acc.begin() + n, data + r * channels + c0);
+            }
+        }
+        return;
+    }
+    std::vector<double> s1(channels), s2(channels), level(data, data + channels);
+    for (size_t i = 0; i < sections_.size(); i++) {
+        const Biquad& s = sections_[i];
+        double gain = s.dcGain();
+        for (size_t c = 0; c < channels; c++) {
+            s2[c] = (s.b2 - s.a2 * gain) * level[c];
+            s1[c] = (s.b1 - s.a1 * gain) * level[c] + s2[c];
+            level[c] *= gain;
+        }
+        for (size_t r = 0; r < rows; r++) {
+            double* row = data + r * channels;
+            for (size_t c = 0; c < channels; c++) {
+                double x = row[c];
+                double y = s.b0 * x + s1[c];
+                s1[c] = s.b1 * x - s.a1 * y + s2[c];
+                s2[c] = s.b2 * x - s.a2 * y;
+                row[c] = y;
+            }
+        }
+    }
+}
+
+bool TemporalFilter::filter(double* data, size_t rows, size_t channels) const
+{
+    std::vector<char> missing;
+    if (fillGaps(data, rows, channels, missing) == 0) {
+        return false;
+    }
+    forward(data, rows, channels);
+    restoreGaps(data, rows, channels, missing);
+    return true;
+}
+
+bool TemporalFilter::filtfilt(double* data, size_t rows, size_t channels) const
+{
+    std::vector<char> missing;
+    if (rows == 0 || fillGaps(data, rows, channels, missing) == 0) {
+        return false;
+    }
+    size_t pad = std::min(padding(), rows - 1);
+    std::vector<double> buffer((rows + 2 * pad) * channels);
+    double* x = &buffer[pad * channels];
+    std::copy(data, data + rows * channels, x);
+    const double* first = data;
+    const double* last = data + (rows - 1) * channels;
+    for (size_t j = 1; j <= pad; j++) {
+        for (size_t c = 0; c < channels; c++) {
+            x[-(long long)j * channels + c] = 2 * first[c] - data[j * channels + c];
+            x[(rows - 1 + j) * channels + c] = 2 * last[c] - data[(rows - 1 - j) * channels + c];
+        }
+    }
+    size_t total = rows + 2 * pad;
+    forward(&buffer[0], total, channels);
+    reverseRows(&buffer[0], total, channels);
+    forward(&buffer[0], total, channels);
+    reverseRows(&buffer[0], total, channels);
+    std::copy(x, x + rows * channels, data);
+    restoreGaps(data, rows, channels, missing);
+    return true;
+}
+
+StreamingFilter::StreamingFilter(const std::vector<double>& kernel, size_t width, const std::vector<size_t>& channels)
+: kernel_(kernel), width_(width), channels_(channels), half_((long long)kernel.size() / 2),
+  base_(0), received_(0), next_(0), finished_(false), ready_(0),
+  acc_(channels.size()), reflected_(channels.size())
+{
+}
+
+void StreamingFilter::push(const float* row, bool present)
+{
+    rows_.push_back(std::vector<float>(row, row + width_));
+    present_.push_back(present);
+    if (present) {
+        last_.resize(channels_.size());
+        for (size_t c = 0; c < channels_.size(); c++) {
+            last_[c] = row[channels_[c]];
+        }
+    }
+    if (last_.empty()) {
+        // No face yet: nothing to filter
+        ready_++;
+        return;
+    }
+    samples_.push_back(last_);
+    if (received_ <= half_) {
+        first_.insert(first_.end(), last_.begin(), last_.end());
+    }
+    received_++;
+    release();
+}
+
+void StreamingFilter::finish()
+{
+    finished_ = true;
+    release();
+}
+
+bool StreamingFilter::pop(float* row, bool& present)
+{
+    if (ready_ == 0) {
+        return false;
+    }
+    std::copy(rows_.front().begin(), rows_.front().end(), row);
+    present = present_.front() != 0;
+    rows_.pop_front();
+    present_.pop_front();
+    ready_--;
+    return true;
+}
+
+const double* StreamingFilter::sample(long long index) const
+{
+    if (index <= half_) {
+        return &first_[index * channels_.size()];
+    }
+    return &samples_[index - base_][0];
+}
+
+const double* StreamingFilter::input(long long index)
+{
+    long long last = received_ - 1;
+    if (index >= 0 && index <= last) {
+        return sample(index);
+    }
+    // Odd reflection about the end sample
+    long long end = index < 0 ? 0 : last;
+    long long mirror = index < 0 ? std::min(-index, last) : std::max(2 * last - index, 0LL);
+    const double* e = sample(end);
+    const double* m = sample(mirror);
+    for (size_t c = 0; c < channels_.size(); c++) {
+        reflected_[c] = 2 * e[c] - m[c];
+    }
+    return &reflected_[0];
+}
+
+/**
+ * Filter the samples whose neighbourhood has arrived, into their rows.
+ */
+void StreamingFilter::release()
+{
+    size_t n = channels_.size();
+    while (next_ < received_ && (finished_ || next_ + half_ < received_)) {
+        std::fill(acc_.begin(), acc_.end(), 0.0);
+        for (size_t k = 0; k < kernel_.size(); k++) {
+            accumulate(&acc_[0], input(next_ + (long long)k - half_), kernel_[k], n);
+        }
+        if (present_[ready_]) {
+            std::vector<float>& row = rows_[ready_];
+            for (size_t c = 0; c < n; c++) {
+                row[channels_[c]] = (float)acc_[c];
+            }
+        }
+        ready_++;
+        next_++;
+        while (base_ < next_ - half_ && !samples_.empty()) {
+            samples_.pop_front();
+            base_++;
+        }
+    }
+    if (finished_) {
+        ready_ = rows_.size();
+    }
+}
@@ -0,0 +1,163 @@
+#ifndef TEMPORALFILTER_HPP
+#define TEMPORALFILTER_HPP
+
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * Temporal filters of the emotion and action unit channels, as
+ * fexc.temporalfilt and fex_bandpass apply them in Matlab (fir1 and
+ * filtfilt), for all the channels of a file at once.
+ *
+ * Data are rows x channels values, channel-interleaved (row-major, the
+ * layout of the output rows): every filter tap is applied to a block of
+ * adjacent channels of one row (SSE2 pairs when compiled for it), so the
+ * loops run over contiguous memory whatever the number of channels.
+ */
+
+enum FilterBand { LOWPASS, HIGHPASS, BANDPASS };
+
+/**
+ * Parse "lp", "hp", "bp" (or lowpass, highpass, bandpass, low, high,
+ * band, as fex_bandpass). Returns false for other names.
+ */
+bool parseFilterBand(const std::string& name, FilterBand& band);
+
+/**
+ * Linear-phase FIR kernel of order + 1 taps, designed as Matlab's fir1:
+ * Hamming-windowed ideal response, scaled to unit gain at DC (LOWPASS),
+ * at Nyquist (HIGHPASS) or at the centre of the band (BANDPASS). Cutoffs
+ * are in Hz; low is the cutoff of LOWPASS and HIGHPASS. HIGHPASS needs an
+ * even order: odd orders are incremented, as fir1 does.
+ */
+std::vector<double> designFir(FilterBand band, int order, double low, double high, double nyquist);
+
+/**
+ * Order of the FIR kernel for rows samples at rate Hz, as
+ * fexc.temporalfilt and fex_bandpass pick it: by default (order 0) three
+ * cycles of the lowest cutoff or a third of the data, whichever is
+ * shorter; at most a third of the data and at least one cycle.
+ */
+int firOrder(int order, double lowest, double rate, size_t rows);
+
+/**
+ * The kernel convolved with itself: one pass of it filters as filtfilt
+ * does with kernel (zero phase, squared magnitude) away from the edges.
+ */
+std::vector<double> selfConvolve(const std::vector<double>& kernel);
+
+/**
+ * Second-order section: y = b0 x + s1; s1 = b1 x - a1 y + s2; s2 = b2 x - a2 y
+ * (transposed direct form II, a0 = 1).
+ */
+struct Biquad {
+    double b0, b1, b2, a1, a2;
+    /** Gain at DC **/
+    double dcGain() const { return (b0 + b1 + b2) / (1 + a1 + a2); }
+};
+
+/**
+ * Butterworth filter of the given order as second-order sections
+ * (bilinear transform); BANDPASS is a HIGHPASS at low followed by a
+ * LOWPASS at high, each of the given order.
+ */
+std::vector<Biquad> designButterworth(FilterBand band, int order, double low, double high, double nyquist);
+
+/**
+ * A FIR kernel or a cascade of biquads, applied to channel-interleaved
+ * data in place.
+ */
+class TemporalFilter {
+public:
+    explicit TemporalFilter(const std::vector<double>& kernel);
+    explicit TemporalFilter(const std::vector<Biquad>& sections);
+
+    /**
+     * Zero-phase filtering as Matlab's filtfilt: the data are extended at
+     * both ends by odd reflection over 3 filter lengths, filtered forward
+     * and backward, each pass starting from the steady state of its first
+     * value. The NaN values of each channel are interpolated linearly for
+     * filtering (held at the ends) and left NaN; channels without a value
+     * stay NaN. Returns false, leaving data as it was, if no channel has a
+     * value.
+     */
+    bool filtfilt(double* data, size_t rows, size_t channels) const;
+
+    /**
+     * Causal filtering, starting from the steady state of the first row;
+     * NaN values as filtfilt().
+     */
+    bool filter(double* data, size_t rows, size_t channels) const;
+
+    /** Samples added at each end by filtfilt() **/
+    size_t padding() const;
+
+private:
+    void forward(double* data, size_t rows, size_t channels) const;
+
+    std::vector<double> kernel_;
+    std::vector<Biquad> sections_;
+};
+
+/**
+ * FIR filter of rows that arrive one at a time, for the drivers: each row
+ * is released once the kernel has seen half its length past it, so with a
+ * symmetric kernel (see selfConvolve) the filtered values are aligned with
+ * their frames. The ends are extended by odd reflection of the samples.
+ *
+ * This approximates filtfilt with the kernel that was self-convolved: the
+ * results match away from the ends and from the frames without a face,
+ * but differ within half a kernel of them, where the reflected and held
+ * values replace the padding and the interpolation of filtfilt (a startup
+ * transient at the start of the video).
+ *
+ * Rows hold width values; only the channels listed are filtered, the
+ * other values are released as they came. Rows that are not present (no
+ * face) hold the last present values for filtering, and are released
+ * unchanged.
+ */
+class StreamingFilter {
+public:
+    StreamingFilter(const std::vector<double>& kernel, size_t width, const std::vector<size_t>& channels);
+
+    /** Add the next row **/
+    void push(const float* row, bool present);
+
+    /** The input has ended: the remaining rows are released **/
+    void finish();
+
+    /**
+     * Copy the next filtered row to row (width values) and return true, or
+     * return false if it is not ready yet.
+     */
+    bool pop(float* row, bool& present);
+
+    /** Rows pushed but not popped **/
+    size_t pending() const { return rows_.size(); }
+
+private:
+    /** Filtered channels of signal sample index, reflected past the ends **/
+    const double* input(long long index);
+    const double* sample(long long index) const;
+    void release();
+
+    std::vector<double> kernel_;
+    size_t width_;
+    std::vector<size_t> channels_;
+    long long half_;                    ///< Samples needed on each side of a row
+    std::vector<double> first_;         ///< Samples 0 to half_, for the left reflection
+    std::deque< std::vector<double> > samples_;   ///< Samples from base_ on
+    long long base_;
+    long long received_;                ///< Samples pushed: rows from the first present one
+    long long next_;                    ///< Next sample to filter
+    bool finished_;
+    std::vector<double> last_;          ///< Last present values, held for rows without a face
+    std::deque< std::vector<float> > rows_;   ///< Rows not popped
+    std::deque<char> present_;
+    size_t ready_;                      ///< Rows at the front of rows_ that can be popped
+    std::vector<double> acc_;
+    std::vector<double> reflected_;
+};
+
+#endif  // TEMPORALFILTER_HPP
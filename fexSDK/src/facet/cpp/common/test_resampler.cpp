@@ -0,0 +1,89 @@
+/**
+ * Checks of StreamingResampler at the rate of its input: rows whose
+ * timestamps are rounded (as in the tables of fexjson2dat) are neither
+ * decimated nor changed, whatever the gap method.
+ *
+ * Usage: test_resampler (exit status 1 on failure)
+ */
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "resampler.hpp"
+
+const size_t ROWS = 300;
+const size_t CHANNELS = 2;
+const double RATE = 30;
+const double TOLERANCE = 1e-6;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+/**
+ * Time of row r, rounded to 9 digits.
+ */
+static double rowTime(size_t r)
+{
+    return floor(r / RATE * 1e9 + 0.5) / 1e9;
+}
+
+static double rowValue(size_t r, size_t c)
+{
+    double t = r / RATE;
+    return c == 0 ? 0.5 + 0.4 * sin(2 * M_PI * 3 * t) : (r % 2 == 0 ? 0.9 : 0.1);
+}
+
+/**
+ * Resample the rows at sourceRate to RATE: the output is the input.
+ */
+static void checkSameRate(GapMethod method, double sourceRate, const std::string& name)
+{
+    int factor = decimationFactor(sourceRate, RATE);
+    check(factor == 1, name + ": no decimation at the input rate");
+    StreamingResampler resampler(CHANNELS, RATE, method, RESAMPLE_MAX_GAP, factor);
+    std::vector<double> row(CHANNELS);
+    for (size_t r = 0; r < ROWS; r++) {
+        for (size_t c = 0; c < CHANNELS; c++) {
+            row[c] = rowValue(r, c);
+        }
+        resampler.push(rowTime(r), &row[0]);
+    }
+    resampler.finish();
+    size_t frames(0);
+    double time;
+    bool same(true);
+    while (resampler.pop(time, &row[0])) {
+        same = same && frames < ROWS && std::fabs(time - rowTime(frames)) <= TOLERANCE;
+        for (size_t c = 0; same && c < CHANNELS; c++) {
+            same = std::fabs(row[c] - rowValue(frames, c)) <= TOLERANCE;
+        }
+        frames++;
+    }
+    check(frames == ROWS, name + ": one output frame per input row");
+    check(same, name + ": output frames equal the input rows");
+}
+
+int main()
+{
+    // A step of 9-digit timestamps at 30 fps: 30.0000003 fps
+    double measured = 1 / (rowTime(1) - rowTime(0));
+    check(decimationFactor(RATE * (1 + 1e-8), RATE) == 1, "rate a hair above the output: factor 1");
+    check(decimationFactor(RATE * 2 * (1 + 1e-8), RATE) == 2, "twice the output rate: factor 2");
+    check(decimationFactor(31, RATE) == 2, "rate clearly above the output: factor 2");
+    check(decimationFactor(RATE * 3, RATE / 3) == 9, "9 times the output rate: factor 9");
+    checkSameRate(LINEAR, measured, "linear");
+    checkSameRate(PCHIP, measured, "pchip");
+    checkSameRate(NEAREST, RATE * (1 + 1e-8), "nearest");
+
+    if (failures == 0) {
+        std::cout << "test_resampler: all checks passed" << std::endl;
+    }
+    return failures > 0 ? 1 : 0;
+}
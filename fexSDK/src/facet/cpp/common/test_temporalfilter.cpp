@@ -0,0 +1,116 @@
+/**
+ * Checks of the NaN handling of TemporalFilter: each channel is filtered on
+ * its own, whatever the NaN values of the other channels, and a channel
+ * without any value stays NaN while the others are filtered.
+ *
+ * Usage: test_temporalfilter (exit status 1 on failure)
+ */
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include "temporalfilter.hpp"
+
+const size_t ROWS = 300;
+const double RATE = 30;
+const double TOLERANCE = 1e-12;
+const double NOT_A_NUMBER = std::numeric_limits<double>::quiet_NaN();
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cout << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+/**
+ * Channel c of data (rows x channels).
+ */
+static std::vector<double> column(const std::vector<double>& data, size_t channels, size_t c)
+{
+    std::vector<double> values;
+    for (size_t i = c; i < data.size(); i += channels) {
+        values.push_back(data[i]);
+    }
+    return values;
+}
+
+/**
+ * Same values, NaN at the same places.
+ */
+static bool same(const std::vector<double>& a, const std::vector<double>& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if ((a[i] != a[i]) != (b[i] != b[i]) || std::fabs(a[i] - b[i]) > TOLERANCE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool allNaN(const std::vector<double>& values)
+{
+    for (size_t i = 0; i < values.size(); i++) {
+        if (values[i] == values[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Filter three channels, the second of them all NaN and the third with
+ * gaps, and compare each with the channel filtered alone.
+ */
+static void checkChannels(const TemporalFilter& filter, bool zeroPhase, const std::string& name)
+{
+    const size_t channels = 3;
+    std::vector<double> data(ROWS * channels);
+    for (size_t r = 0; r < ROWS; r++) {
+        double t = r / RATE;
+        data[r * channels] = sin(2 * M_PI * 0.5 * t) + 0.2 * sin(2 * M_PI * 7 * t);
+        data[r * channels + 1] = NOT_A_NUMBER;
+        data[r * channels + 2] = (r % 37 == 5 || r == 0 || r == ROWS - 1) ? NOT_A_NUMBER : cos(2 * M_PI * 0.3 * t);
+    }
+    std::vector<double> first = column(data, channels, 0);
+    std::vector<double> third = column(data, channels, 2);
+    bool ok = zeroPhase ? filter.filtfilt(&data[0], ROWS, channels) : filter.filter(&data[0], ROWS, channels);
+    check(ok, name + ": filtered with an all-NaN channel");
+    if (zeroPhase) {
+        filter.filtfilt(&first[0], ROWS, 1);
+        filter.filtfilt(&third[0], ROWS, 1);
+    } else {
+        filter.filter(&first[0], ROWS, 1);
+        filter.filter(&third[0], ROWS, 1);
+    }
+    check(same(column(data, channels, 0), first), name + ": channel without NaN as filtered alone");
+    check(allNaN(column(data, channels, 1)), name + ": all-NaN channel stays NaN");
+    check(same(column(data, channels, 2), third), name + ": channel with gaps as filtered alone");
+}
+
+int main()
+{
+    TemporalFilter fir(designFir(LOWPASS, 30, 2, 0, RATE / 2));
+    TemporalFilter iir(designButterworth(BANDPASS, 3, 0.2, 4, RATE / 2));
+    checkChannels(fir, true, "FIR filtfilt");
+    checkChannels(fir, false, "FIR filter");
+    checkChannels(iir, true, "Butterworth filtfilt");
+    checkChannels(iir, false, "Butterworth filter");
+
+    // Nothing to filter: reported, and the data left as they were
+    std::vector<double> empty(ROWS * 2, NOT_A_NUMBER);
+    check(!fir.filtfilt(&empty[0], ROWS, 2), "all channels NaN: not filtered");
+    check(allNaN(empty), "all channels NaN: left NaN");
+
+    if (failures == 0) {
+        std::cout << "test_temporalfilter: all checks passed" << std::endl;
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+#include "textwriter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+
+static const double POW10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13 };
+/** Lower bounds of the decimal exponents -4 to 8 **/
+static const double DECADES[] = { 1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8 };
+
+static void appendPrintf(std::string& out, float value, int precision)
+{
+    char text[64];
+    int n = snprintf(text, sizeof(text), "%.*g", precision, (double)value);
+    out.append(text, std::min(n, (int)sizeof(text) - 1));
+}
+
+void appendFloat(std::string& out, float value, int precision)
+{
+    double a = std::fabs((double)value);
+    // Also sends NaN (comparisons are false) and zero to snprintf
+    if (precision < 1 || precision > ROUNDTRIP_PRECISION || !(a >= 1e-4 && a < POW10[precision])) {
+        appendPrintf(out, value, precision);
+        return;
+    }
+    // Decimal exponent (1e-4 to 1e-1 are inexact, so it can be one off)
+    int exponent = precision - 1;
+    while (exponent > -4 && a < DECADES[exponent + 4]) {
+        exponent--;
+    }
+    // a * 10^k is exact: 24 bits of float mantissa times 5^k (k <= 12) fit in a double
+    double scaled = a * POW10[precision - 1 - exponent];
+    if (scaled >= POW10[precision]) {
+        exponent++;
+        scaled = a * POW10[precision - 1 - exponent];
+    } else if (scaled < POW10[precision - 1]) {
+        exponent--;
+        scaled = a * POW10[precision - 1 - exponent];
+    }
+    // Round half to even, as printf does with the exact value
+    double whole = std::floor(scaled);
+    double fraction = scaled - whole;
+    unsigned long digits = (unsigned long)whole;
+    if (fraction > 0.5 || (fraction == 0.5 && (digits & 1))) {
+        digits++;
+    }
+    if (digits >= (unsigned long)POW10[precision]) {
+        digits /= 10;
+        exponent++;
+        if (exponent >= precision) {
+            // %g switches to the exponent notation
+            appendPrintf(out, value, precision);
+            return;
+        }
+    }
+
+    char text[16];
+    for (int i = precision - 1; i >= 0; i--) {
+        text[i] = (char)('0' + digits % 10);
+        digits /= 10;
+    }
+    // Trailing zeros of the fraction are dropped
+    int last = precision - 1;
+    while (last > exponent && text[last] == '0') {
+        last--;
+    }
+    if (value < 0) {
+        out += '-';
+    }
+    if (exponent >= 0) {
+        out.append(text, exponent + 1);
+        if (last > exponent) {
+            out += '.';
+            out.append(text + exponent + 1, last - exponent);
+        }
+    } else {
+        out += "0.";
+        out.append(-exponent - 1, '0');
+        out.append(text, last + 1);
+    }
+}
+
+void appendInt(std::string& out, long value)
+{
+    char text[24];
+    int i = sizeof(text);
+    unsigned long magnitude = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+    do {
+        text[--i] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        text[--i] = '-';
+    }
+    out.append(text + i, sizeof(text) - i);
+}
+
+int clampPrecision(int precision)
+{
+    return std::max(1, std::min(ROUNDTRIP_PRECISION, precision));
+}
+
+TextWriter::TextWriter(std::ostream& out, bool background, size_t bufferBytes)
+: out_(out), background_(background), bufferBytes_(bufferBytes),
+  handed_(false), flushPending_(false), stopping_(false), closed_(false), flusher_(*this)
+{
+    buffer_.reserve(bufferBytes_ + 4096);
+    if (background_) {
+        pending_.reserve(bufferBytes_ + 4096);
+        background_ = flusher_.start();
+    }
+}
+
+TextWriter::~TextWriter()
+{
+    close();
+}
+
+void TextWriter::handOff(bool flush)
+{
+    if (!background_) {
+        out_.write(buffer_.data(), buffer_.size());
+        buffer_.clear();
+        if (flush) {
+            out_.flush();
+        }
+        return;
+    }
+    {
+        ScopedLock lock(mutex_);
+        // Double buffering: wait until the previous buffer is written
+        while (handed_) {
+            written_.wait(mutex_);
+        }
+        buffer_.swap(pending_);
+        handed_ = true;
+        flushPending_ = flush;
+    }
+    handedOff_.signal();
+}
+
+void TextWriter::flushLoop()
+{
+    while (true) {
+        bool flush;
+        {
+            ScopedLock lock(mutex_);
+            while (!handed_ && !stopping_) {
+                handedOff_.wait(mutex_);
+            }
+            if (!handed_) {
+                return;
+            }
+            flush = flushPending_;
+        }
+        // pending_ belongs to this thread until handed_ is reset
+        out_.write(pending_.data(), pending_.size());
+        if (flush) {
+            out_.flush();
+        }
+        {
+            ScopedLock lock(mutex_);
+            pending_.clear();
+            handed_ = false;
+        }
+        written_.signal();
+    }
+}
+
+bool TextWriter::sync()
+{
+    handOff(true);
+    if (background_) {
+        ScopedLock lock(mutex_);
+        while (handed_) {
+            written_.wait(mutex_);
+        }
+    }
+    return out_.good();
+}
+
+bool TextWriter::close()
+{
+    if (closed_) {
+        return out_.good();
+    }
+    handOff(true);
+    if (background_) {
+        {
+            ScopedLock lock(mutex_);
+            stopping_ = true;
+        }
+        handedOff_.signal();
+        flusher_.join();
+    }
+    closed_ = true;
+    return out_.good();
+}
@@ -0,0 +1,95 @@
+#ifndef TEXTWRITER_HPP
+#define TEXTWRITER_HPP
+
+#include <iostream>
+#include <string>
+#include "threads.hpp"
+
+const int DEFAULT_PRECISION = 6;        /**< Significant digits of std::ostream, the historical text output **/
+const int ROUNDTRIP_PRECISION = 9;      /**< Significant digits that always read back as the same float **/
+const size_t TEXT_BUFFER_BYTES = 1 << 20;
+
+/**
+ * Append value with precision significant digits, exactly as
+ * printf("%.*g", precision, value) writes it. Values between 1e-4 and
+ * 10^precision (precision at most ROUNDTRIP_PRECISION) are converted with
+ * exact integer arithmetic, the others with snprintf.
+ */
+void appendFloat(std::string& out, float value, int precision = DEFAULT_PRECISION);
+
+/**
+ * Append a decimal integer.
+ */
+void appendInt(std::string& out, long value);
+
+/**
+ * Clamp a -p PRECISION argument to [1, ROUNDTRIP_PRECISION].
+ */
+int clampPrecision(int precision);
+
+/**
+ * Buffered writer of text rows. Rows are appended to a large buffer; a
+ * full buffer (or flush()) is swapped with a second one that a background
+ * thread writes to the stream, so rows keep being formatted while the
+ * previous ones are written. Without background, the buffer is written by
+ * the caller (bufferBytes 0 writes every row at once, keeping the order
+ * with other writers of the same stream).
+ *
+ * Nothing else may write to the stream between the first write() and
+ * close().
+ */
+class TextWriter {
+public:
+    TextWriter(std::ostream& out, bool background, size_t bufferBytes = TEXT_BUFFER_BYTES);
+    ~TextWriter();
+
+    void write(const std::string& text)
+    {
+        buffer_ += text;
+        if (buffer_.size() >= bufferBytes_) {
+            handOff(false);
+        }
+    }
+
+    /** Write the buffered rows and flush the stream (asynchronously in background) **/
+    void flush() { handOff(true); }
+
+    /** Write the buffered rows, flush the stream and wait until it is done; false on a stream error **/
+    bool sync();
+
+    /** Write everything and stop the background thread; false on a stream error **/
+    bool close();
+
+private:
+    class Flusher : public Thread {
+    public:
+        explicit Flusher(TextWriter& owner) : owner_(owner) {}
+    protected:
+        void run() { owner_.flushLoop(); }
+    private:
+        TextWriter& owner_;
+    };
+
+    void handOff(bool flush);
+    void flushLoop();
+
+    TextWriter(const TextWriter&);
+    TextWriter& operator=(const TextWriter&);
+
+    std::ostream& out_;
+    bool background_;
+    size_t bufferBytes_;
+    std::string buffer_;        ///< Filled by the caller
+    std::string pending_;       ///< Written by the background thread while handed_
+    bool handed_;
+    bool flushPending_;
+    bool stopping_;
+    bool closed_;
+
+    Mutex mutex_;
+    Condition handedOff_;
+    Condition written_;
+    Flusher flusher_;
+};
+
+#endif  // TEXTWRITER_HPP
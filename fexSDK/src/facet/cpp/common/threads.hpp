@@ -0,0 +1,99 @@
+#ifndef THREADS_HPP
+#define THREADS_HPP
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+
+/**
+ * Minimal wrappers around pthreads. The FACET SDK on OS X requires
+ * libstdc++ (no std::thread), so the drivers use these instead.
+ */
+
+/**
+ * Non-recursive mutex.
+ */
+class Mutex {
+public:
+    Mutex() { pthread_mutex_init(&mutex_, 0); }
+    ~Mutex() { pthread_mutex_destroy(&mutex_); }
+    void lock() { pthread_mutex_lock(&mutex_); }
+    void unlock() { pthread_mutex_unlock(&mutex_); }
+    pthread_mutex_t* native() { return &mutex_; }
+private:
+    Mutex(const Mutex&);
+    Mutex& operator=(const Mutex&);
+    pthread_mutex_t mutex_;
+};
+
+/**
+ * Locks a Mutex for the lifetime of the object.
+ */
+class ScopedLock {
+public:
+    explicit ScopedLock(Mutex& mutex) : mutex_(mutex) { mutex_.lock(); }
+    ~ScopedLock() { mutex_.unlock(); }
+private:
+    ScopedLock(const ScopedLock&);
+    ScopedLock& operator=(const ScopedLock&);
+    Mutex& mutex_;
+};
+
+/**
+ * Condition variable; wait() must be called with the mutex locked.
+ */
+class Condition {
+public:
+    Condition() { pthread_cond_init(&cond_, 0); }
+    ~Condition() { pthread_cond_destroy(&cond_); }
+    void wait(Mutex& mutex) { pthread_cond_wait(&cond_, mutex.native()); }
+    /** Wait at most seconds; returns false on timeout **/
+    bool waitFor(Mutex& mutex, double seconds) {
+        struct timeval now;
+        gettimeofday(&now, 0);
+        double deadline = now.tv_sec + now.tv_usec * 1e-6 + seconds;
+        struct timespec until;
+        until.tv_sec = (time_t)deadline;
+        until.tv_nsec = (long)((deadline - until.tv_sec) * 1e9);
+        return pthread_cond_timedwait(&cond_, mutex.native(), &until) != ETIMEDOUT;
+    }
+    void signal() { pthread_cond_signal(&cond_); }
+    void broadcast() { pthread_cond_broadcast(&cond_); }
+private:
+    Condition(const Condition&);
+    Condition& operator=(const Condition&);
+    pthread_cond_t cond_;
+};
+
+/**
+ * Base class for a thread body: derive, implement run(), then start()/join().
+ */
+class Thread {
+public:
+    Thread() : started_(false) {}
+    virtual ~Thread() {}
+    bool start() {
+        started_ = (pthread_create(&thread_, 0, &Thread::entry, this) == 0);
+        return started_;
+    }
+    void join() {
+        if (started_) {
+            pthread_join(thread_, 0);
+            started_ = false;
+        }
+    }
+protected:
+    virtual void run() = 0;
+private:
+    Thread(const Thread&);
+    Thread& operator=(const Thread&);
+    static void* entry(void* self) {
+        static_cast<Thread*>(self)->run();
+        return 0;
+    }
+    pthread_t thread_;
+    bool started_;
+};
+
+#endif  // THREADS_HPP
@@ -0,0 +1,100 @@
+#include "facechannels.hpp"
+#include <sstream>
+
+using namespace EMOTIENT;
+
+/**
+ * Name of a FACET enum as the text output writes it.
+ */
+template <class T>
+static std::string channelName(const T& value)
+{
+    std::ostringstream name;
+    name << value;
+    return name.str();
+}
+
+FaceChannels::FaceChannels(FacetSDK::FrameAnalyzer& analyzer)
+: pose_(analyzer.IsChannelActive(FacetSDK::POSE)), lmnames_(FacetSDK::AllLandmarkNames())
+{
+    add("face", "FaceBoxX");
+    add("face", "FaceBoxY");
+    add("face", "FaceBoxW");
+    add("face", "FaceBoxH");
+    for (size_t i = 0; i < lmnames_.size(); i++) {
+        add("land", channelName(lmnames_[i]) + "_x");
+        add("land", channelName(lmnames_[i]) + "_y");
+    }
+    if (pose_) {
+        add("pose", "Roll");
+        add("pose", "Pitch");
+        add("pose", "Yaw");
+    }
+
+    // Emotions keep their fexchannels.txt class: emo1, sent1 or emo2
+    const FacetSDK::Channel emotionChannels[] = { FacetSDK::PRIMARY_EMOTIONS, FacetSDK::SENTIMENTS, FacetSDK::ADVANCED_EMOTIONS };
+    const char* emotionClasses[] = { "emo1", "sent1", "emo2" };
+    for (size_t k = 0; k < 3; k++) {
+        if (!analyzer.IsChannelActive(emotionChannels[k])) {
+            continue;
+        }
+        std::vector<FacetSDK::EmotionName> names;
+        if (k == 0) {
+            names = FacetSDK::AllPrimaryEmotionNames();
+        } else if (k == 1) {
+            names = FacetSDK::AllSentimentEmotionNames();
+        } else {
+            names = FacetSDK::AllAdvancedEmotionNames();
+        }
+        for (size_t i = 0; i < names.size(); i++) {
+            add(emotionClasses[k], channelName(names[i]));
+            emotionNames_.push_back(names[i]);
+        }
+    }
+
+    if (analyzer.IsChannelActive(FacetSDK::ACTION_UNITS)) {
+        auNames_ = FacetSDK::AllActionUnits();
+        for (size_t i = 0; i < auNames_.size(); i++) {
+            add("au", channelName(auNames_[i]));
+        }
+    }
+}
+
+void FaceChannels::add(const std::string& channelClass, const std::string& name)
+{
+    classes_.push_back(channelClass);
+    names_.push_back(name);
+}
+
+void FaceChannels::addTo(FexbWriter& writer) const
+{
+    for (size_t i = 0; i < size(); i++) {
+        writer.addChannel(classes_[i], names_[i]);
+    }
+}
+
+void FaceChannels::values(const FacetSDK::Face& face, float* values, const FrameMapping& mapping) const
+{
+    FacetSDK::Rectangle faceLocation;
+    face.FaceLocation(faceLocation);
+    *values++ = mapping.x(faceLocation.x);
+    *values++ = mapping.y(faceLocation.y);
+    *values++ = mapping.width(faceLocation.width);
+    *values++ = mapping.height(faceLocation.height);
+    for (size_t i = 0; i < lmnames_.size(); i++) {
+        FacetSDK::Point landmark = face.LandmarkLocation(lmnames_[i]);
+        *values++ = mapping.x(landmark.x);
+        *values++ = mapping.y(landmark.y);
+    }
+    if (pose_) {
+        *values++ = face.PoseValue(FacetSDK::ROLL);
+        *values++ = face.PoseValue(FacetSDK::PITCH);
+        *values++ = face.PoseValue(FacetSDK::YAW);
+    }
+    for (size_t i = 0; i < emotionNames_.size(); i++) {
+        *values++ = face.EmotionValue(emotionNames_[i]);
+    }
+    for (size_t i = 0; i < auNames_.size(); i++) {
+        *values++ = face.ActionUnitValue(auNames_[i]);
+    }
+}
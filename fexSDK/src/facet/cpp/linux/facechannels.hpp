@@ -0,0 +1,49 @@
+#ifndef FACECHANNELS_HPP
+#define FACECHANNELS_HPP
+
+#include <string>
+#include <vector>
+#include "emotient.hpp"
+#include "fexbinary.hpp"
+#include "framemapping.hpp"
+
+/**
+ * The per-face values a FrameAnalyzer produces, in the order the drivers
+ * write them (face box, landmarks, pose, emotions, sentiments, advanced
+ * emotions, action units), with the channel classes of shared/fexchannels.txt.
+ */
+class FaceChannels {
+public:
+    /**
+     * \param analyzer an initialized analyzer; only its active channels are included
+     */
+    explicit FaceChannels(EMOTIENT::FacetSDK::FrameAnalyzer& analyzer);
+
+    size_t size() const { return names_.size(); }
+    const std::string& channelClass(size_t i) const { return classes_[i]; }
+    const std::string& name(size_t i) const { return names_[i]; }
+
+    /**
+     * Append the channels to the schema of writer.
+     */
+    void addTo(FexbWriter& writer) const;
+
+    /**
+     * Write size() values for face into values, with the face box and the
+     * landmarks mapped to the original frame by mapping.
+     */
+    void values(const EMOTIENT::FacetSDK::Face& face, float* values,
+                const FrameMapping& mapping = FrameMapping()) const;
+
+private:
+    void add(const std::string& channelClass, const std::string& name);
+
+    std::vector<std::string> classes_;
+    std::vector<std::string> names_;
+    bool pose_;
+    std::vector<EMOTIENT::FacetSDK::LandmarkName> lmnames_;
+    std::vector<EMOTIENT::FacetSDK::EmotionName> emotionNames_;
+    std::vector<EMOTIENT::FacetSDK::ActionUnit> auNames_;
+};
+
+#endif  // FACECHANNELS_HPP
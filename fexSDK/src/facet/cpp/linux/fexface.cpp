@@ -14,15 +14,22 @@ fexface
 #include <iostream>
 #include <algorithm>
 #include <fstream>
-#include <time.h>
 #include "emotient.hpp"
 #include "tools.hpp"
 #include "config.hpp"
+#include "falsepositive.hpp"
+#include "framechange.hpp"
+#include "framesampler.hpp"
+#include "runmetrics.hpp"
+#include "searchwindow.hpp"
+#include "stagestats.hpp"
  
 using namespace std;
 using namespace EMOTIENT;
  
 const int   REDFRATE = 1;    /** Desired video sampling rate 1 frame per second **/
+const float MAXGRABGAP = 10.0; /** Gaps longer than this (in seconds) are crossed with a seek **/
+const float MINSCALE = 0.1;    /** Smallest analysis scale reachable with -q **/
 
 /**
  * Helper functions.
@@ -30,6 +37,21 @@ const int   REDFRATE = 1;    /** Desired video sampling rate 1 frame per second
 void printUsage(){
 	std::cout << "Usage:" << std::endl;
 	std::cout << "   videoanalysis -f MOVIEFILE [-m MINFACESIZEPCT] [-b STARTFRAME:ENDFRAME] [-o OUTPUTFILE]" << std::endl;
+	std::cout << "   - The optional [-r FPS] argument sets the sampling rate in frames per second (defaults to 1)." << std::endl;
+	std::cout << "   - The optional [-g SECONDS] argument sets the gap above which the video is seeked" << std::endl;
+	std::cout << "     instead of decoded forward (defaults to 10)." << std::endl;
+	std::cout << "   - The optional [-q QUALITYSCALE] argument analyzes frames at (1 - QUALITYSCALE) of their size" << std::endl;
+	std::cout << "     (defaults to 0); coordinates are reported in full-size frames." << std::endl;
+	std::cout << "   - The optional [-seek] flag seeks to every sampled frame (previous behavior)." << std::endl;
+	std::cout << "   - The optional [-search REFRESH] argument analyzes each sample only around the face of the previous one," << std::endl;
+	std::cout << "     searching whole frames on a miss and every REFRESH samples (defaults to 0: always whole frames)." << std::endl;
+	std::cout << "   - The optional [-dedup THRESHOLD] argument reuses the result of the last analyzed sample for the samples" << std::endl;
+	std::cout << "     that differ from it by at most THRESHOLD gray levels; the FrameReused column flags them (0 disables)." << std::endl;
+	std::cout << "   - The optional [-fp THRESHOLD] argument rejects the faces whose size or position is more than THRESHOLD" << std::endl;
+	std::cout << "     standard deviations from those of the previous samples, as fexc.falsepositive (e.g. " << FALSEPOSITIVE_THRESHOLD << ");" << std::endl;
+	std::cout << "     they are written as Nan and flagged in the FaceRejected column (0 disables)." << std::endl;
+	std::cout << "   - The optional [-metrics BASENAME] argument writes the stage latencies, frame counts and peak memory" << std::endl;
+	std::cout << "     to BASENAME.json and BASENAME.prom (Prometheus), every " << METRICS_INTERVAL << " s and at the end." << std::endl;
 }
 
 // Get cmd line Input
@@ -61,7 +83,7 @@ bool cmdOptionExists(char** begin, char** end, const std::string& option)
 
 
  // Check cmd line Imput
-int parseVideoArg(int argc, char *argv[], string& videoFile, float& ReducedFramerate){
+int parseVideoArg(int argc, char *argv[], string& videoFile, float& ReducedFramerate, float& maxGrabGap, bool& seekMode, float& QualityScale){
     int retVal(FacetSDK::SUCCESS);
 
     // Check that the video input file was passed
@@ -84,6 +106,25 @@ int parseVideoArg(int argc, char *argv[], string& videoFile, float& ReducedFrame
     } else {
      ReducedFramerate = REDFRATE;
     }
+
+    // Gap crossed with a seek rather than with grab()
+    maxGrabGap = MAXGRABGAP;
+    if (cmdOptionExists(argv, argv + argc, "-g")) {
+     char* gaparg = getCmdOption(argv, argv + argc, "-g");
+     std::istringstream iss(gaparg);
+     iss >> maxGrabGap;
+    }
+
+    // Frames are analyzed at (1 - QualityScale) of their size
+    QualityScale = 0;
+    if (cmdOptionExists(argv, argv + argc, "-q")) {
+     char* qscalearg = getCmdOption(argv, argv + argc, "-q");
+     std::istringstream iss(qscalearg);
+     iss >> QualityScale;
+    }
+
+    // Seek to every sampled frame
+    seekMode = cmdOptionExists(argv, argv + argc, "-seek");
      return retVal;
  }
  
@@ -95,6 +136,42 @@ void parseOutputArg(int argc, char *argv[], string& outfile){
         outfile = outputarg;
     } else outfile = "";
 }
+
+ /** Get Search Window Refresh Period **/
+void parseSearchArg(int argc, char *argv[], int& refresh){
+    refresh = 0;
+    char* searcharg = getCmdOption(argv, argv + argc, "-search");
+    if (searcharg) {
+        std::istringstream iss(searcharg);
+        iss >> refresh;
+    }
+}
+
+ /** Get Near-Duplicate Threshold **/
+void parseDedupArg(int argc, char *argv[], double& threshold){
+    threshold = 0;
+    char* deduparg = getCmdOption(argv, argv + argc, "-dedup");
+    if (deduparg) {
+        std::istringstream iss(deduparg);
+        iss >> threshold;
+    }
+}
+
+ /** Get False-Positive Threshold **/
+void parseFalsePositiveArg(int argc, char *argv[], double& threshold){
+    threshold = 0;
+    char* fparg = getCmdOption(argv, argv + argc, "-fp");
+    if (fparg) {
+        std::istringstream iss(fparg);
+        iss >> threshold;
+    }
+}
+
+ /** Get Metrics Files **/
+void parseMetricsArg(int argc, char *argv[], string& metricsBase){
+    char* metricsarg = getCmdOption(argv, argv + argc, "-metrics");
+    metricsBase = metricsarg ? metricsarg : "";
+}
  
 
 /**
@@ -106,8 +183,11 @@ int main (int argc, char *argv[]){
     // Get command line information or set defaults
     string videoFile;
     float ReducedFramerate(REDFRATE);
+    float maxGrabGap(MAXGRABGAP);
+    bool  seekMode(false);
+    float QualityScale(0);
     
-    retVal = parseVideoArg(argc, argv, videoFile,ReducedFramerate);
+    retVal = parseVideoArg(argc, argv, videoFile,ReducedFramerate,maxGrabGap,seekMode,QualityScale);
     if (retVal != FacetSDK::SUCCESS) {
         printUsage();
         exit(retVal);
@@ -124,23 +204,25 @@ int main (int argc, char *argv[]){
     ostream& outstream = (!outFile.empty() ? outfilestream : std::cout);
     
     // Start Clock
-    const clock_t begin_time = clock();
+    const double begin_time = wallSeconds();
 
     // Load the video into OpenCV's capture object and exit if it fails
 	std::cout << "Importing vide with OpenCV ... ";
-    cv::VideoCapture videoCap;
-    videoCap.open(videoFile);
-    if (!videoCap.isOpened()) {
+    LumaSource videoSource;
+    videoSource.open(videoFile);
+    if (!videoSource.isOpened()) {
         std::cout << "Could not open video file for processing!" << std::endl;
         exit(FacetSDK::NOT_AVAILABLE);
     }
-    std::cout << "Video Imported " << float(clock() - begin_time)/ CLOCKS_PER_SEC << std::endl;
+    std::cout << "Video Imported " << float(wallSeconds() - begin_time) << std::endl;
+    // Downscaled while decoding; the mapping restores video coordinates
+    videoSource.setScale(std::max(MINSCALE, std::min(1.0f, 1.0f - QualityScale)));
+    const FrameMapping toVideo = videoSource.mapping();
     /** This Section needs to be Changed:
     Determine the number of video frames so that all of them will be processed
     This is faulty OpenCV code so the estimate might be wrong **/
-    size_t numtotalframes = videoCap.get(CV_CAP_PROP_FRAME_COUNT);
-	float IncrementFrameUsed = videoCap.get(CV_CAP_PROP_FPS) / ReducedFramerate;
-	videoCap.set(CV_CAP_PROP_POS_FRAMES,0);
+    size_t numtotalframes = videoSource.frameCount();
+	float IncrementFrameUsed = videoSource.fps() / ReducedFramerate;
 	// CONSIDER PREALLOCATING
 	// frameanalysis.reserve(numtotalframes); // Pre-allocate
 	// Print some info
@@ -148,7 +230,7 @@ int main (int argc, char *argv[]){
     std::cout << "Analyze: " << numtotalframes << " (Grab 1 frame every " << IncrementFrameUsed << ");\n" << std::endl;
 	
 	// Define Fram & Gray Frame Matrix
-    cv::Mat frame, grayFrame;
+    LumaFrame grayFrame;
     size_t framenum(0);
     
     // Initialize frame analyzer
@@ -166,8 +248,27 @@ int main (int argc, char *argv[]){
     frameAnalyzer.SetChannelActive(FacetSDK::EMOTIONS, false);
     frameAnalyzer.SetChannelActive(FacetSDK::POSE, false);
     
+    // Near-duplicate samples reuse the result of the last analyzed one
+    double dedupThreshold;
+    parseDedupArg(argc, argv, dedupThreshold);
+    bool dedup = dedupThreshold > 0;
+    FrameChangeDetector changeDetector(dedupThreshold);
+    size_t numreused(0);
+
+    // Faces of unusual size or position are rejected as false positives
+    double fpThreshold;
+    parseFalsePositiveArg(argc, argv, fpThreshold);
+    bool rejecting = fpThreshold > 0;
+    FalsePositiveFilter falsePositive(fpThreshold);
+
     /** Compile the file Header **/
     outfilestream << "FrameNumber" << "\t" << "FrameRows" << "\t" << "FrameCols" << "\t";
+    if (dedup) {
+        outfilestream << "FrameReused" << "\t";
+    }
+    if (rejecting) {
+        outfilestream << "FaceRejected" << "\t";
+    }
 	outfilestream << "FaceBoxX" << "\t" << "FaceBoxY" << "\t" << "FaceBoxW" << "\t" << "FaceBoxH" << "\t";
     std::vector<FacetSDK::LandmarkName> lmnames = FacetSDK::AllLandmarkNames();
     for (size_t i = 0; i < lmnames.size(); i++) {
@@ -178,58 +279,186 @@ int main (int argc, char *argv[]){
     /** Create some objects that will be updated during frame processing **/
     FacetSDK::FrameAnalysis frameanalysis;
 
+    // Search each sample around the face of the previous one
+    int searchRefresh;
+    parseSearchArg(argc, argv, searchRefresh);
+    SearchWindow searchWindow(searchRefresh);
+    cv::Mat window;
+
+    // Optional metrics, rewritten in the background while the video is processed
+    string metricsBase;
+    parseMetricsArg(argc, argv, metricsBase);
+    RunMetrics* metrics(0);
+    MetricsReporter* reporter(0);
+    size_t decodeStage(0), analysisStage(0), writeStage(0);
+    size_t framesCounter(0), failedCounter(0), rescannedCounter(0), reusedCounter(0), rejectedCounter(0);
+    size_t grabbedGauge(0), seeksGauge(0);
+    if (!metricsBase.empty()) {
+        metrics = new RunMetrics("fexface", videoFile, metricsBase);
+        decodeStage = metrics->addStage("decode");
+        analysisStage = metrics->addStage("analysis");
+        writeStage = metrics->addStage("write");
+        framesCounter = metrics->addCounter("frames", "Sampled frames analyzed.");
+        failedCounter = metrics->addCounter("frames_failed", "Frames the analyzer could not analyze.");
+        rescannedCounter = metrics->addCounter("frames_rescanned", "Samples analyzed again whole after a miss in the search window.");
+        reusedCounter = metrics->addCounter("frames_reused", "Near-duplicate samples written with the result of the previous sample.");
+        rejectedCounter = metrics->addCounter("faces_rejected", "Faces rejected as false positives.");
+        grabbedGauge = metrics->addGauge("frames_grabbed", "Frames decoded to reach the samples.");
+        seeksGauge = metrics->addGauge("seeks", "Seeks made to reach the samples.");
+        reporter = new MetricsReporter(*metrics);
+    }
+
     /** Start Main Loop **/
-    const clock_t begin_frame = clock();
-    while (framenum < numtotalframes) {
-		// This skips frames when required
-		if (IncrementFrameUsed > 1){
-			videoCap.set(CV_CAP_PROP_POS_FRAMES, framenum);
+    const double begin_frame = wallSeconds();
+    FrameSampler sampler(videoSource, ReducedFramerate, maxGrabGap);
+    size_t numsampled(0);
+    // Columns after FrameReused of the last analyzed sample, and its outcome
+    std::ostringstream faceColumns;
+    retVal = FacetSDK::NOT_AVAILABLE;
+    while (true) {
+        MetricsTimer decodeTimer(metrics, decodeStage);
+		if (seekMode) {
+			// This skips frames when required
+			if (framenum >= numtotalframes) {
+				break;
+			}
+			if (IncrementFrameUsed > 1){
+				videoSource.seek(framenum / videoSource.fps());
+			}
+			if (!videoSource.read(grayFrame)) {
+				break;
+			}
+		} else {
+			// Decode forward to the next sample by timestamp
+			if (!sampler.next(grayFrame)) {
+				break;
+			}
+			framenum = sampler.frameNumber();
 		}
-        
-		videoCap.grab();
-        videoCap.retrieve(frame);
+        decodeTimer.stop();
+		numsampled++;
 		
-        // Convert the image to grayscale (required)
-        cvtColorSafe(frame, grayFrame);
-		// Try to process frame
-        retVal = frameAnalyzer.Analyze(grayFrame.data, grayFrame.rows, grayFrame.cols,frameanalysis);
-        outfilestream << framenum+1 << "\t" << grayFrame.rows << "\t" << grayFrame.cols << "\t";
-        if (retVal != FacetSDK::SUCCESS) {
+		// Try to process frame (already grayscale), or only its search window
+        MetricsTimer analysisTimer(metrics, analysisStage);
+        cv::Rect whole(0, 0, grayFrame.cols(), grayFrame.rows());
+        bool reused = dedup && changeDetector.unchanged(grayFrame.mat());
+        cv::Rect region = searchRefresh > 0 && !reused ? searchWindow.region(numsampled, whole.size()) : whole;
+        if (reused) {
+            // Keep retVal and faceColumns of the last analyzed sample
+            numreused++;
+        } else if (region == whole) {
+            retVal = frameAnalyzer.Analyze(grayFrame.data(), grayFrame.rows(), grayFrame.cols(),frameanalysis);
+        } else {
+            // The analyzer needs contiguous rows
+            grayFrame.mat()(region).copyTo(window);
+            retVal = frameAnalyzer.Analyze(window.data, window.rows, window.cols, frameanalysis);
+            if (retVal == FacetSDK::SUCCESS && frameanalysis.NumFaces() == 0) {
+                region = whole;
+                retVal = frameAnalyzer.Analyze(grayFrame.data(), grayFrame.rows(), grayFrame.cols(),frameanalysis);
+                if (metrics) {
+                    metrics->increment(rescannedCounter);
+                }
+            }
+        }
+        analysisTimer.stop();
+        MetricsTimer writeTimer(metrics, writeStage);
+        FrameMapping mapping = toVideo.region(region.x, region.y);
+        outfilestream << framenum+1 << "\t" << mapping.frameRows(grayFrame.rows()) << "\t" << mapping.frameCols(grayFrame.cols()) << "\t";
+        if (dedup) {
+            outfilestream << (reused ? 1 : 0) << "\t";
+        }
+        if (reused && retVal == FacetSDK::SUCCESS) {
+            outfilestream << faceColumns.str();
+            if (metrics) {
+                metrics->increment(reusedCounter);
+                metrics->increment(framesCounter);
+            }
+        }
+        else if (retVal != FacetSDK::SUCCESS) {
             std::cout << "The frame analyzer could not properly analyze a frame" << std::endl;
             std::cout << "Error code = " << FacetSDK::DefineErrorCode(retVal) << std::endl;
+            if (metrics) {
+                metrics->increment(failedCounter);
+            }
         }
         else{
-            if (frameanalysis.NumFaces() > 0) {
+            faceColumns.str("");
+            bool found = frameanalysis.NumFaces() > 0;
+            bool rejected(false);
+            FacetSDK::Face face;
+            FacetSDK::Rectangle faceLocation;
+            if (found) {
                 // Analyze the largest face
-                FacetSDK::Face face;
                 frameanalysis.LargestFace(face);
-                FacetSDK::Rectangle faceLocation;
                 face.FaceLocation(faceLocation);
-                // Print out detected face box coordinates for largest face
-                outfilestream << faceLocation.x << "\t" << faceLocation.y <<"\t" << faceLocation.width << "\t" << faceLocation.height << "\t";
+                // The search window and the false-positive statistics stay in analyzed frame coordinates
+                cv::Rect_<float> box(faceLocation.x + region.x, faceLocation.y + region.y,
+                                     faceLocation.width, faceLocation.height);
+                searchWindow.update(numsampled, box, true);
+                rejected = rejecting && falsePositive.reject(box, whole.size());
+                if (rejected && metrics) {
+                    metrics->increment(rejectedCounter);
+                }
+            } else {
+                searchWindow.update(numsampled, cv::Rect_<float>(), false);
+            }
+            if (rejecting) {
+                faceColumns << (rejected ? 1 : 0) << "\t";
+            }
+            if (found && !rejected) {
+                // Print out detected face box coordinates for largest face, in the video frame
+                faceColumns << mapping.x(faceLocation.x) << "\t" << mapping.y(faceLocation.y) <<"\t";
+                faceColumns << mapping.width(faceLocation.width) << "\t" << mapping.height(faceLocation.height) << "\t";
                 // Add Landmarks Score
                 std::vector<FacetSDK::LandmarkName> lmnames = FacetSDK::AllLandmarkNames();
                 for (size_t i = 0; i < lmnames.size(); i++) {
-                    outfilestream << face.LandmarkLocation(lmnames[i]).x <<"\t";
-                    outfilestream << face.LandmarkLocation(lmnames[i]).y <<"\t";
+                    faceColumns << mapping.x(face.LandmarkLocation(lmnames[i]).x) <<"\t";
+                    faceColumns << mapping.y(face.LandmarkLocation(lmnames[i]).y) <<"\t";
                 }   
             }
             else{
-                outfilestream << "Nan";
+                faceColumns << "Nan";
+            }
+            faceColumns << "\n";
+            outfilestream << faceColumns.str();
+            if (metrics) {
+                metrics->increment(framesCounter);
             }
-            outfilestream << "\n";
+        }
+        writeTimer.stop();
+        if (metrics && !seekMode) {
+            metrics->setGauge(grabbedGauge, sampler.numGrabbed());
+            metrics->setGauge(seeksGauge, sampler.numSeeks());
         }
 
         /** Print out progress at regular intervals **/
-        if ((framenum+1) % 10 == 0) {
+        if (numsampled % 10 == 0) {
             int pctComplete = 100.0 * framenum / numtotalframes; // update progress
             std::cout << "Percent complete: " << pctComplete << '%'<< "\t";
-            std::cout << "Time Elapsed: " << float( clock () - begin_time ) /  CLOCKS_PER_SEC << "\t";
-            std::cout << "Frames per second: " << int(framenum/ ((clock () - begin_frame)/  CLOCKS_PER_SEC)) << std::endl;
+            double now = wallSeconds();
+            std::cout << "Time Elapsed: " << float(now - begin_time) << "\t";
+            std::cout << "Frames per second: " << float(framenum / std::max(now - begin_frame, 1e-6));
+            if (!seekMode) {
+                std::cout << "\t" << "Grabbed: " << sampler.numGrabbed() << "\t" << "Seeks: " << sampler.numSeeks();
+            }
+            if (dedup) {
+                std::cout << "\t" << "Reused: " << float(100.0 * numreused / numsampled) << '%';
+            }
+            std::cout << std::endl;
         }
 		/** Step to the next frame **/
-        framenum = framenum + IncrementFrameUsed;
+		if (seekMode) {
+			framenum = framenum + IncrementFrameUsed;
+		}
     }
     outfilestream.close();
+    if (rejecting) {
+        std::cout << "Rejected " << falsePositive.numRejected() << " faces as false positives" << std::endl;
+    }
+    if (reporter && !reporter->stop()) {
+        std::cout << "Could not write the metrics to " << metricsBase << ".json and .prom" << std::endl;
+    }
+    delete reporter;
+    delete metrics;
 }
 
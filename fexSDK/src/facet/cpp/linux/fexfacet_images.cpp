@@ -0,0 +1,52 @@
+
+/* This code was adapted from the sample files provided in the Emotient SDK
+and it is meant to work within the toolbox fex-metrica.
+The image drivers fexfacet_face, fexfacet_aus, fexfacet_emotions,
+fexfacet_full and fexfacet_fullh are built from this file, with
+FEX_IMAGE_CHANNELS and FEX_IMAGE_FORMAT (see CMakeLists.txt and
+imagerows.hpp). They output the following variables:
+
+(1) File information (filename; file_width; file_hight);
+(2) Landmarks locations (TopLeft_X; TopLeft_Y; Width; Height;
+    left_eye_lateral_X; left_eye_lateral_Y; left_eye_pupil_X; left_eye_pupil_Y;
+    left_eye_medial_X; left_eye_medial_Y; right_eye_medial_X;right_eye_medial_Y;
+    right_eye_pupil_X; right_eye_pupil_Yl; right_eye_lateral_X; right_eye_lateral_Y
+    nose_tip_X; nose_tip_Y);
+(3) Pose information (Roll; Pitch; Yaw);
+(4) Emotions (anger; contempt; disgust; joy; fear; sadness; surprise),
+    fexfacet_emotions and fexfacet_full(h) only;
+(5) Sentiments (neutral; negative; positive; confusion; frustration),
+    fexfacet_emotions and fexfacet_full(h) only;
+(6) Action Units (AU1; AU2; AU4; AU5; AU6; AU7; AU9; AU10; AU12; AU14;
+    AU15; AU17; AU18; AU20; AU23; AU24; AU25; AU26; AU28),
+    fexfacet_aus and fexfacet_full(h) only.
+
+fexfacet_fullh writes each value after its name ("name:value:"), the
+others separate the values with tabs.
+
+With [-o OUTPUTFILE.fexb], fexfacet_full writes the values to
+OUTPUTFILE.fexb in the binary columnar format instead (see fexbinary.hpp
+and fex_binimport.m), one row per input line, with FrameNumber the line
+number.
+
+-- version 06/01/2014
+
+Code adapted by
+Filippo Rossi, Institute for Neural Computation,
+University of California San Diego.
+Contact info: frossi@ucsd.edu */
+
+#include "imagerows.hpp"
+
+#ifndef FEX_IMAGE_CHANNELS
+#define FEX_IMAGE_CHANNELS IMAGE_FULL
+#endif
+#ifndef FEX_IMAGE_FORMAT
+#define FEX_IMAGE_FORMAT TabRow
+#endif
+
+// Note that the header of the file is added in Matlab using fex_fhead.m, and it is not provided by the cpp code.
+int main (int argc, char *argv[])
+{
+    return runImageDriver< ImageRows<FEX_IMAGE_CHANNELS, FEX_IMAGE_FORMAT> >(argc, argv);
+}
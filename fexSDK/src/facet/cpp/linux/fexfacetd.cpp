@@ -0,0 +1,237 @@
+/**
+ file fexfacetd.cpp
+ Analyzer daemon: initializes the FACET frame analyzers once, then runs
+ the jobs that fexclient sends over a Unix socket. A job is the command
+ line of one of the drivers, with the same flags:
+
+   fexfacet -v VIDEO [-o OUTPUTFILE] [-q QUALITYSCALE] [-c CHANELS] [-m MINFACESIZEPCT] [-t WORKERS] [-p PRECISION]
+            [-metrics BASENAME] [-checkpoint SECONDS] [-resume] [-roi SAMPLEFPS] [-search REFRESH]
+            [-facewidth PIXELS] [-dedup THRESHOLD] [-filter lp:HZ | hp:HZ | bp:LOW:HIGH] [-filterorder ORDER]
+            [-fp THRESHOLD] [-fpskip] [-coreg] [-motion THRESHOLD]
+   fexfacet_face, fexfacet_aus, fexfacet_emotions [-l LISTFILE] [-t WORKERS] [-d DECODERS] [-p PRECISION] [-q QUALITYSCALE]
+   fexfacet_full [-o OUTPUTFILE.fexb] [-l LISTFILE] [-t WORKERS] [-d DECODERS] [-p PRECISION] [-q QUALITYSCALE]
+   fexfacet_fullh [-l LISTFILE] [-t WORKERS] [-d DECODERS] [-p PRECISION] [-q QUALITYSCALE]
+
+ Usage:
+
+   fexfacetd [-s SOCKET] [-n VIDEOANALYZERS] [-i IMAGEANALYZERS]
+
+ Video jobs share VIDEOANALYZERS analyzers (defaults to 2), a job with -t
+ WORKERS takes up to WORKERS of them; image jobs take up to WORKERS
+ of the IMAGEANALYZERS (defaults to 2). The image list is LISTFILE or the
+ standard input of fexclient. Jobs run at the same time while there
+ are free analyzers, and wait for them otherwise. SOCKET defaults to
+ $FEX_SOCKET, or /tmp/fexfacetd-UID.sock. SIGINT or SIGTERM stop the
+ daemon once the running jobs are done.
+**/
+
+#include <signal.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "emotient.hpp"
+#include "imagejob.hpp"
+#include "imagerows.hpp"
+#include "jobsocket.hpp"
+#include "threads.hpp"
+#include "videojob.hpp"
+
+using namespace EMOTIENT;
+
+const size_t VIDEOANALYZERS = 2;
+const size_t IMAGEANALYZERS = 2;
+
+/**
+ * Initialized analyzers shared by the jobs. acquire() waits until it can
+ * take all the analyzers it returns at once, so a waiting job never holds
+ * analyzers another job needs.
+ */
+class AnalyzerPool : public AnalyzerSource {
+public:
+    ~AnalyzerPool()
+    {
+        for (size_t i = 0; i < all_.size(); i++) {
+            delete all_[i];
+        }
+    }
+
+    /** Take ownership of an initialized analyzer **/
+    void add(FacetSDK::FrameAnalyzer* frameAnalyzer)
+    {
+        ScopedLock lock(mutex_);
+        all_.push_back(frameAnalyzer);
+        free_.push_back(frameAnalyzer);
+    }
+
+    int acquire(size_t count, std::vector<FacetSDK::FrameAnalyzer*>& analyzers, std::ostream& log)
+    {
+        ScopedLock lock(mutex_);
+        count = std::min(count, all_.size());
+        while (free_.size() < count) {
+            released_.wait(mutex_);
+        }
+        analyzers.insert(analyzers.end(), free_.end() - count, free_.end());
+        free_.resize(free_.size() - count);
+        return FacetSDK::SUCCESS;
+    }
+
+    void release(std::vector<FacetSDK::FrameAnalyzer*>& analyzers)
+    {
+        ScopedLock lock(mutex_);
+        free_.insert(free_.end(), analyzers.begin(), analyzers.end());
+        analyzers.clear();
+        released_.broadcast();
+    }
+
+private:
+    std::vector<FacetSDK::FrameAnalyzer*> all_;
+    std::vector<FacetSDK::FrameAnalyzer*> free_;
+    Mutex mutex_;
+    Condition released_;
+};
+
+/**
+ * Runs the driver named by the job with the pooled analyzers.
+ */
+class FacetJobs : public JobHandler {
+public:
+    FacetJobs(AnalyzerPool& videoAnalyzers, AnalyzerPool& imageAnalyzers)
+    : videoAnalyzers_(videoAnalyzers), imageAnalyzers_(imageAnalyzers), numJobs_(0) {}
+
+    int run(const std::string& workingDir, const std::vector<std::string>& args,
+            std::istream& in, std::ostream& out)
+    {
+        std::string driver = args[0].substr(args[0].find_last_of('/') + 1);
+        // Paths are relative to the client
+        std::vector<std::string> command(args);
+        for (size_t i = 1; i + 1 < command.size(); i++) {
+            if (command[i] == "-v" || command[i] == "-o" || command[i] == "-l" || command[i] == "-metrics") {
+                command[i + 1] = resolvePath(workingDir, command[i + 1]);
+            }
+        }
+        size_t job = logJob(command);
+        std::vector<char*> argv;
+        for (size_t i = 0; i < command.size(); i++) {
+            argv.push_back(const_cast<char*>(command[i].c_str()));
+        }
+
+        int retVal;
+        if (driver == "fexfacet") {
+            retVal = runVideoJob((int)argv.size(), &argv[0], videoAnalyzers_, out);
+        } else if (driver.compare(0, 9, "fexfacet_") == 0) {
+            ImageJobOptions options;
+            std::vector<FacetSDK::FrameAnalyzer*> analyzers;
+            imageAnalyzers_.acquire(1, analyzers, out);
+            bool binary;
+            ImageRowFormatter* rows = createImageRows(driver, *analyzers[0], binary);
+            imageAnalyzers_.release(analyzers);
+            if (!rows) {
+                retVal = unknownDriver(driver, out);
+            } else if (!parseImageArgs((int)argv.size(), &argv[0], binary, options, out)) {
+                retVal = FacetSDK::EMPTY_INPUT;
+            } else {
+                rows->setPrecision(options.precision);
+                imageAnalyzers_.acquire(options.numWorkers, analyzers, out);
+                retVal = analyzeImageList(analyzers, *rows, options, in, out, workingDir);
+                imageAnalyzers_.release(analyzers);
+            }
+            delete rows;
+        } else {
+            retVal = unknownDriver(driver, out);
+        }
+
+        ScopedLock lock(mutex_);
+        std::cout << "job " << job << " done, status " << retVal << std::endl;
+        return retVal;
+    }
+
+private:
+    static int unknownDriver(const std::string& driver, std::ostream& out)
+    {
+        out << "Unknown driver " << driver << " (fexfacet, fexfacet_face, fexfacet_aus, "
+            << "fexfacet_emotions, fexfacet_full or fexfacet_fullh)" << std::endl;
+        return FacetSDK::EMPTY_INPUT;
+    }
+
+    size_t logJob(const std::vector<std::string>& command)
+    {
+        ScopedLock lock(mutex_);
+        std::cout << "job " << ++numJobs_ << ":";
+        for (size_t i = 0; i < command.size(); i++) {
+            std::cout << " " << command[i];
+        }
+        std::cout << std::endl;
+        return numJobs_;
+    }
+
+    AnalyzerPool& videoAnalyzers_;
+    AnalyzerPool& imageAnalyzers_;
+    Mutex mutex_;       ///< Daemon log
+    size_t numJobs_;
+};
+
+static void onSignal(int)
+{
+    stopServing();
+}
+
+int main(int argc, char* argv[])
+{
+    std::string socketPath = defaultSocketPath();
+    size_t numVideo(VIDEOANALYZERS), numImage(IMAGEANALYZERS);
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (i + 1 < argc && arg == "-s") {
+            socketPath = argv[++i];
+        } else if (i + 1 < argc && (arg == "-n" || arg == "-i")) {
+            std::istringstream iss(argv[++i]);
+            iss >> (arg == "-n" ? numVideo : numImage);
+        } else {
+            std::cout << "Usage:" << std::endl;
+            std::cout << "   fexfacetd [-s SOCKET] [-n VIDEOANALYZERS] [-i IMAGEANALYZERS]" << std::endl;
+            std::cout << "   - SOCKET defaults to " << socketPath << std::endl;
+            std::cout << "   - VIDEOANALYZERS (defaults to " << VIDEOANALYZERS << ") are shared by the fexfacet jobs." << std::endl;
+            std::cout << "   - IMAGEANALYZERS (defaults to " << IMAGEANALYZERS << ") are shared by the image jobs." << std::endl;
+            std::cout << "   Run jobs with fexclient." << std::endl;
+            return -1;
+        }
+    }
+    numVideo = std::max(numVideo, (size_t)1);
+    numImage = std::max(numImage, (size_t)1);
+
+    // Load the models once; video analyzers share the FACET thread budget
+    std::cout << "Initializing " << numVideo << " video and " << numImage << " image analyzers" << std::endl;
+    AnalyzerPool videoAnalyzers, imageAnalyzers;
+    int maxThreads = std::max(1, MAXTHREADS / (int)numVideo);
+    for (size_t i = 0; i < numVideo; i++) {
+        FacetSDK::FrameAnalyzer* frameAnalyzer = new FacetSDK::FrameAnalyzer();
+        int retVal = initVideoAnalyzer(*frameAnalyzer, maxThreads);
+        if (retVal != FacetSDK::SUCCESS) {
+            std::cout << "Could not initialize the FrameAnalyzer" << std::endl;
+            std::cout << "Error code = " << FacetSDK::DefineErrorCode(retVal) << std::endl;
+            delete frameAnalyzer;
+            exit(retVal);
+        }
+        videoAnalyzers.add(frameAnalyzer);
+    }
+    for (size_t i = 0; i < numImage; i++) {
+        FacetSDK::FrameAnalyzer* frameAnalyzer = new FacetSDK::FrameAnalyzer();
+        int retVal = initImageAnalyzer(*frameAnalyzer, IMAGE_THREADS, std::cout);
+        if (retVal != FacetSDK::SUCCESS) {
+            delete frameAnalyzer;
+            exit(retVal);
+        }
+        imageAnalyzers.add(frameAnalyzer);
+    }
+
+    signal(SIGPIPE, SIG_IGN);   // Clients that go away are detected by send()
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    FacetJobs jobs(videoAnalyzers, imageAnalyzers);
+    std::cout << "Listening on " << socketPath << std::endl;
+    return serveJobs(socketPath, jobs);
+}
@@ -0,0 +1,375 @@
+#include "imagejob.hpp"
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <opencv2/opencv.hpp>
+#include "config.hpp"
+#include "threads.hpp"
+#include "facechannels.hpp"
+#include "fexbinary.hpp"
+#include "grayresize.hpp"
+
+using namespace EMOTIENT;
+
+const size_t FRAMECHANNELS = 3; /**< FrameNumber, FrameRows, FrameCols **/
+const float  MINSCALE = 0.1;    /**< Smallest analysis scale reachable with -q **/
+
+bool parseImageArgs(int argc, char* argv[], bool allowBinary, ImageJobOptions& options, std::ostream& log)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (i + 1 < argc && arg == "-l") {
+            options.listFile = argv[++i];
+        } else if (i + 1 < argc && arg == "-o" && allowBinary) {
+            options.binaryFile = argv[++i];
+        } else if (i + 1 < argc && (arg == "-t" || arg == "-d" || arg == "-p")) {
+            std::istringstream iss(argv[++i]);
+            iss >> (arg == "-t" ? options.numWorkers : arg == "-d" ? options.numDecoders : options.precision);
+        } else if (i + 1 < argc && arg == "-q") {
+            std::istringstream iss(argv[++i]);
+            iss >> options.qualityScale;
+        } else {
+            log << "Usage:" << std::endl;
+            log << "   " << argv[0] << (allowBinary ? " [-o OUTPUTFILE.fexb]" : "")
+                << " [-l LISTFILE] [-t WORKERS] [-d DECODERS] [-p PRECISION] [-q QUALITYSCALE] < LISTFILE" << std::endl;
+            log << "   - Analyzes the images listed in LISTFILE (or stdin), one row per image in list order." << std::endl;
+            if (allowBinary) {
+                log << "   - The optional [-o OUTPUTFILE.fexb] writes the binary columnar format (see fex_binimport)." << std::endl;
+            }
+            log << "   - The optional [-t WORKERS] sets the number of parallel frame analyzers (defaults to 1)." << std::endl;
+            log << "   - The optional [-d DECODERS] sets the number of threads decoding images ahead (defaults to 2)." << std::endl;
+            log << "   - The optional [-p PRECISION] sets the significant digits of the values (defaults to "
+                << DEFAULT_PRECISION << "; " << ROUNDTRIP_PRECISION << " reads back the exact values)." << std::endl;
+            log << "   - The optional [-q QUALITYSCALE], between 0 (best) and 1 (fastest), shrinks the images to" << std::endl;
+            log << "     (1 - QUALITYSCALE) of their size before analysis (defaults to 0); coordinates stay in image pixels." << std::endl;
+            return false;
+        }
+    }
+    options.numWorkers = std::max(options.numWorkers, 1);
+    options.numDecoders = std::max(options.numDecoders, 1);
+    options.precision = clampPrecision(options.precision);
+    return true;
+}
+
+int initImageAnalyzer(FacetSDK::FrameAnalyzer& frameAnalyzer, int maxThreads, std::ostream& log)
+{
+    frameAnalyzer.SetMaxThreads(maxThreads);
+    int retVal = frameAnalyzer.Initialize(FACETSDIR, "FrameAnalyzerConfig.json");
+    if (retVal != FacetSDK::SUCCESS) {
+        log << "Could not initialize the FrameAnalyzer" << std::endl;
+        log << "Check that FACETSDIR is pointing to the correct location relative to the working directory." << std::endl;
+        log << "Error code = " << FacetSDK::DefineErrorCode(retVal) << std::endl;
+    }
+    return retVal;
+}
+
+/**
+ * Decode / analyze / write engine for image lists, the counterpart of
+ * FramePipeline: decoder threads read the list and decode the images into
+ * a ring of slots, each worker owns one analyzer, and the calling thread
+ * writes the rows in list order. Image k lives in slot k % ringsize, so
+ * the decoders are at most ringsize images ahead of the output.
+ */
+class ImagePipeline {
+public:
+    ImagePipeline(std::istream& list, const std::string& workingDir,
+                  const std::vector<FacetSDK::FrameAnalyzer*>& analyzers, const ImageRowFormatter& rows,
+                  const FaceChannels& faceChannels, FexbWriter* writer, size_t numDecoders, float scale)
+    : list_(list), workingDir_(workingDir), analyzers_(analyzers), rows_(rows),
+      faceChannels_(faceChannels), writer_(writer), numDecoders_(numDecoders), scale_(scale),
+      ring_(2 * (analyzers.size() + numDecoders) + 2),
+      nextToRead_(0), nextToAnalyze_(0), total_(0), ended_(false) {}
+
+    /** Process the list; returns the number of images **/
+    size_t run(std::ostream& out)
+    {
+        std::vector<Thread*> threads;
+        for (size_t i = 0; i < numDecoders_; i++) {
+            threads.push_back(new Decoder(*this));
+        }
+        for (size_t i = 0; i < analyzers_.size(); i++) {
+            threads.push_back(new Worker(*this, *analyzers_[i]));
+        }
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i]->start();
+        }
+        size_t written = writeLoop(out);
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i]->join();
+            delete threads[i];
+        }
+        return written;
+    }
+
+private:
+    enum SlotState { FREE, DECODING, DECODED, ANALYZING, DONE };
+
+    struct Slot {
+        Slot() : state(FREE), index(0), facePresent(false) {}
+        SlotState state;
+        size_t index;
+        std::string filename;
+        cv::Mat frame;
+        FrameMapping mapping;       ///< From frame to the image file
+        std::string row;            ///< Text row, or the message of an unreadable image (keeps its capacity)
+        std::vector<float> values;  ///< Binary row
+        bool facePresent;
+    };
+
+    class Decoder : public Thread {
+    public:
+        explicit Decoder(ImagePipeline& owner) : owner_(owner) {}
+    protected:
+        void run() { owner_.decodeLoop(); }
+    private:
+        ImagePipeline& owner_;
+    };
+
+    class Worker : public Thread {
+    public:
+        Worker(ImagePipeline& owner, FacetSDK::FrameAnalyzer& analyzer) : owner_(owner), analyzer_(analyzer) {}
+    protected:
+        void run() { owner_.analyzeLoop(analyzer_); }
+    private:
+        ImagePipeline& owner_;
+        FacetSDK::FrameAnalyzer& analyzer_;
+    };
+
+    /** All images are read and analyzed (mutex held) **/
+    bool finished(size_t index) const { return ended_ && index >= total_; }
+
+    void decodeLoop()
+    {
+        GrayResizer resizer;
+        while (true) {
+            Slot* slot(0);
+            {
+                ScopedLock lock(mutex_);
+                while (!ended_ && ring_[nextToRead_ % ring_.size()].state != FREE) {
+                    slotFreed_.wait(mutex_);
+                }
+                if (ended_) {
+                    return;
+                }
+                slot = &ring_[nextToRead_ % ring_.size()];
+                slot->filename.clear();
+                list_ >> slot->filename;
+                if (slot->filename.empty()) {
+                    ended_ = true;
+                    total_ = nextToRead_;
+                    slotFreed_.broadcast();
+                    frameDecoded_.broadcast();
+                    frameDone_.broadcast();
+                    return;
+                }
+                slot->state = DECODING;
+                slot->index = nextToRead_++;
+            }
+            // Decode straight to grayscale (JPEG decoders only read the luma channel)
+            std::string path = (workingDir_.empty() || slot->filename[0] == '/') ? slot->filename
+                                                                                  : workingDir_ + "/" + slot->filename;
+            cv::Mat frame = cv::imread(path, CV_LOAD_IMAGE_GRAYSCALE);
+            FrameMapping mapping;
+            if (scale_ < 1 && frame.rows > 0 && frame.cols > 0) {
+                // Trade quality for speed; the rows map the coordinates back to the image
+                cv::Mat scaled;
+                cv::Size size(std::max((int)(frame.cols * scale_ + 1e-6), 1), std::max((int)(frame.rows * scale_ + 1e-6), 1));
+                grayResize(frame, scaled, size, resizer);
+                mapping = scaledMapping(frame.size(), size);
+                frame = scaled;
+            }
+            {
+                ScopedLock lock(mutex_);
+                slot->frame = frame;
+                slot->mapping = mapping;
+                slot->state = DECODED;
+            }
+            frameDecoded_.broadcast();
+        }
+    }
+
+    void analyzeLoop(FacetSDK::FrameAnalyzer& frameAnalyzer)
+    {
+        // Reused for all the images of the worker
+        FacetSDK::FrameAnalysis frameAnalysis;
+        FacetSDK::Face face;
+        while (true) {
+            Slot* slot(0);
+            {
+                ScopedLock lock(mutex_);
+                while (true) {
+                    if (finished(nextToAnalyze_)) {
+                        return;
+                    }
+                    slot = &ring_[nextToAnalyze_ % ring_.size()];
+                    if (slot->state == DECODED && slot->index == nextToAnalyze_) {
+                        break;
+                    }
+                    frameDecoded_.wait(mutex_);
+                }
+                slot->state = ANALYZING;
+                nextToAnalyze_++;
+            }
+            analyze(*slot, frameAnalyzer, frameAnalysis, face);
+            {
+                ScopedLock lock(mutex_);
+                slot->frame.release();
+                slot->state = DONE;
+            }
+            frameDone_.broadcast();
+        }
+    }
+
+    void analyze(Slot& slot, FacetSDK::FrameAnalyzer& frameAnalyzer, FacetSDK::FrameAnalysis& frameAnalysis,
+                 FacetSDK::Face& face)
+    {
+        const cv::Mat& frame(slot.frame);
+        slot.row.clear();
+        if (writer_) {
+            slot.values.assign(FRAMECHANNELS + faceChannels_.size(), std::numeric_limits<float>::quiet_NaN());
+            slot.values[0] = slot.index + 1;
+            slot.values[1] = slot.mapping.frameRows(frame.rows);
+            slot.values[2] = slot.mapping.frameCols(frame.cols);
+            slot.facePresent = false;
+        }
+        if (frame.rows == 0 || frame.cols == 0) {
+            slot.row += "file ";
+            slot.row += slot.filename;
+            slot.row += " could not be opened as an image.\n";
+        }
+        else if (writer_) {
+            frameAnalyzer.Analyze(frame.data, frame.rows, frame.cols, frameAnalysis);
+            slot.facePresent = (frameAnalysis.NumFaces() > 0);
+            if (slot.facePresent) {
+                frameAnalysis.LargestFace(face);
+                faceChannels_.values(face, &slot.values[FRAMECHANNELS], slot.mapping);
+            }
+        }
+        else {
+            // The image was decoded to grayscale (required)
+            frameAnalyzer.Analyze(frame.data, frame.rows, frame.cols, frameAnalysis);
+            rows_.format(slot.row, slot.filename, frame, frameAnalysis, face, slot.mapping);
+        }
+    }
+
+    size_t writeLoop(std::ostream& out)
+    {
+        TextWriter text(out, true);
+        size_t index(0);
+        bool flushed(true);
+        while (true) {
+            Slot& slot = ring_[index % ring_.size()];
+            mutex_.lock();
+            while (!finished(index) && !(slot.state == DONE && slot.index == index)) {
+                if (!flushed) {
+                    // Rows reach the output as soon as the next one is not ready
+                    mutex_.unlock();
+                    text.flush();
+                    flushed = true;
+                    mutex_.lock();
+                    continue;
+                }
+                frameDone_.wait(mutex_);
+            }
+            bool done = finished(index);
+            mutex_.unlock();
+            if (done) {
+                break;
+            }
+            text.write(slot.row);
+            if (writer_) {
+                writer_->addFrame(&slot.values[0], slot.facePresent);
+            }
+            flushed = false;
+            {
+                ScopedLock lock(mutex_);
+                slot.state = FREE;
+            }
+            slotFreed_.broadcast();
+            index++;
+        }
+        text.close();
+        return index;
+    }
+
+    ImagePipeline(const ImagePipeline&);
+    ImagePipeline& operator=(const ImagePipeline&);
+
+    std::istream& list_;
+    std::string workingDir_;
+    std::vector<FacetSDK::FrameAnalyzer*> analyzers_;
+    const ImageRowFormatter& rows_;
+    const FaceChannels& faceChannels_;
+    FexbWriter* writer_;
+    size_t numDecoders_;
+    float scale_;               ///< Analysis scale of the images
+    std::vector<Slot> ring_;
+
+    size_t nextToRead_;
+    size_t nextToAnalyze_;
+    size_t total_;              ///< Number of images, once ended_
+    bool ended_;                ///< The end of the list was read
+
+    Mutex mutex_;
+    Condition slotFreed_;
+    Condition frameDecoded_;
+    Condition frameDone_;
+};
+
+int analyzeImageList(const std::vector<FacetSDK::FrameAnalyzer*>& analyzers,
+                     const ImageRowFormatter& rows, const ImageJobOptions& options,
+                     std::istream& in, std::ostream& out, const std::string& workingDir)
+{
+    std::ifstream listFile;
+    if (!options.listFile.empty()) {
+        std::string path = (workingDir.empty() || options.listFile[0] == '/') ? options.listFile
+                                                                              : workingDir + "/" + options.listFile;
+        listFile.open(path.c_str());
+        if (!listFile) {
+            out << "Could not open " << options.listFile << std::endl;
+            return FacetSDK::NOT_AVAILABLE;
+        }
+    }
+
+    // Optional binary columnar output
+    FaceChannels faceChannels(*analyzers[0]);
+    FexbWriter binaryWriter;
+    if (!options.binaryFile.empty()) {
+        binaryWriter.addChannel("frame", "FrameNumber");
+        binaryWriter.addChannel("frame", "FrameRows");
+        binaryWriter.addChannel("frame", "FrameCols");
+        faceChannels.addTo(binaryWriter);
+        if (!binaryWriter.open(options.binaryFile)) {
+            out << "Could not open " << options.binaryFile << " for writing" << std::endl;
+            return FacetSDK::NOT_AVAILABLE;
+        }
+    }
+
+    ImagePipeline pipeline(options.listFile.empty() ? in : listFile, workingDir, analyzers, rows,
+                           faceChannels, binaryWriter.isOpen() ? &binaryWriter : 0, options.numDecoders,
+                           std::max(MINSCALE, std::min(1.0f, 1.0f - options.qualityScale)));
+    pipeline.run(out);
+    if (binaryWriter.isOpen() && !binaryWriter.close()) {
+        out << "Error writing " << options.binaryFile << std::endl;
+        return FacetSDK::NOT_AVAILABLE;
+    }
+    return FacetSDK::SUCCESS;
+}
+
+int initImageDriver(int argc, char* argv[], bool allowBinary, ImageJobOptions& options,
+                    std::vector<FacetSDK::FrameAnalyzer*>& analyzers)
+{
+    if (!parseImageArgs(argc, argv, allowBinary, options, std::cout)) {
+        return FacetSDK::EMPTY_INPUT;
+    }
+
+    // Initialize the frame analysis engines
+    int maxThreads = std::max(1, IMAGE_THREADS / options.numWorkers);
+    int retVal(FacetSDK::SUCCESS);
+    for (int i = 0; i < options.numWorkers && retVal == FacetSDK::SUCCESS; i++) {
+        analyzers.push_back(new FacetSDK::FrameAnalyzer());
+        retVal = initImageAnalyzer(*analyzers.back(), maxThreads, std::cout);
+    }
+    return retVal;
+}
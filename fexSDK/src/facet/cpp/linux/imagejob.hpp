@@ -0,0 +1,94 @@
+#ifndef IMAGEJOB_HPP
+#define IMAGEJOB_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "emotient.hpp"
+#include "framemapping.hpp"
+#include "textwriter.hpp"
+
+const int IMAGE_THREADS = 4;    /**< FACET threads of the analyzers of an image list **/
+
+/**
+ * Formats the text row of an analyzed image (see imagerows.hpp). format()
+ * runs on the analyzer workers, each with its own analysis and face
+ * objects, and must only touch its arguments.
+ */
+class ImageRowFormatter {
+public:
+    ImageRowFormatter() : precision_(DEFAULT_PRECISION) {}
+    virtual ~ImageRowFormatter() {}
+    /** Significant digits of the values (-p PRECISION) **/
+    void setPrecision(int precision) { precision_ = precision; }
+    /**
+     * Append the row of an image, ended by a newline.
+     * \param row reused between images of a worker
+     * \param filename the image as named in the list
+     * \param image the analyzed grayscale image
+     * \param analysis the analysis of image
+     * \param face scratch object for the largest face
+     * \param mapping from image to the image file, when it was downscaled (-q)
+     */
+    virtual void format(std::string& row, const std::string& filename, const cv::Mat& image,
+                        EMOTIENT::FacetSDK::FrameAnalysis& analysis,
+                        EMOTIENT::FacetSDK::Face& face, const FrameMapping& mapping) const = 0;
+protected:
+    int precision_;
+};
+
+/**
+ * Command line of the image drivers.
+ */
+struct ImageJobOptions {
+    ImageJobOptions() : numWorkers(1), numDecoders(2), precision(DEFAULT_PRECISION), qualityScale(0) {}
+    std::string listFile;       ///< -l LISTFILE: read the image list from a file instead of stdin
+    std::string binaryFile;     ///< -o OUTPUTFILE.fexb (fexfacet_full only)
+    int numWorkers;             ///< -t WORKERS: parallel frame analyzers
+    int numDecoders;            ///< -d DECODERS: image decoding threads
+    int precision;              ///< -p PRECISION: significant digits of the text rows
+    float qualityScale;         ///< -q QUALITYSCALE: images are analyzed at (1 - QUALITYSCALE) of their size
+};
+
+/**
+ * Parse the flags of an image driver (-o only when allowBinary). Prints the
+ * usage to log and returns false on an unknown flag.
+ */
+bool parseImageArgs(int argc, char* argv[], bool allowBinary, ImageJobOptions& options, std::ostream& log);
+
+/**
+ * Initialize a frame analyzer as the image drivers use it. Prints the
+ * error to log and returns the FacetSDK error code.
+ */
+int initImageAnalyzer(EMOTIENT::FacetSDK::FrameAnalyzer& frameAnalyzer, int maxThreads, std::ostream& log);
+
+/**
+ * Parse the command line of an image driver and initialize
+ * options.numWorkers analyzers, sharing IMAGE_THREADS FACET threads.
+ * Returns the FacetSDK error code; the analyzers are deleted by the caller.
+ */
+int initImageDriver(int argc, char* argv[], bool allowBinary, ImageJobOptions& options,
+                    std::vector<EMOTIENT::FacetSDK::FrameAnalyzer*>& analyzers);
+
+/**
+ * Analyze an image list (paths separated by white space, relative to
+ * workingDir) and write the row of each image to out, in list order. The
+ * list is options.listFile, or "in".
+ *
+ * Images are decoded ahead by options.numDecoders threads, at most a
+ * bounded window of them, and analyzed in parallel by the analyzers (one
+ * thread each). The output is the same for any number of threads.
+ *
+ * With options.binaryFile, all the channels of the analyzers are written
+ * there in the binary columnar format (fexbinary.hpp) instead, with
+ * FrameNumber the position of the image in the list, and out only gets
+ * the messages. Text rows are written to out by a background thread (see
+ * TextWriter), flushed whenever the next row is not ready yet. Returns the
+ * FacetSDK error code.
+ */
+int analyzeImageList(const std::vector<EMOTIENT::FacetSDK::FrameAnalyzer*>& analyzers,
+                     const ImageRowFormatter& rows, const ImageJobOptions& options,
+                     std::istream& in, std::ostream& out, const std::string& workingDir = "");
+
+#endif  // IMAGEJOB_HPP
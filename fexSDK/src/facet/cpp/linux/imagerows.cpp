@@ -0,0 +1,78 @@
+#include "imagerows.hpp"
+
+using namespace EMOTIENT;
+
+void TabRow::begin(std::string& row, const std::string& filename, int rows, int cols)
+{
+    row += filename;
+    row += '\t';
+    appendInt(row, rows);
+    row += '\t';
+    appendInt(row, cols);
+    row += '\t';
+}
+
+void TabRow::value(std::string& row, const std::string&, float value, int precision)
+{
+    appendFloat(row, value, precision);
+    row += '\t';
+}
+
+void TabRow::noFace(std::string& row)
+{
+    row += "NaN\n";
+}
+
+void TabRow::end(std::string& row)
+{
+    // The last value has no separator
+    row[row.size() - 1] = '\n';
+}
+
+void LabeledRow::begin(std::string& row, const std::string& filename, int rows, int cols)
+{
+    row += "filename:";
+    row += filename;
+    row += ":width_f:";
+    appendInt(row, rows);
+    row += ":height_f:";
+    appendInt(row, cols);
+    row += ':';
+}
+
+void LabeledRow::value(std::string& row, const std::string& label, float value, int precision)
+{
+    row += label;
+    row += ':';
+    appendFloat(row, value, precision);
+    row += ':';
+}
+
+void LabeledRow::noFace(std::string& row)
+{
+    row += "No face found\n";
+}
+
+void LabeledRow::end(std::string& row)
+{
+    row += '\n';
+}
+
+ImageRowFormatter* createImageRows(const std::string& driver, FacetSDK::FrameAnalyzer& frameAnalyzer,
+                                   bool& binary)
+{
+    binary = false;
+    if (driver == "fexfacet_face") {
+        return new ImageRows<IMAGE_FACE, TabRow>(frameAnalyzer);
+    } else if (driver == "fexfacet_aus") {
+        return new ImageRows<IMAGE_AUS, TabRow>(frameAnalyzer);
+    } else if (driver == "fexfacet_emotions") {
+        return new ImageRows<IMAGE_EMOTIONS, TabRow>(frameAnalyzer);
+    } else if (driver == "fexfacet_full") {
+        binary = true;
+        return new ImageRows<IMAGE_FULL, TabRow>(frameAnalyzer);
+    } else if (driver == "fexfacet_fullh") {
+        return new ImageRows<IMAGE_FULL, LabeledRow>(frameAnalyzer);
+    }
+    return 0;
+}
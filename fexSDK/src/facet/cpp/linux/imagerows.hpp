@@ -0,0 +1,189 @@
+#ifndef IMAGEROWS_HPP
+#define IMAGEROWS_HPP
+
+#include <sstream>
+#include <string>
+#include <vector>
+#include "emotient.hpp"
+#include "imagejob.hpp"
+
+/**
+ * Channels written by the image drivers, after the face box, the
+ * landmarks and the pose.
+ */
+enum ImageChannels {
+    IMAGE_FACE,         ///< fexfacet_face: nothing else
+    IMAGE_AUS,          ///< fexfacet_aus: action units
+    IMAGE_EMOTIONS,     ///< fexfacet_emotions: primary, sentiment and advanced emotions
+    IMAGE_FULL          ///< fexfacet_full(h): emotions, then action units
+};
+
+/**
+ * Rows of fexfacet_face, _aus, _emotions and _full: the filename, the
+ * image size and the values, separated by tabs. Without a face, the image
+ * size is followed by NaN.
+ */
+struct TabRow {
+    static const bool LABELED = false;
+    static void begin(std::string& row, const std::string& filename, int rows, int cols);
+    static void value(std::string& row, const std::string& label, float value, int precision);
+    static void noFace(std::string& row);
+    static void end(std::string& row);
+};
+
+/**
+ * Rows of fexfacet_fullh: "label:value:" pairs ("filename:FILE:width_f:..."),
+ * or "No face found" after the image size.
+ */
+struct LabeledRow {
+    static const bool LABELED = true;
+    static void begin(std::string& row, const std::string& filename, int rows, int cols);
+    static void value(std::string& row, const std::string& label, float value, int precision);
+    static void noFace(std::string& row);
+    static void end(std::string& row);
+};
+
+/**
+ * Row formatter of an image driver, for a channel set and a row format.
+ * The channel tables and their labels are computed once from the
+ * analyzer, so formatting a row does not allocate (row keeps its
+ * capacity between images).
+ */
+template <ImageChannels CHANNELS, class Format>
+class ImageRows : public ImageRowFormatter {
+public:
+    /** Only fexfacet_full has binary output (-o OUTPUTFILE.fexb) **/
+    static const bool BINARY = (CHANNELS == IMAGE_FULL && !Format::LABELED);
+
+    explicit ImageRows(EMOTIENT::FacetSDK::FrameAnalyzer& frameAnalyzer)
+    : pose_(frameAnalyzer.IsChannelAvailable(EMOTIENT::FacetSDK::POSE))
+    {
+        using namespace EMOTIENT;
+        if (frameAnalyzer.IsChannelAvailable(FacetSDK::LANDMARKS)) {
+            landmarks_ = FacetSDK::AllLandmarkNames();
+            for (size_t i = 0; i < landmarks_.size(); i++) {
+                landmarkLabels_.push_back(label(landmarks_[i]) + "_X");
+                landmarkLabels_.push_back(label(landmarks_[i]) + "_Y");
+            }
+        }
+        if (CHANNELS == IMAGE_EMOTIONS || CHANNELS == IMAGE_FULL) {
+            addEmotions(frameAnalyzer, FacetSDK::PRIMARY_EMOTIONS, FacetSDK::AllPrimaryEmotionNames());
+            addEmotions(frameAnalyzer, FacetSDK::SENTIMENTS, FacetSDK::AllSentimentEmotionNames());
+            addEmotions(frameAnalyzer, FacetSDK::ADVANCED_EMOTIONS, FacetSDK::AllAdvancedEmotionNames());
+        }
+        if ((CHANNELS == IMAGE_AUS || CHANNELS == IMAGE_FULL) &&
+            frameAnalyzer.IsChannelAvailable(FacetSDK::ACTION_UNITS)) {
+            actionUnits_ = FacetSDK::AllActionUnits();
+            for (size_t i = 0; i < actionUnits_.size(); i++) {
+                actionUnitLabels_.push_back(label(actionUnits_[i]));
+            }
+        }
+    }
+
+    void format(std::string& row, const std::string& filename, const cv::Mat& image,
+                EMOTIENT::FacetSDK::FrameAnalysis& analysis, EMOTIENT::FacetSDK::Face& face,
+                const FrameMapping& mapping) const
+    {
+        using namespace EMOTIENT;
+        Format::begin(row, filename, mapping.frameRows(image.rows), mapping.frameCols(image.cols));
+        if (analysis.NumFaces() == 0) {
+            Format::noFace(row);
+            return;
+        }
+        // Analyze the largest face
+        analysis.LargestFace(face);
+        FacetSDK::Rectangle faceLocation;
+        face.FaceLocation(faceLocation);
+        Format::value(row, boxLabels()[0], mapping.x(faceLocation.x), precision_);
+        Format::value(row, boxLabels()[1], mapping.y(faceLocation.y), precision_);
+        Format::value(row, boxLabels()[2], mapping.width(faceLocation.width), precision_);
+        Format::value(row, boxLabels()[3], mapping.height(faceLocation.height), precision_);
+        for (size_t i = 0; i < landmarks_.size(); i++) {
+            FacetSDK::Point point = face.LandmarkLocation(landmarks_[i]);
+            Format::value(row, landmarkLabels_[2 * i], mapping.x(point.x), precision_);
+            Format::value(row, landmarkLabels_[2 * i + 1], mapping.y(point.y), precision_);
+        }
+        if (pose_) {
+            Format::value(row, poseLabels()[0], face.PoseValue(FacetSDK::ROLL), precision_);
+            Format::value(row, poseLabels()[1], face.PoseValue(FacetSDK::PITCH), precision_);
+            Format::value(row, poseLabels()[2], face.PoseValue(FacetSDK::YAW), precision_);
+        }
+        for (size_t i = 0; i < emotions_.size(); i++) {
+            Format::value(row, emotionLabels_[i], face.EmotionValue(emotions_[i]), precision_);
+        }
+        for (size_t i = 0; i < actionUnits_.size(); i++) {
+            Format::value(row, actionUnitLabels_[i], face.ActionUnitValue(actionUnits_[i]), precision_);
+        }
+        Format::end(row);
+    }
+
+private:
+    template <class Name>
+    static std::string label(const Name& name)
+    {
+        std::ostringstream oss;
+        oss << name;
+        return oss.str();
+    }
+
+    static const std::string* boxLabels()
+    {
+        static const std::string labels[] = {"TopLeft_X", "TopLeft_Y", "Width", "Height"};
+        return labels;
+    }
+
+    static const std::string* poseLabels()
+    {
+        static const std::string labels[] = {"Roll", "Pitch", "Yaw"};
+        return labels;
+    }
+
+    void addEmotions(EMOTIENT::FacetSDK::FrameAnalyzer& frameAnalyzer, EMOTIENT::FacetSDK::Channel channel,
+                     const std::vector<EMOTIENT::FacetSDK::EmotionName>& names)
+    {
+        if (frameAnalyzer.IsChannelAvailable(channel)) {
+            for (size_t i = 0; i < names.size(); i++) {
+                emotions_.push_back(names[i]);
+                emotionLabels_.push_back(label(names[i]));
+            }
+        }
+    }
+
+    bool pose_;
+    std::vector<EMOTIENT::FacetSDK::LandmarkName> landmarks_;
+    std::vector<std::string> landmarkLabels_;
+    std::vector<EMOTIENT::FacetSDK::EmotionName> emotions_;
+    std::vector<std::string> emotionLabels_;
+    std::vector<EMOTIENT::FacetSDK::ActionUnit> actionUnits_;
+    std::vector<std::string> actionUnitLabels_;
+};
+
+/**
+ * The row formatter of an image driver by name (fexfacet_face, _aus,
+ * _emotions, _full or _fullh), or 0. Sets binary if the driver has binary
+ * output.
+ */
+ImageRowFormatter* createImageRows(const std::string& driver, EMOTIENT::FacetSDK::FrameAnalyzer& frameAnalyzer,
+                                   bool& binary);
+
+/**
+ * main() of an image driver with Rows, an ImageRows instantiation.
+ */
+template <class Rows>
+int runImageDriver(int argc, char* argv[])
+{
+    ImageJobOptions options;
+    std::vector<EMOTIENT::FacetSDK::FrameAnalyzer*> analyzers;
+    int retVal = initImageDriver(argc, argv, Rows::BINARY, options, analyzers);
+    if (retVal == EMOTIENT::FacetSDK::SUCCESS) {
+        Rows rows(*analyzers[0]);
+        rows.setPrecision(options.precision);
+        retVal = analyzeImageList(analyzers, rows, options, std::cin, std::cout);
+    }
+    for (size_t i = 0; i < analyzers.size(); i++) {
+        delete analyzers[i];
+    }
+    return retVal;
+}
+
+#endif  // IMAGEROWS_HPP
@@ -0,0 +1,416 @@
+#include "pipeline.hpp"
+#include <cmath>
+
+using namespace EMOTIENT;
+
+const double FACE_MARGIN = 0.5;   /**< Margin of the second pass of setFalsePositiveFilter, as a fraction of the face size **/
+const double FACE_MIN_OVERLAP = 0.5;    /**< Share of the accepted face the face of the second pass must cover **/
+
+/**
+ * The emotion and action unit channels, turned off or on.
+ */
+static void setChannels(FacetSDK::FrameAnalyzer& analyzer, const std::vector<FacetSDK::Channel>& channels, bool active)
+{
+    for (size_t i = 0; i < channels.size(); i++) {
+        analyzer.SetChannelActive(channels[i], active);
+    }
+}
+
+/**
+ * True if the largest face of analysis, found in region, covers at least
+ * FACE_MIN_OVERLAP of box (in whole-frame coordinates).
+ */
+static bool coversFace(FacetSDK::FrameAnalysis& analysis, const cv::Rect& region, const cv::Rect_<float>& box)
+{
+    if (analysis.NumFaces() == 0) {
+        return false;
+    }
+    FacetSDK::Face face;
+    analysis.LargestFace(face);
+    FacetSDK::Rectangle location;
+    face.FaceLocation(location);
+    cv::Rect_<float> found(location.x + region.x, location.y + region.y, location.width, location.height);
+    return (found & box).area() >= FACE_MIN_OVERLAP * box.area();
+}
+
+FramePipeline::FramePipeline(LumaSource& source,
+                             const std::vector<FacetSDK::FrameAnalyzer*>& analyzers,
+                             FrameFormatter& formatter, std::ostream& outstream, size_t ringsize)
+: source_(source), analyzers_(analyzers), formatter_(formatter), outstream_(outstream),
+  numtotalframes_(0), firstframe_(0), nextToAnalyze_(0), nextRecorded_(0), checkpoint_(0), search_(0), change_(0),
+  falsePositive_(0), skipChannels_(false), metrics_(0)
+{
+    // Every worker needs a frame, and the decoder needs one more to stay ahead
+    if (ringsize < analyzers_.size() + 1) {
+        ringsize = analyzers_.size() + 1;
+    }
+    ring_.resize(ringsize);
+}
+
+FramePipeline::~FramePipeline()
+{
+}
+
+void FramePipeline::setMetrics(RunMetrics* metrics)
+{
+    metrics_ = metrics;
+    if (metrics_) {
+        decodeStage_ = metrics_->addStage("decode");
+        analysisStage_ = metrics_->addStage("analysis");
+        formatStage_ = metrics_->addStage("format");
+        writeStage_ = metrics_->addStage("write");
+        framesCounter_ = metrics_->addCounter("frames", "Frames analyzed and written.");
+        failedCounter_ = metrics_->addCounter("frames_failed", "Frames the analyzer could not analyze.");
+        undecodedCounter_ = metrics_->addCounter("frames_undecoded", "Frames that could not be decoded.");
+        rescannedCounter_ = metrics_->addCounter("frames_rescanned", "Frames analyzed again whole after a miss in the search window.");
+        reusedCounter_ = metrics_->addCounter("frames_reused", "Near-duplicate frames written with the result of the previous frame.");
+        rejectedCounter_ = metrics_->addCounter("faces_rejected", "Faces rejected as false positives.");
+        reanalyzedCounter_ = metrics_->addCounter("faces_reanalyzed", "Accepted faces analyzed again with the channels of -fpskip.");
+        decodedGauge_ = metrics_->addGauge("queue_decoded", "Decoded frames waiting for an analyzer.");
+        doneGauge_ = metrics_->addGauge("queue_done", "Analyzed frames waiting for the writer.");
+    }
+}
+
+void FramePipeline::setCheckpoint(Checkpointer* checkpoint)
+{
+    checkpoint_ = checkpoint;
+}
+
+void FramePipeline::setSearchWindow(SearchWindow* search)
+{
+    search_ = search;
+}
+
+void FramePipeline::setChangeDetector(FrameChangeDetector* change)
+{
+    change_ = change;
+}
+
+void FramePipeline::setFalsePositiveFilter(FalsePositiveFilter* filter, bool skipChannels)
+{
+    falsePositive_ = filter;
+    skipChannels_ = filter && skipChannels;
+}
+
+size_t FramePipeline::run(size_t numtotalframes, size_t firstframe)
+{
+    numtotalframes_ = numtotalframes;
+    firstframe_ = firstframe;
+    nextToAnalyze_ = firstframe;
+    nextRecorded_ = firstframe;
+    for (size_t i = 0; i < ring_.size(); i++) {
+        ring_[i].state = FREE;
+    }
+    if (change_) {
+        // The first frame of a run always has its own result
+        change_->reset();
+    }
+
+    Decoder decoder(*this);
+    std::vector<Worker*> workers;
+    for (size_t i = 0; i < analyzers_.size(); i++) {
+        workers.push_back(new Worker(*this, *analyzers_[i]));
+    }
+
+    decoder.start();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i]->start();
+    }
+
+    // The calling thread is the writer
+    size_t written = writeLoop();
+
+    decoder.join();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i]->join();
+        delete workers[i];
+    }
+    return written;
+}
+
+void FramePipeline::decodeLoop()
+{
+    for (size_t framenum = firstframe_; framenum < numtotalframes_; framenum++) {
+        Slot& slot = ring_[framenum % ring_.size()];
+        {
+            ScopedLock lock(mutex_);
+            while (slot.state != FREE) {
+                slotFreed_.wait(mutex_);
+            }
+        }
+        // A FREE slot is owned by the decoder, so no lock is needed to fill it
+        MetricsTimer timer(metrics_, decodeStage_);
+        bool decoded = source_.read(slot.frame);
+        bool reused = decoded && change_ && change_->unchanged(slot.frame.mat());
+        timer.stop();
+        {
+            ScopedLock lock(mutex_);
+            slot.framenum = framenum;
+            slot.decoded = decoded;
+            slot.reused = reused;
+            slot.state = DECODED;
+        }
+        frameDecoded_.broadcast();
+    }
+}
+
+void FramePipeline::analyzeLoop(FacetSDK::FrameAnalyzer& analyzer)
+{
+    FacetSDK::FrameAnalysis frameanalysis;
+    cv::Mat window;
+    // Channels analyzed only for the faces accepted by falsePositive_
+    std::vector<FacetSDK::Channel> skipped;
+    if (skipChannels_) {
+        const FacetSDK::Channel functional[] = { FacetSDK::PRIMARY_EMOTIONS, FacetSDK::SENTIMENTS,
+                                                 FacetSDK::ADVANCED_EMOTIONS, FacetSDK::ACTION_UNITS };
+        for (size_t i = 0; i < 4; i++) {
+            if (analyzer.IsChannelActive(functional[i])) {
+                skipped.push_back(functional[i]);
+            }
+        }
+        setChannels(analyzer, skipped, false);
+    }
+    while (true) {
+        Slot* slot(0);
+        {
+            ScopedLock lock(mutex_);
+            while (true) {
+                if (nextToAnalyze_ >= numtotalframes_) {
+                    setChannels(analyzer, skipped, true);
+                    return;
+                }
+                slot = &ring_[nextToAnalyze_ % ring_.size()];
+                if (slot->state == DECODED) {
+                    break;
+                }
+                frameDecoded_.wait(mutex_);
+            }
+            slot->state = ANALYZING;
+            nextToAnalyze_++;
+        }
+
+        int retVal(FacetSDK::NOT_AVAILABLE);
+        // The slot is owned by this worker until it is DONE
+        slot->row.clear();
+        if (slot->decoded && !slot->reused) {
+            cv::Rect region;
+            bool rejected(false);
+            MetricsTimer analysisTimer(metrics_, analysisStage_);
+            retVal = analyze(analyzer, slot->frame, slot->framenum, frameanalysis, window, region, skipped, rejected);
+            analysisTimer.stop();
+            if (retVal == FacetSDK::SUCCESS) {
+                MetricsTimer formatTimer(metrics_, formatStage_);
+                if (rejected) {
+                    formatter_.reject(slot->row, slot->framenum, slot->frame.mat());
+                } else {
+                    formatter_.format(slot->row, slot->framenum, slot->frame.mat(), frameanalysis, analyzer, region);
+                }
+            }
+            // Left on by the second pass of an accepted face, for format()
+            setChannels(analyzer, skipped, false);
+        } else if (search_ || falsePositive_) {
+            // Nothing to record, but the frames after it wait for their turn
+            waitRecorded(slot->framenum);
+            recorded(slot->framenum);
+        }
+
+        {
+            ScopedLock lock(mutex_);
+            slot->retVal = retVal;
+            slot->state = DONE;
+        }
+        frameDone_.broadcast();
+    }
+}
+
+/**
+ * Wait until the faces of the frames before frames are recorded.
+ */
+void FramePipeline::waitRecorded(size_t frames)
+{
+    ScopedLock lock(mutex_);
+    while (nextRecorded_ < frames) {
+        frameRecorded_.wait(mutex_);
+    }
+}
+
+/**
+ * The face of frame framenum is recorded: the next frame's turn.
+ */
+void FramePipeline::recorded(size_t framenum)
+{
+    {
+        ScopedLock lock(mutex_);
+        nextRecorded_ = framenum + 1;
+    }
+    frameRecorded_.broadcast();
+}
+
+/**
+ * Analyze frame, or only the region of it given by search_ (copied to
+ * window, as the analyzer needs contiguous rows). region receives the part
+ * of the frame that frameanalysis refers to. rejected is set when
+ * falsePositive_ rejects the face found; the skipped channels are turned
+ * on and analyzed only for the faces it accepts, and the face found then
+ * is rejected if it does not cover the accepted one. The face found is
+ * recorded by search_ and judged by falsePositive_ in frame order, after
+ * the frames before it.
+ */
+int FramePipeline::analyze(FacetSDK::FrameAnalyzer& analyzer, const LumaFrame& frame, size_t framenum,
+                           FacetSDK::FrameAnalysis& frameanalysis, cv::Mat& window, cv::Rect& region,
+                           const std::vector<FacetSDK::Channel>& skipped, bool& rejected)
+{
+    cv::Rect whole(0, 0, frame.cols(), frame.rows());
+    region = whole;
+    if (search_) {
+        // The region follows the faces of the frames lag() or more before this one
+        if (framenum + 1 > search_->lag()) {
+            waitRecorded(framenum + 1 - search_->lag());
+        }
+        region = search_->region(framenum, whole.size());
+    }
+    int retVal;
+    if (region == whole) {
+        retVal = analyzer.Analyze(frame.data(), frame.rows(), frame.cols(), frameanalysis);
+    } else {
+        frame.mat()(region).copyTo(window);
+        retVal = analyzer.Analyze(window.data, window.rows, window.cols, frameanalysis);
+        if (retVal == FacetSDK::SUCCESS && frameanalysis.NumFaces() == 0) {
+            // Lost the face: search the whole frame
+            region = whole;
+            retVal = analyzer.Analyze(frame.data(), frame.rows(), frame.cols(), frameanalysis);
+            if (metrics_) {
+                metrics_->increment(rescannedCounter_);
+            }
+        }
+    }
+    if (!(search_ || falsePositive_)) {
+        return retVal;
+    }
+    cv::Rect_<float> box;
+    bool found = retVal == FacetSDK::SUCCESS && frameanalysis.NumFaces() > 0;
+    if (found) {
+        FacetSDK::Face face;
+        frameanalysis.LargestFace(face);
+        FacetSDK::Rectangle faceLocation;
+        face.FaceLocation(faceLocation);
+        box = cv::Rect_<float>(faceLocation.x + region.x, faceLocation.y + region.y,
+                               faceLocation.width, faceLocation.height);
+    }
+    waitRecorded(framenum);
+    if (search_ && retVal == FacetSDK::SUCCESS) {
+        search_->update(framenum, box, found);
+    }
+    if (falsePositive_ && found) {
+        rejected = falsePositive_->reject(box, whole.size());
+    }
+    recorded(framenum);
+    if (!falsePositive_ || !found) {
+        return retVal;
+    }
+    if (rejected) {
+        if (metrics_) {
+            metrics_->increment(rejectedCounter_);
+        }
+    } else if (!skipped.empty()) {
+        // Second pass with all the channels, around the accepted face
+        double dx = FACE_MARGIN * box.width, dy = FACE_MARGIN * box.height;
+        int x0 = (int)std::floor(box.x - dx), y0 = (int)std::floor(box.y - dy);
+        int x1 = (int)std::ceil(box.x + box.width + dx), y1 = (int)std::ceil(box.y + box.height + dy);
+        region = cv::Rect(x0, y0, x1 - x0, y1 - y0) & whole;
+        setChannels(analyzer, skipped, true);
+        if (metrics_) {
+            metrics_->increment(reanalyzedCounter_);
+        }
+        frame.mat()(region).copyTo(window);
+        retVal = analyzer.Analyze(window.data, window.rows, window.cols, frameanalysis);
+        if (retVal == FacetSDK::SUCCESS && frameanalysis.NumFaces() == 0) {
+            region = whole;
+            retVal = analyzer.Analyze(frame.data(), frame.rows(), frame.cols(), frameanalysis);
+        }
+        // The face written must be the face accepted
+        if (retVal == FacetSDK::SUCCESS && !coversFace(frameanalysis, region, box)) {
+            rejected = true;
+            if (metrics_) {
+                metrics_->increment(rejectedCounter_);
+            }
+        }
+    }
+    return retVal;
+}
+
+size_t FramePipeline::writeLoop()
+{
+    size_t written(0);
+    bool checkpointFailed(false);
+    // Result of the last analyzed frame, for the near duplicates that follow it
+    std::string previousRow;
+    int previousRetVal(FacetSDK::NOT_AVAILABLE);
+    for (size_t framenum = firstframe_; framenum < numtotalframes_; framenum++) {
+        Slot& slot = ring_[framenum % ring_.size()];
+        size_t numDecoded(0), numDone(0);
+        {
+            ScopedLock lock(mutex_);
+            while (slot.state != DONE) {
+                frameDone_.wait(mutex_);
+            }
+            if (metrics_) {
+                for (size_t i = 0; i < ring_.size(); i++) {
+                    numDecoded += (ring_[i].state == DECODED);
+                    numDone += (ring_[i].state == DONE);
+                }
+            }
+        }
+        if (metrics_) {
+            metrics_->setGauge(decodedGauge_, numDecoded);
+            metrics_->setGauge(doneGauge_, numDone);
+        }
+        if (slot.reused) {
+            slot.retVal = previousRetVal;
+        } else if (change_ && slot.decoded) {
+            previousRetVal = slot.retVal;
+            previousRow = slot.row;
+        }
+        if (!slot.decoded) {
+            std::cout << "Could not decode frame " << framenum+1 << std::endl;
+            if (metrics_) {
+                metrics_->increment(undecodedCounter_);
+            }
+        } else if (slot.retVal != FacetSDK::SUCCESS) {
+            std::cout << "The frame analyzer could not properly analyze a frame" << std::endl;
+            std::cout << "Error code = " << FacetSDK::DefineErrorCode(slot.retVal) << std::endl;
+            if (metrics_) {
+                metrics_->increment(failedCounter_);
+            }
+        } else {
+            MetricsTimer timer(metrics_, writeStage_);
+            if (slot.reused) {
+                formatter_.reuse(slot.row, framenum, previousRow);
+                if (metrics_) {
+                    metrics_->increment(reusedCounter_);
+                }
+            }
+            formatter_.write(outstream_, slot.row);
+            timer.stop();
+            written++;
+            if (metrics_) {
+                metrics_->increment(framesCounter_);
+            }
+        }
+        // The timestamp of a decoded frame tells where to resume
+        if (checkpoint_ && slot.decoded && checkpoint_->due()) {
+            long long offset = formatter_.commit();
+            if (offset >= 0 && !checkpoint_->save(framenum + 1, slot.frame.timestamp(), offset) && !checkpointFailed) {
+                std::cout << "Could not write the checkpoint " << checkpoint_->fileName() << std::endl;
+                checkpointFailed = true;
+            }
+        }
+        formatter_.progress(framenum, numtotalframes_);
+        {
+            ScopedLock lock(mutex_);
+            slot.state = FREE;
+        }
+        slotFreed_.signal();
+    }
+    return written;
+}
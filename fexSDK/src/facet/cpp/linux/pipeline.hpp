@@ -0,0 +1,211 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "emotient.hpp"
+#include "checkpoint.hpp"
+#include "falsepositive.hpp"
+#include "framechange.hpp"
+#include "lumasource.hpp"
+#include "runmetrics.hpp"
+#include "searchwindow.hpp"
+#include "threads.hpp"
+
+/**
+ * Formats the analysis of a single frame. format() runs on the analyzer
+ * worker threads and must only touch its arguments; write() and progress()
+ * run on the writer thread, once per frame, in frame order.
+ */
+class FrameFormatter {
+public:
+    virtual ~FrameFormatter() {}
+    /**
+     * Append the output row of a frame.
+     * \param row receives the formatted row (reused between frames, so it keeps its capacity)
+     * \param framenum 0-based frame number
+     * \param grayFrame the grayscale frame
+     * \param analysis the analysis result for the frame
+     * \param analyzer the analyzer that produced the result
+     * \param region the region of grayFrame that was analyzed: the
+     *        coordinates in analysis are relative to its top-left corner
+     */
+    virtual void format(std::string& row, size_t framenum, const cv::Mat& grayFrame,
+                        EMOTIENT::FacetSDK::FrameAnalysis& analysis,
+                        EMOTIENT::FacetSDK::FrameAnalyzer& analyzer,
+                        const cv::Rect& region) = 0;
+    /**
+     * Make the row of frame framenum, a near duplicate of the frame of row
+     * previous (see FramePipeline::setChangeDetector), from that row.
+     * Runs on the writer thread.
+     */
+    virtual void reuse(std::string& row, size_t framenum, const std::string& previous) { row = previous; }
+    /**
+     * Append the row of a frame whose face was rejected as a false positive
+     * (see FramePipeline::setFalsePositiveFilter). Runs on the worker threads.
+     */
+    virtual void reject(std::string& row, size_t framenum, const cv::Mat& grayFrame) {}
+    /**
+     * Write a row produced by format() to the output stream.
+     */
+    virtual void write(std::ostream& out, const std::string& row) { out << row; }
+    /**
+     * Called after frame framenum has been written (or failed).
+     */
+    virtual void progress(size_t framenum, size_t numtotalframes) {}
+    /**
+     * Put the rows written so far on disk, and return the size of the
+     * output they fill; -1 if they cannot be committed now.
+     */
+    virtual long long commit() { return -1; }
+};
+
+/**
+ * Staged decode / analyze / write engine.
+ *
+ * One decoder thread fills a bounded ring of grayscale frames (references
+ * to the decoder's luma planes when built with libav, see LumaSource),
+ * each analyzer worker owns one FrameAnalyzer and formats its rows, and the
+ * calling thread writes the rows back in frame order. Frame k always lives
+ * in ring slot k % ringsize, so re-sequencing needs no extra buffering and
+ * the output is identical to the sequential loop.
+ */
+class FramePipeline {
+public:
+    /**
+     * \param source an opened video
+     * \param analyzers initialized analyzers, one worker thread per analyzer
+     * \param formatter row formatter
+     * \param outstream destination of the formatted rows
+     * \param ringsize number of frames in flight (at least analyzers.size() + 1)
+     */
+    FramePipeline(LumaSource& source,
+                  const std::vector<EMOTIENT::FacetSDK::FrameAnalyzer*>& analyzers,
+                  FrameFormatter& formatter, std::ostream& outstream, size_t ringsize);
+    ~FramePipeline();
+
+    /**
+     * Record the stage times (decode, analysis, format, write), the frame
+     * counts and the queue depths of the next run() in metrics.
+     */
+    void setMetrics(RunMetrics* metrics);
+
+    /**
+     * Commit the output (FrameFormatter::commit) and save a checkpoint
+     * after a decoded frame whenever checkpoint is due.
+     */
+    void setCheckpoint(Checkpointer* checkpoint);
+
+    /**
+     * Analyze only the region of each frame given by search, around the
+     * face of the frames search->lag() or more before it; a frame without a
+     * face in its region is analyzed again whole. The faces are recorded in
+     * search in frame order, so the regions do not depend on the order the
+     * workers finish in, and at most lag() frames are analyzed at a time.
+     */
+    void setSearchWindow(SearchWindow* search);
+
+    /**
+     * Skip the analysis of the frames change finds unchanged since the
+     * last analyzed frame: their rows are made from its row by
+     * FrameFormatter::reuse. change is only used by the decoder thread.
+     */
+    void setChangeDetector(FrameChangeDetector* change);
+
+    /**
+     * Judge the largest face of each analyzed frame with filter: the rows of
+     * the frames it rejects are made by FrameFormatter::reject. With
+     * skipChannels, frames are first analyzed with the emotion and action
+     * unit channels off, and only accepted faces are analyzed again with
+     * them, in the region around the face; the frame is rejected if the
+     * face found then is not the face accepted. As every accepted face is
+     * analyzed twice, this only saves time when many faces are rejected
+     * (see the faces_reanalyzed counter). The faces are judged in frame
+     * order, so the output does not depend on the order the workers finish in.
+     */
+    void setFalsePositiveFilter(FalsePositiveFilter* filter, bool skipChannels);
+
+    /**
+     * Process frames firstframe to numtotalframes - 1 (the source is
+     * positioned at firstframe) and return the number of rows written.
+     */
+    size_t run(size_t numtotalframes, size_t firstframe = 0);
+
+private:
+    enum SlotState { FREE, DECODED, ANALYZING, DONE };
+
+    struct Slot {
+        Slot() : state(FREE), framenum(0), decoded(false), reused(false), retVal(0) {}
+        SlotState state;
+        size_t framenum;
+        bool decoded;
+        bool reused;        ///< Not analyzed: a near duplicate of the last analyzed frame
+        LumaFrame frame;
+        std::string row;
+        int retVal;
+    };
+
+    class Decoder : public Thread {
+    public:
+        explicit Decoder(FramePipeline& owner) : owner_(owner) {}
+    protected:
+        void run() { owner_.decodeLoop(); }
+    private:
+        FramePipeline& owner_;
+    };
+
+    class Worker : public Thread {
+    public:
+        Worker(FramePipeline& owner, EMOTIENT::FacetSDK::FrameAnalyzer& analyzer)
+        : owner_(owner), analyzer_(analyzer) {}
+    protected:
+        void run() { owner_.analyzeLoop(analyzer_); }
+    private:
+        FramePipeline& owner_;
+        EMOTIENT::FacetSDK::FrameAnalyzer& analyzer_;
+    };
+
+    void decodeLoop();
+    void analyzeLoop(EMOTIENT::FacetSDK::FrameAnalyzer& analyzer);
+    int analyze(EMOTIENT::FacetSDK::FrameAnalyzer& analyzer, const LumaFrame& frame, size_t framenum,
+                EMOTIENT::FacetSDK::FrameAnalysis& frameanalysis, cv::Mat& window, cv::Rect& region,
+                const std::vector<EMOTIENT::FacetSDK::Channel>& skipped, bool& rejected);
+    void waitRecorded(size_t frames);
+    void recorded(size_t framenum);
+    size_t writeLoop();
+
+    FramePipeline(const FramePipeline&);
+    FramePipeline& operator=(const FramePipeline&);
+
+    LumaSource& source_;
+    std::vector<EMOTIENT::FacetSDK::FrameAnalyzer*> analyzers_;
+    FrameFormatter& formatter_;
+    std::ostream& outstream_;
+    std::vector<Slot> ring_;
+
+    size_t numtotalframes_;
+    size_t firstframe_;
+    size_t nextToAnalyze_;
+    size_t nextRecorded_;       ///< Frames before it have their face recorded (search_, falsePositive_), in frame order
+    Checkpointer* checkpoint_;  ///< Null without checkpoints
+    SearchWindow* search_;      ///< Null to analyze whole frames
+    FrameChangeDetector* change_;   ///< Null to analyze every frame
+    FalsePositiveFilter* falsePositive_;    ///< Null to accept every face
+    bool skipChannels_;
+
+    RunMetrics* metrics_;       ///< Null when not measured
+    size_t decodeStage_, analysisStage_, formatStage_, writeStage_;
+    size_t framesCounter_, failedCounter_, undecodedCounter_, rescannedCounter_, reusedCounter_, rejectedCounter_,
+           reanalyzedCounter_;
+    size_t decodedGauge_, doneGauge_;
+
+    Mutex mutex_;
+    Condition slotFreed_;
+    Condition frameDecoded_;
+    Condition frameDone_;
+    Condition frameRecorded_;
+};
+
+#endif  // PIPELINE_HPP
@@ -0,0 +1,1174 @@
+#include "videojob.hpp"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string.h>
+#include "checkpoint.hpp"
+#include "config.hpp"
+#include "coregister.hpp"
+#include "pipeline.hpp"
+#include "facechannels.hpp"
+#include "faceroi.hpp"
+#include "falsepositive.hpp"
+#include "fexbinary.hpp"
+#include "framechange.hpp"
+#include "framesampler.hpp"
+#include "motioncorrect.hpp"
+#include "runmetrics.hpp"
+#include "stagestats.hpp"
+#include "temporalfilter.hpp"
+#include "textwriter.hpp"
+
+using namespace std;
+using namespace EMOTIENT;
+
+const float QSCALE    = 0.00; /**< Quality scaling factor: 0.00 = best quality; 1.00 = worst**/
+const int   CHANELS   = 1; /** Chanels to be used **/
+const float MINFACESIZEPCT = .05; /**< The minimum facebox size to search, as percentage of image width */
+const int   WORKERS   = 1;    /**< Number of analyzer workers (each owns a FrameAnalyzer) **/
+const float MINSCALE  = 0.1;  /**< Smallest analysis scale reachable with -q **/
+const std::string BINARY_EXT = ".fexb"; /**< Output files with this extension are written in binary columns **/
+const size_t FRAMECHANNELS = 3; /**< FrameNumber, FrameRows, FrameCols (and FrameReused with -dedup, FaceRejected with -fp) **/
+const float ROISCALE  = 0.5;  /**< Scale of the -roi sample, relative to the analysis scale **/
+const float MAXGRABGAP = 10.0; /**< Sample gaps longer than this (in seconds) are crossed with a seek **/
+
+/** Start Utilities Functions ++++++++++++++++++++++++++++++++++++++++++++ **/
+
+/**
+ * Helper function to alert the user how the application should be called from the command-line.
+ */
+static void printUsage(std::ostream& log){
+	log << "Usage:" << std::endl;
+	log << "   videoanalysis -f MOVIEFILE [-m MINFACESIZEPCT] [-b STARTFRAME:ENDFRAME] [-o OUTPUTFILE]" << std::endl;
+	log << "   - The required -f MOVIEFILE argument must be an absolute path to an opencv supported video file." << std::endl;
+    log << "   - The optional [-m MINFACESIZEPCT] argument is a floating point percentage between 0 and 1." << std::endl;
+    log << "     (defaults to .05)" << std::endl;
+    log << "   - The optional [-b STARTFRAME:ENDFRAME] argument specifies start:end frames for baselining intensity." << std::endl;
+    log << "     (if not specified, does not output intensity at all)" << std::endl;
+    log << "   - The optional [-o OUTPUTFILE] argymebt specifies an output CSV file." << std::endl;
+    log << "     (an OUTPUTFILE ending in " << BINARY_EXT << " is written in the binary columnar format, see fex_binimport)" << std::endl;
+    log << "   - The optional [-t WORKERS] argument sets the number of parallel frame analyzers." << std::endl;
+    log << "     (defaults to 1; decoding and writing always run on their own threads)" << std::endl;
+    log << "   - The optional [-q QUALITYSCALE] argument, between 0 (best) and 1 (fastest), shrinks the frames" << std::endl;
+    log << "     to (1 - QUALITYSCALE) of their size before analysis (defaults to 0)." << std::endl;
+    log << "   - The optional [-facewidth PIXELS] argument instead shrinks the frames until the smallest face searched" << std::endl;
+    log << "     (see -m) is PIXELS wide. Face boxes, landmarks and FrameRows/FrameCols are always those of the video frames." << std::endl;
+    log << "   - The optional [-p PRECISION] argument sets the significant digits of the text output" << std::endl;
+    log << "     (defaults to " << DEFAULT_PRECISION << "; " << ROUNDTRIP_PRECISION << " reads back the exact values)." << std::endl;
+    log << "   - The optional [-metrics BASENAME] argument writes the stage latencies, frame counts, queue depths" << std::endl;
+    log << "     and peak memory to BASENAME.json and BASENAME.prom (Prometheus), every " << METRICS_INTERVAL << " s and at the end." << std::endl;
+    log << "   - The optional [-checkpoint SECONDS] argument sets how often the OUTPUTFILE is committed to disk," << std::endl;
+    log << "     with its position in the video in OUTPUTFILE" << CHECKPOINT_EXT << " (defaults to " << CHECKPOINT_INTERVAL << "; 0 disables)." << std::endl;
+    log << "   - The optional [-resume] flag continues an interrupted run from the checkpoint of its OUTPUTFILE," << std::endl;
+    log << "     seeking the video and appending to the committed rows (starts over if there is no checkpoint)." << std::endl;
+    log << "   - The optional [-roi SAMPLEFPS] argument first detects the face in SAMPLEFPS downscaled frames per second," << std::endl;
+    log << "     then analyzes every frame cropped to the region of the face; coordinates stay in whole frames (0 disables)." << std::endl;
+    log << "   - The optional [-search REFRESH] argument analyzes each frame only around the face of the frames " << SEARCH_LAG << " or more" << std::endl;
+    log << "     before it, searching whole frames on a miss and every REFRESH frames (0, the default, always searches whole" << std::endl;
+    log << "     frames). The output does not depend on -t, but at most " << SEARCH_LAG << " frames are analyzed at a time." << std::endl;
+    log << "   - The optional [-dedup THRESHOLD] argument reuses the result of the last analyzed frame for the frames that differ" << std::endl;
+    log << "     from it by at most THRESHOLD gray levels (mean over " << CHANGE_THUMB_COLS << "x" << CHANGE_THUMB_ROWS << " blocks; e.g. 1)," << std::endl;
+    log << "     at most " << CHANGE_MAX_RUN << " frames in a row; the FrameReused column flags them (0 disables)." << std::endl;
+    log << "   - The optional [-filter lp:HZ | hp:HZ | bp:LOW:HIGH] argument filters the emotion, sentiment and action unit" << std::endl;
+    log << "     channels of a " << BINARY_EXT << " OUTPUTFILE while it is written, close to fexc.temporalfilt (zero phase, rows are" << std::endl;
+    log << "     delayed by the kernel order; values differ from filtfilt at the ends and around frames without a face);" << std::endl;
+    log << "     [-filterorder ORDER] sets the kernel order (defaults to 3 cycles of the lowest cutoff). Checkpoints are" << std::endl;
+    log << "     disabled while filtering." << std::endl;
+    log << "   - The optional [-fp THRESHOLD] argument rejects the faces whose size or position is more than THRESHOLD standard" << std::endl;
+    log << "     deviations from the faces found before them, as fexc.falsepositive (e.g. " << FALSEPOSITIVE_THRESHOLD << "; 0 disables); their frames" << std::endl;
+    log << "     are written without a face and flagged in the FaceRejected column. With the optional [-fpskip] flag," << std::endl;
+    log << "     emotions and action units are only analyzed for the faces that are not rejected: each accepted face is" << std::endl;
+    log << "     analyzed twice (faces_reanalyzed in -metrics), so -fpskip only pays off on footage with many false positives." << std::endl;
+    log << "   - The optional [-coreg] flag adds coregistration channels to a " << BINARY_EXT << " OUTPUTFILE, as fexc.coregister: the" << std::endl;
+    log << "     face box corners and landmarks of each frame are aligned (Procrustes) to the mean of the faces written" << std::endl;
+    log << "     before it, giving the error, scale, rotation and translation (coreg_ER, coreg_B, coreg_T1-4, coreg_C1-2)" << std::endl;
+    log << "     and the aligned points. Checkpoints are disabled while coregistering." << std::endl;
+    log << "   - The optional [-motion THRESHOLD] argument corrects the emotion, sentiment and action unit channels of a" << std::endl;
+    log << "     " << BINARY_EXT << " OUTPUTFILE for head motion, as fexc.motioncorrect: each is regressed on |roll|, |pitch| and |yaw|" << std::endl;
+    log << "     of the faces written before it, using the pose predictors with |r| >= THRESHOLD (0 to 1) and p <= " << MOTION_ALPHA << "," << std::endl;
+    log << "     and its residual plus the constant is written. The first " << MOTION_WARMUP << " faces are not corrected; needs the pose channel." << std::endl;
+    log << "     Checkpoints are disabled while correcting motion." << std::endl;
+	log << std::endl;
+	log << "Output:" << std::endl;
+    log << "   - Prints to screen the average emotion outputs at regular intervals while processing the video." << std::endl;
+	log << "   - Prints a CSV-formatted set of video analyzed emotion outputs to screen (or to file if OUTPUTFILE is specified.)" << std::endl;
+}
+
+// Get cmd line Input
+static char* getCmdOption(char ** begin, char ** end, const std::string & option){
+    char ** itr = std::find(begin, end, option);
+    if (itr != end && ++itr != end)
+    {
+        return *itr;
+    }
+    return 0;
+}
+
+/** CMD LINE **/
+static bool cmdOptionExists(char** begin, char** end, const std::string& option)
+{
+    return std::find(begin, end, option) != end;
+}
+
+
+ // Check cmd line Imput
+static int parseVideoArg(int argc, char *argv[], string& videoFile, float& QualityScale, int& ChanelsList, float&minFaceSizePct, int& numWorkers, int& precision){
+    int retVal(FacetSDK::SUCCESS);
+
+    // Check that the video input file was passed
+    if(argc < 2){
+     return(FacetSDK::EMPTY_INPUT);
+    }
+
+    // Get the video filepath
+    char* videoarg = getCmdOption(argv, argv + argc, "-v");
+    if(videoarg == 0){
+     return(FacetSDK::EMPTY_INPUT);
+    }
+    videoFile = videoarg;
+
+    // Set quality scaling: frames are analyzed at (1 - QualityScale) of their size
+    if (cmdOptionExists(argv, argv + argc, "-q")) {
+     char* qscalearg = getCmdOption(argv, argv + argc, "-q");
+     std::istringstream iss(qscalearg);
+     iss >> QualityScale;
+    } else {
+     QualityScale = QSCALE;
+    }
+
+    // Get chanels list
+    if (cmdOptionExists(argv, argv + argc, "-c")) {
+     char* chanelarg = getCmdOption(argv, argv + argc, "-c");
+     std::istringstream iss(chanelarg);
+     iss >> ChanelsList;
+    } else {
+     ChanelsList = CHANELS;
+    }
+
+
+    // Set the minimum facebox size
+    if (cmdOptionExists(argv, argv + argc, "-m")) {
+        char* minsizearg = getCmdOption(argv, argv + argc, "-m");
+        std::istringstream iss(minsizearg);
+        iss >> minFaceSizePct;
+    } else {
+        minFaceSizePct = MINFACESIZEPCT;
+    }
+
+    // Set the number of analyzer workers
+    numWorkers = WORKERS;
+    if (cmdOptionExists(argv, argv + argc, "-t")) {
+        char* workersarg = getCmdOption(argv, argv + argc, "-t");
+        std::istringstream iss(workersarg);
+        iss >> numWorkers;
+        if (numWorkers < 1) {
+            numWorkers = 1;
+        }
+    }
+
+    // Set the significant digits of the text output
+    precision = DEFAULT_PRECISION;
+    if (cmdOptionExists(argv, argv + argc, "-p")) {
+        char* precisionarg = getCmdOption(argv, argv + argc, "-p");
+        std::istringstream iss(precisionarg);
+        iss >> precision;
+        precision = clampPrecision(precision);
+    }
+
+     return retVal;
+ }
+
+ /** Get Output File **/
+static void parseOutputArg(int argc, char *argv[], string& outfile){
+    bool outfilepassed = cmdOptionExists(argv, argv + argc, "-o");
+    if (outfilepassed) {
+        char* outputarg = getCmdOption(argv, argv + argc, "-o");
+        outfile = outputarg;
+    } else outfile = "";
+}
+
+ /** Get Checkpoint Interval and Resume Flag **/
+static void parseCheckpointArg(int argc, char *argv[], double& interval, bool& resume){
+    interval = CHECKPOINT_INTERVAL;
+    char* intervalarg = getCmdOption(argv, argv + argc, "-checkpoint");
+    if (intervalarg) {
+        std::istringstream iss(intervalarg);
+        iss >> interval;
+    }
+    resume = cmdOptionExists(argv, argv + argc, "-resume");
+}
+
+ /** Get Target Face Width **/
+static void parseFaceWidthArg(int argc, char *argv[], float& faceWidth){
+    faceWidth = 0;
+    char* facewidtharg = getCmdOption(argv, argv + argc, "-facewidth");
+    if (facewidtharg) {
+        std::istringstream iss(facewidtharg);
+        iss >> faceWidth;
+    }
+}
+
+ /** Get ROI Sampling Rate **/
+static void parseRoiArg(int argc, char *argv[], double& samplesPerSec){
+    samplesPerSec = 0;
+    char* roiarg = getCmdOption(argv, argv + argc, "-roi");
+    if (roiarg) {
+        std::istringstream iss(roiarg);
+        iss >> samplesPerSec;
+    }
+}
+
+ /** Get Search Window Refresh Period **/
+static void parseSearchArg(int argc, char *argv[], int& refresh){
+    refresh = 0;
+    char* searcharg = getCmdOption(argv, argv + argc, "-search");
+    if (searcharg) {
+        std::istringstream iss(searcharg);
+        iss >> refresh;
+    }
+}
+
+ /** Get Near-Duplicate Threshold **/
+static void parseDedupArg(int argc, char *argv[], double& threshold){
+    threshold = 0;
+    char* deduparg = getCmdOption(argv, argv + argc, "-dedup");
+    if (deduparg) {
+        std::istringstream iss(deduparg);
+        iss >> threshold;
+    }
+}
+
+ /** Get False-Positive Threshold, and whether to skip the channels of rejected faces **/
+static void parseFalsePositiveArg(int argc, char *argv[], double& threshold, bool& skipChannels){
+    threshold = 0;
+    char* fparg = getCmdOption(argv, argv + argc, "-fp");
+    if (fparg) {
+        std::istringstream iss(fparg);
+        iss >> threshold;
+    }
+    skipChannels = cmdOptionExists(argv, argv + argc, "-fpskip");
+}
+
+ /** Get Motion Correction Threshold (-1: none) **/
+static void parseMotionArg(int argc, char *argv[], double& threshold){
+    threshold = -1;
+    char* motionarg = getCmdOption(argv, argv + argc, "-motion");
+    if (motionarg) {
+        std::istringstream iss(motionarg);
+        iss >> threshold;
+    }
+}
+
+ /** Get Streaming Filter: lp:HZ, hp:HZ or bp:LOW:HIGH, and its order **/
+static bool parseFilterArg(int argc, char *argv[], FilterBand& band, double& low, double& high, int& order){
+    order = 0;
+    char* orderarg = getCmdOption(argv, argv + argc, "-filterorder");
+    if (orderarg) {
+        std::istringstream iss(orderarg);
+        iss >> order;
+    }
+    char* filterarg = getCmdOption(argv, argv + argc, "-filter");
+    if (filterarg == 0) {
+        return false;
+    }
+    std::string spec(filterarg);
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos || !parseFilterBand(spec.substr(0, colon), band)) {
+        return false;
+    }
+    low = high = 0;
+    char sep;
+    std::istringstream iss(spec.substr(colon + 1));
+    iss >> low;
+    if (band == BANDPASS && !(iss >> sep >> high && sep == ':' && high > low)) {
+        return false;
+    }
+    return low > 0;
+}
+
+ /** Get Metrics Files **/
+static void parseMetricsArg(int argc, char *argv[], string& metricsBase){
+    char* metricsarg = getCmdOption(argv, argv + argc, "-metrics");
+    metricsBase = metricsarg ? metricsarg : "";
+}
+
+
+int initVideoAnalyzer(FacetSDK::FrameAnalyzer& frameAnalyzer, int maxThreads){
+    frameAnalyzer.SetMaxThreads(maxThreads);
+    return frameAnalyzer.Initialize(FACETSDIR, "FrameAnalyzerConfig.json");
+}
+
+int configureFrameAnalyzer(FacetSDK::FrameAnalyzer& frameAnalyzer, float minFaceWidth, int ChanelsList,
+                           bool verbose, std::ostream& log){
+    int retVal = frameAnalyzer.SetMinFaceDetectionWidth(minFaceWidth);
+    if (verbose) {
+        log << "min face size = " << minFaceWidth << std::endl;
+    }
+
+    // Undo the channels of a previous job
+    frameAnalyzer.SetChannelActive(FacetSDK::ACTION_UNITS, true);
+    frameAnalyzer.SetChannelActive(FacetSDK::PRIMARY_EMOTIONS, true);
+    frameAnalyzer.SetChannelActive(FacetSDK::SENTIMENTS, true);
+    frameAnalyzer.SetChannelActive(FacetSDK::ADVANCED_EMOTIONS, true);
+
+    if (ChanelsList == 2){
+        frameAnalyzer.SetChannelActive(FacetSDK::ACTION_UNITS, false);
+    }
+    else if (ChanelsList == 3){
+        if (verbose) log << "Deactivating Emotions" << std::endl;
+        frameAnalyzer.SetChannelActive(FacetSDK::PRIMARY_EMOTIONS, false);
+        frameAnalyzer.SetChannelActive(FacetSDK::SENTIMENTS, false);
+        frameAnalyzer.SetChannelActive(FacetSDK::ADVANCED_EMOTIONS, false);
+    }
+    else if (ChanelsList == 4){
+        if (verbose) log << "Deactivating All" << std::endl;
+        frameAnalyzer.SetChannelActive(FacetSDK::ACTION_UNITS, false);
+        frameAnalyzer.SetChannelActive(FacetSDK::PRIMARY_EMOTIONS, false);
+        frameAnalyzer.SetChannelActive(FacetSDK::SENTIMENTS, false);
+        frameAnalyzer.SetChannelActive(FacetSDK::ADVANCED_EMOTIONS, false);
+    }
+    else{
+        if (verbose) log << "Using All" << std::endl;
+    }
+    return retVal;
+}
+
+int NewAnalyzers::acquire(size_t count, std::vector<FacetSDK::FrameAnalyzer*>& analyzers, std::ostream& log){
+    // The analyzers share the FACET thread budget
+    int maxThreads = std::max(1, maxThreads_ / (int)count);
+    for (size_t i = 0; i < count; i++) {
+        FacetSDK::FrameAnalyzer* frameAnalyzer = new FacetSDK::FrameAnalyzer();
+        int retVal = initVideoAnalyzer(*frameAnalyzer, maxThreads);
+        if (retVal != FacetSDK::SUCCESS) {
+            log << "Could not initialize the FrameAnalyzer" << std::endl;
+            log << "Error code = " << FacetSDK::DefineErrorCode(retVal) << std::endl;
+            delete frameAnalyzer;
+            release(analyzers);
+            return retVal;
+        }
+        analyzers.push_back(frameAnalyzer);
+    }
+    return FacetSDK::SUCCESS;
+}
+
+void NewAnalyzers::release(std::vector<FacetSDK::FrameAnalyzer*>& analyzers){
+    for (size_t i = 0; i < analyzers.size(); i++) {
+        delete analyzers[i];
+    }
+    analyzers.clear();
+}
+
+/**
+ * Formats one output row per analyzed frame, and prints progress. With a
+ * FexbWriter, rows are the raw float values of the frame and are appended
+ * to the binary columns instead of the text output.
+ */
+class FexfacetFormatter : public FrameFormatter {
+public:
+    FexfacetFormatter(double begin_time, double begin_frame, const FaceChannels& channels, FexbWriter* writer,
+                      TextWriter* text, int precision, bool flagReused, bool flagRejected, std::ostream& log)
+    : begin_time_(begin_time), begin_frame_(begin_frame),
+      first_frame_(0), channels_(channels), writer_(writer), text_(text), file_(0), precision_(precision),
+      flagReused_(flagReused), flagRejected_(flagRejected),
+      frameChannels_(FRAMECHANNELS + (flagReused ? 1 : 0) + (flagRejected ? 1 : 0)), reused_(0), log_(log),
+      lmnames_(FacetSDK::AllLandmarkNames()),
+      emotionNames_(FacetSDK::AllPrimaryEmotionNames()),
+      SentNames_(FacetSDK::AllSentimentEmotionNames()),
+      AdveEmoNames_(FacetSDK::AllAdvancedEmotionNames()),
+      auNames_(FacetSDK::AllActionUnits()),
+      values_(frameChannels_ + channels.size()), filter_(0), coreg_(0), coregChannels_(0), motion_(0) {}
+
+    void format(std::string& row, size_t framenum, const cv::Mat& grayFrame,
+                FacetSDK::FrameAnalysis& frameanalysis, FacetSDK::FrameAnalyzer& frameAnalyzer,
+                const cv::Rect& region){
+        // Face coordinates in the video frame
+        FrameMapping mapping = mapping_.region(region.x, region.y);
+        if (writer_) {
+            formatBinary(row, framenum, grayFrame, frameanalysis, mapping);
+            return;
+        }
+        // Frame Number and image size
+        appendInt(row, framenum+1);
+        row += '\t';
+        appendInt(row, mapping.frameRows(grayFrame.rows));
+        row += '\t';
+        appendInt(row, mapping.frameCols(grayFrame.cols));
+        row += '\t';
+        if (flagReused_) {
+            row += "0\t";
+        }
+        if (flagRejected_) {
+            row += "0\t";
+        }
+        if (frameanalysis.NumFaces() > 0) {
+            // Analyze the largest face
+            FacetSDK::Face face;
+            frameanalysis.LargestFace(face);
+            FacetSDK::Rectangle faceLocation;
+            face.FaceLocation(faceLocation);
+            // Print out detected face box coordinates for largest face
+            appendValue(row, mapping.x(faceLocation.x));
+            appendValue(row, mapping.y(faceLocation.y));
+            appendValue(row, mapping.width(faceLocation.width));
+            appendValue(row, mapping.height(faceLocation.height));
+            // Add Landmarks Score
+            for (size_t i = 0; i < lmnames_.size(); i++) {
+                FacetSDK::Point point = face.LandmarkLocation(lmnames_[i]);
+                appendValue(row, mapping.x(point.x));
+                appendValue(row, mapping.y(point.y));
+            }
+            // Add Head Pose Information
+            if (frameAnalyzer.IsChannelActive(FacetSDK::POSE)) {
+                appendValue(row, face.PoseValue(FacetSDK::ROLL));
+                appendValue(row, face.PoseValue(FacetSDK::PITCH));
+                appendFloat(row, face.PoseValue(FacetSDK::YAW), precision_);
+            }
+            // Add Primary Emotions if the Chanel is Available
+            if (frameAnalyzer.IsChannelActive(FacetSDK::PRIMARY_EMOTIONS)) {
+                for (size_t i = 0; i < emotionNames_.size(); i++) {
+                    appendTabValue(row, face.EmotionValue(emotionNames_[i]));
+                }
+            }
+            // Add Sentiments
+            if (frameAnalyzer.IsChannelActive(FacetSDK::SENTIMENTS)) {
+                for (size_t i = 0; i < SentNames_.size(); i++) {
+                    appendTabValue(row, face.EmotionValue(SentNames_[i]));
+                }
+            }
+            // Advance Emotions
+            if (frameAnalyzer.IsChannelActive(FacetSDK::ADVANCED_EMOTIONS)) {
+                for (size_t i = 0; i < AdveEmoNames_.size(); i++) {
+                    appendTabValue(row, face.EmotionValue(AdveEmoNames_[i]));
+                }
+            }
+            // Action Units
+            if (frameAnalyzer.IsChannelActive(FacetSDK::ACTION_UNITS)) {
+                for (size_t i = 0; i < auNames_.size(); i++) {
+                    appendTabValue(row, face.ActionUnitValue(auNames_[i]));
+                }
+            }
+        }
+        else{
+            row += "Nan";
+        }
+        row += '\n';
+    }
+
+    /** A row without a face, flagged as rejected **/
+    void reject(std::string& row, size_t framenum, const cv::Mat& grayFrame){
+        if (writer_) {
+            std::vector<float> values(frameChannels_ + channels_.size() + coregChannels_,
+                                      std::numeric_limits<float>::quiet_NaN());
+            values[0] = framenum + 1;
+            values[1] = mapping_.frameRows(grayFrame.rows);
+            values[2] = mapping_.frameCols(grayFrame.cols);
+            if (flagReused_) {
+                values[FRAMECHANNELS] = 0;
+            }
+            values[frameChannels_ - 1] = 1;
+            row.append(reinterpret_cast<const char*>(&values[0]), values.size() * sizeof(float));
+            row += (char)0;
+            return;
+        }
+        appendInt(row, framenum+1);
+        row += '\t';
+        appendInt(row, mapping_.frameRows(grayFrame.rows));
+        row += '\t';
+        appendInt(row, mapping_.frameCols(grayFrame.cols));
+        row += '\t';
+        if (flagReused_) {
+            row += "0\t";
+        }
+        row += "1\tNan\n";
+    }
+
+    /** The row of the analyzed frame, renumbered and flagged as reused **/
+    void reuse(std::string& row, size_t framenum, const std::string& previous){
+        reused_++;
+        if (writer_) {
+            row = previous;
+            float values[2] = {(float)(framenum + 1), 1.0f};
+            memcpy(&row[0], &values[0], sizeof(float));
+            memcpy(&row[FRAMECHANNELS * sizeof(float)], &values[1], sizeof(float));
+            return;
+        }
+        // FrameNumber, FrameRows, FrameCols, FrameReused
+        size_t start = previous.find('\t');
+        size_t flag = previous.find('\t', previous.find('\t', start + 1) + 1) + 1;
+        row.clear();
+        appendInt(row, framenum+1);
+        row.append(previous, start, flag - start);
+        row += '1';
+        row.append(previous, flag + 1, std::string::npos);
+    }
+
+    void write(std::ostream& out, const std::string& row){
+        if (!writer_) {
+            text_->write(row);
+            return;
+        }
+        // The row holds the values followed by the face-present flag
+        memcpy(&values_[0], row.data(), values_.size() * sizeof(float));
+        bool facePresent = row[row.size() - 1] != 0;
+        if (coreg_ && facePresent) {
+            coregister();
+        }
+        if (motion_ && facePresent) {
+            correctMotion();
+        }
+        if (!filter_) {
+            writer_->addFrame(&values_[0], facePresent);
+            return;
+        }
+        filter_->push(&values_[0], facePresent);
+        while (filter_->pop(&values_[0], facePresent)) {
+            writer_->addFrame(&values_[0], facePresent);
+        }
+    }
+
+    /** Binary rows go through filter, once the kernel has seen the frames after them **/
+    void setFilter(StreamingFilter* filter){
+        filter_ = filter;
+    }
+
+    /**
+     * Binary rows end with the coregistration of their face: error,
+     * COREG_PARAMS parameters, then the points aligned (face box corners
+     * and landmarks), in the order of the rows.
+     */
+    void setCoregistration(StreamingCoregistration* coreg){
+        coreg_ = coreg;
+        coregChannels_ = coreg ? 1 + COREG_PARAMS + 2 * coreg->points() : 0;
+        values_.resize(frameChannels_ + channels_.size() + coregChannels_);
+    }
+
+    /**
+     * The columns of binary rows in channels are corrected for the head
+     * motion of their pose columns (roll, pitch, yaw), before filtering.
+     */
+    void setMotionCorrection(StreamingMotionCorrection* motion, const size_t pose[MOTION_PREDICTORS],
+                             const std::vector<size_t>& channels){
+        motion_ = motion;
+        std::copy(pose, pose + MOTION_PREDICTORS, motionPose_);
+        motionChannels_ = channels;
+        motionValues_.resize(channels.size());
+    }
+
+    /** Write the rows still held by the filter, at the end of the video **/
+    void flushFilter(){
+        if (!filter_) {
+            return;
+        }
+        filter_->finish();
+        bool facePresent;
+        while (filter_->pop(&values_[0], facePresent)) {
+            writer_->addFrame(&values_[0], facePresent);
+        }
+    }
+
+    /** Rows to commit() to fileName; progress counts the frames from firstFrame **/
+    void setOutput(std::ofstream* file, const std::string& fileName, size_t firstFrame){
+        file_ = file;
+        fileName_ = fileName;
+        first_frame_ = firstFrame;
+    }
+
+    /** Rows report the video frames the analyzed frames are mapped to **/
+    void setMapping(const FrameMapping& mapping){
+        mapping_ = mapping;
+    }
+
+    /** Flush the rows written so far to disk: size of the output, or -1 **/
+    long long commit(){
+        long long offset(-1);
+        if (writer_) {
+            // Only whole blocks: -1 until the current one is complete
+            offset = writer_->sync();
+        } else if (file_ && text_->sync()) {
+            offset = (long long)file_->tellp();
+        }
+        if (offset < 0 || !syncFile(fileName_)) {
+            return -1;
+        }
+        return offset;
+    }
+
+    /** Print out progress at regular intervals **/
+    void progress(size_t framenum, size_t numtotalframes){
+        if ((framenum+1) % 10 == 0) {
+            int pctComplete = 100.0 * framenum / numtotalframes; // update progress
+            log_ << "Percent complete: " << pctComplete << '%'<< "\t";
+            // Wall-clock time: clock() adds up the CPU time of the workers
+            double now = wallSeconds();
+            log_ << "Time Elapsed: " << float(now - begin_time_) << "\t";
+            log_ << "Frames per second: " << float((framenum + 1 - first_frame_) / std::max(now - begin_frame_, 1e-6));
+            if (flagReused_) {
+                log_ << "\t" << "Reused: " << float(100.0 * reused_ / (framenum + 1 - first_frame_)) << '%';
+            }
+            log_ << std::endl;
+        }
+    }
+
+private:
+    /** Fill the coregistration channels of the row in values_ **/
+    void coregister(){
+        // Face box top-left and bottom-right corners, then the landmarks
+        const float* face = &values_[frameChannels_];
+        size_t points = coreg_->points();
+        std::vector<double> shape(2 * points), aligned(2 * points), params(COREG_PARAMS);
+        shape[0] = face[0];
+        shape[1] = face[1];
+        shape[2] = face[0] + face[2];
+        shape[3] = face[1] + face[3];
+        for (size_t i = 4; i < shape.size(); i++) {
+            shape[i] = face[i];
+        }
+        double error;
+        coreg_->align(&shape[0], &aligned[0], &params[0], error);
+        float* out = &values_[frameChannels_ + channels_.size()];
+        *out++ = error;
+        for (size_t i = 0; i < COREG_PARAMS; i++) {
+            *out++ = params[i];
+        }
+        for (size_t i = 0; i < aligned.size(); i++) {
+            *out++ = aligned[i];
+        }
+    }
+
+    /** Correct the motion channels of the row in values_ **/
+    void correctMotion(){
+        double pose[MOTION_PREDICTORS];
+        for (size_t j = 0; j < MOTION_PREDICTORS; j++) {
+            pose[j] = values_[motionPose_[j]];
+        }
+        for (size_t c = 0; c < motionChannels_.size(); c++) {
+            motionValues_[c] = values_[motionChannels_[c]];
+        }
+        if (motion_->correct(pose, motionValues_.empty() ? 0 : &motionValues_[0])) {
+            for (size_t c = 0; c < motionChannels_.size(); c++) {
+                values_[motionChannels_[c]] = motionValues_[c];
+            }
+        }
+    }
+
+    /** A value followed by a tab **/
+    void appendValue(std::string& row, float value) const {
+        appendFloat(row, value, precision_);
+        row += '\t';
+    }
+
+    /** A tab followed by a value **/
+    void appendTabValue(std::string& row, float value) const {
+        row += '\t';
+        appendFloat(row, value, precision_);
+    }
+
+    /** Raw values of the frame columns and the face channels **/
+    void formatBinary(std::string& row, size_t framenum, const cv::Mat& grayFrame,
+                      FacetSDK::FrameAnalysis& frameanalysis, const FrameMapping& mapping){
+        std::vector<float> values(frameChannels_ + channels_.size() + coregChannels_, std::numeric_limits<float>::quiet_NaN());
+        values[0] = framenum + 1;
+        values[1] = mapping.frameRows(grayFrame.rows);
+        values[2] = mapping.frameCols(grayFrame.cols);
+        if (flagReused_) {
+            values[FRAMECHANNELS] = 0;
+        }
+        if (flagRejected_) {
+            values[frameChannels_ - 1] = 0;
+        }
+        char facePresent = (frameanalysis.NumFaces() > 0);
+        if (facePresent) {
+            FacetSDK::Face face;
+            frameanalysis.LargestFace(face);
+            channels_.values(face, &values[frameChannels_], mapping);
+        }
+        row.append(reinterpret_cast<const char*>(&values[0]), values.size() * sizeof(float));
+        row += facePresent;
+    }
+
+    double begin_time_;     ///< Wall-clock seconds
+    double begin_frame_;
+    size_t first_frame_;
+    const FaceChannels& channels_;
+    FexbWriter* writer_;
+    TextWriter* text_;
+    std::ofstream* file_;
+    std::string fileName_;
+    int precision_;
+    bool flagReused_;       ///< Rows have the FrameReused column
+    bool flagRejected_;     ///< Rows have the FaceRejected column, after FrameReused
+    size_t frameChannels_;
+    size_t reused_;         ///< Rows made by reuse(), writer thread only
+    std::ostream& log_;
+    FrameMapping mapping_;  ///< From the analyzed frames to the video frames
+    std::vector<FacetSDK::LandmarkName> lmnames_;
+    std::vector<FacetSDK::EmotionName> emotionNames_;
+    std::vector<FacetSDK::EmotionName> SentNames_;
+    std::vector<FacetSDK::EmotionName> AdveEmoNames_;
+    std::vector<FacetSDK::ActionUnit> auNames_;
+    std::vector<float> values_;   ///< Writer thread only
+    StreamingFilter* filter_;     ///< Of the binary rows, or null
+    StreamingCoregistration* coreg_;  ///< Of the faces of the binary rows, or null
+    size_t coregChannels_;
+    StreamingMotionCorrection* motion_;     ///< Of the binary rows, or null
+    size_t motionPose_[MOTION_PREDICTORS];
+    std::vector<size_t> motionChannels_;
+    std::vector<double> motionValues_;
+};
+
+
+/**
+ * Schema of the coregistration channels (see FexfacetFormatter::setCoregistration).
+ */
+static void addCoregChannels(FexbWriter& writer){
+    const char* params[] = { "ER", "B", "T1", "T2", "T3", "T4", "C1", "C2" };
+    for (size_t i = 0; i < 1 + COREG_PARAMS; i++) {
+        writer.addChannel("coreg", std::string("coreg_") + params[i]);
+    }
+    std::vector<std::string> points;
+    points.push_back("FaceBoxTL");
+    points.push_back("FaceBoxBR");
+    std::vector<FacetSDK::LandmarkName> lmnames = FacetSDK::AllLandmarkNames();
+    for (size_t i = 0; i < lmnames.size(); i++) {
+        std::ostringstream name;
+        name << lmnames[i];
+        points.push_back(name.str());
+    }
+    for (size_t i = 0; i < points.size(); i++) {
+        writer.addChannel("coreg", "coreg_" + points[i] + "_x");
+        writer.addChannel("coreg", "coreg_" + points[i] + "_y");
+    }
+}
+
+/**
+ * Write the column names of the text output.
+ */
+static void writeTextHeader(std::ostream& outstream, FacetSDK::FrameAnalyzer& frameAnalyzer, bool flagReused,
+                            bool flagRejected){
+    outstream << "FrameNumber" << "\t" << "FrameRows" << "\t" << "FrameCols" << "\t";
+    if (flagReused) {
+        outstream << "FrameReused" << "\t";
+    }
+    if (flagRejected) {
+        outstream << "FaceRejected" << "\t";
+    }
+	outstream << "FaceBoxX" << "\t" << "FaceBoxY" << "\t" << "FaceBoxW" << "\t" << "FaceBoxH" << "\t";
+    std::vector<FacetSDK::LandmarkName> lmnames = FacetSDK::AllLandmarkNames();
+    for (size_t i = 0; i < lmnames.size(); i++) {
+        outstream << lmnames[i] <<"_x" << "\t" << lmnames[i] <<"_y" << "\t";
+    }
+    outstream << "Roll" << "\t" << "Pitch" << "\t" << "Yaw" << "\t";
+    if (frameAnalyzer.IsChannelActive(FacetSDK::PRIMARY_EMOTIONS)) {
+        std::vector<FacetSDK::EmotionName> emotionNames = FacetSDK::AllPrimaryEmotionNames();
+        for (size_t i = 0; i < emotionNames.size(); i++) {
+            outstream << emotionNames[i] << "\t";
+        }
+     }
+    if (frameAnalyzer.IsChannelActive(FacetSDK::SENTIMENTS)) {
+       std::vector<FacetSDK::EmotionName> SentNames = FacetSDK::AllSentimentEmotionNames();
+       for (size_t i = 0; i < SentNames.size(); i++) {
+           outstream << SentNames[i] << "\t";
+       }
+    }
+    if (frameAnalyzer.IsChannelActive(FacetSDK::ADVANCED_EMOTIONS)) {
+        std::vector<FacetSDK::EmotionName> AdveEmoNames = FacetSDK::AllAdvancedEmotionNames();
+        for (size_t i = 0; i < AdveEmoNames.size(); i++) {
+            outstream << AdveEmoNames[i] << "\t";
+        }
+     }
+    if (frameAnalyzer.IsChannelActive(FacetSDK::ACTION_UNITS)) {
+        std::vector<FacetSDK::ActionUnit> auNames = FacetSDK::AllActionUnits();
+        for (size_t i = 0; i < auNames.size(); i++) {
+            outstream << auNames[i] << "\t";
+        }
+     }
+    outstream << "\n";
+}
+
+/**
+ * Reopen the text output of an interrupted run to append after its first
+ * offset bytes: the file must start with the header of this run.
+ */
+static bool reopenTextOutput(std::ofstream& outfilestream, const std::string& outFile,
+                             const std::string& header, long long offset){
+    std::ifstream previous(outFile.c_str(), ios::in | ios::binary);
+    std::string start(header.size(), '\0');
+    if (offset < (long long)header.size() || !previous.read(&start[0], start.size()) || start != header) {
+        return false;
+    }
+    // The committed rows must all be there
+    previous.seekg(0, ios::end);
+    if ((long long)previous.tellg() < offset) {
+        return false;
+    }
+    previous.close();
+    if (!truncateFile(outFile, offset)) {
+        return false;
+    }
+    outfilestream.open(outFile.c_str(), ios::in | ios::out | ios::binary);
+    outfilestream.seekp(0, ios::end);
+    return outfilestream.good();
+}
+
+/**
+ * First pass of -roi: analyze samplesPerSec frames per second of the video
+ * at a reduced scale and return the region of the face in video pixels
+ * (empty if no face was found). The source is rewound to the first frame,
+ * with its scale restored.
+ */
+static cv::Rect sampleFaceRoi(LumaSource& videoSource, const std::string& videoFile,
+                              FacetSDK::FrameAnalyzer& frameAnalyzer, double samplesPerSec,
+                              float minFaceSizePct, std::ostream& log){
+    double scale = videoSource.scale();
+    videoSource.setScale(std::max(MINSCALE, ROISCALE * (float)scale));
+    // Only the face boxes are needed
+    configureFrameAnalyzer(frameAnalyzer, minFaceSizePct * videoSource.frameWidth(), 4, false, log);
+    FrameMapping toVideo = videoSource.mapping();
+
+    std::vector<cv::Rect_<float> > boxes;
+    FrameSampler sampler(videoSource, samplesPerSec, MAXGRABGAP);
+    LumaFrame grayFrame;
+    FacetSDK::FrameAnalysis frameanalysis;
+    while (sampler.next(grayFrame)) {
+        int retVal = frameAnalyzer.Analyze(grayFrame.data(), grayFrame.rows(), grayFrame.cols(), frameanalysis);
+        if (retVal != FacetSDK::SUCCESS || frameanalysis.NumFaces() == 0) {
+            continue;
+        }
+        FacetSDK::Face face;
+        frameanalysis.LargestFace(face);
+        FacetSDK::Rectangle faceLocation;
+        face.FaceLocation(faceLocation);
+        boxes.push_back(cv::Rect_<float>(toVideo.x(faceLocation.x), toVideo.y(faceLocation.y),
+                                         toVideo.width(faceLocation.width), toVideo.height(faceLocation.height)));
+    }
+    cv::Rect roi = estimateFaceRoi(boxes, cv::Size(videoSource.crop().width, videoSource.crop().height));
+    log << "Face region: " << boxes.size() << " faces in " << sampler.numSampled() << " sampled frames";
+    if (roi.area() > 0) {
+        log << "; x " << roi.x << ", y " << roi.y << ", " << roi.width << "x" << roi.height << std::endl;
+    } else {
+        log << "; analyzing whole frames" << std::endl;
+    }
+
+    videoSource.setScale(scale);
+    if (!videoSource.seek(0)) {
+        videoSource.open(videoFile);
+        videoSource.setScale(scale);
+    }
+    return roi;
+}
+
+int runVideoJob(int argc, char *argv[], AnalyzerSource& analyzers, std::ostream& log){
+    int retVal;
+
+    // Get command line information or set defaults
+    string videoFile;
+    float QualityScale(QSCALE);
+    int   ChanelsList;
+    float minFaceSizePct(MINFACESIZEPCT);
+    int   numWorkers(WORKERS);
+    int   precision(DEFAULT_PRECISION);
+
+    retVal = parseVideoArg(argc, argv, videoFile, QualityScale, ChanelsList,minFaceSizePct,numWorkers,precision);
+    if (retVal != FacetSDK::SUCCESS) {
+        printUsage(log);
+        return retVal;
+    }
+
+    // Create the output stream either as a file or the log depending on argument
+    string outFile;
+    parseOutputArg(argc, argv, outFile);
+    std::ofstream outfilestream;
+    ostream& outstream = (!outFile.empty() ? outfilestream : log);
+
+    // Start Clock
+    const double begin_time = wallSeconds();
+
+    // Open the video (decoded straight to grayscale) and exit if it fails
+    LumaSource videoSource;
+    videoSource.open(videoFile);
+    if (!videoSource.isOpened()) {
+        log << "Could not open video file for processing!" << std::endl;
+        return FacetSDK::NOT_AVAILABLE;
+    }
+    // Trade quality for speed: frames are converted and downscaled in one pass while decoding
+    float faceWidth;
+    parseFaceWidthArg(argc, argv, faceWidth);
+    float scale = 1.0f - QualityScale;
+    if (faceWidth > 0) {
+        scale = faceWidth / (minFaceSizePct * videoSource.width());
+    }
+    videoSource.setScale(std::max(MINSCALE, std::min(1.0f, scale)));
+
+    /** Determine the minimum-size facebox to search based on user-configured minFaceSizePct **/
+    float imageWidth = videoSource.frameWidth();
+    float minFaceWidth = minFaceSizePct * imageWidth;
+
+    // One frame analyzer per worker
+    std::vector<FacetSDK::FrameAnalyzer*> frameAnalyzers;
+    retVal = analyzers.acquire(numWorkers, frameAnalyzers, log);
+    if (retVal != FacetSDK::SUCCESS) {
+        return retVal;
+    }
+
+    // Two passes: find the face in a sparse sample, then analyze only its
+    // region of every frame (the sample is the same on a resumed run)
+    double roiSamplesPerSec;
+    parseRoiArg(argc, argv, roiSamplesPerSec);
+    cv::Rect roi;
+    if (roiSamplesPerSec > 0) {
+        roi = sampleFaceRoi(videoSource, videoFile, *frameAnalyzers[0], roiSamplesPerSec, minFaceSizePct, log);
+        videoSource.setCrop(roi);
+    }
+
+    for (size_t i = 0; i < frameAnalyzers.size(); i++) {
+        configureFrameAnalyzer(*frameAnalyzers[i], minFaceWidth, ChanelsList, i == 0, log);
+    }
+    FacetSDK::FrameAnalyzer& frameAnalyzer = *frameAnalyzers[0];
+
+    // Near-duplicate frames reuse the result of the last analyzed frame
+    double dedupThreshold;
+    parseDedupArg(argc, argv, dedupThreshold);
+    bool dedup = dedupThreshold > 0;
+
+    // Faces of unusual size or position are rejected as false positives
+    double fpThreshold;
+    bool fpSkip;
+    parseFalsePositiveArg(argc, argv, fpThreshold, fpSkip);
+    bool rejecting = fpThreshold > 0;
+    size_t frameChannels = FRAMECHANNELS + (dedup ? 1 : 0) + (rejecting ? 1 : 0);
+
+    // Binary output: the header is the channel schema
+    FaceChannels channels(frameAnalyzer);
+    FexbWriter binaryWriter;
+    bool binary = outFile.size() > BINARY_EXT.size() &&
+                  outFile.compare(outFile.size() - BINARY_EXT.size(), BINARY_EXT.size(), BINARY_EXT) == 0;
+    if (binary) {
+        binaryWriter.addChannel("frame", "FrameNumber");
+        binaryWriter.addChannel("frame", "FrameRows");
+        binaryWriter.addChannel("frame", "FrameCols");
+        if (dedup) {
+            binaryWriter.addChannel("frame", "FrameReused");
+        }
+        if (rejecting) {
+            binaryWriter.addChannel("frame", "FaceRejected");
+        }
+        channels.addTo(binaryWriter);
+    }
+
+    // Online coregistration of the faces, after the channels of the analyzer
+    bool coregistering = cmdOptionExists(argv, argv + argc, "-coreg");
+    if (coregistering && !binary) {
+        log << "Ignoring -coreg: it needs a " << BINARY_EXT << " output" << std::endl;
+        coregistering = false;
+    }
+    StreamingCoregistration coregistration(2 + FacetSDK::AllLandmarkNames().size());
+    size_t rowChannels = frameChannels + channels.size();
+    if (coregistering) {
+        addCoregChannels(binaryWriter);
+        rowChannels += 1 + COREG_PARAMS + 2 * coregistration.points();
+    }
+
+    // Online motion correction of the functional channels, on the pose of the same rows
+    double motionThreshold;
+    parseMotionArg(argc, argv, motionThreshold);
+    std::vector<size_t> motionChannels;
+    size_t motionPose[MOTION_PREDICTORS];
+    size_t numPose(0);
+    for (size_t i = 0; i < channels.size(); i++) {
+        const std::string& channelClass = channels.channelClass(i);
+        if (channelClass == "emo1" || channelClass == "sent1" || channelClass == "emo2" || channelClass == "au") {
+            motionChannels.push_back(frameChannels + i);
+        } else if (channelClass == "pose" && numPose < MOTION_PREDICTORS) {
+            // Roll, Pitch, Yaw
+            motionPose[numPose++] = frameChannels + i;
+        }
+    }
+    bool correcting = cmdOptionExists(argv, argv + argc, "-motion");
+    if (correcting && !(motionThreshold >= 0 && motionThreshold <= 1 && binary && numPose == MOTION_PREDICTORS &&
+                        !motionChannels.empty())) {
+        log << "Ignoring -motion: it needs a THRESHOLD from 0 to 1, the pose channel and a " << BINARY_EXT
+            << " output" << std::endl;
+        correcting = false;
+    }
+    StreamingMotionCorrection motionCorrection(motionChannels.size(), std::max(motionThreshold, 0.0));
+
+    // Output files are committed at checkpoints, and an interrupted run can
+    // resume after the last one: seek the video, keep the committed rows
+    double checkpointInterval;
+    bool resume;
+    parseCheckpointArg(argc, argv, checkpointInterval, resume);
+
+    // Optional zero-phase filter of the functional channels, as the rows are
+    // written: rows wait for the kernel, so there is nothing to checkpoint
+    FilterBand filterBand;
+    double filterLow, filterHigh;
+    int filterOrder;
+    bool filtering = parseFilterArg(argc, argv, filterBand, filterLow, filterHigh, filterOrder);
+    double nyquist = videoSource.fps() / 2;
+    if (cmdOptionExists(argv, argv + argc, "-filter") &&
+        !(filtering && binary && (filterBand == BANDPASS ? filterHigh : filterLow) < nyquist)) {
+        log << "Ignoring -filter: it needs lp:HZ, hp:HZ or bp:LOW:HIGH below the Nyquist frequency and a "
+            << BINARY_EXT << " output" << std::endl;
+        filtering = false;
+    }
+    std::vector<size_t> filtered;
+    std::vector<double> kernel;
+    if (filtering) {
+        for (size_t i = 0; i < channels.size(); i++) {
+            const std::string& channelClass = channels.channelClass(i);
+            if (channelClass == "emo1" || channelClass == "sent1" || channelClass == "emo2" || channelClass == "au") {
+                filtered.push_back(frameChannels + i);
+            }
+        }
+        // The kernel applied twice in one pass: filtfilt but at the ends and gaps
+        size_t knownFrames = videoSource.frameCount() > 0 ? videoSource.frameCount() : std::numeric_limits<int>::max();
+        int order = firOrder(filterOrder, filterLow, videoSource.fps(), knownFrames);
+        kernel = selfConvolve(designFir(filterBand, order, filterLow, filterHigh, nyquist));
+        checkpointInterval = 0;
+        resume = false;
+        log << "Filtering " << filtered.size() << " channels with a kernel of order " << order << std::endl;
+    }
+    // The coregistration mean and the motion regressions are built from
+    // every face written before a row, and a resumed run could not rebuild
+    // them: no checkpoints either
+    if ((coregistering || correcting) && (checkpointInterval > 0 || resume)) {
+        checkpointInterval = 0;
+        resume = false;
+        log << "Checkpoints are disabled while " << (coregistering ? "coregistering" : "correcting motion") << std::endl;
+    }
+    std::string checkpointFile(outFile + CHECKPOINT_EXT);
+    Checkpoint checkpoint;
+    bool resuming(false);
+    if (resume && outFile.empty()) {
+        log << "Nothing to resume without an output file (-o)" << std::endl;
+    } else if (resume) {
+        resuming = loadCheckpoint(checkpointFile, checkpoint) && checkpoint.input == videoFile;
+        // Past the last committed frame
+        double frameSeconds = videoSource.fps() > 0 ? 1.0 / videoSource.fps() : 1e-3;
+        resuming = resuming && videoSource.seek(checkpoint.timestamp + frameSeconds);
+        if (resuming && binary) {
+            resuming = binaryWriter.resume(outFile, checkpoint.offset);
+        } else if (resuming) {
+            std::ostringstream header;
+            writeTextHeader(header, frameAnalyzer, dedup, rejecting);
+            resuming = reopenTextOutput(outfilestream, outFile, header.str(), checkpoint.offset);
+        }
+        if (resuming) {
+            log << "Resuming " << videoFile << " at frame " << checkpoint.frame + 1 << std::endl;
+        } else {
+            log << "Could not resume from " << checkpointFile << ": starting over" << std::endl;
+            if (!videoSource.seek(0)) {
+                videoSource.open(videoFile);
+            }
+        }
+    }
+    if (!resuming && binary && !binaryWriter.open(outFile)) {
+        log << "Could not open " << outFile << " for writing" << std::endl;
+        analyzers.release(frameAnalyzers);
+        return FacetSDK::NOT_AVAILABLE;
+    }
+
+    /** Compile the file Header **/
+    if (!resuming && !binary) {
+        if (!outFile.empty()) {
+            outfilestream.open(outFile.c_str(), ios::out);
+        }
+        writeTextHeader(outstream, frameAnalyzer, dedup, rejecting);
+    }
+
+
+    /** This Section needs to be Changed:
+    Determine the number of video frames so that all of them will be processed
+    This is faulty OpenCV code so the estimate might be wrong **/
+    size_t numtotalframes = videoSource.frameCount();
+    log << "Total n of frames: " << numtotalframes << std::endl;
+
+
+    /** Start Main Loop: decode, analyze and write run as pipeline stages **/
+    const double begin_frame = wallSeconds();
+    // Rows to a file are written by a background thread; rows to the log
+    // are written at once, in order with the progress messages
+    bool background = !outFile.empty() && !binary;
+    TextWriter textWriter(outstream, background, background ? TEXT_BUFFER_BYTES : 0);
+    FexfacetFormatter formatter(begin_time, begin_frame, channels, binary ? &binaryWriter : 0, &textWriter,
+                                precision, dedup, rejecting, log);
+    formatter.setMapping(videoSource.mapping());
+    if (coregistering) {
+        formatter.setCoregistration(&coregistration);
+    }
+    if (correcting) {
+        formatter.setMotionCorrection(&motionCorrection, motionPose, motionChannels);
+    }
+    StreamingFilter filter(kernel, rowChannels, filtered);
+    if (filtering) {
+        formatter.setFilter(&filter);
+    }
+    FramePipeline pipeline(videoSource, frameAnalyzers, formatter, outstream, 2*frameAnalyzers.size() + 2);
+    size_t firstframe = resuming ? checkpoint.frame : 0;
+
+    // Search each frame around the face of the previous ones, a few frames
+    // back so that the workers can analyze them at the same time
+    int searchRefresh;
+    parseSearchArg(argc, argv, searchRefresh);
+    SearchWindow searchWindow(searchRefresh, SEARCH_LAG);
+    if (searchRefresh > 0) {
+        pipeline.setSearchWindow(&searchWindow);
+    }
+    FrameChangeDetector changeDetector(dedupThreshold);
+    if (dedup) {
+        pipeline.setChangeDetector(&changeDetector);
+    }
+    FalsePositiveFilter falsePositive(fpThreshold);
+    if (rejecting) {
+        pipeline.setFalsePositiveFilter(&falsePositive, fpSkip);
+    }
+    Checkpointer checkpointer(checkpointFile, videoFile, checkpointInterval);
+    if (!outFile.empty()) {
+        if (!resuming) {
+            // From an earlier run of the file being rewritten
+            checkpointer.remove();
+        }
+        formatter.setOutput(binary ? 0 : &outfilestream, outFile, firstframe);
+        if (checkpointInterval > 0) {
+            pipeline.setCheckpoint(&checkpointer);
+        }
+    }
+
+    // Optional metrics, rewritten in the background while the video is processed
+    string metricsBase;
+    parseMetricsArg(argc, argv, metricsBase);
+    RunMetrics* metrics(0);
+    MetricsReporter* reporter(0);
+    if (!metricsBase.empty()) {
+        metrics = new RunMetrics("fexfacet", videoFile, metricsBase);
+        size_t expected = metrics->addGauge("frames_expected", "Frames in the video (container estimate).");
+        metrics->setGauge(expected, numtotalframes);
+        pipeline.setMetrics(metrics);
+        reporter = new MetricsReporter(*metrics);
+    }
+    pipeline.run(numtotalframes, firstframe);
+    formatter.flushFilter();
+    if (rejecting) {
+        log << "Rejected " << falsePositive.numRejected() << " faces as false positives" << std::endl;
+    }
+    textWriter.close();
+    outstream.flush();
+    outfilestream.close();
+    analyzers.release(frameAnalyzers);
+    if (reporter && !reporter->stop()) {
+        log << "Could not write the metrics to " << metricsBase << ".json and .prom" << std::endl;
+    }
+    delete reporter;
+    delete metrics;
+    if (binary && !binaryWriter.close()) {
+        log << "Error writing " << outFile << std::endl;
+        return FacetSDK::NOT_AVAILABLE;
+    }
+    // Complete: a later -resume starts over
+    if (!outFile.empty()) {
+        checkpointer.remove();
+    }
+    return FacetSDK::SUCCESS;
+}
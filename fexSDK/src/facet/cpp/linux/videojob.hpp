@@ -0,0 +1,63 @@
+#ifndef VIDEOJOB_HPP
+#define VIDEOJOB_HPP
+
+#include <iostream>
+#include <vector>
+#include "emotient.hpp"
+
+const int MAXTHREADS = 8;   /**< FACET threads shared by all the analyzers of a video **/
+
+/**
+ * Provides the frame analyzers of a video job: new ones for the fexfacet
+ * executable, initialized ones shared between jobs for the daemon.
+ */
+class AnalyzerSource {
+public:
+    virtual ~AnalyzerSource() {}
+    /**
+     * Get count initialized analyzers (fewer if the source has fewer), to
+     * be given back with release(). Prints the error to log and returns the
+     * FacetSDK error code.
+     */
+    virtual int acquire(size_t count, std::vector<EMOTIENT::FacetSDK::FrameAnalyzer*>& analyzers,
+                        std::ostream& log) = 0;
+    virtual void release(std::vector<EMOTIENT::FacetSDK::FrameAnalyzer*>& analyzers) = 0;
+};
+
+/**
+ * Initializes new analyzers for each job, sharing maxThreads FACET threads,
+ * and deletes them afterwards.
+ */
+class NewAnalyzers : public AnalyzerSource {
+public:
+    explicit NewAnalyzers(int maxThreads) : maxThreads_(maxThreads) {}
+    int acquire(size_t count, std::vector<EMOTIENT::FacetSDK::FrameAnalyzer*>& analyzers, std::ostream& log);
+    void release(std::vector<EMOTIENT::FacetSDK::FrameAnalyzer*>& analyzers);
+private:
+    int maxThreads_;
+};
+
+/**
+ * Initialize a frame analyzer for videos. Returns the FacetSDK error code.
+ */
+int initVideoAnalyzer(EMOTIENT::FacetSDK::FrameAnalyzer& frameAnalyzer, int maxThreads);
+
+/**
+ * Set the minimum face width and the channels of a frame analyzer used
+ * before (channels are activated again first).
+ *  1 = All features
+ *  2 = All emotions -- deactivate action Units
+ *  3 = Action units only
+ *  4 = Facial landmarks and pose (deactivate all)
+ */
+int configureFrameAnalyzer(EMOTIENT::FacetSDK::FrameAnalyzer& frameAnalyzer, float minFaceWidth,
+                           int ChanelsList, bool verbose, std::ostream& log);
+
+/**
+ * Run fexfacet with the command line argc/argv (see printUsage), with
+ * analyzers from analyzers. Messages, progress and the rows (when there is
+ * no -o OUTPUTFILE) are written to log. Returns the FacetSDK error code.
+ */
+int runVideoJob(int argc, char* argv[], AnalyzerSource& analyzers, std::ostream& log);
+
+#endif  // VIDEOJOB_HPP
@@ -0,0 +1,612 @@
+/**
+ * \file fexbatch.cpp
+ *
+ * \brief Tracks a list of videos in a single process under one thread budget, and writes for each video the
+ *        JSON output of fexfacetexec -w.
+ *
+ * Usage:
+ *		fexbatch -l <MANIFEST> [-d <OUTPUTDIR>] [-o <RESULTS>] [-t <THREADS>] [-j <WORKERS>]
+ *		         [-w <WINDOW>] [-v <OVERLAP>] [-s <MINSIZE>] [-r <RESIZE>] [-facewidth <PIXELS>]
+ *      - MANIFEST is a required argument: a text file with one video per line, optionally followed by a tab
+ *        and the output JSON file name. Empty lines and lines starting with # are skipped.
+ *      - OUTPUTDIR: directory of the output files not named in MANIFEST, NAME.json for video NAME.EXT
+ *        (default: the directory of the video).
+ *      - RESULTS: tab-separated file with the outcome of each video: video, output, status (ok or error),
+ *        duration, segments, seconds and error message (default: MANIFEST.results.tsv).
+ *      - THREADS: number of threads of all the trackers together (default: the number of CPUs).
+ *      - WORKERS: number of videos or segments tracked at a time (default: THREADS); each tracker gets
+ *        THREADS / WORKERS threads.
+ *      - WINDOW, OVERLAP: tracking window and overlap in seconds, as fexfacetexec -w and -v (default 60 and 5).
+ *      - MINSIZE, RESIZE, PIXELS: minimum face size, resize factor and face width, as fexfacetexec -s, -r
+ *        and -facewidth. Coordinates and resolutions in the output are those of the video frames.
+ *
+ * Scheduling:
+ *      The duration and frame size of every video are probed first, and videos are started by decreasing
+ *      cost (duration times frame area; videos of unknown duration first, as they cannot be split). Once
+ *      every video is started, an idle worker steals the second half of the remaining windows of the
+ *      running segment with the most work left, so a long video does not run alone at the end of the batch.
+ *      A stolen segment seeks to its first window and is stitched to the previous one as two windows are
+ *      (see WindowedTracker): the output does not depend on how a video was split.
+ *
+ * Copyright © 2014 Emotient, Inc. All rights reserved.
+ * Use, publication or distribution of Emotient content is prohibited without the prior written consent of Emotient.
+ * Any permitted activity or inactivity is subject to Emotient's Terms of Use.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <sstream>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <emotient.hpp>
+#include "lumasource.hpp"
+#include "stagestats.hpp"
+#include "threads.hpp"
+#include "windowtracker.hpp"
+
+using namespace std;
+using namespace EMOTIENT;
+
+const double DEFAULT_WINDOW = 60.0;
+const double DEFAULT_WINDOW_OVERLAP = 5.0;
+const int DEFAULT_MIN_SIZE = 50;
+const size_t MIN_STEAL_WINDOWS = 2;     ///< Smallest number of windows an idle worker steals
+
+/**
+ * Consecutive windows of a video, tracked by one worker.
+ */
+struct Segment {
+    size_t video;
+    size_t number;                      ///< Order of creation in the video (0: the first segment)
+    size_t first;                       ///< First window
+    size_t end;                         ///< End window, 0 for the end of the video; lowered when stolen from
+    double time;                        ///< Time of the last frame tracked, -1 before the first
+    bool tracking;                      ///< Still decoding: the rest of the segment may be stolen
+    WindowedTracker* tracker;
+};
+
+/**
+ * A video of the manifest and its segments, in window order.
+ */
+struct Video {
+    string file;
+    string output;
+    double duration;                    ///< Seconds, 0 if unknown
+    int width;                          ///< Size of the tracked frames
+    int height;
+    FrameMapping mapping;               ///< From the tracked frames to the video frames
+    double cost;                        ///< Estimated work, to start long videos first
+    list<Segment> segments;
+    size_t numSegments;
+    size_t running;                     ///< Segments not finished
+    string error;
+    double begin;
+    double seconds;
+};
+
+/**
+ * Hands out segments to the workers, and writes the output of a video
+ * when its last segment is finished.
+ */
+class BatchScheduler {
+public:
+    BatchScheduler(vector<Video>& videos, double windowLength, double windowOverlap, int minSize, int maxThreads);
+
+    /**
+     * The next segment to track: the first window of the most expensive
+     * video not started, or else the second half of the running segment
+     * with the most work left. Returns false when nothing is worth taking.
+     */
+    bool next(Segment*& segment);
+
+    /**
+     * Publish the time of the frame segment is about to track. Returns
+     * false when the frame is past the windows of segment, which then
+     * cannot be stolen from anymore.
+     */
+    bool progress(Segment& segment, double time);
+
+    /** The segment stopped decoding: its windows cannot be stolen anymore **/
+    void stop(Segment& segment);
+
+    /**
+     * The segment is tracked (error is empty on success); the output of
+     * its video is written when it was the last segment.
+     */
+    void finished(Segment& segment, const string& error);
+
+    const Video& video(const Segment& segment) const { return videos_[segment.video]; }
+
+private:
+    void write(Video& video);
+    WindowedTracker* newTracker(const Video& video) const;
+
+    vector<Video>& videos_;
+    vector<size_t> order_;              ///< Videos by decreasing cost
+    size_t nextVideo_;
+    size_t done_;
+    double windowLength_;
+    double windowOverlap_;
+    int minSize_;
+    int maxThreads_;
+    Mutex mutex_;
+};
+
+/**
+ * Tracks the segments handed out by a BatchScheduler.
+ */
+class BatchWorker : public Thread {
+public:
+    BatchWorker(BatchScheduler& scheduler, double scale) : scheduler_(scheduler), scale_(scale) {}
+
+protected:
+    void run();
+
+private:
+    int track(Segment& segment, string& error);
+
+    BatchScheduler& scheduler_;
+    double scale_;                      ///< Of the tracked frames
+};
+
+static bool byDecreasingCost(const pair<double, size_t>& a, const pair<double, size_t>& b)
+{
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+BatchScheduler::BatchScheduler(vector<Video>& videos, double windowLength, double windowOverlap, int minSize, int maxThreads)
+: videos_(videos), nextVideo_(0), done_(0), windowLength_(windowLength), windowOverlap_(windowOverlap),
+  minSize_(minSize), maxThreads_(maxThreads)
+{
+    vector< pair<double, size_t> > costs;
+    for (size_t v = 0; v < videos_.size(); v++) {
+        if (videos_[v].error.empty()) {
+            costs.push_back(make_pair(videos_[v].cost, v));
+        }
+    }
+    sort(costs.begin(), costs.end(), byDecreasingCost);
+    for (size_t i = 0; i < costs.size(); i++) {
+        order_.push_back(costs[i].second);
+    }
+}
+
+/**
+ * A tracker of the frames of video: faces down to minSize video pixels,
+ * coordinates mapped back to the video frames.
+ */
+WindowedTracker* BatchScheduler::newTracker(const Video& video) const
+{
+    int minSize = std::max(1, cvRound(minSize_ / video.mapping.scaleX));
+    WindowedTracker* tracker = new WindowedTracker(windowLength_, windowOverlap_, minSize, maxThreads_);
+    tracker->setMapping(video.mapping);
+    return tracker;
+}
+
+bool BatchScheduler::next(Segment*& segment)
+{
+    ScopedLock lock(mutex_);
+    if (nextVideo_ < order_.size()) {
+        Video& video(videos_[order_[nextVideo_++]]);
+        Segment head;
+        head.video = order_[nextVideo_ - 1];
+        head.number = video.numSegments++;
+        head.first = 0;
+        head.end = 0;
+        head.time = -1;
+        head.tracking = true;
+        head.tracker = newTracker(video);
+        video.segments.push_back(head);
+        video.running++;
+        video.begin = wallSeconds();
+        segment = &video.segments.back();
+        return true;
+    }
+
+    // Every video is started: split the running segment with the most windows left
+    Video* victimVideo(0);
+    list<Segment>::iterator victim;
+    size_t split(0);
+    double most(0);
+    for (size_t v = 0; v < videos_.size(); v++) {
+        Video& video(videos_[v]);
+        if (video.running == 0 || !video.error.empty() || video.duration <= 0) {
+            continue;
+        }
+        for (list<Segment>::iterator s = video.segments.begin(); s != video.segments.end(); ++s) {
+            if (!s->tracking) {
+                continue;
+            }
+            size_t end = s->end > 0 ? s->end : s->tracker->lastWindow(video.duration) + 1;
+            size_t current = s->time < 0 ? s->first : max(s->first, s->tracker->lastWindow(s->time));
+            // The windows up to current may be open: the victim keeps them and half of the rest
+            if (end < current + 2 * MIN_STEAL_WINDOWS) {
+                continue;
+            }
+            size_t mid = current + 1 + (end - current - 1) / 2;
+            double work = double(end - current) * video.width * video.height;
+            if (work > most) {
+                most = work;
+                victimVideo = &video;
+                victim = s;
+                split = mid;
+            }
+        }
+    }
+    if (victimVideo == 0) {
+        return false;
+    }
+    Segment stolen;
+    stolen.video = victim->video;
+    stolen.number = victimVideo->numSegments++;
+    stolen.first = split;
+    stolen.end = victim->end;
+    stolen.time = -1;
+    stolen.tracking = true;
+    stolen.tracker = newTracker(*victimVideo);
+    stolen.tracker->setWindows(stolen.first, stolen.end);
+    victim->end = split;
+    list<Segment>::iterator after(victim);
+    segment = &*victimVideo->segments.insert(++after, stolen);
+    victimVideo->running++;
+    return true;
+}
+
+bool BatchScheduler::progress(Segment& segment, double time)
+{
+    ScopedLock lock(mutex_);
+    segment.tracker->setWindows(segment.first, segment.end);
+    if (segment.tracker->isPast(time)) {
+        segment.tracking = false;
+        return false;
+    }
+    segment.time = time;
+    return true;
+}
+
+void BatchScheduler::stop(Segment& segment)
+{
+    ScopedLock lock(mutex_);
+    segment.tracking = false;
+}
+
+void BatchScheduler::finished(Segment& segment, const string& error)
+{
+    Video* complete(0);
+    {
+        ScopedLock lock(mutex_);
+        Video& video(videos_[segment.video]);
+        if (!error.empty() && video.error.empty()) {
+            video.error = error;
+        }
+        if (--video.running == 0) {
+            complete = &video;
+        }
+    }
+    // No other worker refers to the segments of a complete video
+    if (complete) {
+        write(*complete);
+    }
+}
+
+/**
+ * Stitch the segments of video in window order and write its JSON file.
+ */
+void BatchScheduler::write(Video& video)
+{
+    WindowedTracker& head(*video.segments.front().tracker);
+    string error(video.error);
+    if (error.empty()) {
+        list<Segment>::iterator s = video.segments.begin();
+        for (++s; s != video.segments.end() && error.empty(); ++s) {
+            if (head.append(*s->tracker) != 0) {
+                error = "could not merge the segments";
+            }
+        }
+        int retVal(FacetSDK::SUCCESS);
+        if (error.empty() && (retVal = head.finish(video.mapping.cols, video.mapping.rows)) != FacetSDK::SUCCESS) {
+            ostringstream message;
+            message << "could not write the output (error code " << retVal << ")";
+            error = message.str();
+        }
+    }
+    for (list<Segment>::iterator s = video.segments.begin(); s != video.segments.end(); ++s) {
+        delete s->tracker;
+        s->tracker = 0;
+    }
+    if (!error.empty()) {
+        remove(video.output.c_str());
+    }
+
+    ScopedLock lock(mutex_);
+    video.error = error;
+    video.seconds = wallSeconds() - video.begin;
+    std::cout << "[" << ++done_ << "/" << order_.size() << "] " << video.file << ": ";
+    if (error.empty()) {
+        std::cout << video.seconds << " s, " << video.numSegments << " segment(s)" << std::endl;
+    } else {
+        std::cout << "ERROR -- " << error << std::endl;
+    }
+}
+
+void BatchWorker::run()
+{
+    Segment* segment;
+    while (scheduler_.next(segment)) {
+        string error;
+        track(*segment, error);
+        scheduler_.finished(*segment, error);
+    }
+}
+
+/**
+ * Decode and track the frames of segment, as fexfacetexec does for the
+ * whole video. Returns the FacetSDK error code, or -1.
+ */
+int BatchWorker::track(Segment& segment, string& error)
+{
+    const Video& video(scheduler_.video(segment));
+    WindowedTracker& tracker(*segment.tracker);
+    LumaSource source;
+    int retVal(FacetSDK::SUCCESS);
+    if (segment.number == 0) {
+        retVal = tracker.open(video.output);
+    } else {
+        ostringstream spillFileName;
+        spillFileName << video.output << "." << segment.number << ".tmp";
+        retVal = tracker.openSegment(spillFileName.str());
+    }
+    if (retVal != 0) {
+        error = "could not open the output";
+    } else if (!source.open(video.file)) {
+        error = "could not open the video";
+        retVal = -1;
+    }
+    if (retVal != 0) {
+        scheduler_.stop(segment);
+        return retVal;
+    }
+    if (scale_ < 1) {
+        source.setScale(scale_);
+    }
+    if (segment.first > 0) {
+        // Frames before the first window are ignored by the tracker
+        source.seek(tracker.windowStart(segment.first));
+    }
+
+    double endVideoTime = video.duration > 0 ? video.duration : numeric_limits<double>::max();
+    double latestVideoTime(0);
+    LumaFrame lumaFrame;
+    while (source.grab() && source.retrieve(lumaFrame)) {
+        double videoTime = lumaFrame.timestamp();
+        if (videoTime < latestVideoTime || videoTime > endVideoTime) {
+            break;  // started over, or reached the end of the video
+        }
+        latestVideoTime = videoTime;
+        if (!scheduler_.progress(segment, videoTime)) {
+            break;
+        }
+        if ((retVal = tracker.addFrame(lumaFrame.mat(), videoTime)) != FacetSDK::SUCCESS) {
+            break;
+        }
+    }
+    scheduler_.stop(segment);
+    if (retVal == FacetSDK::SUCCESS) {
+        retVal = tracker.finishWindows();
+    }
+    if (retVal != FacetSDK::SUCCESS) {
+        ostringstream message;
+        if (tracker.numFailed() > 0) {
+            message << "could not track the frame at " << latestVideoTime << " s (error code " << retVal << ")";
+        } else {
+            message << "tracking failed with error code " << retVal;
+        }
+        error = message.str();
+    }
+    return retVal;
+}
+
+/**
+ * Helper function to extract a command-line argument
+ */
+char* getCmdOption(char ** begin, char ** end, const std::string & option){
+    char ** itr = std::find(begin, end, option);
+    return (itr != end && ++itr != end) ? *itr : 0;
+}
+
+/**
+ * Helper function to check whether a command-line argument was passed.
+ */
+bool cmdOptionExists(char** begin, char** end, const std::string& option){
+    return std::find(begin, end, option) != end;
+}
+
+/**
+ * Output file of a video without one in the manifest: DIRECTORY/NAME.json
+ */
+static string outputFileName(const string& videoFile, const string& outputDir)
+{
+    size_t slash = videoFile.find_last_of('/');
+    string name = slash == string::npos ? videoFile : videoFile.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    if (dot != string::npos && dot > 0) {
+        name = name.substr(0, dot);
+    }
+    string dir = outputDir.empty() ? (slash == string::npos ? "." : videoFile.substr(0, slash)) : outputDir;
+    return dir + "/" + name + ".json";
+}
+
+/**
+ * Read the videos of the manifest. Returns false if it cannot be read.
+ */
+static bool readManifest(const string& manifest, const string& outputDir, vector<Video>& videos)
+{
+    ifstream input(manifest.c_str());
+    if (!input) {
+        return false;
+    }
+    string line;
+    while (getline(input, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        Video video;
+        size_t tab = line.find('\t');
+        video.file = line.substr(0, tab);
+        video.output = tab == string::npos ? outputFileName(video.file, outputDir) : line.substr(tab + 1);
+        video.duration = 0;
+        video.width = 0;
+        video.height = 0;
+        video.cost = 0;
+        video.numSegments = 0;
+        video.running = 0;
+        video.begin = 0;
+        video.seconds = 0;
+        videos.push_back(video);
+    }
+    return true;
+}
+
+/**
+ * Open the video to read its duration and the size of its tracked frames.
+ */
+static void probe(Video& video, double scale)
+{
+    LumaSource source;
+    if (!source.open(video.file)) {
+        video.error = "could not open the video";
+        return;
+    }
+    if (scale < 1) {
+        source.setScale(scale);
+    }
+    video.width = source.frameWidth();
+    video.height = source.frameHeight();
+    video.mapping = source.mapping();
+    video.duration = source.duration();
+    if (video.duration <= 0 && source.frameCount() > 0 && source.fps() > 0) {
+        video.duration = source.frameCount() / source.fps();
+    }
+    // Unknown durations first: they cannot be split
+    video.cost = video.duration > 0 ? video.duration * video.width * video.height : numeric_limits<double>::max();
+}
+
+/**
+ * Write the outcome of every video. Returns false on error.
+ */
+static bool writeResults(const string& resultsFile, const vector<Video>& videos)
+{
+    ofstream output(resultsFile.c_str());
+    output << "video\toutput\tstatus\tduration\tsegments\tseconds\terror\n";
+    for (size_t v = 0; v < videos.size(); v++) {
+        const Video& video(videos[v]);
+        output << video.file << "\t" << video.output << "\t" << (video.error.empty() ? "ok" : "error") << "\t"
+               << video.duration << "\t" << video.numSegments << "\t" << video.seconds << "\t" << video.error << "\n";
+    }
+    output.close();
+    return !output.fail();
+}
+
+/**
+ * Application entry point
+ * @param argc is number of arguments
+ * @param argv is array of pointers to argument strings
+ */
+int main(int argc, char* argv[]) {
+#ifdef _WIN32
+	FacetSDK::InitializeLicensing(FACET);  // Necessary only with Windows; call before any other FACET call
+#endif
+    char* manifestArg = getCmdOption(argv, argv + argc, "-l");
+    if (manifestArg == 0) {
+        std::cerr << "ERROR: -l manifest file name REQUIRED" << std::endl;
+        return FacetSDK::EMPTY_INPUT;
+    }
+    string manifest(manifestArg);
+    char* dirArg = getCmdOption(argv, argv + argc, "-d");
+    string outputDir(dirArg ? dirArg : "");
+    char* resultsArg = getCmdOption(argv, argv + argc, "-o");
+    string resultsFile(resultsArg ? resultsArg : manifest + ".results.tsv");
+
+    int maxThreads = cv::getNumberOfCPUs();
+    if (cmdOptionExists(argv, argv + argc, "-t")) {
+        std::istringstream iss(getCmdOption(argv, argv + argc, "-t"));
+        iss >> maxThreads;
+    }
+    maxThreads = std::max(maxThreads, 1);
+    int numWorkers = maxThreads;
+    if (cmdOptionExists(argv, argv + argc, "-j")) {
+        std::istringstream iss(getCmdOption(argv, argv + argc, "-j"));
+        iss >> numWorkers;
+    }
+    numWorkers = std::max(numWorkers, 1);
+    double windowLength = DEFAULT_WINDOW, windowOverlap = DEFAULT_WINDOW_OVERLAP;
+    if (cmdOptionExists(argv, argv + argc, "-w")) {
+        std::istringstream iss(getCmdOption(argv, argv + argc, "-w"));
+        iss >> windowLength;
+    }
+    if (cmdOptionExists(argv, argv + argc, "-v")) {
+        std::istringstream iss(getCmdOption(argv, argv + argc, "-v"));
+        iss >> windowOverlap;
+    }
+    if (!(windowLength > 0)) {
+        std::cerr << "ERROR: -w window length must be positive" << std::endl;
+        return FacetSDK::EMPTY_INPUT;
+    }
+    int minSize = DEFAULT_MIN_SIZE, faceWidth = 0;
+    double resize = 1;
+    if (cmdOptionExists(argv, argv + argc, "-s")) {
+        std::istringstream iss(getCmdOption(argv, argv + argc, "-s"));
+        iss >> minSize;
+    }
+    if (cmdOptionExists(argv, argv + argc, "-r")) {
+        std::istringstream iss(getCmdOption(argv, argv + argc, "-r"));
+        iss >> resize;
+    }
+    if (cmdOptionExists(argv, argv + argc, "-facewidth")) {
+        std::istringstream iss(getCmdOption(argv, argv + argc, "-facewidth"));
+        iss >> faceWidth;
+    }
+    double scale = faceWidth > 0 ? (double)faceWidth / std::max(minSize, 1) : 1.0 / resize;
+
+    vector<Video> videos;
+    if (!readManifest(manifest, outputDir, videos)) {
+        std::cerr << "ERROR: could not read " << manifest << std::endl;
+        return FacetSDK::EMPTY_INPUT;
+    }
+    for (size_t v = 0; v < videos.size(); v++) {
+        probe(videos[v], scale);
+    }
+
+    // The trackers of all the workers share the thread budget
+    BatchScheduler scheduler(videos, windowLength, windowOverlap, minSize, std::max(1, maxThreads / numWorkers));
+    vector<BatchWorker*> workers;
+    for (int w = 0; w < numWorkers; w++) {
+        workers.push_back(new BatchWorker(scheduler, scale));
+        workers.back()->start();
+    }
+    for (size_t w = 0; w < workers.size(); w++) {
+        workers[w]->join();
+        delete workers[w];
+    }
+
+    size_t failed(0);
+    for (size_t v = 0; v < videos.size(); v++) {
+        if (!videos[v].error.empty()) {
+            std::cout << "ERROR -- " << videos[v].file << ": " << videos[v].error << std::endl;
+            failed++;
+        }
+    }
+    if (!writeResults(resultsFile, videos)) {
+        std::cout << "ERROR -- could not write " << resultsFile << std::endl;
+        return -1;
+    }
+    std::cout << videos.size() - failed << " of " << videos.size() << " videos tracked, results in " << resultsFile << std::endl;
+    exit(failed > 0 ? -1 : 0);
+}
@@ -8,6 +8,32 @@
  *      - VIDEONAME is a required argument. Must be a string file name containing the video.
  *      - OUTPUTNAME is a required argument. Must be a string file name to write the output JSON to.
  *
+ *		video_2_json -f <VIDEONAME> -o <OUTPUTNAME> -w <WINDOW> [-v <OVERLAP>]
+ *      - Windowed tracking: tracks are created over WINDOW seconds long windows overlapping by OVERLAP
+ *        seconds (default 5), and stitched across windows. Memory depends on WINDOW instead of the
+ *        length of the video, and -m defaults to no limit.
+ *        After each window, the finished windows are committed to disk with a checkpoint in
+ *        OUTPUTNAME.ckpt; with [-resume], an interrupted run goes on from its checkpoint (seeking
+ *        back to the first window that was not finished) and writes the same JSON file.
+ *
+ *      [-r <RESIZE>] [-facewidth <PIXELS>]
+ *      - Frames are tracked at 1/RESIZE of their size (fractions allowed), or at the scale where faces
+ *        of the minimum size (-s, in video pixels) are PIXELS wide. Coordinates and the resolution in
+ *        the JSON file are those of the video frames.
+ *
+ *      [-roi <SAMPLEFPS>]
+ *      - Two passes: the face is first detected in SAMPLEFPS frames per second (at half the tracking
+ *        scale), and only the region around it is tracked in every frame. Coordinates and the
+ *        resolution in the JSON file are those of the whole frames.
+ *
+ *      [-t <THREADS>]
+ *      - Maximum number of tracker threads (default: the number of CPUs). Use fexbatch to process
+ *        several videos under one thread budget.
+ *
+ *      [-metrics <BASENAME>]
+ *      - Writes the stage latencies (decode, track, create_tracks, output), frame counts and peak memory
+ *        to BASENAME.json and BASENAME.prom (Prometheus text format), every 10 s and at the end.
+ *
  * Output:
  *		JSON file containing a listing of all tracks(each track is a single face over time), with all frames in
  *			which it appeared and the Emotient channel output for each frame. Note that this is in track-order.
@@ -24,11 +50,18 @@
 #include <sstream>
 #include <fstream>
 #include <time.h>
+#include <limits>
 #include <opencv2/opencv.hpp>
 #include <emotient.hpp>
-#include <json/json.h>
 #include "config.hpp"
 #include "tools.hpp"
+#include "checkpoint.hpp"
+#include "faceroi.hpp"
+#include "framesampler.hpp"
+#include "lumasource.hpp"
+#include "runmetrics.hpp"
+#include "trackjson.hpp"
+#include "windowtracker.hpp"
 
 const int FILE_NOT_FOUND = -3;              ///< The specified file could not be found.
 const int INITIALIZATION_ERROR = -5;        ///< Could not initialize the object.
@@ -38,37 +71,42 @@ using namespace cv;
 using namespace EMOTIENT;
 
 const float MILLIS_PER_SEC = 1000.0;
-const float DEFAULT_IMAGE_SCALE_FACTOR = 1.;
+const double DEFAULT_IMAGE_SCALE_FACTOR = 1.;
 const int DEFAULT_MAX_FRAMES = 100000;
 const int DEFAULT_MIN_SIZE = 50;
 const int DEFAULT_NUM_TRACKS = 10;
+const double DEFAULT_WINDOW_OVERLAP = 5.0;
+const double ROI_SAMPLE_SCALE = 0.5;        ///< Scale of the -roi sample, relative to the tracking scale
+const double ROI_MAX_GRAB_GAP = 10.0;       ///< Sample gaps longer than this (in seconds) are crossed with a seek
 
 //Prepare the video to be played
 int
-InitVideo(cv::VideoCapture& videoCap, double& startVideoTime, double& endVideoTime, double& latestVideoTime){
-    if( !videoCap.isOpened() ){
+InitVideo(LumaSource& videoSource, double& startVideoTime, double& endVideoTime, double& latestVideoTime){
+    if( !videoSource.isOpened() ){
         return INITIALIZATION_ERROR;
     } else {
-        videoCap.set(CV_CAP_PROP_POS_AVI_RATIO, 1);  // Determine length of movie by finding end
-        endVideoTime = videoCap.get(CV_CAP_PROP_POS_MSEC) / MILLIS_PER_SEC;
-        videoCap.set(CV_CAP_PROP_POS_AVI_RATIO, 0);  // rewind to start of video
-        startVideoTime = videoCap.get(CV_CAP_PROP_POS_MSEC) / MILLIS_PER_SEC;
+        // Length of movie from the container; unknown lengths do not stop the loop
+        startVideoTime = 0;
+        endVideoTime = videoSource.duration() > 0 ? videoSource.duration() : std::numeric_limits<double>::max();
         latestVideoTime = startVideoTime;
-        videoCap.set(CV_CAP_PROP_POS_FRAMES, 0); // start at frame 0 of video
         return FacetSDK::SUCCESS;
     }
 }
 
+/**
+ * Decode the next frame to grayscale, already resized by the source (see
+ * LumaSource::setScale). The luma plane is used without a copy.
+ */
 bool
-PrepNextFrame(const double& endVideoTime, const int resize, cv::VideoCapture& videoCap, cv::Mat& frame, size_t& frameNumber, double& latestVideoTime){
+PrepNextFrame(const double& endVideoTime, LumaSource& videoSource, LumaFrame& lumaFrame, cv::Mat& grayFrame, size_t& frameNumber, double& latestVideoTime){
     bool retVal(true);
-    retVal = videoCap.grab();
+    retVal = videoSource.grab();
     if(retVal){
-        retVal = videoCap.retrieve(frame);
+        retVal = videoSource.retrieve(lumaFrame);
         if(retVal){
             frameNumber += 1;
-            cv::resize(frame, frame, cv::Size(frame.cols/resize, frame.rows/resize));
-            double videoTime = videoCap.get(CV_CAP_PROP_POS_MSEC) / MILLIS_PER_SEC;
+            grayFrame = lumaFrame.mat();
+            double videoTime = lumaFrame.timestamp();
             if (videoTime < latestVideoTime) {
                 retVal = false;  // we've started over again (this sometimes happens with VideoCap); break
             } else if (videoTime > endVideoTime) {
@@ -80,6 +118,62 @@ PrepNextFrame(const double& endVideoTime, const int resize, cv::VideoCapture& vi
     return retVal;
 }
 
+/**
+ * First pass of -roi: detect the largest face in samplesPerSec frames per
+ * second, decoded at ROI_SAMPLE_SCALE of the current scale, and return its
+ * region in video pixels (empty if there is no face). The source is then
+ * rewound with its scale restored.
+ */
+cv::Rect
+SampleFaceRoi(LumaSource& videoSource, const string& videoFile, double samplesPerSec, int minSize, int maxThreads){
+    cv::Rect roi;
+    FacetSDK::FrameAnalyzer frameAnalyzer;
+    frameAnalyzer.SetMaxThreads(maxThreads);
+    if (frameAnalyzer.Initialize(FACETSDIR, "FrameAnalyzerConfig.json") != FacetSDK::SUCCESS) {
+        std::cout << "Could not initialize the FrameAnalyzer: tracking whole frames" << std::endl;
+        return roi;
+    }
+    frameAnalyzer.SetChannelActive(FacetSDK::ACTION_UNITS, false);
+    frameAnalyzer.SetChannelActive(FacetSDK::EMOTIONS, false);
+    frameAnalyzer.SetChannelActive(FacetSDK::POSE, false);
+
+    double scale = videoSource.scale();
+    videoSource.setScale(scale * ROI_SAMPLE_SCALE);
+    FrameMapping toVideo = videoSource.mapping();
+    frameAnalyzer.SetMinFaceDetectionWidth(minSize / toVideo.scaleX);
+
+    std::vector<cv::Rect_<float> > boxes;
+    FrameSampler sampler(videoSource, samplesPerSec, ROI_MAX_GRAB_GAP);
+    LumaFrame lumaFrame;
+    FacetSDK::FrameAnalysis frameAnalysis;
+    while (sampler.next(lumaFrame)) {
+        if (frameAnalyzer.Analyze(lumaFrame.data(), lumaFrame.rows(), lumaFrame.cols(), frameAnalysis) != FacetSDK::SUCCESS ||
+            frameAnalysis.NumFaces() == 0) {
+            continue;
+        }
+        FacetSDK::Face face;
+        frameAnalysis.LargestFace(face);
+        FacetSDK::Rectangle location;
+        face.FaceLocation(location);
+        boxes.push_back(cv::Rect_<float>(toVideo.x(location.x), toVideo.y(location.y),
+                                         toVideo.width(location.width), toVideo.height(location.height)));
+    }
+    roi = estimateFaceRoi(boxes, cv::Size(videoSource.width(), videoSource.height()));
+    std::cout << "Face region: " << boxes.size() << " faces in " << sampler.numSampled() << " sampled frames";
+    if (roi.area() > 0) {
+        std::cout << "; x " << roi.x << ", y " << roi.y << ", " << roi.width << "x" << roi.height << std::endl;
+    } else {
+        std::cout << "; tracking whole frames" << std::endl;
+    }
+
+    videoSource.setScale(scale);
+    if (!videoSource.seek(0)) {
+        videoSource.open(videoFile);
+        videoSource.setScale(scale);
+    }
+    return roi;
+}
+
 /**
  * Helper function to extract a command-line argument
  */
@@ -98,7 +192,9 @@ bool cmdOptionExists(char** begin, char** end, const std::string& option){
 /**
  * Check and parse command line arguments
  */
-int parseVideoArg(int argc, char *argv[], string& videoFile, int& maxFrames, int& minSize, int& resize, string& outputfile){
+int parseVideoArg(int argc, char *argv[], string& videoFile, int& maxFrames, int& minSize, double& resize, string& outputfile,
+                  double& windowLength, double& windowOverlap, int& maxThreads, string& metricsBase, bool& resume,
+                  double& roiSamplesPerSec, int& faceWidth){
     int retVal(FacetSDK::SUCCESS);
 
     // Check that proper arguments were passed to command-line
@@ -138,146 +234,63 @@ int parseVideoArg(int argc, char *argv[], string& videoFile, int& maxFrames, int
         iss >> minSize;
     }
 
-    // Set the optional image resize scale factor, an integer - divide the size by this.
+    // Set the optional image resize scale factor - divide the size by this.
     resize = DEFAULT_IMAGE_SCALE_FACTOR;
     if (cmdOptionExists(argv, argv + argc, "-r")) {
         char* resizeArg = getCmdOption(argv, argv + argc, "-r");
         std::istringstream iss(resizeArg);
         iss >> resize;
     }
-    
-    return retVal;
-}
 
-int SerializeTracksToJSON(const std::string& outputFileName,
-                        std::vector<EMOTIENT::FacetSDK::VideoAnalysisPtr> &tracks,
-                        std::vector<double> &frameTimes,
-                        int &width,
-                        int &height) {
-    int retVal(0);
-    EMOTIENT::FacetSDK::VideoAnalysisPtr track;
-    std::ofstream fid(outputFileName.c_str());
-    if(!fid){
-        std::cout << "ERROR -- WriteFile could not open JSON file " << outputFileName << std::endl;
-        exit(-1);
+    // Or the optional width at which the smallest faces are tracked (0: use -r)
+    faceWidth = 0;
+    if (cmdOptionExists(argv, argv + argc, "-facewidth")) {
+        char* faceWidthArg = getCmdOption(argv, argv + argc, "-facewidth");
+        std::istringstream iss(faceWidthArg);
+        iss >> faceWidth;
     }
-    
-    Json::Value root;
-    Json::Value &joutput = root["output"];
-    
-    // First insert frametimes vector
-    Json::Value &jframetimes = joutput["frametimes"];
-    for (size_t i(0); i < frameTimes.size(); ++i) {
-        jframetimes.append(frameTimes[i]);
-    }
-    
-    // Now insert a resolution dict
-    joutput["resolution"]["height"] = height;
-    joutput["resolution"]["width"] = width;
-    
-    // Next build and insert tracks vector
-    Json::Value &jtracks = joutput["tracks"];
-    for(size_t tracknum(0); tracknum < tracks.size(); ++tracknum){
-        Json::Value jtrack;
-        Json::Value &jframes = jtrack["frames"];
-        std::vector<float> frameTimesVec;
-        std::vector<bool> isFacePresentVec;
-        std::vector<FacetSDK::Rectangle> faceLocationsVec;
-        std::map< FacetSDK::EmotionName, std::vector<float> > emotionEvidenceMap;
-        std::map< FacetSDK::ActionUnitEnum, std::vector<float> > actionunitMap;
-        std::map< FacetSDK::DemographicName, std::vector<float> > demographicEvidenceMap;
-        std::map< FacetSDK::LandmarkName, std::vector<FacetSDK::Point> > landmarkPointsMap;
-        std::map< FacetSDK::PoseDimension, std::vector<float> > poseMap;
-
-        // Pull out all the frames per track
-        track = tracks[tracknum];
-        track->FrameTimes(frameTimesVec);
-        track->IsFacePresent(isFacePresentVec);
-        track->FaceLocations(faceLocationsVec);
 
-        // Grab the names of all channels
-        std::vector<FacetSDK::EmotionName> allEmotions(FacetSDK::AllEmotionNames());
-        std::vector<FacetSDK::ActionUnitEnum> allActionUnits(FacetSDK::AllActionUnits());        
-        std::vector<FacetSDK::LandmarkName> allLandmarks(FacetSDK::AllLandmarkNames());
-        std::vector<FacetSDK::DemographicName> allDemographics(FacetSDK::AllDemographicNames());
-        std::vector<FacetSDK::PoseDimension> allPoseDimensions(FacetSDK::AllPoseDimensions());
-
-        // Store evidence for each emotion
-        for(std::vector<FacetSDK::EmotionName>::const_iterator emotion = allEmotions.begin(); emotion != allEmotions.end(); ++emotion) {
-        	track->EmotionEvidence(*emotion,emotionEvidenceMap[*emotion]);
-        }
-        
-        // Store evidence for each AU
-        for(std::vector<FacetSDK::ActionUnitEnum>::const_iterator au = allActionUnits.begin(); au != allActionUnits.end(); ++au) {
-        	track->ActionUnitEvidence(*au,actionunitMap[*au]);
+    // Set the optional tracking window and overlap, in seconds (0: the whole video)
+    windowLength = 0;
+    if (cmdOptionExists(argv, argv + argc, "-w")) {
+        char* windowArg = getCmdOption(argv, argv + argc, "-w");
+        std::istringstream iss(windowArg);
+        iss >> windowLength;
+        if (!cmdOptionExists(argv, argv + argc, "-m")) {
+            maxFrames = std::numeric_limits<int>::max();
         }
+    }
+    windowOverlap = DEFAULT_WINDOW_OVERLAP;
+    if (cmdOptionExists(argv, argv + argc, "-v")) {
+        char* overlapArg = getCmdOption(argv, argv + argc, "-v");
+        std::istringstream iss(overlapArg);
+        iss >> windowOverlap;
+    }
 
-        // Store evidence for each demographic
-        for(std::vector<FacetSDK::DemographicName>::const_iterator demographic = allDemographics.begin(); demographic != allDemographics.end(); ++demographic) {
-        	track->DemographicEvidence(*demographic, demographicEvidenceMap[*demographic]);
-        }
+    // Set the optional number of tracker threads
+    maxThreads = cv::getNumberOfCPUs();
+    if (cmdOptionExists(argv, argv + argc, "-t")) {
+        char* threadsArg = getCmdOption(argv, argv + argc, "-t");
+        std::istringstream iss(threadsArg);
+        iss >> maxThreads;
+        maxThreads = std::max(maxThreads, 1);
+    }
 
-        // Store evidence for each landmark
-        for(std::vector<FacetSDK::LandmarkName>::const_iterator landmark = allLandmarks.begin(); landmark != allLandmarks.end(); ++landmark) {
-        	track->LandmarkLocations(*landmark, landmarkPointsMap[*landmark]);
-        }
+    // Set the optional metrics files
+    char* metricsArg = getCmdOption(argv, argv + argc, "-metrics");
+    metricsBase = metricsArg ? metricsArg : "";
 
-        // Store each pose dimension
-        for(std::vector<FacetSDK::PoseDimension>::const_iterator poseDimension = allPoseDimensions.begin(); poseDimension != allPoseDimensions.end(); ++poseDimension) {
-			track->Pose(*poseDimension, poseMap[*poseDimension]);
-        }
-        
-        // Add frames into frames slot of track dictionary
-        for (size_t framenum(0); framenum < isFacePresentVec.size(); ++framenum) {
-            bool isFacePresent = isFacePresentVec[framenum];
-            // add frame to JSON if frame contains one or more faces
-            if (isFacePresent == true) {
-                Json::Value jframe;
-                jframe["timestamp"] = frameTimesVec[framenum];
-                jframe["face-location"]["x"] = faceLocationsVec[framenum].x;
-                jframe["face-location"]["y"] = faceLocationsVec[framenum].y;
-                jframe["face-location"]["width"] = faceLocationsVec[framenum].width;
-                jframe["face-location"]["height"] = faceLocationsVec[framenum].height;
-                jframe["demographic-evidence"]["isMale"] = demographicEvidenceMap[FacetSDK::IS_MALE][framenum];
-                // Store pose data in JSON
-                for (std::map< FacetSDK::PoseDimension, std::vector<float> >::iterator it = poseMap.begin();
-                     it != poseMap.end(); ++it) {
-                    std::string posenamestr = FacetSDK::PoseDimensionToString(it->first);
-                	jframe["pose"][posenamestr] = it->second[framenum];
-                }
-                // Store emotion data in JSON
-                for (std::map< FacetSDK::EmotionName, std::vector<float> >::iterator it = emotionEvidenceMap.begin();
-                     it != emotionEvidenceMap.end(); ++it) {
-                    std::string emonamestr = FacetSDK::EmotionNameToString(it->first);
-                    jframe["emotion-evidence"][emonamestr] = it->second[framenum];;
-                }
-                // Store AUs
-                for (std::map< FacetSDK::ActionUnitEnum, std::vector<float> >::iterator it = actionunitMap.begin();
-                     it != actionunitMap.end(); ++it) {
-                    std::string aunamestr = FacetSDK::ActionUnitToString(it->first);
-                    jframe["au-evidence"][aunamestr] = it->second[framenum];;
-                }
-                
-                // Store landmark data in JSON
-                for (std::map< FacetSDK::LandmarkName, std::vector<FacetSDK::Point> >::iterator it = landmarkPointsMap.begin();
-                     it != landmarkPointsMap.end(); ++it) {
-                    std::string landmarknamestr = FacetSDK::LandmarkNameToString(it->first);
-                    jframe["landmarks"][landmarknamestr]["x"] = it->second[framenum].x;
-                    jframe["landmarks"][landmarknamestr]["y"] = it->second[framenum].y;
-                }
-                jframes.append(jframe);
-            }
-        }
-        
-        // Add a track to the tracks
-        jtracks.append(jtrack);
+    // Resume windowed tracking from its checkpoint
+    resume = cmdOptionExists(argv, argv + argc, "-resume");
+
+    // Set the optional sampling rate of the face region (0: whole frames)
+    roiSamplesPerSec = 0;
+    if (cmdOptionExists(argv, argv + argc, "-roi")) {
+        char* roiArg = getCmdOption(argv, argv + argc, "-roi");
+        std::istringstream iss(roiArg);
+        iss >> roiSamplesPerSec;
     }
     
-    if( root.size() == 0)
-        fid << "{}" ;
-    else
-        fid << root;
-    fid.close();
     return retVal;
 }
 
@@ -291,61 +304,161 @@ int main(int argc, char* argv[]) {
 	FacetSDK::InitializeLicensing(FACET);  // Necessary only with Windows; call before any other FACET call
 #endif
     int retVal(0);
-    string videoFile(""), outputfile("");
-    int maxFrames, minSize, resize;
-    if( FacetSDK::SUCCESS != (retVal = parseVideoArg(argc, argv, videoFile, maxFrames, minSize, resize, outputfile))){
+    string videoFile(""), outputfile(""), metricsBase("");
+    int maxFrames, minSize, maxThreads, faceWidth;
+    double resize, windowLength, windowOverlap, roiSamplesPerSec;
+    bool resume;
+    if( FacetSDK::SUCCESS != (retVal = parseVideoArg(argc, argv, videoFile, maxFrames, minSize, resize, outputfile, windowLength, windowOverlap, maxThreads, metricsBase, resume, roiSamplesPerSec, faceWidth))){
         return retVal;
     }
+
+    // Optional metrics, rewritten in the background while the video is processed
+    RunMetrics* metrics(0);
+    MetricsReporter* reporter(0);
+    size_t decodeStage(0), trackStage(0), createStage(0), outputStage(0), framesCounter(0), failedCounter(0);
+    if (!metricsBase.empty()) {
+        metrics = new RunMetrics("fexfacetexec", videoFile, metricsBase);
+        decodeStage = metrics->addStage("decode");
+        trackStage = metrics->addStage("track");
+        createStage = metrics->addStage("create_tracks");
+        outputStage = metrics->addStage("output");
+        framesCounter = metrics->addCounter("frames", "Frames added to the tracker.");
+        failedCounter = metrics->addCounter("frames_failed", "Frames the tracker could not add.");
+        reporter = new MetricsReporter(*metrics);
+    }
     
-    // Load the video into OpenCV's capture object and exit if it fails
-    cv::VideoCapture videoCap;
-    videoCap.open(videoFile);
-    if (!videoCap.isOpened()) {
+    // Open the video (decoded straight to grayscale) and exit if it fails
+    LumaSource videoSource;
+    videoSource.open(videoFile);
+    if (!videoSource.isOpened()) {
         std::cout << "Could not open video file for processing" << std::endl;
         retVal = -7;
     } else {
 
         double startVideoTime(0), endVideoTime(0), latestVideoTime(0);
-        InitVideo(videoCap, startVideoTime, endVideoTime, latestVideoTime);
-        
-        // Prepare the tracking manager
-        FacetSDK::SpatialTrackingManagerPtr tracker;
+        InitVideo(videoSource, startVideoTime, endVideoTime, latestVideoTime);
+        double scale = faceWidth > 0 ? (double)faceWidth / std::max(minSize, 1) : 1.0 / resize;
+        if (scale < 1) {
+            // Frames are converted and area-resized in a single pass while decoding
+            videoSource.setScale(scale);
+        }
+
+        // Track only the region of the face
+        if (roiSamplesPerSec > 0) {
+            cv::Rect roi = SampleFaceRoi(videoSource, videoFile, roiSamplesPerSec, minSize, maxThreads);
+            videoSource.setCrop(roi);
+        }
+        // Coordinates are mapped back to the video frames, and faces are tracked down to minSize video pixels
+        FrameMapping toVideo = videoSource.mapping();
+        int frameWidth(videoSource.width()), frameHeight(videoSource.height());
+        int trackMinSize = std::max(1, cvRound(minSize / toVideo.scaleX));
         
-        if (FacetSDK::TrackerFactory::GetSpatialTracker(tracker, FACETSDIR, "TrackerConfig.json") != FacetSDK::SUCCESS) {
-            std::cout << "Could not load tracker params" << std::endl;
-            retVal = -8;
-        } else {
-            // Always enable background subtraction
-            tracker->SetBackgroundModelActive(true);
-            tracker->SetChannelActive(FacetSDK::ACTION_UNITS, true);
-            tracker->SetChannelActive(FacetSDK::LANDMARKS, true);
-                
-            // Now start running on frames to create the graph
-            tracker->SetMaxThreads(cv::getNumberOfCPUs());
-            tracker->SetMinFaceSize(minSize);
-            cv::Mat frame, grayFrame;
-            size_t frameNumber(0);
-            std::vector<double> frameTimes;
-            while (PrepNextFrame(endVideoTime, resize, videoCap, frame, frameNumber, latestVideoTime) && (int)frameNumber < maxFrames)
-            {
-                //add frame to tracker
-            	cvtColorSafe(frame, grayFrame);
-                tracker->AddFrame(grayFrame.data,grayFrame.rows,grayFrame.cols, FacetSDK::TrackerMetaData(latestVideoTime));
-                frameTimes.push_back(latestVideoTime);
-                std::cout<<"."<<std::flush;
+        LumaFrame lumaFrame;
+        cv::Mat grayFrame;
+        size_t frameNumber(0);
+        if (windowLength > 0) {
+            // Windowed tracking: tracks of finished windows are flushed to disk
+            WindowedTracker* tracker = new WindowedTracker(windowLength, windowOverlap, trackMinSize, maxThreads);
+            tracker->setMapping(toVideo);
+            size_t first(0);
+            if (resume && tracker->resume(outputfile, videoFile, first) == 0) {
+                // Decode again from the first window that was not finished
+                std::cout << "Resuming " << videoFile << " at " << tracker->windowStart(first) << " s" << std::endl;
+                if (first > 0 && !videoSource.seek(tracker->windowStart(first))) {
+                    std::cout << "Could not seek " << videoFile << std::endl;
+                    retVal = -7;
+                }
+            } else {
+                if (resume) {
+                    std::cout << "Could not resume from " << outputfile << CHECKPOINT_EXT << ": starting over" << std::endl;
+                    delete tracker;
+                    tracker = new WindowedTracker(windowLength, windowOverlap, trackMinSize, maxThreads);
+                    tracker->setMapping(toVideo);
+                }
+                if (tracker->open(outputfile) != 0) {
+                    retVal = -1;
+                }
+                tracker->setCheckpoint(outputfile, videoFile);
             }
-            std::cout<<std::endl;
-
-            // do the tracking and get the results
-            std::vector<EMOTIENT::FacetSDK::VideoAnalysisPtr> tracks;
-            retVal = tracker->CreateTracks(tracks);
-            if (retVal == 0) {
-                // Serialize the tracks to JSON
-                SerializeTracksToJSON(outputfile, tracks, frameTimes, grayFrame.cols, grayFrame.rows);
+            WindowedTracker& windowedTracker(*tracker);
+            windowedTracker.setMetrics(metrics, createStage);
+            if (retVal == FacetSDK::SUCCESS) {
+                while (retVal == FacetSDK::SUCCESS)
+                {
+                    MetricsTimer decodeTimer(metrics, decodeStage);
+                    if (!PrepNextFrame(endVideoTime, videoSource, lumaFrame, grayFrame, frameNumber, latestVideoTime) || (int)frameNumber >= maxFrames) {
+                        break;
+                    }
+                    decodeTimer.stop();
+                    // Includes the tracks of the windows that end at this frame
+                    MetricsTimer trackTimer(metrics, trackStage);
+                    size_t numFailed = windowedTracker.numFailed();
+                    retVal = windowedTracker.addFrame(grayFrame, latestVideoTime);
+                    trackTimer.stop();
+                    if (metrics) {
+                        metrics->increment(retVal == FacetSDK::SUCCESS ? framesCounter : failedCounter);
+                    }
+                    if (windowedTracker.numFailed() > numFailed) {
+                        // As without windows, a frame the tracker cannot add is skipped
+                        retVal = FacetSDK::SUCCESS;
+                    }
+                    std::cout<<"."<<std::flush;
+                }
+                std::cout<<std::endl;
+                if (retVal == FacetSDK::SUCCESS) {
+                    MetricsTimer outputTimer(metrics, outputStage);
+                    retVal = windowedTracker.finish(frameWidth, frameHeight);
+                }
+            }
+            delete tracker;
+        } else {
+            // Prepare the tracking manager
+            FacetSDK::SpatialTrackingManagerPtr tracker;
+            
+            if (CreateTracker(tracker, trackMinSize, maxThreads) != FacetSDK::SUCCESS) {
+                std::cout << "Could not load tracker params" << std::endl;
+                retVal = -8;
             } else {
-                std::cerr << "Tracker failed to CreateTracks with error code " << retVal << std::endl;
+                // Now start running on frames to create the graph
+                std::vector<double> frameTimes;
+                while (true)
+                {
+                    MetricsTimer decodeTimer(metrics, decodeStage);
+                    if (!PrepNextFrame(endVideoTime, videoSource, lumaFrame, grayFrame, frameNumber, latestVideoTime) || (int)frameNumber >= maxFrames) {
+                        break;
+                    }
+                    decodeTimer.stop();
+                    //add frame to tracker
+                    MetricsTimer trackTimer(metrics, trackStage);
+                    int addVal = tracker->AddFrame(grayFrame.data,grayFrame.rows,grayFrame.cols, FacetSDK::TrackerMetaData(latestVideoTime));
+                    trackTimer.stop();
+                    if (metrics) {
+                        metrics->increment(addVal == FacetSDK::SUCCESS ? framesCounter : failedCounter);
+                    }
+                    frameTimes.push_back(latestVideoTime);
+                    std::cout<<"."<<std::flush;
+                }
+                std::cout<<std::endl;
+
+                // do the tracking and get the results
+                std::vector<EMOTIENT::FacetSDK::VideoAnalysisPtr> tracks;
+                MetricsTimer createTimer(metrics, createStage);
+                retVal = tracker->CreateTracks(tracks);
+                createTimer.stop();
+                if (retVal == 0) {
+                    // Serialize the tracks to JSON, formatting tracks in parallel
+                    MetricsTimer outputTimer(metrics, outputStage);
+                    SerializeTracksToJSON(outputfile, tracks, frameTimes, frameWidth, frameHeight, maxThreads, toVideo);
+                } else {
+                    std::cerr << "Tracker failed to CreateTracks with error code " << retVal << std::endl;
+                }
             }
         }
     }
+    if (reporter && !reporter->stop()) {
+        std::cout << "Could not write the metrics to " << metricsBase << ".json and .prom" << std::endl;
+    }
+    delete reporter;
+    delete metrics;
     exit(retVal);
 }
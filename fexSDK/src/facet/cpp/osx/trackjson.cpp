@@ -0,0 +1,374 @@
+#include "trackjson.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdio.h>
+#include <stdlib.h>
+#include "textwriter.hpp"
+#include "threads.hpp"
+
+using namespace EMOTIENT;
+
+/** Indentation of the frame objects (output.tracks[].frames[]) **/
+static const std::string FRAME_INDENT(5, '\t');
+
+/**
+ * Append value as a JSON number. Non-finite values are written as null
+ * (jsoncpp wrote "nan", which is not JSON).
+ */
+static inline void appendNumber(std::string& out, double value, const char* format)
+{
+    if (value != value || std::fabs(value) > 1e300) {
+        out += "null";
+        return;
+    }
+    char number[32];
+    int n = snprintf(number, sizeof(number), format, value);
+    out.append(number, n);
+}
+
+/**
+ * Append a float with 9 significant digits, which is enough to read back
+ * the same float (see appendFloat), or null.
+ */
+static inline void appendJsonFloat(std::string& out, float value)
+{
+    if (value != value || std::fabs((double)value) > 1e300) {
+        out += "null";
+    } else if (value == 0) {
+        out += '0';
+    } else {
+        appendFloat(out, value, ROUNDTRIP_PRECISION);
+    }
+}
+
+TrackFormatter::TrackFormatter()
+{
+    const std::string indent(FRAME_INDENT + "\t\t");
+    emotions_.init(FacetSDK::AllEmotionNames(), FacetSDK::EmotionNameToString, indent);
+    actionUnits_.init(FacetSDK::AllActionUnits(), FacetSDK::ActionUnitToString, indent);
+    landmarks_.init(FacetSDK::AllLandmarkNames(), FacetSDK::LandmarkNameToString, indent);
+    poses_.init(FacetSDK::AllPoseDimensions(), FacetSDK::PoseDimensionToString, indent);
+}
+
+void TrackFormatter::fetch(FacetSDK::VideoAnalysis& track, TrackData& data) const
+{
+    track.FrameTimes(data.frameTimes);
+    track.IsFacePresent(data.isFacePresent);
+    track.FaceLocations(data.faceLocations);
+    track.DemographicEvidence(FacetSDK::IS_MALE, data.isMale);
+    data.emotions.resize(emotions_.size());
+    for (size_t c = 0; c < emotions_.size(); c++) {
+        track.EmotionEvidence(emotions_.channels[c], data.emotions[c]);
+    }
+    data.actionUnits.resize(actionUnits_.size());
+    for (size_t c = 0; c < actionUnits_.size(); c++) {
+        track.ActionUnitEvidence(actionUnits_.channels[c], data.actionUnits[c]);
+    }
+    data.landmarks.resize(landmarks_.size());
+    for (size_t c = 0; c < landmarks_.size(); c++) {
+        track.LandmarkLocations(landmarks_.channels[c], data.landmarks[c]);
+    }
+    data.poses.resize(poses_.size());
+    for (size_t c = 0; c < poses_.size(); c++) {
+        track.Pose(poses_.channels[c], data.poses[c]);
+    }
+    if (mapping_.identity()) {
+        return;
+    }
+    for (size_t f = 0; f < data.faceLocations.size(); f++) {
+        FacetSDK::Rectangle& location = data.faceLocations[f];
+        location.x = mapping_.x(location.x);
+        location.y = mapping_.y(location.y);
+        location.width = mapping_.width(location.width);
+        location.height = mapping_.height(location.height);
+    }
+    for (size_t c = 0; c < data.landmarks.size(); c++) {
+        for (size_t f = 0; f < data.landmarks[c].size(); f++) {
+            data.landmarks[c][f].x = mapping_.x(data.landmarks[c][f].x);
+            data.landmarks[c][f].y = mapping_.y(data.landmarks[c][f].y);
+        }
+    }
+}
+
+/**
+ * Append one group of channels ("au-evidence", ...) of frame framenum.
+ */
+template <class T>
+void TrackFormatter::formatGroup(std::string& out, const char* name, const ChannelKeys<T>& keys,
+                                 const std::vector< std::vector<float> >& values, size_t framenum)
+{
+    out += FRAME_INDENT;
+    out += "\t\"";
+    out += name;
+    out += "\" : {\n";
+    for (size_t c = 0; c < keys.size(); c++) {
+        out += keys.prefixes[c];
+        appendJsonFloat(out, values[c][framenum]);
+        out += (c + 1 < keys.size()) ? ",\n" : "\n";
+    }
+    out += FRAME_INDENT;
+    out += "\t},\n";
+}
+
+size_t TrackFormatter::format(const TrackData& data, double begin, double end, std::string& out) const
+{
+    const std::string& in(FRAME_INDENT);
+    size_t numFrames(0);
+    for (size_t f = 0; f < data.isFacePresent.size(); f++) {
+        // Frames without the face are not written
+        if (!data.isFacePresent[f] || data.frameTimes[f] < begin || data.frameTimes[f] >= end) {
+            continue;
+        }
+        if (numFrames++ > 0) {
+            out += ",\n";
+        }
+        out += in;
+        out += "{\n";
+
+        formatGroup(out, "au-evidence", actionUnits_, data.actionUnits, f);
+
+        out += in;
+        out += "\t\"demographic-evidence\" : {\n";
+        out += in;
+        out += "\t\t\"isMale\" : ";
+        appendJsonFloat(out, data.isMale[f]);
+        out += "\n";
+        out += in;
+        out += "\t},\n";
+
+        formatGroup(out, "emotion-evidence", emotions_, data.emotions, f);
+
+        const FacetSDK::Rectangle& face(data.faceLocations[f]);
+        out += in;
+        out += "\t\"face-location\" : {\n";
+        out += in;
+        out += "\t\t\"height\" : ";
+        appendJsonFloat(out, face.height);
+        out += ",\n";
+        out += in;
+        out += "\t\t\"width\" : ";
+        appendJsonFloat(out, face.width);
+        out += ",\n";
+        out += in;
+        out += "\t\t\"x\" : ";
+        appendJsonFloat(out, face.x);
+        out += ",\n";
+        out += in;
+        out += "\t\t\"y\" : ";
+        appendJsonFloat(out, face.y);
+        out += "\n";
+        out += in;
+        out += "\t},\n";
+
+        out += in;
+        out += "\t\"landmarks\" : {\n";
+        for (size_t c = 0; c < landmarks_.size(); c++) {
+            const FacetSDK::Point& point(data.landmarks[c][f]);
+            out += landmarks_.prefixes[c];
+            out += "{\n";
+            out += in;
+            out += "\t\t\t\"x\" : ";
+            appendJsonFloat(out, point.x);
+            out += ",\n";
+            out += in;
+            out += "\t\t\t\"y\" : ";
+            appendJsonFloat(out, point.y);
+            out += "\n";
+            out += in;
+            out += (c + 1 < landmarks_.size()) ? "\t\t},\n" : "\t\t}\n";
+        }
+        out += in;
+        out += "\t},\n";
+
+        formatGroup(out, "pose", poses_, data.poses, f);
+
+        out += in;
+        out += "\t\"timestamp\" : ";
+        appendJsonFloat(out, data.frameTimes[f]);
+        out += "\n";
+        out += in;
+        out += "}";
+    }
+    return numFrames;
+}
+
+TrackJsonStream::TrackJsonStream(std::ostream& out)
+: out_(out), numTimes_(0), numTracks_(0), numFrames_(0)
+{
+    out_ << "{\n\t\"output\" : {\n\t\t\"frametimes\" : [";
+}
+
+void TrackJsonStream::frameTime(double time)
+{
+    line_ = (numTimes_++ == 0) ? "\n\t\t\t" : ",\n\t\t\t";
+    appendNumber(line_, time, "%.17g");
+    out_ << line_;
+}
+
+void TrackJsonStream::beginTracks(int width, int height)
+{
+    out_ << (numTimes_ == 0 ? "]" : "\n\t\t]") << ",\n";
+    out_ << "\t\t\"resolution\" : {\n\t\t\t\"height\" : " << height
+         << ",\n\t\t\t\"width\" : " << width << "\n\t\t},\n";
+    out_ << "\t\t\"tracks\" : [";
+}
+
+void TrackJsonStream::beginTrack()
+{
+    out_ << (numTracks_++ == 0 ? "\n" : ",\n") << "\t\t\t{\n\t\t\t\t\"frames\" : [";
+    numFrames_ = 0;
+}
+
+void TrackJsonStream::frames(const char* text, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+    out_ << (numFrames_++ == 0 ? "\n" : ",\n");
+    out_.write(text, size);
+}
+
+void TrackJsonStream::endTrack()
+{
+    out_ << (numFrames_ == 0 ? "]" : "\n\t\t\t\t]") << "\n\t\t\t}";
+}
+
+bool TrackJsonStream::end()
+{
+    out_ << (numTracks_ == 0 ? "]" : "\n\t\t]") << "\n\t}\n}\n";
+    out_.flush();
+    return out_.good();
+}
+
+/**
+ * Formats tracks on worker threads and writes them in order.
+ */
+class TrackJsonWriter {
+public:
+    TrackJsonWriter(std::vector<FacetSDK::VideoAnalysisPtr>& tracks, size_t numThreads)
+    : tracks_(tracks), numThreads_(std::max<size_t>(1, std::min(numThreads, tracks.size()))),
+      window_(2 * numThreads_), next_(0), written_(0),
+      buffers_(tracks.size()), ready_(tracks.size(), 0) {}
+
+    void setMapping(const FrameMapping& mapping) { formatter_.setMapping(mapping); }
+
+    void write(TrackJsonStream& json)
+    {
+        std::vector<Worker*> workers;
+        if (!tracks_.empty()) {
+            for (size_t i = 0; i < numThreads_; i++) {
+                workers.push_back(new Worker(*this));
+                workers.back()->start();
+            }
+        }
+        std::string track;
+        for (size_t i = 0; i < tracks_.size(); i++) {
+            {
+                ScopedLock lock(mutex_);
+                while (!ready_[i]) {
+                    readyCond_.wait(mutex_);
+                }
+                track.swap(buffers_[i]);
+                std::string().swap(buffers_[i]);
+                written_ = i + 1;
+                spaceCond_.broadcast();
+            }
+            json.beginTrack();
+            json.frames(track.data(), track.size());
+            json.endTrack();
+        }
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i]->join();
+            delete workers[i];
+        }
+    }
+
+private:
+    class Worker : public Thread {
+    public:
+        explicit Worker(TrackJsonWriter& owner) : owner_(owner) {}
+    protected:
+        void run() { owner_.work(); }
+    private:
+        TrackJsonWriter& owner_;
+    };
+
+    /**
+     * Worker loop: take the next track (at most window_ ahead of the
+     * writer), fetch and format it.
+     */
+    void work()
+    {
+        TrackData data;
+        std::string text;
+        while (true) {
+            size_t tracknum;
+            {
+                ScopedLock lock(mutex_);
+                while (next_ < tracks_.size() && next_ >= written_ + window_) {
+                    spaceCond_.wait(mutex_);
+                }
+                if (next_ >= tracks_.size()) {
+                    return;
+                }
+                tracknum = next_++;
+            }
+            {
+                // The SDK objects are only read by one thread at a time
+                ScopedLock lock(fetchMutex_);
+                formatter_.fetch(*tracks_[tracknum], data);
+            }
+            text.clear();
+            formatter_.format(data, -std::numeric_limits<double>::infinity(),
+                              std::numeric_limits<double>::infinity(), text);
+            {
+                ScopedLock lock(mutex_);
+                buffers_[tracknum].swap(text);
+                ready_[tracknum] = 1;
+                readyCond_.broadcast();
+            }
+        }
+    }
+
+    std::vector<FacetSDK::VideoAnalysisPtr>& tracks_;
+    TrackFormatter formatter_;
+    size_t numThreads_;
+    size_t window_;                     ///< Tracks formatted ahead of the writer
+
+    Mutex mutex_;
+    Mutex fetchMutex_;
+    Condition readyCond_;
+    Condition spaceCond_;
+    size_t next_;                       ///< Next track to format
+    size_t written_;                    ///< Tracks written so far
+    std::vector<std::string> buffers_;
+    std::vector<char> ready_;
+};
+
+int SerializeTracksToJSON(const std::string& outputFileName,
+                          std::vector<FacetSDK::VideoAnalysisPtr>& tracks,
+                          const std::vector<double>& frameTimes,
+                          int width,
+                          int height,
+                          size_t numThreads,
+                          const FrameMapping& mapping) {
+    std::ofstream fid(outputFileName.c_str());
+    if(!fid){
+        std::cout << "ERROR -- WriteFile could not open JSON file " << outputFileName << std::endl;
+        exit(-1);
+    }
+    TrackJsonStream json(fid);
+    for (size_t i = 0; i < frameTimes.size(); i++) {
+        json.frameTime(frameTimes[i]);
+    }
+    json.beginTracks(width, height);
+    TrackJsonWriter writer(tracks, numThreads);
+    writer.setMapping(mapping);
+    writer.write(json);
+    bool ok = json.end();
+    fid.close();
+    return ok ? 0 : -1;
+}
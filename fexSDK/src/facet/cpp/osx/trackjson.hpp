@@ -0,0 +1,137 @@
+#ifndef TRACKJSON_HPP
+#define TRACKJSON_HPP
+
+#include <algorithm>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <emotient.hpp>
+#include "framemapping.hpp"
+
+/**
+ * Channels of one kind sorted by their JSON key, with the text written
+ * before each value.
+ */
+template <class T>
+struct ChannelKeys {
+    std::vector<T> channels;
+    std::vector<std::string> prefixes;
+
+    template <class ToString>
+    void init(const std::vector<T>& all, ToString toString, const std::string& indent)
+    {
+        std::vector< std::pair<std::string, T> > named;
+        for (size_t i = 0; i < all.size(); i++) {
+            named.push_back(std::make_pair(std::string(toString(all[i])), all[i]));
+        }
+        std::sort(named.begin(), named.end());
+        for (size_t i = 0; i < named.size(); i++) {
+            channels.push_back(named[i].second);
+            prefixes.push_back(indent + "\"" + named[i].first + "\" : ");
+        }
+    }
+    size_t size() const { return channels.size(); }
+};
+
+/**
+ * All values of one track, as one flat array per channel.
+ */
+struct TrackData {
+    std::vector<float> frameTimes;
+    std::vector<bool> isFacePresent;
+    std::vector<EMOTIENT::FacetSDK::Rectangle> faceLocations;
+    std::vector<float> isMale;
+    std::vector< std::vector<float> > emotions;
+    std::vector< std::vector<float> > actionUnits;
+    std::vector< std::vector<EMOTIENT::FacetSDK::Point> > landmarks;
+    std::vector< std::vector<float> > poses;
+};
+
+/**
+ * Formats the frames of a track as the objects of output.tracks[].frames.
+ * Keys are in the (sorted) order jsoncpp writes them, with its layout.
+ */
+class TrackFormatter {
+public:
+    TrackFormatter();
+
+    /**
+     * Copy all channels of track into data.
+     */
+    void fetch(EMOTIENT::FacetSDK::VideoAnalysis& track, TrackData& data) const;
+
+    /**
+     * Map the face locations and landmarks fetched from now on back to the
+     * video frames, when the analyzed frames were scaled or cropped.
+     */
+    void setMapping(const FrameMapping& mapping) { mapping_ = mapping; }
+
+    /**
+     * Append the frames with a face and begin <= timestamp < end, separated
+     * by ",\n". Returns the number of frames appended.
+     */
+    size_t format(const TrackData& data, double begin, double end, std::string& out) const;
+
+private:
+    template <class T>
+    static void formatGroup(std::string& out, const char* name, const ChannelKeys<T>& keys,
+                            const std::vector< std::vector<float> >& values, size_t framenum);
+
+    ChannelKeys<EMOTIENT::FacetSDK::EmotionName> emotions_;
+    ChannelKeys<EMOTIENT::FacetSDK::ActionUnitEnum> actionUnits_;
+    ChannelKeys<EMOTIENT::FacetSDK::LandmarkName> landmarks_;
+    ChannelKeys<EMOTIENT::FacetSDK::PoseDimension> poses_;
+    FrameMapping mapping_;
+};
+
+/**
+ * Writes the JSON document piece by piece, in order:
+ *
+ *   {"output": {"frametimes": [...], "resolution": {"height", "width"},
+ *               "tracks": [{"frames": [...]}, ...]}}
+ *
+ * frameTime() for every frame, then beginTracks(), then for each track
+ * beginTrack(), frames() any number of times and endTrack(), then end().
+ */
+class TrackJsonStream {
+public:
+    explicit TrackJsonStream(std::ostream& out);
+
+    void frameTime(double time);
+    void beginTracks(int width, int height);
+    void beginTrack();
+    /** Append frames formatted by TrackFormatter::format **/
+    void frames(const char* text, size_t size);
+    void endTrack();
+    /** Close the document; returns false if writing failed **/
+    bool end();
+
+private:
+    std::ostream& out_;
+    size_t numTimes_;
+    size_t numTracks_;
+    size_t numFrames_;  ///< frames() calls in the current track
+    std::string line_;
+};
+
+/**
+ * Write the tracks to outputFileName with TrackJsonStream. The document is
+ * streamed: numThreads workers format one track each into a text buffer,
+ * and buffers are written in track order as soon as they are ready, so at
+ * most 2 * numThreads tracks are held in memory.
+ *
+ * Face locations and landmarks are mapped to the video frames, see
+ * TrackFormatter::setMapping.
+ *
+ * Exits the program if the file cannot be opened. Returns 0, or -1 if
+ * writing failed.
+ */
+int SerializeTracksToJSON(const std::string& outputFileName,
+                          std::vector<EMOTIENT::FacetSDK::VideoAnalysisPtr>& tracks,
+                          const std::vector<double>& frameTimes,
+                          int width,
+                          int height,
+                          size_t numThreads,
+                          const FrameMapping& mapping = FrameMapping());
+
+#endif  // TRACKJSON_HPP
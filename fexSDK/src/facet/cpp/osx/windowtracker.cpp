@@ -0,0 +1,580 @@
+#include "windowtracker.hpp"
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <sys/types.h>
+#include <unistd.h>
+#include "checkpoint.hpp"
+#include "config.hpp"
+
+using namespace EMOTIENT;
+
+const double TIME_TOLERANCE = 1e-3;     /**< Frame times closer than this are the same frame **/
+const double MIN_AGREEMENT = 0.5;       /**< Mean IoU over the overlap to continue a track **/
+const double MIN_OVERLAP = 1.0;         /**< Seconds; cuts are inside both windows **/
+const size_t TIMES = std::numeric_limits<size_t>::max();  /**< Track of the spilled frame times **/
+
+int CreateTracker(FacetSDK::SpatialTrackingManagerPtr& tracker, int minSize, int maxThreads)
+{
+    int retVal = FacetSDK::TrackerFactory::GetSpatialTracker(tracker, FACETSDIR, "TrackerConfig.json");
+    if (retVal != FacetSDK::SUCCESS) {
+        return retVal;
+    }
+    // Always enable background subtraction
+    tracker->SetBackgroundModelActive(true);
+    tracker->SetChannelActive(FacetSDK::ACTION_UNITS, true);
+    tracker->SetChannelActive(FacetSDK::LANDMARKS, true);
+    tracker->SetMaxThreads(maxThreads);
+    tracker->SetMinFaceSize(minSize);
+    return FacetSDK::SUCCESS;
+}
+
+WindowedTracker::WindowedTracker(double windowLength, double overlap, int minSize, int maxThreads)
+: windowLength_(windowLength), overlap_(std::min(std::max(overlap, MIN_OVERLAP), windowLength / 2)),
+  minSize_(minSize), maxThreads_(maxThreads), first_(0), end_(0), nextWindow_(0), finished_(0),
+  lastCut_(-std::numeric_limits<double>::infinity()),
+  nextTrack_(0), json_(0), spill_(0), spillSize_(0), checkpointFailed_(false), numFailed_(0), metrics_(0),
+  createStage_(0)
+{
+}
+
+void WindowedTracker::setWindows(size_t first, size_t end)
+{
+    first_ = first;
+    end_ = end;
+    nextWindow_ = std::max(nextWindow_, first);
+    if (finished_ == 0 && windows_.empty()) {
+        // Frames before the cut of the previous window belong to the previous segment
+        lastCut_ = first > 0 ? cut(first - 1) : -std::numeric_limits<double>::infinity();
+    }
+}
+
+size_t WindowedTracker::lastWindow(double time) const
+{
+    return time > 0 ? (size_t)(time / (windowLength_ - overlap_)) : 0;
+}
+
+bool WindowedTracker::isPast(double time) const
+{
+    return end_ > 0 && time >= windowStart(end_ - 1) + windowLength_;
+}
+
+void WindowedTracker::setMetrics(RunMetrics* metrics, size_t createStage)
+{
+    metrics_ = metrics;
+    createStage_ = createStage;
+}
+
+WindowedTracker::~WindowedTracker()
+{
+    delete json_;
+    if (spill_) {
+        fclose(spill_);
+        // Unless a run can resume from it
+        if (checkpointFileName_.empty()) {
+            remove(spillFileName_.c_str());
+        }
+    }
+}
+
+int WindowedTracker::open(const std::string& outputFileName)
+{
+    output_.open(outputFileName.c_str());
+    if (!output_) {
+        std::cout << "ERROR -- could not open JSON file " << outputFileName << std::endl;
+        return -1;
+    }
+    spillFileName_ = outputFileName + ".tmp";
+    spill_ = fopen(spillFileName_.c_str(), "w+b");
+    if (spill_ == 0) {
+        std::cout << "ERROR -- could not open " << spillFileName_ << std::endl;
+        return -1;
+    }
+    json_ = new TrackJsonStream(output_);
+    return 0;
+}
+
+void WindowedTracker::setCheckpoint(const std::string& outputFileName, const std::string& input)
+{
+    input_ = input;
+    checkpointFileName_ = outputFileName + CHECKPOINT_EXT;
+    remove(checkpointFileName_.c_str());
+}
+
+int WindowedTracker::resume(const std::string& outputFileName, const std::string& input, size_t& first)
+{
+    input_ = input;
+    checkpointFileName_ = outputFileName + CHECKPOINT_EXT;
+    if (!loadCheckpoint(first)) {
+        checkpointFileName_.clear();
+        return -1;
+    }
+    // The spill file is cut after the frames of the finished windows
+    spillFileName_ = outputFileName + ".tmp";
+    if (!truncateFile(spillFileName_, spillSize_) || (spill_ = fopen(spillFileName_.c_str(), "r+b")) == 0 ||
+        fseeko(spill_, 0, SEEK_END) != 0 || ftello(spill_) != (off_t)spillSize_) {
+        std::cout << "ERROR -- could not reopen " << spillFileName_ << std::endl;
+        return -1;
+    }
+    output_.open(outputFileName.c_str());
+    if (!output_) {
+        std::cout << "ERROR -- could not open JSON file " << outputFileName << std::endl;
+        return -1;
+    }
+    json_ = new TrackJsonStream(output_);
+    setWindows(first, 0);
+    return 0;
+}
+
+/**
+ * Sync the spill file, then replace the checkpoint: the windows before the
+ * first open one are finished and spilled.
+ */
+bool WindowedTracker::saveCheckpoint()
+{
+    if (fflush(spill_) != 0 || fsync(fileno(spill_)) != 0) {
+        return false;
+    }
+    std::ostringstream text;
+    text.precision(17);
+    text << "input\t" << input_ << "\n";
+    text << "window\t" << windowLength_ << "\n";
+    text << "overlap\t" << overlap_ << "\n";
+    text << "first\t" << (windows_.empty() ? nextWindow_ : windows_.front().index) << "\n";
+    text << "spill\t" << spillSize_ << "\n";
+    text << "tracks\t" << nextTrack_ << "\n";
+    text << "finished\t" << finished_ << "\n";
+    text << "cut\t" << lastCut_ << "\n";
+    for (size_t s = 0; s < segments_.size(); s++) {
+        text << "segment\t" << segments_[s].track << ' ' << segments_[s].offset << ' ' << segments_[s].size << "\n";
+    }
+    // Boxes the tracks of the next window are stitched to
+    const std::vector<OverlapBoxes>* boxes[2] = { &previous_, &firstFront_ };
+    const char* keys[2] = { "previous", "front" };
+    for (size_t b = 0; b < 2; b++) {
+        for (size_t i = 0; i < boxes[b]->size(); i++) {
+            const OverlapBoxes& track((*boxes[b])[i]);
+            text << keys[b] << '\t' << track.track << ' ' << track.times.size();
+            for (size_t f = 0; f < track.times.size(); f++) {
+                const FacetSDK::Rectangle& r(track.faces[f]);
+                text << ' ' << track.times[f] << ' ' << r.x << ' ' << r.y << ' ' << r.width << ' ' << r.height;
+            }
+            text << "\n";
+        }
+    }
+    return replaceFile(checkpointFileName_, text.str(), true);
+}
+
+/**
+ * Restore the state saved by saveCheckpoint() for the same input and
+ * windows; first is the window to go on from.
+ */
+bool WindowedTracker::loadCheckpoint(size_t& first)
+{
+    std::ifstream file(checkpointFileName_.c_str());
+    std::string line, input;
+    double windowLength(0), overlap(0), lastCut(0);
+    long long spillSize(-1);
+    size_t nextTrack(0), finished(0);
+    std::vector<Segment> segments;
+    std::vector<OverlapBoxes> previous, firstFront;
+    while (std::getline(file, line)) {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos) {
+            continue;
+        }
+        std::string key(line.substr(0, tab));
+        std::istringstream value(line.substr(tab + 1));
+        if (key == "input") {
+            input = line.substr(tab + 1);
+        } else if (key == "window") {
+            value >> windowLength;
+        } else if (key == "overlap") {
+            value >> overlap;
+        } else if (key == "first") {
+            value >> first;
+        } else if (key == "spill") {
+            value >> spillSize;
+        } else if (key == "tracks") {
+            value >> nextTrack;
+        } else if (key == "finished") {
+            value >> finished;
+        } else if (key == "cut") {
+            value >> lastCut;
+        } else if (key == "segment") {
+            Segment segment;
+            value >> segment.track >> segment.offset >> segment.size;
+            segments.push_back(segment);
+        } else if (key == "previous" || key == "front") {
+            OverlapBoxes track;
+            size_t count(0);
+            value >> track.track >> count;
+            for (size_t f = 0; f < count && value; f++) {
+                float time;
+                FacetSDK::Rectangle r;
+                value >> time >> r.x >> r.y >> r.width >> r.height;
+                track.times.push_back(time);
+                track.faces.push_back(r);
+            }
+            (key == "previous" ? previous : firstFront).push_back(track);
+        }
+        if (!value) {
+            return false;
+        }
+    }
+    if (input != input_ || windowLength != windowLength_ || overlap != overlap_ || spillSize < 0 || finished == 0) {
+        return false;
+    }
+    spillSize_ = spillSize;
+    nextTrack_ = nextTrack;
+    finished_ = finished;
+    lastCut_ = lastCut;
+    segments_.swap(segments);
+    previous_.swap(previous);
+    firstFront_.swap(firstFront);
+    return true;
+}
+
+int WindowedTracker::openSegment(const std::string& spillFileName)
+{
+    spillFileName_ = spillFileName;
+    spill_ = fopen(spillFileName_.c_str(), "w+b");
+    if (spill_ == 0) {
+        std::cout << "ERROR -- could not open " << spillFileName_ << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int WindowedTracker::addFrame(const cv::Mat& grayFrame, double time)
+{
+    int retVal(FacetSDK::SUCCESS);
+    if ((first_ > 0 && time < windowStart(first_)) || isPast(time)) {
+        return retVal;
+    }
+    bool finished(false);
+    while (!windows_.empty() && time >= windows_.front().end) {
+        if ((retVal = finishWindow(false)) != FacetSDK::SUCCESS) {
+            return retVal;
+        }
+        finished = true;
+    }
+    if (finished && !checkpointFileName_.empty() && !saveCheckpoint() && !checkpointFailed_) {
+        std::cout << "Could not write the checkpoint " << checkpointFileName_ << std::endl;
+        checkpointFailed_ = true;
+    }
+    // Windows without frames (gaps in the video) are never opened
+    while (windowStart(nextWindow_) + windowLength_ <= time) {
+        nextWindow_++;
+    }
+    while (windowStart(nextWindow_) <= time && (end_ == 0 || nextWindow_ < end_)) {
+        Window window;
+        window.index = nextWindow_;
+        window.start = windowStart(nextWindow_);
+        window.end = window.start + windowLength_;
+        if ((retVal = CreateTracker(window.tracker, minSize_, maxThreads_)) != FacetSDK::SUCCESS) {
+            std::cout << "Could not load tracker params" << std::endl;
+            return retVal;
+        }
+        windows_.push_back(window);
+        nextWindow_++;
+    }
+    // Every window gets the frame, even if another one could not add it
+    for (size_t i = 0; i < windows_.size(); i++) {
+        int addVal = windows_[i].tracker->AddFrame(grayFrame.data, grayFrame.rows, grayFrame.cols,
+                                                   FacetSDK::TrackerMetaData(time));
+        if (addVal != FacetSDK::SUCCESS && retVal == FacetSDK::SUCCESS) {
+            retVal = addVal;
+        }
+    }
+    if (retVal != FacetSDK::SUCCESS) {
+        numFailed_++;
+    }
+    // Frames in the overlaps with the previous and next segments belong to one of them
+    if ((first_ == 0 || time >= cut(first_ - 1)) && (end_ == 0 || time < cut(end_ - 1))) {
+        times_.push_back(time);
+    }
+    return retVal;
+}
+
+/**
+ * Boxes of the frames with a face and begin <= time < end.
+ */
+void WindowedTracker::overlapBoxes(const TrackData& data, double begin, double end, OverlapBoxes& boxes)
+{
+    boxes.times.clear();
+    boxes.faces.clear();
+    for (size_t f = 0; f < data.isFacePresent.size(); f++) {
+        if (data.isFacePresent[f] && data.frameTimes[f] >= begin && data.frameTimes[f] < end) {
+            boxes.times.push_back(data.frameTimes[f]);
+            boxes.faces.push_back(data.faceLocations[f]);
+        }
+    }
+}
+
+/**
+ * Sum of the IoU of the boxes at the same times, over the number of
+ * frames where either track has a face.
+ */
+double WindowedTracker::agreement(const OverlapBoxes& a, const OverlapBoxes& b)
+{
+    double sum(0);
+    size_t i(0), j(0), frames(0);
+    while (i < a.times.size() || j < b.times.size()) {
+        frames++;
+        if (j == b.times.size() || (i < a.times.size() && a.times[i] < b.times[j] - TIME_TOLERANCE)) {
+            i++;
+        } else if (i == a.times.size() || b.times[j] < a.times[i] - TIME_TOLERANCE) {
+            j++;
+        } else {
+            const FacetSDK::Rectangle& r(a.faces[i]);
+            const FacetSDK::Rectangle& s(b.faces[j]);
+            double w = std::min(r.x + r.width, s.x + s.width) - std::max(r.x, s.x);
+            double h = std::min(r.y + r.height, s.y + s.height) - std::max(r.y, s.y);
+            if (w > 0 && h > 0) {
+                double intersection = w * h;
+                sum += intersection / (r.width * r.height + s.width * s.height - intersection);
+            }
+            i++;
+            j++;
+        }
+    }
+    return frames > 0 ? sum / frames : 0;
+}
+
+/**
+ * Global track of each track of the window: the best agreeing track of the
+ * previous window (one to one, best pairs first), or a new track.
+ */
+std::vector<size_t> WindowedTracker::stitch(const std::vector<OverlapBoxes>& front)
+{
+    std::vector< std::pair<double, std::pair<size_t, size_t> > > pairs;
+    for (size_t i = 0; i < front.size(); i++) {
+        for (size_t j = 0; j < previous_.size(); j++) {
+            double score = agreement(front[i], previous_[j]);
+            if (score >= MIN_AGREEMENT) {
+                pairs.push_back(std::make_pair(-score, std::make_pair(i, j)));
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    const size_t NONE = std::numeric_limits<size_t>::max();
+    std::vector<size_t> ids(front.size(), NONE);
+    std::vector<bool> taken(previous_.size(), false);
+    for (size_t k = 0; k < pairs.size(); k++) {
+        size_t i = pairs[k].second.first, j = pairs[k].second.second;
+        if (ids[i] == NONE && !taken[j]) {
+            ids[i] = previous_[j].track;
+            taken[j] = true;
+        }
+    }
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (ids[i] == NONE) {
+            ids[i] = nextTrack_++;
+        }
+    }
+    return ids;
+}
+
+/**
+ * Spill the frame times before end as one segment of doubles.
+ */
+int WindowedTracker::spillTimes(double end)
+{
+    size_t count(0);
+    while (count < times_.size() && times_[count] < end) {
+        count++;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    Segment segment;
+    segment.track = TIMES;
+    segment.offset = spillSize_;
+    segment.size = count * sizeof(double);
+    if (fwrite(&times_[0], 1, segment.size, spill_) != segment.size) {
+        std::cout << "ERROR -- could not write " << spillFileName_ << std::endl;
+        return -1;
+    }
+    spillSize_ += segment.size;
+    segments_.push_back(segment);
+    times_.erase(times_.begin(), times_.begin() + count);
+    return 0;
+}
+
+bool WindowedTracker::readSpill(const Segment& segment, std::vector<char>& buffer)
+{
+    buffer.resize(segment.size);
+    if (fseeko(spill_, (off_t)segment.offset, SEEK_SET) != 0 ||
+        fread(&buffer[0], 1, segment.size, spill_) != segment.size) {
+        std::cout << "ERROR -- could not read " << spillFileName_ << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Create the tracks of the oldest window, spill its frames up to its cut
+ * and release its tracker.
+ */
+int WindowedTracker::finishWindow(bool last)
+{
+    Window& window(windows_.front());
+    std::vector<FacetSDK::VideoAnalysisPtr> tracks;
+    MetricsTimer timer(metrics_, createStage_);
+    int retVal = window.tracker->CreateTracks(tracks);
+    timer.stop();
+    if (retVal != FacetSDK::SUCCESS) {
+        std::cerr << "Tracker failed to CreateTracks with error code " << retVal << std::endl;
+        return retVal;
+    }
+    double cutBegin = lastCut_;
+    double cutEnd = last ? std::numeric_limits<double>::infinity() : cut(window.index);
+
+    std::vector<OverlapBoxes> front(tracks.size()), back(tracks.size());
+    size_t firstSegment = segments_.size();
+    TrackData data;
+    std::string text;
+    for (size_t i = 0; i < tracks.size(); i++) {
+        formatter_.fetch(*tracks[i], data);
+        overlapBoxes(data, window.start, window.start + overlap_, front[i]);
+        overlapBoxes(data, window.end - overlap_, window.end, back[i]);
+        text.clear();
+        if (formatter_.format(data, cutBegin, cutEnd, text) > 0) {
+            Segment segment;
+            segment.track = i;
+            segment.offset = spillSize_;
+            segment.size = text.size();
+            if (fwrite(text.data(), 1, text.size(), spill_) != text.size()) {
+                std::cout << "ERROR -- could not write " << spillFileName_ << std::endl;
+                return -1;
+            }
+            spillSize_ += text.size();
+            segments_.push_back(segment);
+        }
+    }
+
+    std::vector<size_t> ids = stitch(front);
+    for (size_t s = firstSegment; s < segments_.size(); s++) {
+        segments_[s].track = ids[segments_[s].track];
+    }
+    for (size_t i = 0; i < back.size(); i++) {
+        back[i].track = ids[i];
+    }
+    if (spillTimes(cutEnd) != 0) {
+        return -1;
+    }
+    if (finished_++ == 0) {
+        firstFront_ = front;
+    }
+    previous_.swap(back);
+    lastCut_ = cutEnd;
+    windows_.pop_front();
+    return FacetSDK::SUCCESS;
+}
+
+int WindowedTracker::finishWindows()
+{
+    int retVal(FacetSDK::SUCCESS);
+    while (!windows_.empty()) {
+        // Only the last window of the video keeps the frames up to its end
+        if ((retVal = finishWindow(end_ == 0 && windows_.size() == 1)) != FacetSDK::SUCCESS) {
+            return retVal;
+        }
+    }
+    // Frames of windows that were never finished
+    return spillTimes(std::numeric_limits<double>::infinity()) == 0 ? retVal : -1;
+}
+
+int WindowedTracker::append(WindowedTracker& next)
+{
+    // The tracks of the first window of next continue ours as across two
+    // windows, and take new track numbers in the same order; the tracks
+    // created later in next are numbered after them.
+    std::vector<size_t> ids = stitch(next.firstFront_);
+    for (size_t t = ids.size(); t < next.nextTrack_; t++) {
+        ids.push_back(nextTrack_++);
+    }
+
+    std::vector<char> buffer;
+    for (size_t s = 0; s < next.segments_.size(); s++) {
+        Segment segment(next.segments_[s]);
+        if (!next.readSpill(segment, buffer)) {
+            return -1;
+        }
+        if (fwrite(&buffer[0], 1, segment.size, spill_) != segment.size) {
+            std::cout << "ERROR -- could not write " << spillFileName_ << std::endl;
+            return -1;
+        }
+        if (segment.track != TIMES) {
+            segment.track = ids[segment.track];
+        }
+        segment.offset = spillSize_;
+        spillSize_ += segment.size;
+        segments_.push_back(segment);
+    }
+
+    // A segment without frames leaves the ending overlap of the previous one
+    if (next.finished_ > 0) {
+        previous_ = next.previous_;
+        for (size_t i = 0; i < previous_.size(); i++) {
+            previous_[i].track = ids[previous_[i].track];
+        }
+        lastCut_ = next.lastCut_;
+        finished_ += next.finished_;
+    }
+    end_ = next.end_;
+    nextWindow_ = std::max(nextWindow_, next.nextWindow_);
+    return 0;
+}
+
+int WindowedTracker::finish(int width, int height)
+{
+    int retVal = finishWindows();
+    if (retVal != FacetSDK::SUCCESS) {
+        return retVal;
+    }
+    fflush(spill_);
+
+    // Frame times in spill order, then the segments by track, in time order
+    std::vector<char> buffer;
+    std::vector< std::pair<size_t, size_t> > order;
+    for (size_t s = 0; s < segments_.size(); s++) {
+        if (segments_[s].track != TIMES) {
+            order.push_back(std::make_pair(segments_[s].track, s));
+            continue;
+        }
+        if (!readSpill(segments_[s], buffer)) {
+            return -1;
+        }
+        const double* times = reinterpret_cast<const double*>(&buffer[0]);
+        for (size_t f = 0; f < buffer.size() / sizeof(double); f++) {
+            json_->frameTime(times[f]);
+        }
+    }
+    std::sort(order.begin(), order.end());
+
+    json_->beginTracks(width, height);
+    for (size_t k = 0; k < order.size(); k++) {
+        const Segment& segment(segments_[order[k].second]);
+        if (k == 0 || order[k - 1].first != segment.track) {
+            json_->beginTrack();
+        }
+        if (!readSpill(segment, buffer)) {
+            return -1;
+        }
+        json_->frames(&buffer[0], buffer.size());
+        if (k + 1 == order.size() || order[k + 1].first != segment.track) {
+            json_->endTrack();
+        }
+    }
+    bool ok = json_->end();
+    output_.close();
+    if (ok && !checkpointFileName_.empty()) {
+        // Complete: the spill file goes with the checkpoint
+        remove(checkpointFileName_.c_str());
+        checkpointFileName_.clear();
+    }
+    return ok ? FacetSDK::SUCCESS : -1;
+}
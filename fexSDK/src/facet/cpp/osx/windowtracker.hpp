@@ -0,0 +1,209 @@
+#ifndef WINDOWTRACKER_HPP
+#define WINDOWTRACKER_HPP
+
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <emotient.hpp>
+#include "runmetrics.hpp"
+#include "trackjson.hpp"
+
+/**
+ * Load the tracker parameters and configure a tracker as fexfacetexec
+ * uses it, with at most maxThreads threads. Returns the FacetSDK error code.
+ */
+int CreateTracker(EMOTIENT::FacetSDK::SpatialTrackingManagerPtr& tracker, int minSize, int maxThreads);
+
+/**
+ * Tracks a video over fixed-length, overlapping time windows, so memory
+ * depends on the window length instead of the video length.
+ *
+ * Window k covers [k * step, k * step + windowLength), step = windowLength
+ * - overlap, and has its own tracker: at most two trackers are alive. When
+ * a window ends its tracks are created, and each frame is kept from the
+ * window whose cut it falls in (cuts are in the middle of the overlaps).
+ * A track continues a track of the previous window when their face boxes
+ * agree over the overlap (mean intersection over union), so identities
+ * carry across windows.
+ *
+ * The frames and frame times of finished windows are formatted and
+ * spilled to OUTPUTNAME.tmp; finish() writes the JSON file (same format as
+ * SerializeTracksToJSON) by gathering the frames of each track from it.
+ *
+ * With setCheckpoint(), the spill file is synced after each finished
+ * window and the state needed to go on is saved to OUTPUTNAME.ckpt: an
+ * interrupted run can resume() from the first window still open, by
+ * decoding from its start again.
+ *
+ * A video can also be split into segments of consecutive windows tracked
+ * in parallel (setWindows()): each segment decodes from the start of its
+ * first window, and append() stitches the tracks of a segment to those of
+ * the previous one as across two windows. The JSON file is then the same
+ * as when a single tracker sees the whole video.
+ */
+class WindowedTracker {
+public:
+    /**
+     * \param windowLength window length in seconds
+     * \param overlap overlap of consecutive windows in seconds, between 1 and windowLength / 2
+     * \param minSize minimum face size of the trackers
+     * \param maxThreads maximum number of threads of each tracker
+     */
+    WindowedTracker(double windowLength, double overlap, int minSize, int maxThreads);
+    ~WindowedTracker();
+
+    /**
+     * Record the CreateTracks() time of each window in stage createStage of metrics.
+     */
+    void setMetrics(RunMetrics* metrics, size_t createStage);
+
+    /**
+     * Track only windows first to end - 1 (end 0: up to the end of the
+     * video); frames outside them are ignored. end may be lowered while
+     * tracking, but not to a window that is already open.
+     */
+    void setWindows(size_t first, size_t end);
+
+    /** Start time of window index **/
+    double windowStart(size_t index) const { return index * (windowLength_ - overlap_); }
+    /** Index of the last window that starts at or before time **/
+    size_t lastWindow(double time) const;
+    /** True if time is after the windows of setWindows(): later frames are ignored **/
+    bool isPast(double time) const;
+
+    /**
+     * Map the face locations and landmarks of the frames added from now on
+     * back to the video frames, when they are scaled or cropped.
+     */
+    void setMapping(const FrameMapping& mapping) { formatter_.setMapping(mapping); }
+
+    /**
+     * Open the output and spill files. Returns 0, or -1 on error.
+     */
+    int open(const std::string& outputFileName);
+
+    /**
+     * Once open(), save a checkpoint of the tracking of input to
+     * outputFileName.ckpt after each finished window. Removes the
+     * checkpoint of an earlier run.
+     */
+    void setCheckpoint(const std::string& outputFileName, const std::string& input);
+
+    /**
+     * Open the output and the spill file of an interrupted run of input,
+     * as its checkpoint left them, and go on checkpointing. The frames of
+     * the video must be added again from windowStart(first). Returns 0, or
+     * -1 if there is no usable checkpoint (the tracker is then unusable).
+     */
+    int resume(const std::string& outputFileName, const std::string& input, size_t& first);
+
+    /**
+     * Open only a spill file, for a segment whose tracks are append()ed to
+     * the tracker of the previous segment. Returns 0, or -1 on error.
+     */
+    int openSegment(const std::string& spillFileName);
+
+    /**
+     * Track a grayscale frame at time (seconds, increasing). Windows that
+     * end before time are finished first. Returns the FacetSDK error code:
+     * of finishing or opening a window (the frame is then not added), or
+     * the first error of the window trackers adding the frame, which is
+     * counted by numFailed() and still added to the other windows.
+     */
+    int addFrame(const cv::Mat& grayFrame, double time);
+
+    /** Frames that a window tracker could not add **/
+    size_t numFailed() const { return numFailed_; }
+
+    /**
+     * Finish the open windows. Returns the FacetSDK error code, or -1 if
+     * spilling failed.
+     */
+    int finishWindows();
+
+    /**
+     * Append the tracks and frame times of next, the segment that follows
+     * the windows of this one, once both are finishWindows()ed. Returns 0,
+     * or -1 if copying the spilled frames failed.
+     */
+    int append(WindowedTracker& next);
+
+    /**
+     * Finish the open windows and write the tracks. Returns the FacetSDK
+     * error code, or -1 if writing failed.
+     */
+    int finish(int width, int height);
+
+private:
+    WindowedTracker(const WindowedTracker&);
+    WindowedTracker& operator=(const WindowedTracker&);
+
+    struct Window {
+        size_t index;
+        double start;
+        double end;
+        EMOTIENT::FacetSDK::SpatialTrackingManagerPtr tracker;
+    };
+
+    /** Face boxes of a track in an overlap, by time **/
+    struct OverlapBoxes {
+        size_t track;
+        std::vector<float> times;
+        std::vector<EMOTIENT::FacetSDK::Rectangle> faces;
+    };
+
+    /** Spilled frames of a track, or frame times (track TIMES) **/
+    struct Segment {
+        size_t track;
+        long long offset;
+        size_t size;
+    };
+
+    int finishWindow(bool last);
+    /** End of the frames kept from window index (the middle of its ending overlap) **/
+    double cut(size_t index) const { return windowStart(index) + windowLength_ - overlap_ / 2; }
+    int spillTimes(double end);
+    bool readSpill(const Segment& segment, std::vector<char>& buffer);
+    bool saveCheckpoint();
+    bool loadCheckpoint(size_t& first);
+    static void overlapBoxes(const TrackData& data, double begin, double end, OverlapBoxes& boxes);
+    static double agreement(const OverlapBoxes& a, const OverlapBoxes& b);
+    std::vector<size_t> stitch(const std::vector<OverlapBoxes>& front);
+
+    double windowLength_;
+    double overlap_;
+    int minSize_;
+    int maxThreads_;
+    size_t first_;                      ///< First window tracked
+    size_t end_;                        ///< End of the windows tracked, 0 for no limit
+    std::deque<Window> windows_;
+    size_t nextWindow_;                 ///< Index of the next window to open
+    size_t finished_;                   ///< Number of windows finished
+    double lastCut_;                    ///< End of the frames kept so far
+
+    TrackFormatter formatter_;
+    std::vector<OverlapBoxes> previous_;  ///< Tracks of the last finished window in its ending overlap
+    std::vector<OverlapBoxes> firstFront_; ///< Tracks of the first finished window in its starting overlap
+    size_t nextTrack_;                  ///< Next global track number
+
+    std::ofstream output_;
+    TrackJsonStream* json_;             ///< Null for a segment
+    std::vector<double> times_;         ///< Frame times not spilled yet
+    std::string spillFileName_;
+    FILE* spill_;
+    long long spillSize_;
+    std::vector<Segment> segments_;
+
+    std::string input_;
+    std::string checkpointFileName_;    ///< Empty without checkpoints
+    bool checkpointFailed_;
+    size_t numFailed_;
+
+    RunMetrics* metrics_;               ///< Null when not measured
+    size_t createStage_;
+};
+
+#endif  // WINDOWTRACKER_HPP
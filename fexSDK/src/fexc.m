@@ -2067,6 +2067,18 @@ for k = 1:length(self)
 fprintf('Correcting fexc %d/%d for motion artifacts.\n',k,length(self));
 % Get Pose info
 X = self(k).get('pose','double');
+% All channels at once with the compiled fex_motioncorrectmex, see
+% fex_motioncorrectmex.cpp
+if exist('fex_motioncorrectmex','file') == 3
+    whiten = any(strcmpi(args.normalize,{'-whiten','whiten'}));
+    R = fex_motioncorrectmex(double(self(k).functional),X(:,1:3),args.thrs,whiten);
+    self(k).update('functional',R);
+    if ~isempty(self(k).sentiments)
+        self(k).derivesentiments();
+    end
+    waitbar(k/length(self),h);
+    continue
+end
 ind  = ~isnan(sum(double(self(k).functional),2)) & ~isnan(sum(X,2));
 Y = double(self(k).functional(ind,:));
 
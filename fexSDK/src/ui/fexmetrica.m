@@ -303,6 +303,7 @@ handles.args.data = '';
 [filename,pathname] = uigetfile({'*.mat','fexc Object (*.mat)';
                                  '*.csv;*.txt;','Text File (*.csv, *.txt)'; ...
                                  '*.json','Json file';...
+                                 '*.fexb','Binary FACET file';...
                                  '*.mov;*.avi;*.mp4','Video File'},'Select a file');
                               
 handles.file_list = sprintf('%s%s',pathname,filename);
@@ -162,8 +162,13 @@ filt_kr.amplitude = [hz(:),amp(1:length(hz))'];
 fi_idx = dsearchn(hz',dfi');
 filt_kr.sse  = sum((ifi - amp(fi_idx)./max(filt_kr.amplitude(:,2))).^2); 
 
-% Apply filter to the data
-filt_ts.real = filtfilt(filt_kr.kernel,1,data);
+% Apply filter to the data (all columns at once with the compiled
+% fex_filtfiltmex, see fex_filtfiltmex.cpp)
+if exist('fex_filtfiltmex','file') == 3
+    filt_ts.real = fex_filtfiltmex(filt_kr.kernel,data);
+else
+    filt_ts.real = filtfilt(filt_kr.kernel,1,data);
+end
 % Get the analytic signal
 % Note that real(hilbert(filt_ts)) = filt_ts. You can use the hilber
 % transform to obtain inst. estimate of power, and of fase angle.
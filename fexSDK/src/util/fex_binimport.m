@@ -0,0 +1,131 @@
+function [data,info] = fex_binimport(binfile,channels)
+%
+%
+% FEX_BINIMPORT - imports binary columnar files from the FACET drivers.
+%
+% FEX_BINIMPORT reads the .fexb files written by fexfacet and fexfacet_full
+% (option -o FILE.fexb). The file is memory mapped, and only the columns
+% requested are read from disk.
+%
+% SYNTAX:
+%
+% DATA = FEX_BINIMPORT(BINFILE)
+% DATA = FEX_BINIMPORT(BINFILE,CHANNELS)
+% [DATA,INFO] = FEX_BINIMPORT(...)
+%
+% INPUT:
+%
+% BINFILE - a path to a .fexb file.
+% CHANNELS - [OPTIONAL] a cell with the names of the channels to import
+%   (e.g. {'FrameNumber','joy','AU12'}). Default: all channels.
+%
+% OUTPUT:
+%
+% DATA - a dataset with one variable per channel, and one row per frame.
+%   Frames without a face are NaN.
+% INFO - a structure with fields:
+%
+%   Class - channel classes (as in fexchannels.txt, plus 'frame');
+%   Name - channel names;
+%   NumFrames - number of frames in the file;
+%   IsFace - logical vector, true for the frames with a face;
+%   read - handle to a function reading one more column lazily:
+%
+%        >> x = info.read('anger');
+%
+% FILE LAYOUT:
+%
+% A 64 bytes header ('FEXB', version, data offset, number of channels,
+% frames per block, reserved, number of frames), one 64 bytes record per
+% channel (16 chars class, 48 chars name), then blocks of frames. Each
+% block holds a face-present bitmap and one single precision column per
+% channel. See fexbinary.hpp.
+%
+% See also FEXGENC, FEX_IMPUTIL, FEX_JSONPARSER.
+%
+%
+%
+% Copyright (c) - 2014 - 2015 Filippo Rossi, Institute for Neural Computation,
+% University of California, San Diego. email: frossi@ucsd.edu
+%
+% VERSION: 1.0.1 10-Jan-2015.
+
+
+if ~exist('binfile','var')
+    error('Not enough input argument.')
+elseif ~exist(binfile,'file')
+    error('I couldnt find the .fexb file.')
+end
+
+% Read the header
+hdr = memmapfile(binfile,'Format',{'uint8',[1 4],'magic';...
+    'uint32',[1 1],'version';'uint32',[1 1],'dataOffset';...
+    'uint32',[1 1],'numChannels';'uint32',[1 1],'blockFrames';...
+    'uint32',[1 1],'reserved';'uint64',[1 1],'numFrames'},'Repeat',1);
+h = hdr.Data;
+if ~strcmp(char(h.magic),'FEXB')
+    error('%s is not a .fexb file.',binfile);
+end
+nc = double(h.numChannels);
+B  = double(h.blockFrames);
+
+% Read the channel schema
+schema = memmapfile(binfile,'Offset',64,'Format',...
+    {'uint8',[1 16],'class';'uint8',[1 48],'name'},'Repeat',nc);
+info.Class = arrayfun(@(s) char(s.class(s.class > 0)),schema.Data,'UniformOutput',false);
+info.Name  = arrayfun(@(s) char(s.name(s.name > 0)),schema.Data,'UniformOutput',false);
+
+% Block geometry, in 4 bytes words: bitmap, then nc columns of B values
+bitmapWords = B/32;
+blockWords  = bitmapWords + nc*B;
+d = dir(binfile);
+numBlocks = floor((d.bytes - double(h.dataOffset))/(4*blockWords));
+info.NumFrames = min(double(h.numFrames),numBlocks*B);
+if h.numFrames == 0 && numBlocks > 0
+% The writer did not close the file: use the complete blocks
+    warning('%s was not closed: reading %d complete blocks.',binfile,numBlocks);
+    info.NumFrames = numBlocks*B;
+end
+n  = info.NumFrames;
+nb = ceil(n/B);
+
+% Map the data: columns are read only when indexed
+vals  = memmapfile(binfile,'Offset',double(h.dataOffset),'Format','single');
+bytes = memmapfile(binfile,'Offset',double(h.dataOffset),'Format','uint8');
+
+% Face-present bitmap: bit k of byte j is frame 8j + k
+idx = bsxfun(@plus,(1:B/8)',(0:nb-1)*blockWords*4);
+bits = bsxfun(@bitget,double(bytes.Data(idx(:))),1:8)';
+info.IsFace = logical(reshape(bits(1:n),[],1));
+
+info.read = @(name) readcolumn(vals,channelindex(info.Name,name),B,bitmapWords,blockWords,n);
+
+% Select the channels
+if ~exist('channels','var') || isempty(channels)
+    channels = info.Name;
+end
+channels = cellstr(channels);
+X = nan(n,length(channels));
+for k = 1:length(channels)
+    X(:,k) = info.read(channels{k});
+end
+data = mat2dataset(X,'VarNames',genvarname(channels(:)'));
+
+end
+
+
+function c = channelindex(names,name)
+% Index of a channel in the schema
+c = find(strcmp(names,name),1,'first');
+if isempty(c)
+    error('Channel "%s" not found.',name);
+end
+end
+
+
+function x = readcolumn(vals,c,B,bitmapWords,blockWords,n)
+% Column C across blocks; the memory map only reads the indexed values
+nb  = ceil(n/B);
+idx = bsxfun(@plus,(1:B)',bitmapWords + (c-1)*B + (0:nb-1)*blockWords);
+x   = double(vals.Data(reshape(idx(1:n),[],1)));
+end
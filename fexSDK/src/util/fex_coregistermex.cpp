@@ -0,0 +1,112 @@
+/*
+ * FEX_COREGISTERMEX - Procrustes coregistration of the faces of a session.
+ *
+ * Usage:
+ *
+ *   [Y,P,M,R] = fex_coregistermex(LL)
+ *   [Y,P,M,R] = fex_coregistermex(LL,SCALING,REFLECTION,ITERATIONS,THREADS)
+ *
+ * LL is the K*2*N array of points of FEX_REALLIGN (face box corners and
+ * landmarks of N frames). Each frame is aligned to the mean shape M (K*2)
+ * as procrustes(M,LL(:,:,i),'scaling',SCALING,'reflection',REFLECTION)
+ * would: Y (N*2K) holds the aligned points, x and y interleaved, P (N*7)
+ * the parameters [b,T(:)',c(1,:)] and R (N*1) the error d. Frames with
+ * NaNs are NaN and are left out of M.
+ *
+ * SCALING defaults to true, REFLECTION to false. With ITERATIONS > 1 (the
+ * default is 1, as FEX_REALLIGN), M is refined as the mean of the aligned
+ * frames until it converges. THREADS defaults to the number of CPUs. The
+ * native kernel is facet/cpp/common/coregister.hpp; FEX_REALLIGN uses it
+ * when it is compiled:
+ *
+ *   mex -I../facet/cpp/common fex_coregistermex.cpp ../facet/cpp/common/coregister.cpp
+ *
+ * See also FEX_REALLIGN, PROCRUSTES.
+ */
+
+#include <unistd.h>
+#include <vector>
+#include "mex.h"
+#include "coregister.hpp"
+
+/**
+ * Optional logical or numeric scalar argument i.
+ */
+static double scalarArg(int nrhs, const mxArray* prhs[], int i, double fallback)
+{
+    if (nrhs <= i || mxIsEmpty(prhs[i])) {
+        return fallback;
+    }
+    if (!(mxIsNumeric(prhs[i]) || mxIsLogical(prhs[i])) || mxGetNumberOfElements(prhs[i]) != 1) {
+        mexErrMsgIdAndTxt("fex:coregistermex", "SCALING, REFLECTION, ITERATIONS and THREADS must be scalars.");
+    }
+    return mxGetScalar(prhs[i]);
+}
+
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+    if (nrhs < 1 || nrhs > 5 || nlhs > 4) {
+        mexErrMsgIdAndTxt("fex:coregistermex", "Usage: [Y,P,M,R] = fex_coregistermex(LL,SCALING,REFLECTION,ITERATIONS,THREADS)");
+    }
+    const mxArray* input = prhs[0];
+    mwSize ndims = mxGetNumberOfDimensions(input);
+    const mwSize* dims = mxGetDimensions(input);
+    if (!mxIsDouble(input) || mxIsComplex(input) || mxIsSparse(input) || ndims > 3 || dims[1] != 2) {
+        mexErrMsgIdAndTxt("fex:coregistermex", "LL must be a real K*2*N double array.");
+    }
+    size_t points = dims[0];
+    size_t frames = ndims == 3 ? dims[2] : 1;
+    bool scaling = scalarArg(nrhs, prhs, 1, 1) != 0;
+    bool reflection = scalarArg(nrhs, prhs, 2, 0) != 0;
+    int iterations = (int)scalarArg(nrhs, prhs, 3, 1);
+    int threads = (int)scalarArg(nrhs, prhs, 4, (double)sysconf(_SC_NPROCESSORS_ONLN));
+
+    // Frame by frame, x and y interleaved
+    const double* ll = mxGetPr(input);
+    size_t width = 2 * points;
+    std::vector<double> shapes(frames * width);
+    for (size_t f = 0; f < frames; f++) {
+        for (size_t p = 0; p < points; p++) {
+            shapes[f * width + 2 * p] = ll[f * width + p];
+            shapes[f * width + 2 * p + 1] = ll[f * width + points + p];
+        }
+    }
+    std::vector<double> aligned(frames * width), params(frames * COREG_PARAMS), error(frames);
+    Coregistration coregistration(points, scaling, reflection, iterations, 1e-9, threads);
+    if (frames > 0 && points > 0) {
+        coregistration.run(&shapes[0], frames, &aligned[0], &params[0], &error[0]);
+    }
+
+    plhs[0] = mxCreateDoubleMatrix(frames, width, mxREAL);
+    double* y = mxGetPr(plhs[0]);
+    for (size_t f = 0; f < frames; f++) {
+        for (size_t i = 0; i < width; i++) {
+            y[i * frames + f] = aligned[f * width + i];
+        }
+    }
+    if (nlhs > 1) {
+        plhs[1] = mxCreateDoubleMatrix(frames, COREG_PARAMS, mxREAL);
+        double* p = mxGetPr(plhs[1]);
+        for (size_t f = 0; f < frames; f++) {
+            for (size_t i = 0; i < COREG_PARAMS; i++) {
+                p[i * frames + f] = params[f * COREG_PARAMS + i];
+            }
+        }
+    }
+    if (nlhs > 2) {
+        plhs[2] = mxCreateDoubleMatrix(points, 2, mxREAL);
+        double* m = mxGetPr(plhs[2]);
+        const std::vector<double>& reference = coregistration.reference();
+        for (size_t p = 0; p < points && !reference.empty(); p++) {
+            m[p] = reference[2 * p];
+            m[points + p] = reference[2 * p + 1];
+        }
+    }
+    if (nlhs > 3) {
+        plhs[3] = mxCreateDoubleMatrix(frames, 1, mxREAL);
+        double* r = mxGetPr(plhs[3]);
+        for (size_t f = 0; f < frames; f++) {
+            r[f] = error[f];
+        }
+    }
+}
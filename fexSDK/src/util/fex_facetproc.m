@@ -23,6 +23,17 @@ function [Y,cmd,h] = fex_facetproc(list,varargin)
 %     is set to the current working directory, unless you enter a FEXOBJ
 %     object as first argument. In this case, the output directory is set
 %     to FEXOBJ.DIROUT, assuming that the property is not empty.
+% parallel: process several videos in parallel (default 1). When the
+%     executable fexbatch is found next to the FACET executable, all the
+%     videos are tracked by a single fexbatch process, which shares the
+%     CPUs between videos and splits long ones between idle workers (60
+%     seconds tracking windows); otherwise each video runs in its own
+%     process with parfor.
+% roi: sampling rate in frames per second of a first pass that locates
+%     the face (default 0: off). Each video is then tracked only in the
+%     region of the face, in the same process, with coordinates in the
+%     original frames (see FEX_FASTPROC). Videos are not processed with
+%     fexbatch when roi is set.
 % 
 % OUTPUT:
 %
@@ -64,6 +75,11 @@ if ~isempty(find(strcmpi('parallel',varargin),1))
     IS_PAR = varargin{find(strcmpi('parallel',varargin)) + 1};
 end
 
+ROI_FPS = 0;
+if ~isempty(find(strcmpi('roi',varargin),1))
+    ROI_FPS = varargin{find(strcmpi('roi',varargin)) + 1};
+end
+
 % Read LIST argument, transform to cell, and add name for output files.
 nlist = cell(1,2);
 switch class(list)
@@ -120,6 +136,9 @@ h = cell(size(nlist,1),1);
 cmd = cell(size(h));
 for k = 1:size(nlist,1)
     cmd{k} = sprintf('%s -f "%s" -o "%s"',FACET_EXEC,nlist{k,1},Y{k});
+    if ROI_FPS > 0
+        cmd{k} = sprintf('%s -roi %.2f',cmd{k},ROI_FPS);
+    end
 end
 
 % Update envirnoment (! temporararely) (done by fex_init??)
@@ -136,7 +155,32 @@ end
 % cd(tpar);
 
 % Run the preprocessing
-if size(nlist,1) > 1 && IS_PAR
+BATCH_EXEC = sprintf('%s/fexbatch',fileparts(FACET_EXEC));
+if size(nlist,1) > 1 && IS_PAR && ROI_FPS == 0 && exist(BATCH_EXEC,'file')
+    % One process for all the videos: write the manifest, read the results
+    manifest = [tempname '.txt'];
+    fid = fopen(manifest,'w');
+    for k = 1:size(nlist,1)
+        fprintf(fid,'%s\t%s\n',nlist{k,1},Y{k});
+    end
+    fclose(fid);
+    cmd = {sprintf('%s -l "%s" -o "%s.results.tsv"',BATCH_EXEC,manifest,manifest)};
+    system(cmd{1});
+    fid = fopen(sprintf('%s.results.tsv',manifest),'r');
+    if fid < 0
+        h(:) = {1};
+    else
+        % Tabs only: paths may hold spaces
+        results = textscan(fid,'%s%s%s%*[^\n]','Delimiter','\t','Whitespace','','HeaderLines',1);
+        fclose(fid);
+        % Match each video by name; videos without a row failed
+        [found,row] = ismember(nlist(:,1),results{1});
+        h = num2cell(ones(size(nlist,1),1));
+        h(found) = num2cell(double(~strcmp(results{3}(row(found)),'ok')));
+        delete(sprintf('%s.results.tsv',manifest));
+    end
+    delete(manifest);
+elseif size(nlist,1) > 1 && IS_PAR
     % Add waitbar with cancel button
     % he = waitbar(0,sprintf('Processing %d Videos',size(nlist,1)),...
     %    'CreateCancelBtn','setappdata(gcbf,''canceling'',1)');
@@ -0,0 +1,66 @@
+/*
+ * FEX_FILTFILTMEX - Zero-phase FIR filter of all the columns of a matrix.
+ *
+ * Usage:
+ *
+ *   Y = fex_filtfiltmex(B,X)
+ *
+ * Same as filtfilt(B,1,X) for a N*K matrix X of doubles, with the filter
+ * engine of the native tools (facet/cpp/common/temporalfilter.hpp): the K
+ * columns are filtered together, one row of the transposed data at a
+ * time. Unlike filtfilt, the NaNs of each column are interpolated for
+ * filtering and returned as NaN, and a column of NaNs is returned as is
+ * while the others are filtered; if all the columns are NaN, a warning
+ * is issued. FEX_BANDPASS uses it when it is compiled:
+ *
+ *   mex -I../facet/cpp/common fex_filtfiltmex.cpp ../facet/cpp/common/temporalfilter.cpp
+ *
+ * See also FEX_BANDPASS, FILTFILT.
+ */
+
+#include <algorithm>
+#include <vector>
+#include "mex.h"
+#include "temporalfilter.hpp"
+
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+    if (nrhs != 2 || nlhs > 1) {
+        mexErrMsgIdAndTxt("fex:filtfiltmex", "Usage: Y = fex_filtfiltmex(B,X)");
+    }
+    for (int i = 0; i < 2; i++) {
+        if (!mxIsDouble(prhs[i]) || mxIsComplex(prhs[i]) || mxIsSparse(prhs[i])) {
+            mexErrMsgIdAndTxt("fex:filtfiltmex", "B and X must be real double arrays.");
+        }
+    }
+    const double* b = mxGetPr(prhs[0]);
+    std::vector<double> kernel(b, b + mxGetNumberOfElements(prhs[0]));
+    if (kernel.empty()) {
+        mexErrMsgIdAndTxt("fex:filtfiltmex", "B is empty.");
+    }
+
+    // A row vector is a single channel, as in filtfilt
+    size_t rows = mxGetM(prhs[1]);
+    size_t channels = mxGetN(prhs[1]);
+    if (rows == 1) {
+        std::swap(rows, channels);
+    }
+    const double* x = mxGetPr(prhs[1]);
+    std::vector<double> data(rows * channels);
+    for (size_t c = 0; c < channels; c++) {
+        for (size_t r = 0; r < rows; r++) {
+            data[r * channels + c] = x[c * rows + r];
+        }
+    }
+    if (rows > 0 && channels > 0 && !TemporalFilter(kernel).filtfilt(&data[0], rows, channels)) {
+        mexWarnMsgIdAndTxt("fex:filtfiltmex", "X has no column with a value: it is returned unfiltered.");
+    }
+
+    plhs[0] = mxCreateDoubleMatrix(mxGetM(prhs[1]), mxGetN(prhs[1]), mxREAL);
+    double* y = mxGetPr(plhs[0]);
+    for (size_t c = 0; c < channels; c++) {
+        for (size_t r = 0; r < rows; r++) {
+            y[c * rows + r] = data[r * channels + c];
+        }
+    }
+}
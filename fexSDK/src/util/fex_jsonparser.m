@@ -6,7 +6,9 @@ function [data,new_name] = fex_jsonparser(jsonfile,new_name,USE_MATLAB)
 % FEX_JSONPARSER is set to import .json files from FACET SDK.
 % FEX_JSONPARSER saves the data as .csv files, and return a structure DATA
 % with the new data. Since reading a .json file in Matlab is slow,
-% FEX_JSONPARSER uses the Python script FEX_JSON2DAT when possible.
+% FEX_JSONPARSER uses the compiled converter FEXJSON2DAT when possible
+% (built with the FACET drivers, and found next to the FACET executable or
+% on the system path), and the Python script FEX_JSON2DAT otherwise.
 %
 % SYNTAX:
 %
@@ -17,13 +19,13 @@ function [data,new_name] = fex_jsonparser(jsonfile,new_name,USE_MATLAB)
 % JSONFILE -  a path to a json file.
 % NEW_NAME - path to the new file name.
 % USE_MATLAB - boolean value. When true, the JSONFILE is read using Matlab,
-%   otherwise FEX_JSON2DAT.PY is used. Default: false.
+%   otherwise FEXJSON2DAT (or FEX_JSON2DAT.PY) is used. Default: false.
 %
 % OUTPUT:
 %
 % DATA - a structure with data from the .json file.
 %
-% See also FEXC, FEX_IMPUTIL, FEX_JSON2DAT.PY.
+% See also FEXC, FEX_IMPUTIL, FEX_BINIMPORT, FEXJSON2DAT, FEX_JSON2DAT.PY.
 %
 %
 %
@@ -59,11 +61,12 @@ end
 % Generate new name
 new_name = sprintf('%s/%s.csv',p,n);
 
-% Find Python script
+% Find the compiled converter, then the Python script
+NATIVE_EXEC = findnative();
 JSON_EXEC = which('fex_json2dat.py');
-if isempty(JSON_EXEC)
+if isempty(NATIVE_EXEC) && isempty(JSON_EXEC)
     USE_MATLAB = true;
-    warning('fex_json2dat.py not found. Using Matlab instead');
+    warning('fexjson2dat and fex_json2dat.py not found. Using Matlab instead');
 end
 
 % Set USE_MATLAB flag
@@ -72,7 +75,21 @@ if ~exist('USE_MATLAB','var')
 end
 
 % Import the .json file
-if USE_MATLAB
+if ~USE_MATLAB && ~isempty(NATIVE_EXEC)
+% Compiled converter: the .csv file has a header with the channels found
+    cmd = sprintf('"%s" "%s" "%s"',NATIVE_EXEC,jsonfile,new_name);
+    [h,out] = system(cmd);
+    if h ~= 0
+        w_mess = sprintf('FEXJSON2DAT failed with error:\n\n');
+        warning('%s%s\n\nSet: USE_MATLAB = true.',w_mess,out);
+    else
+        datat = importdata(new_name);
+        hdrc  = genvarname(datat.colheaders);
+        for i = 1:length(hdrc)
+            data.(hdrc{i}) = datat.data(:,i);
+        end
+    end
+elseif USE_MATLAB
 % Slow MATLAB based parsing
     data = matjsonpars(jsonfile,new_name);
 else
@@ -103,6 +120,31 @@ end
     
 % +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
 
+function exec = findnative()
+%
+% FINDNATIVE - Helper to locate the fexjson2dat executable.
+%
+% Internal use only.
+
+exec = '';
+% Next to the FACET executable
+if exist('fexinfo.dat','file')
+    info = importdata('fexinfo.dat');
+    if isfield(info,'EXEC')
+        exec = fullfile(fileparts(info.EXEC),'fexjson2dat');
+    end
+end
+% On the system path
+if ~exist(exec,'file')
+    [h,out] = system('which fexjson2dat');
+    exec = '';
+    if h == 0
+        exec = strtrim(out);
+    end
+end
+
+% +++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++++
+
 function data = matjsonpars(jsonfile,new_name)
 %
 % MATJSONPARS - Heloper for parsing of JSON files. 
@@ -0,0 +1,97 @@
+/*
+ * FEX_MOTIONCORRECTMEX - Removal of pose artifacts from the functional channels.
+ *
+ * Usage:
+ *
+ *   R = fex_motioncorrectmex(Y,X)
+ *   R = fex_motioncorrectmex(Y,X,THRS,WHITEN)
+ *
+ * Y is the N*K matrix of functional channels (emotions and action units)
+ * and X the N*3 matrix of the pose (roll, pitch, yaw). As FEXC's
+ * MOTIONCORRECT, each column of Y is regressed on a constant and the
+ * absolute pose, using only the pose variables that correlate with it
+ * with p <= 0.05 and |r| >= THRS, and R holds the residuals plus the
+ * constant. Rows with a NaN in X or in any column of Y are left out and
+ * are NaN in R.
+ *
+ * THRS defaults to 0; with WHITEN true (default false) the absolute pose
+ * is whitened first, as FEX_WHITENINGT. The native kernel is
+ * facet/cpp/common/motioncorrect.hpp, which solves all the columns at
+ * once; FEXC.MOTIONCORRECT uses it when it is compiled:
+ *
+ *   mex -I../facet/cpp/common fex_motioncorrectmex.cpp ../facet/cpp/common/motioncorrect.cpp
+ *
+ * See also FEXC, FEX_WHITENINGT, REGRESS.
+ */
+
+#include <vector>
+#include "mex.h"
+#include "motioncorrect.hpp"
+
+/**
+ * Optional logical or numeric scalar argument i.
+ */
+static double scalarArg(int nrhs, const mxArray* prhs[], int i, double fallback)
+{
+    if (nrhs <= i || mxIsEmpty(prhs[i])) {
+        return fallback;
+    }
+    if (!(mxIsNumeric(prhs[i]) || mxIsLogical(prhs[i])) || mxGetNumberOfElements(prhs[i]) != 1) {
+        mexErrMsgIdAndTxt("fex:motioncorrectmex", "THRS and WHITEN must be scalars.");
+    }
+    return mxGetScalar(prhs[i]);
+}
+
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+    if (nrhs < 2 || nrhs > 4 || nlhs > 1) {
+        mexErrMsgIdAndTxt("fex:motioncorrectmex", "Usage: R = fex_motioncorrectmex(Y,X,THRS,WHITEN)");
+    }
+    for (int i = 0; i < 2; i++) {
+        if (!mxIsDouble(prhs[i]) || mxIsComplex(prhs[i]) || mxIsSparse(prhs[i]) ||
+            mxGetNumberOfDimensions(prhs[i]) > 2) {
+            mexErrMsgIdAndTxt("fex:motioncorrectmex", "Y and X must be real double matrices.");
+        }
+    }
+    size_t rows = mxGetM(prhs[0]);
+    size_t channels = mxGetN(prhs[0]);
+    if (mxGetM(prhs[1]) != rows || mxGetN(prhs[1]) < MOTION_PREDICTORS) {
+        mexErrMsgIdAndTxt("fex:motioncorrectmex", "X must have the rows of Y and 3 columns (roll, pitch, yaw).");
+    }
+    double threshold = scalarArg(nrhs, prhs, 2, 0);
+    bool whiten = scalarArg(nrhs, prhs, 3, 0) != 0;
+
+    // Rows of the pose then the channels, for the kernel
+    const double* y = mxGetPr(prhs[0]);
+    const double* x = mxGetPr(prhs[1]);
+    size_t width = MOTION_PREDICTORS + channels;
+    std::vector<double> values(rows * width);
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t j = 0; j < MOTION_PREDICTORS; j++) {
+            values[r * width + j] = x[j * rows + r];
+        }
+        for (size_t c = 0; c < channels; c++) {
+            values[r * width + MOTION_PREDICTORS + c] = y[c * rows + r];
+        }
+    }
+    size_t pose[MOTION_PREDICTORS];
+    for (size_t j = 0; j < MOTION_PREDICTORS; j++) {
+        pose[j] = j;
+    }
+    std::vector<size_t> columns(channels);
+    for (size_t c = 0; c < channels; c++) {
+        columns[c] = MOTION_PREDICTORS + c;
+    }
+    MotionCorrection correction(threshold < 0 ? -threshold : threshold, whiten);
+    if (rows > 0 && channels > 0) {
+        correction.correct(&values[0], rows, width, pose, columns);
+    }
+
+    plhs[0] = mxCreateDoubleMatrix(rows, channels, mxREAL);
+    double* out = mxGetPr(plhs[0]);
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < channels; c++) {
+            out[c * rows + r] = values[r * width + MOTION_PREDICTORS + c];
+        }
+    }
+}
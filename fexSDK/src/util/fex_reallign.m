@@ -66,8 +66,14 @@ function [Y,P,M,R] = coregstep(XX,args)
 
 % Function for the actual coregistration of the images.
 
-R = nan(size(XX,1),1);
 LL = getlandmarks(XX);
+% All frames at once with the compiled fex_coregistermex, see
+% fex_coregistermex.cpp
+if exist('fex_coregistermex','file') == 3
+    [Y,P,M,R] = fex_coregistermex(LL,args.scaling,args.reflection);
+    return
+end
+R = nan(size(XX,1),1);
 M = nanmean(LL,3);
 P = nan(size(XX,1),round(1+size(LL,2)+size(LL,2).^2));
 Y = nan(size(XX,1),numel(M));
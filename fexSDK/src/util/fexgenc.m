@@ -518,6 +518,8 @@ switch ex
 %         end    
     case '.csv'
         args.data = dataset('File',fname,'Delimiter',',');
+    case '.fexb'
+        args.data = fex_binimport(fname);
     case {'.xlsx','.xls'}
         args.data = dataset('XLSFile',fname);
     case ''